@@ -0,0 +1,61 @@
+#include "arena.hpp"
+
+#include <cstdint>
+#include <cstring>
+
+extern "C" {
+#include "util.h"
+}
+
+// smallest block; larger requests get a block of their own size
+#define ARENA_BLOCK_SIZE (64 << 10)
+
+struct ArenaBlock {
+    ArenaBlock* next;
+    // data follows, aligned for any type
+    alignas(std::max_align_t) char data[1];
+};
+
+void arena_init(Arena* arena) {
+    arena->blocks = NULL;
+    arena->cursor = NULL;
+    arena->end = NULL;
+}
+
+void arena_clear(Arena* arena) {
+    ArenaBlock* block = arena->blocks;
+    while (block != NULL) {
+        ArenaBlock* next = block->next;
+        free(block);
+        block = next;
+    }
+    arena_init(arena);
+}
+
+static char* align(char* p, size_t alignment) {
+    uintptr_t address = (uintptr_t) p;
+    return p + (alignment - address % alignment) % alignment;
+}
+
+void* arena_alloc(Arena* arena, size_t size, size_t alignment) {
+    char* p = align(arena->cursor, alignment);
+    if (arena->cursor == NULL || p > arena->end || size > (size_t) (arena->end - p)) {
+        // alignment beyond that of the block data is left as slack
+        size_t capacity = size + alignment > ARENA_BLOCK_SIZE ? size + alignment : ARENA_BLOCK_SIZE;
+        ArenaBlock* block = (ArenaBlock*) MALLOC(offsetof(ArenaBlock, data) + capacity);
+        block->next = arena->blocks;
+        arena->blocks = block;
+        arena->cursor = block->data;
+        arena->end = block->data + capacity;
+        p = align(arena->cursor, alignment);
+    }
+    arena->cursor = p + size;
+    return p;
+}
+
+char* arena_strdup(Arena* arena, const char* s) {
+    size_t size = strlen(s) + 1;
+    char* copy = (char*) arena_alloc(arena, size, 1);
+    memcpy(copy, s, size);
+    return copy;
+}
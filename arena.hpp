@@ -0,0 +1,35 @@
+#ifndef ARENA_HPP
+#define ARENA_HPP
+
+#include <cstddef>
+#include <new>
+
+struct ArenaBlock;
+
+// objects released all at once; allocations are contiguous within a block,
+// and a block is sized for the largest request, so that an array of n
+// objects is never split
+struct Arena {
+    ArenaBlock* blocks;  // most recent first
+    char* cursor;
+    char* end;
+};
+
+void arena_init(Arena* arena);
+// free every block
+void arena_clear(Arena* arena);
+
+void* arena_alloc(Arena* arena, size_t size, size_t alignment);
+char* arena_strdup(Arena* arena, const char* s);
+
+// array of n default-initialized objects; their destructors are never called
+template<typename T>
+T* arena_new(Arena* arena, size_t n) {
+    T* objects = (T*) arena_alloc(arena, n * sizeof(T), alignof(T));
+    for (size_t i = 0; i < n; i += 1) {
+        new (&objects[i]) T;
+    }
+    return objects;
+}
+
+#endif
@@ -5,16 +5,21 @@ extern "C" {
 #include "logging.h"
 }
 
+#include <cstring>
+
 static const double G = 6.67259e-11;
 
 void body_init(CelestialBody* body) {
-    *body = {0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, {}};
+    *body = {0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, {}};
 }
 
 void body_clear(CelestialBody* body) {
-    free(body->satellites);
-    free(body->positive_pole);
-    free(body->orbit);
+    if (body->satellites_capacity > 0) {
+        free(body->satellites);
+    }
+    body->satellites = NULL;
+    body->n_satellites = 0;
+    body->satellites_capacity = 0;
 }
 
 static void _body_update_sphere_of_influence(CelestialBody* body) {
@@ -171,7 +176,19 @@ double body_angular_diameter(CelestialBody* body, double distance) {
 }
 
 void body_append_satellite(CelestialBody* body, CelestialBody* satellite) {
-    body->satellites = (CelestialBody**) REALLOC(body->satellites, sizeof(CelestialBody*) * (body->n_satellites+1));
+    if (body->n_satellites + 1 > body->satellites_capacity) {
+        // an array that is not owned is copied first
+        size_t capacity = body->n_satellites < 2 ? 4 : body->n_satellites * 2;
+        CelestialBody** satellites = (CelestialBody**) MALLOC(sizeof(CelestialBody*) * capacity);
+        if (body->n_satellites > 0) {
+            memcpy(satellites, body->satellites, sizeof(CelestialBody*) * body->n_satellites);
+        }
+        if (body->satellites_capacity > 0) {
+            free(body->satellites);
+        }
+        body->satellites = satellites;
+        body->satellites_capacity = capacity;
+    }
     body->satellites[body->n_satellites] = satellite;
     body->n_satellites += 1;
 }
@@ -211,3 +228,30 @@ glm::dvec3 body_global_velocity_at_time(CelestialBody* body, double time) {
     glm::dvec3 relative_velocity = orbit_velocity_at_time(body->orbit, time);
     return primary_velocity + relative_velocity;
 }
+
+glm::dmat3 body_orientation_at_time(CelestialBody* body, double time) {
+    glm::dmat4 orientation(1.);
+
+    // axial tilt
+    if (body->positive_pole != NULL) {
+        double z_angle = body->positive_pole->ecliptic_longitude - M_PI / 2.;
+        orientation = glm::rotate(orientation, z_angle, glm::dvec3(0., 0., 1.));
+        double x_angle = body->positive_pole->ecliptic_latitude - M_PI / 2.;
+        orientation = glm::rotate(orientation, x_angle, glm::dvec3(1., 0., 0.));
+    }
+
+    // the positive pole follows the right-hand rule, so the body always turns
+    // counter-clockwise around it; reduce modulo a turn to avoid loss of
+    // significance
+    if (body->sidereal_day != 0.) {
+        double turn_fraction = fmod(time / fabs(body->sidereal_day), 1.);
+        orientation = glm::rotate(orientation, 2. * M_PI * turn_fraction, glm::dvec3(0., 0., 1.));
+    }
+    return glm::dmat3(orientation);
+}
+
+glm::dvec3 body_surface_position_at_time(CelestialBody* body, double latitude, double longitude, double altitude, double time) {
+    double r = body->radius + altitude;
+    glm::dvec3 local = r * glm::dvec3(cos(latitude) * cos(longitude), cos(latitude) * sin(longitude), sin(latitude));
+    return body_orientation_at_time(body, time) * local;
+}
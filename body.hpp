@@ -17,6 +17,7 @@ struct CelestialBody {
     double mass;
     size_t n_satellites;
     CelestialBody** satellites;
+    size_t satellites_capacity;  // 0 when the array is not owned by the body
 
     // orbit
     Orbit* orbit;
@@ -32,6 +33,8 @@ struct CelestialBody {
 };
 
 void body_init (CelestialBody* body);
+// release the list of satellites, when owned; the name, orbit and positive
+// pole belong to whoever set them
 void body_clear(CelestialBody* body);
 
 void body_set_name     (CelestialBody* body, const char* name);
@@ -52,4 +55,10 @@ void body_remove_satellite(CelestialBody* body, CelestialBody* satellite);
 glm::dvec3 body_global_position_at_time(CelestialBody* body, double time);
 glm::dvec3 body_global_velocity_at_time(CelestialBody* body, double time);
 
+// rotation from the body-fixed frame (z towards the positive pole, x towards
+// the prime meridian) to the ecliptic frame; matches the rendering
+glm::dmat3 body_orientation_at_time(CelestialBody* body, double time);
+// position of a surface site relative to the center of the body
+glm::dvec3 body_surface_position_at_time(CelestialBody* body, double latitude, double longitude, double altitude, double time);
+
 #endif
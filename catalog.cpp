@@ -0,0 +1,574 @@
+#include "catalog.hpp"
+
+#include "parallel.hpp"
+
+#include <cctype>
+#include <clocale>
+#include <cmath>
+#include <cstring>
+#include <unordered_set>
+
+extern "C" {
+#include "util.h"
+#include "logging.h"
+}
+
+// bytes of the file parsed by a same task
+#define CATALOG_CHUNK_SIZE (1 << 20)
+// longest number field
+#define CATALOG_MAX_NUMBER_LENGTH 64
+// lines searched for the end of the header of MPCORB files
+#define CATALOG_MAX_HEADER_LINES 256
+// geometric albedo assumed when estimating the size from the magnitude
+#define CATALOG_DEFAULT_ALBEDO .14
+
+static const double AU = 149597870700.;
+static const double DAY = 86400.;
+static const double JD_J2000 = 2451545.;
+
+// Both formats are one body per line; the file is mapped, cut into chunks at
+// line boundaries, and the chunks are parsed in parallel into their own
+// entries and names, which are then appended in order.
+
+struct Chunk {
+    const char* begin;
+    const char* end;
+    std::vector<CatalogEntry> entries;
+    std::string names;
+    size_t skipped;
+};
+
+static bool is_blank(const char* begin, const char* end) {
+    for (const char* c = begin; c < end; c += 1) {
+        if (!isspace((unsigned char) *c)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+static void trim(const char** begin, const char** end) {
+    while (*begin < *end && isspace((unsigned char) **begin)) {
+        *begin += 1;
+    }
+    while (*end > *begin && isspace((unsigned char) (*end)[-1])) {
+        *end -= 1;
+    }
+}
+
+static int parse_number(const char* begin, const char* end, char decimal_point, double* value) {
+    /* The whole field must be a number, blanks aside */
+    trim(&begin, &end);
+    size_t n = (size_t) (end - begin);
+    if (n == 0 || n >= CATALOG_MAX_NUMBER_LENGTH) {
+        return -1;
+    }
+    char buffer[CATALOG_MAX_NUMBER_LENGTH];
+    for (size_t i = 0; i < n; i += 1) {
+        // the decimal point of strtod() follows the locale
+        buffer[i] = begin[i] == '.' ? decimal_point : begin[i];
+    }
+    buffer[n] = '\0';
+    char* parsed;
+    *value = strtod(buffer, &parsed);
+    return parsed == buffer + n ? 0 : -1;
+}
+
+static double julian_day(long year, long month, long day) {
+    /* At midnight, in the Gregorian calendar (Fliegel and Van Flandern) */
+    long a = (14 - month) / 12;
+    long y = year + 4800 - a;
+    long m = month + 12 * a - 3;
+    long jdn = day + (153 * m + 2) / 5 + 365 * y + y / 4 - y / 100 + y / 400 - 32045;
+    return (double) jdn - .5;
+}
+
+static void split_chunks(std::vector<Chunk>* chunks, const char* begin, const char* end) {
+    while (begin < end) {
+        const char* cut = end - begin > CATALOG_CHUNK_SIZE ? begin + CATALOG_CHUNK_SIZE : end;
+        while (cut < end && cut[-1] != '\n') {
+            cut += 1;
+        }
+        chunks->push_back({begin, cut, {}, {}, 0});
+        begin = cut;
+    }
+}
+
+template<typename F>
+static int import_lines(Catalog* catalog, const char* filename, const char* begin, const char* end, F read_line) {
+    /* read_line(line, end, entry, name) returns 1 for lines without a body,
+     * and -1 for malformed ones */
+    std::vector<Chunk> chunks;
+    split_chunks(&chunks, begin, end);
+
+    parallel_for(chunks.size(), [&](size_t first, size_t last) {
+        for (size_t k = first; k < last; k += 1) {
+            Chunk* chunk = &chunks[k];
+            const char* line = chunk->begin;
+            while (line < chunk->end) {
+                const char* next = (const char*) memchr(line, '\n', (size_t) (chunk->end - line));
+                next = next == NULL ? chunk->end : next + 1;
+                const char* line_end = next;
+                while (line_end > line && (line_end[-1] == '\n' || line_end[-1] == '\r')) {
+                    line_end -= 1;
+                }
+
+                CatalogEntry entry;
+                std::string name;
+                int ret = read_line(line, line_end, &entry, &name);
+                if (ret < 0) {
+                    chunk->skipped += 1;
+                } else if (ret == 0) {
+                    entry.name = (uint32_t) chunk->names.size();
+                    chunk->names.append(name);
+                    chunk->names.push_back('\0');
+                    chunk->entries.push_back(entry);
+                }
+                line = next;
+            }
+        }
+    });
+
+    size_t n_entries = catalog->entries.size();
+    size_t n_names = catalog->names.size();
+    size_t skipped = 0;
+    for (auto& chunk : chunks) {
+        n_entries += chunk.entries.size();
+        n_names += chunk.names.size();
+        skipped += chunk.skipped;
+    }
+    if (n_names > UINT32_MAX) {
+        CRITICAL("Too many names in '%s'", filename);
+        return -1;
+    }
+    if (skipped > 0) {
+        WARNING("Skipped %zu malformed lines in '%s'", skipped, filename);
+    }
+
+    catalog->entries.reserve(n_entries);
+    catalog->names.reserve(n_names);
+    for (auto& chunk : chunks) {
+        uint32_t offset = (uint32_t) catalog->names.size();
+        for (auto entry : chunk.entries) {
+            entry.name += offset;
+            catalog->entries.push_back(entry);
+        }
+        catalog->names.append(chunk.names);
+    }
+    catalog->bodies.resize(n_entries, NULL);
+    return 0;
+}
+
+void catalog_init(Catalog* catalog, CelestialBody* primary) {
+    catalog->primary = primary;
+    catalog->entries.clear();
+    catalog->names.clear();
+    catalog->bodies.clear();
+    catalog->index.clear();
+}
+
+static void free_body(CelestialBody* body) {
+    /* Once detached from the primary */
+    delete body->orbit;
+    body->orbit = NULL;
+    free((char*) body->name);
+    body_clear(body);
+    delete body;
+}
+
+void catalog_clear(Catalog* catalog) {
+    // detach all the bodies in a single pass over the satellites
+    std::unordered_set<CelestialBody*> materialized;
+    for (auto body : catalog->bodies) {
+        if (body != NULL) {
+            materialized.insert(body);
+        }
+    }
+    CelestialBody* primary = catalog->primary;
+    size_t n = 0;
+    for (size_t i = 0; i < primary->n_satellites; i += 1) {
+        if (materialized.count(primary->satellites[i]) == 0) {
+            primary->satellites[n] = primary->satellites[i];
+            n += 1;
+        }
+    }
+    primary->n_satellites = n;
+
+    for (auto body : materialized) {
+        free_body(body);
+    }
+    catalog_init(catalog, primary);
+}
+
+// MPCORB columns, from 1 and inclusive, as documented by the Minor Planet
+// Center
+
+static int read_column(const char* line, const char* end, size_t first, size_t last, char decimal_point, double* value) {
+    if ((size_t) (end - line) < last) {
+        return -1;
+    }
+    return parse_number(line + first - 1, line + last, decimal_point, value);
+}
+
+static int unpack_digit(char c) {
+    /* 0-9, then A-Z for 10-35 */
+    if (c >= '0' && c <= '9') {
+        return c - '0';
+    } else if (c >= 'A' && c <= 'Z') {
+        return c - 'A' + 10;
+    }
+    return -1;
+}
+
+static int unpack_epoch(const char* packed, double* epoch) {
+    /* Packed dates are e.g. K2555 for 2025-05-05, at 0h TT */
+    int century = unpack_digit(packed[0]);
+    int decade = unpack_digit(packed[1]);
+    int year = unpack_digit(packed[2]);
+    int month = unpack_digit(packed[3]);
+    int day = unpack_digit(packed[4]);
+    if (century < 10 || decade < 0 || decade > 9 || year < 0 || year > 9 || month < 1 || month > 12 || day < 1 || day > 31) {
+        return -1;
+    }
+    double jd = julian_day(century * 100 + decade * 10 + year, month, day);
+    *epoch = (jd - JD_J2000) * DAY;
+    return 0;
+}
+
+static int read_mpcorb_line(const char* line, const char* end, char decimal_point, CatalogEntry* entry, std::string* name) {
+    if (is_blank(line, end)) {
+        return 1;
+    }
+
+    double semi_major_axis;
+    double mean_anomaly, argument_of_periapsis, longitude_of_ascending_node, inclination, eccentricity;
+    if (end - line < 103 || unpack_epoch(line + 20, &entry->epoch) < 0 ||
+        read_column(line, end, 27, 35, decimal_point, &mean_anomaly) < 0 ||
+        read_column(line, end, 38, 46, decimal_point, &argument_of_periapsis) < 0 ||
+        read_column(line, end, 49, 57, decimal_point, &longitude_of_ascending_node) < 0 ||
+        read_column(line, end, 60, 68, decimal_point, &inclination) < 0 ||
+        read_column(line, end, 71, 79, decimal_point, &eccentricity) < 0 ||
+        read_column(line, end, 93, 103, decimal_point, &semi_major_axis) < 0) {
+        return -1;
+    }
+    if (!(eccentricity >= 0. && eccentricity < 1.) || !(semi_major_axis > 0.)) {
+        return -1;
+    }
+
+    // the magnitude is blank when unknown
+    double absolute_magnitude;
+    if (read_column(line, end, 9, 13, decimal_point, &absolute_magnitude) < 0) {
+        absolute_magnitude = NAN;
+    }
+
+    // readable designation, e.g. "(1) Ceres", or else the packed one
+    const char* name_begin = line + 166;
+    const char* name_end = end - line > 194 ? line + 194 : end;
+    if (name_begin < name_end) {
+        trim(&name_begin, &name_end);
+    }
+    if (!(name_begin < name_end)) {
+        name_begin = line;
+        name_end = line + 7;
+        trim(&name_begin, &name_end);
+    }
+    name->assign(name_begin, name_end);
+
+    entry->absolute_magnitude = (float) absolute_magnitude;
+    entry->periapsis = semi_major_axis * AU * (1. - eccentricity);
+    entry->eccentricity = eccentricity;
+    entry->inclination = radians(inclination);
+    entry->longitude_of_ascending_node = radians(longitude_of_ascending_node);
+    entry->argument_of_periapsis = radians(argument_of_periapsis);
+    entry->mean_anomaly_at_epoch = radians(mean_anomaly);
+    return 0;
+}
+
+int catalog_import_mpcorb(Catalog* catalog, const char* filename) {
+    size_t length;
+    char* data = map_file(filename, &length);
+    if (data == NULL) {
+        CRITICAL("Failed to open '%s'", filename);
+        return -1;
+    }
+    const char* end = data + length;
+
+    // the header, if any, ends with a line of dashes
+    const char* begin = data;
+    const char* line = data;
+    for (int i = 0; i < CATALOG_MAX_HEADER_LINES && line < end; i += 1) {
+        const char* next = (const char*) memchr(line, '\n', (size_t) (end - line));
+        next = next == NULL ? end : next + 1;
+        if (next - line >= 5 && strncmp(line, "-----", 5) == 0) {
+            begin = next;
+            break;
+        }
+        line = next;
+    }
+
+    char decimal_point = localeconv()->decimal_point[0];
+    int ret = import_lines(catalog, filename, begin, end, [&](const char* l, const char* e, CatalogEntry* entry, std::string* name) {
+        return read_mpcorb_line(l, e, decimal_point, entry, name);
+    });
+    unmap_file(data, length);
+    return ret;
+}
+
+// SBDB exports are CSV, with the names of the columns in the first line
+
+enum SbdbColumn {
+    SBDB_IGNORED,
+    SBDB_NAME,
+    SBDB_A,
+    SBDB_Q,
+    SBDB_E,
+    SBDB_I,
+    SBDB_OM,
+    SBDB_W,
+    SBDB_MA,
+    SBDB_EPOCH,
+    SBDB_TP,
+    SBDB_H,
+    SBDB_COLUMNS,
+};
+
+static bool next_field(const char** cursor, const char* end, const char** field_begin, const char** field_end) {
+    /* Returns false after the last field, when *cursor is NULL; quotes are
+     * removed, but doubled quotes within are left as is */
+    if (*cursor == NULL) {
+        return false;
+    }
+    const char* c = *cursor;
+    while (c < end && *c == ' ') {
+        c += 1;
+    }
+    if (c < end && *c == '"') {
+        c += 1;
+        *field_begin = c;
+        while (c < end && !(*c == '"' && (c + 1 >= end || c[1] != '"'))) {
+            c += *c == '"' ? 2 : 1;
+        }
+        *field_end = c;
+        c = (const char*) memchr(c, ',', (size_t) (end - c));
+        if (c == NULL) {
+            c = end;
+        }
+    } else {
+        *field_begin = c;
+        const char* comma = (const char*) memchr(c, ',', (size_t) (end - c));
+        c = comma == NULL ? end : comma;
+        *field_end = c;
+    }
+    *cursor = c < end ? c + 1 : NULL;
+    return true;
+}
+
+static int read_sbdb_header(std::vector<SbdbColumn>* columns, const char* line, const char* end) {
+    static const struct { const char* name; SbdbColumn column; } known[] = {
+        {"a", SBDB_A}, {"q", SBDB_Q}, {"e", SBDB_E}, {"i", SBDB_I}, {"om", SBDB_OM}, {"w", SBDB_W},
+        {"ma", SBDB_MA}, {"epoch", SBDB_EPOCH}, {"tp", SBDB_TP}, {"H", SBDB_H},
+    };
+    // the name is taken from the first of these that is present
+    static const char* const names[] = {"full_name", "name", "pdes"};
+
+    std::vector<std::string> header;
+    const char* field_begin;
+    const char* field_end;
+    while (next_field(&line, end, &field_begin, &field_end)) {
+        trim(&field_begin, &field_end);
+        header.push_back(std::string(field_begin, field_end));
+    }
+
+    columns->assign(header.size(), SBDB_IGNORED);
+    bool present[SBDB_COLUMNS] = {};
+    for (size_t i = 0; i < header.size(); i += 1) {
+        for (auto& k : known) {
+            if (header[i] == k.name && !present[k.column]) {
+                (*columns)[i] = k.column;
+                present[k.column] = true;
+            }
+        }
+    }
+    for (auto name : names) {
+        for (size_t i = 0; i < header.size() && !present[SBDB_NAME]; i += 1) {
+            if (header[i] == name) {
+                (*columns)[i] = SBDB_NAME;
+                present[SBDB_NAME] = true;
+            }
+        }
+    }
+
+    bool has_elements = present[SBDB_E] && present[SBDB_I] && present[SBDB_OM] && present[SBDB_W];
+    bool has_periapsis = present[SBDB_A] || present[SBDB_Q];
+    bool has_anomaly = (present[SBDB_MA] && present[SBDB_EPOCH]) || present[SBDB_TP];
+    return present[SBDB_NAME] && has_elements && has_periapsis && has_anomaly ? 0 : -1;
+}
+
+static int read_sbdb_line(const char* line, const char* end, const std::vector<SbdbColumn>& columns, char decimal_point, CatalogEntry* entry, std::string* name) {
+    if (is_blank(line, end)) {
+        return 1;
+    }
+
+    double values[SBDB_COLUMNS];
+    for (size_t k = 0; k < SBDB_COLUMNS; k += 1) {
+        values[k] = NAN;
+    }
+    const char* name_begin = NULL;
+    const char* name_end = NULL;
+    const char* field_begin;
+    const char* field_end;
+    for (size_t i = 0; i < columns.size() && next_field(&line, end, &field_begin, &field_end); i += 1) {
+        SbdbColumn column = columns[i];
+        if (column == SBDB_NAME) {
+            name_begin = field_begin;
+            name_end = field_end;
+        } else if (column != SBDB_IGNORED && !is_blank(field_begin, field_end)) {
+            if (parse_number(field_begin, field_end, decimal_point, &values[column]) < 0) {
+                return -1;
+            }
+        }
+    }
+    if (name_begin == NULL) {
+        return -1;
+    }
+    trim(&name_begin, &name_end);
+    name->clear();
+    for (const char* c = name_begin; c < name_end; c += 1) {
+        name->push_back(*c);
+        if (*c == '"') {  // doubled quote
+            c += 1;
+        }
+    }
+
+    double eccentricity = values[SBDB_E];
+    double periapsis = values[SBDB_Q];
+    if (std::isnan(periapsis)) {
+        periapsis = values[SBDB_A] * (1. - eccentricity);
+    }
+    if (!(eccentricity >= 0.) || !(periapsis > 0.) || std::isnan(values[SBDB_I]) || std::isnan(values[SBDB_OM]) || std::isnan(values[SBDB_W])) {
+        return -1;
+    }
+
+    // comets often only come with the time of perihelion
+    if (!std::isnan(values[SBDB_MA]) && !std::isnan(values[SBDB_EPOCH])) {
+        entry->epoch = (values[SBDB_EPOCH] - JD_J2000) * DAY;
+        entry->mean_anomaly_at_epoch = radians(values[SBDB_MA]);
+    } else if (!std::isnan(values[SBDB_TP])) {
+        entry->epoch = (values[SBDB_TP] - JD_J2000) * DAY;
+        entry->mean_anomaly_at_epoch = 0.;
+    } else {
+        return -1;
+    }
+
+    entry->absolute_magnitude = (float) values[SBDB_H];
+    entry->periapsis = periapsis * AU;
+    entry->eccentricity = eccentricity;
+    entry->inclination = radians(values[SBDB_I]);
+    entry->longitude_of_ascending_node = radians(values[SBDB_OM]);
+    entry->argument_of_periapsis = radians(values[SBDB_W]);
+    return 0;
+}
+
+int catalog_import_sbdb(Catalog* catalog, const char* filename) {
+    size_t length;
+    char* data = map_file(filename, &length);
+    if (data == NULL) {
+        CRITICAL("Failed to open '%s'", filename);
+        return -1;
+    }
+    const char* begin = data;
+    const char* end = data + length;
+    if (length >= 3 && memcmp(begin, "\xEF\xBB\xBF", 3) == 0) {  // byte order mark
+        begin += 3;
+    }
+
+    const char* header_end = (const char*) memchr(begin, '\n', (size_t) (end - begin));
+    header_end = header_end == NULL ? end : header_end;
+    const char* body = header_end < end ? header_end + 1 : end;
+    if (header_end > begin && header_end[-1] == '\r') {
+        header_end -= 1;
+    }
+    std::vector<SbdbColumn> columns;
+    if (read_sbdb_header(&columns, begin, header_end) < 0) {
+        CRITICAL("Missing columns in the header of '%s'", filename);
+        unmap_file(data, length);
+        return -1;
+    }
+
+    char decimal_point = localeconv()->decimal_point[0];
+    int ret = import_lines(catalog, filename, body, end, [&](const char* l, const char* e, CatalogEntry* entry, std::string* name) {
+        return read_sbdb_line(l, e, columns, decimal_point, entry, name);
+    });
+    unmap_file(data, length);
+    return ret;
+}
+
+const char* catalog_name(Catalog* catalog, size_t i) {
+    return catalog->names.c_str() + catalog->entries[i].name;
+}
+
+size_t catalog_find(Catalog* catalog, const char* name) {
+    // keep the first of duplicates
+    if (catalog->index.size() != catalog->entries.size()) {
+        catalog->index.clear();
+        catalog->index.reserve(catalog->entries.size());
+        for (size_t i = 0; i < catalog->entries.size(); i += 1) {
+            catalog->index.emplace(catalog_name(catalog, i), i);
+        }
+    }
+    auto search = catalog->index.find(name);
+    return search == catalog->index.end() ? SIZE_MAX : search->second;
+}
+
+int catalog_orbit(Catalog* catalog, size_t i, Orbit* orbit) {
+    CatalogEntry* entry = &catalog->entries[i];
+    if (orbit_from_periapsis(orbit, catalog->primary, entry->periapsis, entry->eccentricity) < 0) {
+        return -1;
+    }
+    return orbit_orientate(orbit, entry->longitude_of_ascending_node, entry->inclination, entry->argument_of_periapsis, entry->epoch, entry->mean_anomaly_at_epoch);
+}
+
+CelestialBody* catalog_materialize(Catalog* catalog, size_t i) {
+    if (catalog->bodies[i] != NULL) {
+        return catalog->bodies[i];
+    }
+
+    Orbit* orbit = new Orbit;
+    if (catalog_orbit(catalog, i, orbit) < 0) {
+        delete orbit;
+        return NULL;
+    }
+
+    CelestialBody* body = new CelestialBody;
+    body_init(body);
+    body_set_name(body, strdup(catalog_name(catalog, i)));
+    // diameter from the absolute magnitude and the albedo
+    double absolute_magnitude = catalog->entries[i].absolute_magnitude;
+    if (!std::isnan(absolute_magnitude)) {
+        double diameter = 1329e3 / sqrt(CATALOG_DEFAULT_ALBEDO) * pow(10., -absolute_magnitude / 5.);
+        body_set_radius(body, diameter / 2.);
+    }
+    body_set_orbit(body, orbit);
+    catalog->bodies[i] = body;
+    return body;
+}
+
+size_t catalog_materialize_if(Catalog* catalog, const std::function<bool(const CatalogEntry&)>& needed) {
+    size_t n = 0;
+    for (size_t i = 0; i < catalog->entries.size(); i += 1) {
+        if (needed(catalog->entries[i]) && catalog_materialize(catalog, i) != NULL) {
+            n += 1;
+        }
+    }
+    return n;
+}
+
+void catalog_release(Catalog* catalog, size_t i) {
+    CelestialBody* body = catalog->bodies[i];
+    if (body == NULL) {
+        return;
+    }
+    body_remove_satellite(catalog->primary, body);
+    free_body(body);
+    catalog->bodies[i] = NULL;
+}
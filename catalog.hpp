@@ -0,0 +1,63 @@
+#ifndef CATALOG_HPP
+#define CATALOG_HPP
+
+#include "body.hpp"
+
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// elements of a small body, as imported; angles are in radians, the epoch in
+// seconds since J2000
+struct CatalogEntry {
+    uint32_t name;  // offset in the names of the catalog
+    float absolute_magnitude;  // NAN when unknown
+    double periapsis;
+    double eccentricity;
+    double inclination;
+    double longitude_of_ascending_node;
+    double argument_of_periapsis;
+    double epoch;
+    double mean_anomaly_at_epoch;
+};
+
+// small bodies around a same primary, kept as bare elements; an entry only
+// becomes a CelestialBody when it is materialized
+struct Catalog {
+    CelestialBody* primary;
+    std::vector<CatalogEntry> entries;
+    std::string names;  // NUL-terminated, one after the other
+    std::vector<CelestialBody*> bodies;  // by entry, NULL until materialized
+    std::unordered_map<std::string, size_t> index;  // built on first lookup
+};
+
+void catalog_init(Catalog* catalog, CelestialBody* primary);
+// release the materialized bodies; must be called before the primary is
+// unloaded
+void catalog_clear(Catalog* catalog);
+
+// append the entries of an MPCORB-style file (fixed-width columns, as
+// distributed by the Minor Planet Center); return -1 on failure
+int catalog_import_mpcorb(Catalog* catalog, const char* filename);
+// append the entries of a CSV export of the JPL Small-Body Database; columns
+// are found by name in the header: e, i, om, w, q or a, then ma and epoch, or
+// tp; the name is taken from full_name, name or pdes
+int catalog_import_sbdb(Catalog* catalog, const char* filename);
+
+const char* catalog_name(Catalog* catalog, size_t i);
+// return SIZE_MAX when there is no such entry
+size_t catalog_find(Catalog* catalog, const char* name);
+// orbit of an entry, for analyses that do not need the body itself
+int catalog_orbit(Catalog* catalog, size_t i, Orbit* orbit);
+
+// body of an entry, created on first use as a satellite of the primary; NULL
+// when the elements do not make an orbit
+CelestialBody* catalog_materialize(Catalog* catalog, size_t i);
+// materialize the entries for which needed() is true; return their number
+size_t catalog_materialize_if(Catalog* catalog, const std::function<bool(const CatalogEntry&)>& needed);
+// turn an entry back into bare elements, e.g. once out of focus
+void catalog_release(Catalog* catalog, size_t i);
+
+#endif
@@ -38,6 +38,18 @@ static double get_number(cJSON* json, const char* system_id, const char* param_n
     return jparam->valuedouble;
 }
 
+static double get_optional_number(cJSON* json, const char* param_name, double default_value) {
+    cJSON* jparam = cJSON_GetObjectItemCaseSensitive(json, param_name);
+    if (jparam == NULL) {
+        return default_value;
+    }
+    if (!cJSON_IsNumber(jparam)) {
+        CRITICAL("The parameter '%s' is not a number", param_name);
+        exit(EXIT_FAILURE);
+    }
+    return jparam->valuedouble;
+}
+
 struct SystemConfig load_system_config(cJSON* config, const char* system_id) {
     cJSON* systems = cJSON_GetObjectItemCaseSensitive(config, "systems");
     if (systems == NULL) {
@@ -77,6 +89,7 @@ struct Config load_config(const char* filename, const char* system_id) {
 
     struct Config ret;
     ret.system = load_system_config(config, system_id);
+    ret.thumbnail_refresh_rate = get_optional_number(config, "thumbnail_refresh_rate", 10.);
     free(json);
     return ret;
 }
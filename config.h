@@ -13,6 +13,8 @@ struct SystemConfig {
 
 struct Config {
     struct SystemConfig system;
+    // per second, when only time changes; 0 to refresh every frame
+    double thumbnail_refresh_rate;
 };
 
 struct Config load_config(const char* filename, const char* system);
@@ -0,0 +1,336 @@
+#include "conjunction.hpp"
+
+#include "parallel.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+
+// when deriving the cell size, expected number of objects per cell if they
+// were evenly spread in their bounding box
+#define CONJUNCTION_OCCUPANCY 1.
+// a step must be short enough to hold at most one closest approach per pair
+#define CONJUNCTION_STEPS_PER_REVOLUTION 32
+// with fast outliers, the step is chosen so that this fraction of the objects
+// only need to look at adjacent cells, with some margin for their speeds
+// changing; without, all of them do, at any time
+#define CONJUNCTION_BULK .99
+#define CONJUNCTION_STEP_MARGIN .9
+#define CONJUNCTION_BLOCKS_PER_THREAD 64
+
+// bits per coordinate in cell keys; cells whose coordinates only differ by
+// multiples of 2^21 share a key, which only costs a few needless checks
+#define CELL_BITS 21
+#define CELL_MASK ((1 << CELL_BITS) - 1)
+
+// cells after the current one in lexicographic order, among the 26 adjacent
+static const int64_t half_neighbourhood[13][3] = {
+    {0, 0, 1},
+    {0, 1, -1}, {0, 1, 0}, {0, 1, 1},
+    {1, -1, -1}, {1, -1, 0}, {1, -1, 1},
+    {1, 0, -1}, {1, 0, 0}, {1, 0, 1},
+    {1, 1, -1}, {1, 1, 0}, {1, 1, 1},
+};
+
+// objects at the middle of the current step, by component, and their cells
+struct ConjunctionStep {
+    std::vector<double> x;
+    std::vector<double> y;
+    std::vector<double> z;
+    std::vector<double> vx;
+    std::vector<double> vy;
+    std::vector<double> vz;
+    std::vector<int64_t> cx;
+    std::vector<int64_t> cy;
+    std::vector<int64_t> cz;
+    // bound on the speed during the step, and the matching radius of the
+    // neighbourhood, in cells
+    std::vector<double> speeds;
+    std::vector<int64_t> reaches;
+
+    // spatial hash: objects sorted by bucket, along with their cell keys so
+    // that buckets are scanned sequentially; 32 bit indices keep the table
+    // small enough to stay in cache
+    std::vector<uint32_t> buckets;
+    std::vector<uint32_t> bucket_starts;
+    std::vector<uint32_t> sorted;
+    std::vector<uint64_t> sorted_keys;
+};
+
+static uint64_t cell_key(int64_t cx, int64_t cy, int64_t cz) {
+    return ((uint64_t) cx & CELL_MASK) << (2 * CELL_BITS) | ((uint64_t) cy & CELL_MASK) << CELL_BITS | ((uint64_t) cz & CELL_MASK);
+}
+
+static uint32_t cell_bucket(uint64_t key, uint32_t mask) {
+    return (uint32_t) ((key * 0x9E3779B97F4A7C15u) >> 32) & mask;
+}
+
+static void propagate(ConjunctionStep* step, Orbit** orbits, size_t n_orbits, double time, double cell_size) {
+    parallel_for(n_orbits, [&](size_t begin, size_t end) {
+        for (size_t i = begin; i < end; i += 1) {
+            glm::dvec3 position, velocity;
+            orbit_state_at_time(orbits[i], time, &position, &velocity);
+            step->x[i] = position[0];
+            step->y[i] = position[1];
+            step->z[i] = position[2];
+            step->vx[i] = velocity[0];
+            step->vy[i] = velocity[1];
+            step->vz[i] = velocity[2];
+            step->cx[i] = (int64_t) floor(position[0] / cell_size);
+            step->cy[i] = (int64_t) floor(position[1] / cell_size);
+            step->cz[i] = (int64_t) floor(position[2] / cell_size);
+        }
+    });
+}
+
+static void set_reaches(ConjunctionStep* step, size_t n_orbits, double half_step, double threshold, double cell_size, const std::vector<double>& max_accelerations) {
+    /* A pair closer than the threshold during the step is at most
+     * threshold + (s_i + s_j) half_step apart at its middle, where s_i and s_j
+     * bound the speeds; the faster object of the pair looks that far */
+    parallel_for(n_orbits, [&](size_t begin, size_t end) {
+        for (size_t i = begin; i < end; i += 1) {
+            double v2 = step->vx[i] * step->vx[i] + step->vy[i] * step->vy[i] + step->vz[i] * step->vz[i];
+            step->speeds[i] = sqrt(v2) + max_accelerations[i] * half_step;
+            step->reaches[i] = (int64_t) floor((threshold + 2. * step->speeds[i] * half_step) / cell_size) + 1;
+        }
+    });
+}
+
+static double step_duration(const ConjunctionStep* step, double threshold, double cell_size) {
+    /* Longest step for which most objects only look at adjacent cells */
+    std::vector<double> speeds(step->speeds);
+    auto bulk = speeds.begin() + (ptrdiff_t) ((double) (speeds.size() - 1) * CONJUNCTION_BULK);
+    std::nth_element(speeds.begin(), bulk, speeds.end());
+    return CONJUNCTION_STEP_MARGIN * (cell_size - threshold) / *bulk;
+}
+
+static void hash_cells(ConjunctionStep* step, size_t n_orbits) {
+    /* Counting sort of the objects by bucket */
+    size_t n_buckets = step->bucket_starts.size() - 1;
+    uint32_t mask = (uint32_t) n_buckets - 1;
+    std::fill(step->bucket_starts.begin(), step->bucket_starts.end(), 0);
+    for (size_t i = 0; i < n_orbits; i += 1) {
+        uint32_t bucket = cell_bucket(cell_key(step->cx[i], step->cy[i], step->cz[i]), mask);
+        step->buckets[i] = bucket;
+        step->bucket_starts[bucket + 1] += 1;
+    }
+    for (size_t k = 0; k < n_buckets; k += 1) {
+        step->bucket_starts[k + 1] += step->bucket_starts[k];
+    }
+
+    std::vector<uint32_t> cursors(step->bucket_starts.begin(), step->bucket_starts.end() - 1);
+    for (size_t i = 0; i < n_orbits; i += 1) {
+        uint32_t position = cursors[step->buckets[i]];
+        step->sorted[position] = (uint32_t) i;
+        step->sorted_keys[position] = cell_key(step->cx[i], step->cy[i], step->cz[i]);
+        cursors[step->buckets[i]] += 1;
+    }
+}
+
+static bool may_approach(const ConjunctionStep* step, size_t i, size_t j, double half_step, double threshold, const std::vector<double>& max_accelerations) {
+    /* Closest approach of the relative linear motion, with a margin for the curvature */
+    glm::dvec3 dr(step->x[j] - step->x[i], step->y[j] - step->y[i], step->z[j] - step->z[i]);
+    glm::dvec3 dv(step->vx[j] - step->vx[i], step->vy[j] - step->vy[i], step->vz[j] - step->vz[i]);
+    double v2 = glm::dot(dv, dv);
+    double tau = v2 > 0. ? -glm::dot(dr, dv) / v2 : 0.;
+    tau = fmax(-half_step, fmin(tau, half_step));
+    double distance = glm::length(dr + tau * dv);
+    double margin = .5 * (max_accelerations[i] + max_accelerations[j]) * half_step * half_step;
+    return distance <= threshold + margin;
+}
+
+int conjunction_screen(std::vector<Conjunction>* conjunctions, Orbit** orbits, size_t n_orbits, const ConjunctionOptions* options) {
+    conjunctions->clear();
+    if (!(options->threshold > 0.) || !(options->time_min < options->time_max)) {
+        return -1;
+    }
+    if (n_orbits < 2) {
+        return 0;
+    }
+
+    // bounds on the speeds and accelerations, reached at periapsis
+    CelestialBody* primary = orbits[0]->primary;
+    double mu = primary->gravitational_parameter;
+    double min_period = INFINITY;
+    std::vector<double> max_speeds(n_orbits);
+    std::vector<double> max_accelerations(n_orbits);
+    for (size_t i = 0; i < n_orbits; i += 1) {
+        Orbit* o = orbits[i];
+        if (o->primary != primary) {
+            return -1;
+        }
+        max_speeds[i] = orbit_speed_at_distance(o, o->periapsis);
+        max_accelerations[i] = mu / (o->periapsis * o->periapsis);
+        if (o->eccentricity < 1.) {
+            min_period = fmin(min_period, o->period);
+        }
+    }
+
+    // without fast outliers, looking further for some objects could not make
+    // the step much longer than the one from the fastest object overall
+    double max_speed = *std::max_element(max_speeds.begin(), max_speeds.end());
+    auto bulk = max_speeds.begin() + (ptrdiff_t) ((double) (n_orbits - 1) * CONJUNCTION_BULK);
+    std::nth_element(max_speeds.begin(), bulk, max_speeds.end());
+    bool adaptive = CONJUNCTION_STEP_MARGIN * max_speed > *bulk;
+
+    ConjunctionStep step;
+    step.x.resize(n_orbits);
+    step.y.resize(n_orbits);
+    step.z.resize(n_orbits);
+    step.vx.resize(n_orbits);
+    step.vy.resize(n_orbits);
+    step.vz.resize(n_orbits);
+    step.cx.resize(n_orbits);
+    step.cy.resize(n_orbits);
+    step.cz.resize(n_orbits);
+    step.speeds.resize(n_orbits);
+    step.reaches.resize(n_orbits);
+    step.buckets.resize(n_orbits);
+    step.sorted.resize(n_orbits);
+    step.sorted_keys.resize(n_orbits);
+    size_t n_buckets = 1;
+    while (n_buckets < n_orbits) {
+        n_buckets *= 2;
+    }
+    step.bucket_starts.resize(n_buckets + 1);
+
+    double cell_size = options->cell_size;
+    if (cell_size <= 0.) {
+        // from the bounding box of the objects at the start
+        propagate(&step, orbits, n_orbits, options->time_min, 1.);
+        double volume = 1.;
+        for (auto component : {&step.x, &step.y, &step.z}) {
+            auto bounds = std::minmax_element(component->begin(), component->end());
+            volume *= fmax(*bounds.second - *bounds.first, options->threshold);
+        }
+        cell_size = cbrt(volume * CONJUNCTION_OCCUPANCY / (double) n_orbits);
+    }
+    cell_size = fmax(cell_size, 2. * options->threshold);
+
+    // with fast outliers, the first step is derived from the speeds at the
+    // start, and each next one from the speeds during the previous one, so
+    // that a single fast object only widens its own neighbourhood; otherwise,
+    // every object only looks at adjacent cells
+    double duration;
+    if (adaptive) {
+        propagate(&step, orbits, n_orbits, options->time_min, cell_size);
+        set_reaches(&step, n_orbits, 0., options->threshold, cell_size, max_accelerations);
+        duration = step_duration(&step, options->threshold, cell_size);
+    } else {
+        std::fill(step.reaches.begin(), step.reaches.end(), 1);
+        duration = (cell_size - options->threshold) / max_speed;
+    }
+
+    size_t n_blocks = std::min(n_orbits, (size_t) parallel_concurrency() * CONJUNCTION_BLOCKS_PER_THREAD);
+    std::vector<std::vector<Conjunction>> block_conjunctions(n_blocks);
+
+    double time = options->time_min;
+    while (time < options->time_max) {
+        duration = fmin(duration, min_period / CONJUNCTION_STEPS_PER_REVOLUTION);
+        double time_end = fmin(time + duration, options->time_max);
+        double half_step = (time_end - time) / 2.;
+
+        auto check_pair = [&](size_t i, size_t j, std::vector<Conjunction>* found) {
+            if (!may_approach(&step, i, j, half_step, options->threshold, max_accelerations)) {
+                return;
+            }
+            if (i > j) {
+                std::swap(i, j);
+            }
+            Encounter encounter;
+            if (encounter_refine(&encounter, orbits[i], orbits[j], time, time_end) < 0) {
+                return;
+            }
+            if (encounter.distance < options->threshold) {
+                found->push_back({i, j, encounter});
+            }
+        };
+
+        propagate(&step, orbits, n_orbits, time + half_step, cell_size);
+        if (adaptive) {
+            set_reaches(&step, n_orbits, half_step, options->threshold, cell_size, max_accelerations);
+        }
+        hash_cells(&step, n_orbits);
+
+        // look for neighbours in the cells within reach; a pair is checked by
+        // the object with the larger reach, and between equal reaches, only
+        // by the one whose cell comes first in lexicographic order, or first
+        // in the bucket; objects are visited in bucket order for locality
+        parallel_for(n_blocks, [&](size_t begin, size_t end) {
+            uint32_t mask = (uint32_t) n_buckets - 1;
+            for (size_t block = begin; block < end; block += 1) {
+                size_t block_begin = n_orbits * block / n_blocks;
+                size_t block_end = n_orbits * (block + 1) / n_blocks;
+                for (size_t p = block_begin; p < block_end; p += 1) {
+                    size_t i = step.sorted[p];
+                    uint64_t key = step.sorted_keys[p];
+                    uint32_t bucket = step.buckets[i];
+                    int64_t reach = step.reaches[i];
+
+                    // common case: the same cell and half of the adjacent
+                    // ones, the other half will visit this one
+                    if (reach == 1) {
+                        for (size_t q = p + 1; q < step.bucket_starts[bucket + 1]; q += 1) {
+                            size_t j = step.sorted[q];
+                            if (step.sorted_keys[q] == key && (!adaptive || step.reaches[j] == 1)) {
+                                check_pair(i, j, &block_conjunctions[block]);
+                            }
+                        }
+                        for (size_t offset = 0; offset < 13; offset += 1) {
+                            int64_t cx = step.cx[i] + half_neighbourhood[offset][0];
+                            int64_t cy = step.cy[i] + half_neighbourhood[offset][1];
+                            int64_t cz = step.cz[i] + half_neighbourhood[offset][2];
+                            uint64_t neighbour_key = cell_key(cx, cy, cz);
+                            uint32_t neighbour_bucket = cell_bucket(neighbour_key, mask);
+                            for (size_t q = step.bucket_starts[neighbour_bucket]; q < step.bucket_starts[neighbour_bucket + 1]; q += 1) {
+                                size_t j = step.sorted[q];
+                                if (step.sorted_keys[q] == neighbour_key && (!adaptive || step.reaches[j] == 1)) {
+                                    check_pair(i, j, &block_conjunctions[block]);
+                                }
+                            }
+                        }
+                        continue;
+                    }
+
+                    for (size_t q = step.bucket_starts[bucket]; q < step.bucket_starts[bucket + 1]; q += 1) {
+                        size_t j = step.sorted[q];
+                        if (step.sorted_keys[q] == key && (step.reaches[j] < reach || (step.reaches[j] == reach && q > p))) {
+                            check_pair(i, j, &block_conjunctions[block]);
+                        }
+                    }
+                    for (int64_t dx = -reach; dx <= reach; dx += 1) {
+                        for (int64_t dy = -reach; dy <= reach; dy += 1) {
+                            for (int64_t dz = -reach; dz <= reach; dz += 1) {
+                                if (dx == 0 && dy == 0 && dz == 0) {
+                                    continue;
+                                }
+                                bool after = dx > 0 || (dx == 0 && (dy > 0 || (dy == 0 && dz > 0)));
+                                uint64_t neighbour_key = cell_key(step.cx[i] + dx, step.cy[i] + dy, step.cz[i] + dz);
+                                uint32_t neighbour_bucket = cell_bucket(neighbour_key, mask);
+                                for (size_t q = step.bucket_starts[neighbour_bucket]; q < step.bucket_starts[neighbour_bucket + 1]; q += 1) {
+                                    size_t j = step.sorted[q];
+                                    if (step.sorted_keys[q] == neighbour_key && (step.reaches[j] < reach || (step.reaches[j] == reach && after))) {
+                                        check_pair(i, j, &block_conjunctions[block]);
+                                    }
+                                }
+                            }
+                        }
+                    }
+                }
+            }
+        });
+
+        time = time_end;
+        if (adaptive) {
+            duration = step_duration(&step, options->threshold, cell_size);
+        }
+    }
+
+    for (auto& v : block_conjunctions) {
+        conjunctions->insert(conjunctions->end(), v.begin(), v.end());
+    }
+    std::sort(conjunctions->begin(), conjunctions->end(), [](const Conjunction& a, const Conjunction& b) {
+        return a.encounter.time < b.encounter.time;
+    });
+    return 0;
+}
@@ -0,0 +1,26 @@
+#ifndef CONJUNCTION_HPP
+#define CONJUNCTION_HPP
+
+#include "encounter.hpp"
+
+#include <vector>
+
+struct ConjunctionOptions {
+    double time_min;
+    double time_max;
+    double threshold;  // report closest approaches below this distance
+    double cell_size;  // of the spatial hash; 0 to derive it from the density
+};
+
+struct Conjunction {
+    size_t i;
+    size_t j;  // i < j
+    Encounter encounter;
+};
+
+// list the closest approaches below the threshold between any two of the
+// objects, in chronological order; all orbits must share the same primary;
+// return -1 on failure
+int conjunction_screen(std::vector<Conjunction>* conjunctions, Orbit** orbits, size_t n_orbits, const ConjunctionOptions* options);
+
+#endif
@@ -1,7 +1,6 @@
 #version 330 core
 
 uniform sampler2D Texture0;
-uniform vec4 u_color;
 
 in vec2 f_texcoord;
 
@@ -1,12 +1,14 @@
 #version 330 core
 
-uniform mat4 model_view_projection_matrix;
-
 in vec3 v_position;
 in vec2 v_texcoord;
 
 out vec2 f_texcoord;
 
+mat4 object_model_view(void) {
+    return model_view_matrix;
+}
+
 void base(void) {
     gl_Position = model_view_projection_matrix * vec4(v_position, 1.0);
     f_texcoord = v_texcoord;
@@ -1,8 +1,5 @@
 #version 330 core
 
-uniform mat4 model_view_projection_matrix;
-uniform mat4 projection_matrix;
-
 in vec3 v_position;
 in vec2 v_texcoord;
 
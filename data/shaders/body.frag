@@ -0,0 +1,109 @@
+#version 330 core
+
+uniform sampler2DArray body_textures;
+uniform bool cubemaps;  // six layers per body, one for each face
+uniform bool markers;  // points of the mean color of the texture
+uniform bool impostors;  // see body.vert
+uniform mat4 cubemap_matrix;
+
+in vec2 f_texcoord;
+in vec3 f_cubemap_position;
+flat in float f_layer;
+in vec3 f_ray;
+flat in vec3 f_center;
+flat in float f_radius;
+flat in mat3 f_rotation;
+
+out vec4 o_color;
+
+// surface of the fragment, see lighting.frag and logz.frag
+bool lighting_per_fragment;
+vec3 lighting_fragment_vertex;
+vec3 lighting_fragment_normal;
+float logz_fragment;
+
+const float PI = 3.14159265358979;
+
+vec4 sample_cubemap(vec3 d) {
+    // select the face and its coordinates as a cubemap texture would
+    vec3 a = abs(d);
+    float face;
+    float major;
+    vec2 st;
+    if (a.x >= a.y && a.x >= a.z) {
+        face = d.x > 0. ? 0. : 1.;
+        major = a.x;
+        st = vec2(d.x > 0. ? -d.z : d.z, -d.y);
+    } else if (a.y >= a.z) {
+        face = d.y > 0. ? 2. : 3.;
+        major = a.y;
+        st = vec2(d.x, d.y > 0. ? d.z : -d.z);
+    } else {
+        face = d.z > 0. ? 4. : 5.;
+        major = a.z;
+        st = vec2(d.z > 0. ? d.x : -d.x, -d.y);
+    }
+    vec3 coordinates = vec3(.5 * st / major + .5, f_layer + face);
+
+    // the coordinates jump across edges, so the gradients come from the
+    // direction instead, lest the edges be sampled from the smallest mipmap
+    float gx = .5 * length(dFdx(d)) / major;
+    float gy = .5 * length(dFdy(d)) / major;
+    return textureGrad(body_textures, coordinates, vec2(gx, 0.), vec2(0., gy));
+}
+
+vec3 impostor(void) {
+    /* Intersect the ray of the fragment with the sphere, and return the
+     * point of the surface in model coordinates */
+    vec3 d = normalize(f_ray);
+
+    // the distance to the center dwarfs the radius, so the terms that
+    // cancel out are computed from the part of the center off the ray
+    vec3 off_ray = cross(d, f_center);
+    float discriminant = f_radius * f_radius - dot(off_ray, off_ray);
+    if (discriminant < 0.) {
+        discard;
+    }
+    vec3 normal = (cross(d, off_ray) - sqrt(discriminant) * d) / f_radius;
+    vec3 vertex = f_center + f_radius * normal;
+    if (vertex.z > 0.) {
+        discard;  // behind the camera
+    }
+
+    lighting_per_fragment = true;
+    lighting_fragment_vertex = vertex;
+    lighting_fragment_normal = normal;
+    logz_fragment = 1. - vertex.z;
+    return f_rotation * normal;
+}
+
+vec2 equirectangular_texcoord(vec3 p) {
+    // as in UVSphereMesh; of the two ways to wrap the longitude, the one that
+    // does not jump across the fragment keeps the mipmap level right
+    float u = 1. - atan(p.x, p.y) / (2. * PI);
+    float u1 = fract(u);
+    float u2 = fract(u + .5) - .5;
+    u = fwidth(u1) <= fwidth(u2) ? u1 : u2;
+    return vec2(u, 1. - acos(clamp(p.z, -1., 1.)) / PI);
+}
+
+void body(void) {
+    if (impostors) {
+        vec3 position = impostor();
+        if (cubemaps) {
+            o_color = sample_cubemap(vec3(cubemap_matrix * vec4(position, 1.)));
+        } else {
+            o_color = texture(body_textures, vec3(equirectangular_texcoord(position), f_layer));
+        }
+        return;
+    }
+
+    if (markers) {
+        // the smallest mipmap level
+        o_color = textureLod(body_textures, vec3(.5, .5, f_layer), 16.);
+    } else if (cubemaps) {
+        o_color = sample_cubemap(f_cubemap_position);
+    } else {
+        o_color = texture(body_textures, vec3(f_texcoord, f_layer));
+    }
+}
@@ -0,0 +1,54 @@
+#version 330 core
+
+uniform mat4 cubemap_matrix;
+uniform bool impostors;  // camera-facing quads instead of spheres
+
+in vec3 v_position;
+in vec2 v_texcoord;
+in mat4 i_model;
+in float i_layer;
+
+out vec2 f_texcoord;
+out vec3 f_cubemap_position;
+flat out float f_layer;
+// for impostors, in view coordinates
+out vec3 f_ray;  // a point of the quad
+flat out vec3 f_center;
+flat out float f_radius;
+flat out mat3 f_rotation;  // from view to model coordinates
+
+mat4 object_model_view(void) {
+    return view_matrix * i_model;
+}
+
+void impostor(void) {
+    // the cone tangent to the sphere cuts the plane of its center along a
+    // circle, which the quad must cover
+    mat4 model_view = object_model_view();
+    vec3 center = vec3(model_view[3]);
+    float radius = length(model_view[0].xyz);
+    float distance = length(center);
+    float size = radius * distance / sqrt(max(distance * distance - radius * radius, 1e-4 * radius * radius));
+
+    vec3 w = center / distance;
+    vec3 up = abs(w.y) < .99 ? vec3(0., 1., 0.) : vec3(1., 0., 0.);
+    vec3 u = normalize(cross(w, up));
+    vec3 v = cross(u, w);
+    f_ray = center + size * (v_position.x * u + v_position.y * v);
+    gl_Position = projection_matrix * vec4(f_ray, 1.);
+
+    f_center = center;
+    f_radius = radius;
+    f_rotation = transpose(mat3(model_view)) / radius;
+}
+
+void body(void) {
+    if (impostors) {
+        impostor();
+    } else {
+        gl_Position = projection_matrix * object_model_view() * vec4(v_position, 1.0);
+        f_texcoord = v_texcoord;
+        f_cubemap_position = vec3(cubemap_matrix * vec4(v_position, 1.));
+    }
+    f_layer = i_layer;
+}
@@ -1,6 +1,5 @@
 #version 330 core
 
-uniform vec4 u_color;
 uniform samplerCube cubemap_texture;
 
 in vec3 f_cubemap_position;
@@ -1,7 +1,6 @@
 #version 330 core
 
 // Uniforms
-uniform mat4 model_view_projection_matrix;
 uniform vec3 u_light_source;
 uniform vec2 u_dims;
 uniform float u_intensity;
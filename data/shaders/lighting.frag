@@ -1,12 +1,15 @@
 #version 330 core
 
-uniform vec3 lighting_source;
-
 in vec3 lighting_vertex;
 in vec3 lighting_normal;
 
 out vec4 o_color;
 
+// set by the shaders that find the surface per fragment, e.g. impostors
+bool lighting_per_fragment = false;
+vec3 lighting_fragment_vertex;
+vec3 lighting_fragment_normal;
+
 // lighting
 const vec4 light_ambient = vec4(0., 0., 0., 1.);
 const vec4 light_diffuse = vec4(5., 5., 5., 1.);
@@ -22,13 +25,16 @@ const vec4 product_diffuse = light_diffuse * material_diffuse;
 const vec4 product_specular = light_specular * material_specular;
 
 void lighting() {
-    vec3 perceived_light = normalize(-lighting_vertex); // vector to eye position (0, 0, 0)
-    vec3 incident_light = normalize(lighting_source - lighting_vertex);
-    vec3 reflected_light = normalize(-reflect(incident_light, lighting_normal));
+    vec3 vertex = lighting_per_fragment ? lighting_fragment_vertex : lighting_vertex;
+    vec3 normal = lighting_per_fragment ? lighting_fragment_normal : lighting_normal;
+
+    vec3 perceived_light = normalize(-vertex); // vector to eye position (0, 0, 0)
+    vec3 incident_light = normalize(lighting_source.xyz - vertex);
+    vec3 reflected_light = normalize(-reflect(incident_light, normal));
 
     // geometry-dependent values
     float component_ambient = 1.0;
-    float component_diffuse = pow(max(dot(lighting_normal, incident_light), 0.0), 2.0);
+    float component_diffuse = pow(max(dot(normal, incident_light), 0.0), 2.0);
     float component_specular = pow(max(dot(reflected_light, perceived_light), 0.0), 0.3 * shininess);
 
     // light-dependent values
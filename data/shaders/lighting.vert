@@ -1,6 +1,5 @@
 #version 330 core
 #
-uniform mat4 model_view_matrix;
 
 in vec3 v_position;
 in vec3 v_normal;
@@ -8,7 +7,11 @@ in vec3 v_normal;
 out vec3 lighting_vertex;
 out vec3 lighting_normal;
 
+// defined by the shader that places the object
+mat4 object_model_view(void);
+
 void lighting() {
-    lighting_vertex = vec3(model_view_matrix * vec4(v_position, 1.0));
-    lighting_normal = normalize(mat3(model_view_matrix) * v_normal);
+    mat4 model_view = object_model_view();
+    lighting_vertex = vec3(model_view * vec4(v_position, 1.0));
+    lighting_normal = normalize(mat3(model_view) * v_normal);
 }
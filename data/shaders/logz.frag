@@ -2,11 +2,15 @@
 
 in float flogz;
 
+// 1 + w of the fragment, set by the shaders that find the surface per
+// fragment; the interpolated value is used otherwise
+float logz_fragment = 0.;
+
 void logz(void) {
     // fix for depth buffer using logarithmic scale
     // http://outerra.blogspot.com/2013/07/logarithmic-depth-buffer-optimizations.html
     float farplane = 1e20;
     float Fcoef = 2.0 / log2(farplane + 1.0);
     float Fcoef_half = 0.5 * Fcoef;
-    gl_FragDepth = log2(flogz) * Fcoef_half;
+    gl_FragDepth = log2(logz_fragment > 0. ? logz_fragment : flogz) * Fcoef_half;
 }
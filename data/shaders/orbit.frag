@@ -0,0 +1,9 @@
+#version 330 core
+
+flat in vec4 f_color;
+
+out vec4 o_color;
+
+void orbit(void) {
+    o_color = f_color;
+}
@@ -0,0 +1,74 @@
+#version 330 core
+
+uniform bool apses;  // draw the markers of the orbits rather than the lines
+uniform int n_segments;  // of each line
+
+// positions are in the plane of the orbit, then placed by i_model
+in mat4 i_model;
+// semi-latus rectum, eccentricity, semi-major axis, semi-minor axis
+in vec4 i_orbit_shape;
+// true anomaly of the body, true anomaly at escape, cosine and sine of the
+// eccentric anomaly of the body minus π
+in vec4 i_orbit_anomalies;
+// true anomalies of the ascending and descending nodes, mask of the shown
+// markers, flags
+in vec4 i_orbit_markers;
+in vec4 i_color;
+
+flat out vec4 f_color;
+
+// flags, as in render.cpp
+const int ORBIT_OPEN = 1;  // only drawn from the body to the escape
+const int ORBIT_FOCUSED = 2;  // drawn from the body rather than the focus
+
+const float PI = 3.14159265358979;
+
+vec2 conic_position(float true_anomaly) {
+    float r = i_orbit_shape.x / (1. + i_orbit_shape.y * cos(true_anomaly));
+    return r * vec2(cos(true_anomaly), sin(true_anomaly));
+}
+
+vec2 line_position(float t, int flags) {
+    bool focused = (flags & ORBIT_FOCUSED) != 0;
+    if ((flags & ORBIT_OPEN) != 0) {
+        // the first point is exactly on the body
+        vec2 position = conic_position(mix(i_orbit_anomalies.x, i_orbit_anomalies.y, t));
+        return focused ? position - conic_position(i_orbit_anomalies.x) : position;
+    }
+
+    vec2 axes = i_orbit_shape.zw;
+    if (focused) {
+        // circle through the body, with more points close to it
+        float x = 2. * t - 1.;
+        float theta = PI * x * x * x;
+        vec2 v = vec2(1. - cos(theta), sin(theta));
+        vec2 r = i_orbit_anomalies.zw;
+        return axes * vec2(r.x * v.x - r.y * v.y, r.y * v.x + r.x * v.y);
+    }
+    float eccentric_anomaly = PI * (2. * t - 1.);
+    return axes * vec2(cos(eccentric_anomaly) - i_orbit_shape.y, sin(eccentric_anomaly));
+}
+
+vec2 marker_position(int marker, int flags) {
+    // periapsis, apoapsis, ascending node, descending node
+    float true_anomaly = marker == 0 ? 0. : marker == 1 ? PI : marker == 2 ? i_orbit_markers.x : i_orbit_markers.y;
+    vec2 position = conic_position(true_anomaly);
+    return (flags & ORBIT_FOCUSED) != 0 ? position - conic_position(i_orbit_anomalies.x) : position;
+}
+
+void orbit(void) {
+    f_color = i_color;
+
+    int flags = int(i_orbit_markers.w);
+    vec2 position;
+    if (apses) {
+        if ((int(i_orbit_markers.z) & (1 << gl_VertexID)) == 0) {
+            gl_Position = vec4(2., 2., 0., 1.);  // clipped
+            return;
+        }
+        position = marker_position(gl_VertexID, flags);
+    } else {
+        position = line_position(float(gl_VertexID) / float(n_segments), flags);
+    }
+    gl_Position = projection_matrix * view_matrix * i_model * vec4(position, 0., 1.);
+}
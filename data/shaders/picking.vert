@@ -1,4 +0,0 @@
-#version 330 core
-
-void picking() {
-}
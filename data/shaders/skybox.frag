@@ -1,6 +1,5 @@
 #version 330 core
 
-uniform vec4 u_color;
 uniform samplerCube skybox_texture;
 
 in vec3 cubemap_dir;
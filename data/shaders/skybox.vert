@@ -1,7 +1,5 @@
 #version 330 core
 
-uniform mat4 model_view_projection_matrix;
-
 in vec3 v_position;
 
 out vec3 cubemap_dir;
@@ -1,6 +1,5 @@
 #version 330 core
 
-uniform mat4 model_view_projection_matrix;
 uniform float visibility;
 uniform vec2 star_glow_size;
 uniform vec3 star_glow_position;
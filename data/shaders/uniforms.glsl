@@ -0,0 +1,16 @@
+// inserted in every shader after the #version line; the layouts must match
+// ViewBlock and ObjectBlock in program.hpp
+
+// written once per view
+layout(std140) uniform View {
+    mat4 view_matrix;
+    mat4 projection_matrix;
+    vec4 lighting_source;  // in view coordinates
+};
+
+// written for each draw that changes it
+layout(std140) uniform Object {
+    mat4 model_view_matrix;
+    mat4 model_view_projection_matrix;
+    vec4 u_color;
+};
@@ -0,0 +1,172 @@
+#include "encounter.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+#define ENCOUNTER_SAMPLES_PER_REVOLUTION 16
+#define ENCOUNTER_MIN_SAMPLES 64
+#define ENCOUNTER_MAX_ITERATIONS 50
+#define ENCOUNTER_TIME_TOLERANCE 1e-3
+
+static double range_rate(Orbit* a, Orbit* b, double time, double* derivative, Encounter* encounter) {
+    /* Half the derivative of the squared distance, and its own derivative */
+    glm::dvec3 position_a, velocity_a, position_b, velocity_b;
+    orbit_state_at_time(a, time, &position_a, &velocity_a);
+    orbit_state_at_time(b, time, &position_b, &velocity_b);
+
+    double mu = a->primary->gravitational_parameter;
+    double ra = glm::length(position_a);
+    double rb = glm::length(position_b);
+    glm::dvec3 acceleration = -mu * position_a / (ra * ra * ra) + mu * position_b / (rb * rb * rb);
+
+    glm::dvec3 dr = position_a - position_b;
+    glm::dvec3 dv = velocity_a - velocity_b;
+    if (derivative != NULL) {
+        *derivative = glm::dot(dv, dv) + glm::dot(dr, acceleration);
+    }
+    if (encounter != NULL) {
+        encounter->time = time;
+        encounter->distance = glm::length(dr);
+        encounter->relative_speed = glm::length(dv);
+    }
+    return glm::dot(dr, dv);
+}
+
+static double true_anomaly_of_direction(Orbit* o, const glm::dvec3& direction) {
+    glm::dvec3 local = glm::inverse(o->orientation) * direction;
+    return atan2(local[1], local[0]);
+}
+
+static void append_passages(std::vector<double>* times, Orbit* o, double true_anomaly, double time_min, double time_max) {
+    double time = orbit_time_at_true_anomaly(o, true_anomaly);
+    if (!std::isfinite(time)) {  // beyond the asymptotes of an open orbit
+        return;
+    }
+
+    if (o->eccentricity >= 1.) {
+        if (time_min < time && time < time_max) {
+            times->push_back(time);
+        }
+        return;
+    }
+
+    time += ceil((time_min - time) / o->period) * o->period;
+    for (; time < time_max; time += o->period) {
+        times->push_back(time);
+    }
+}
+
+static void append_geometric_events(std::vector<double>* times, Orbit* o, const glm::dvec3& node_line, double time_min, double time_max) {
+    // apsides
+    append_passages(times, o, 0., time_min, time_max);
+    append_passages(times, o, M_PI, time_min, time_max);
+
+    // mutual nodes, where the orbit crosses the plane of the other one
+    if (node_line != glm::dvec3(0.)) {
+        double node = true_anomaly_of_direction(o, node_line);
+        append_passages(times, o, node, time_min, time_max);
+        append_passages(times, o, node + M_PI, time_min, time_max);
+    }
+}
+
+static Encounter polish(Orbit* a, Orbit* b, double low, double f_low, double high, double f_high) {
+    /* Safeguarded Newton on the range-rate, within a sign-changing bracket */
+    double time = low - f_low * (high - low) / (f_high - f_low);
+    Encounter encounter;
+    for (int i = 0; i < ENCOUNTER_MAX_ITERATIONS; i += 1) {
+        double derivative;
+        double f = range_rate(a, b, time, &derivative, &encounter);
+        if (f < 0.) {
+            low = time;
+        } else {
+            high = time;
+        }
+
+        double next = time - f / derivative;
+        if (!(derivative > 0.) || next <= low || next >= high) {
+            next = (low + high) / 2.;
+        }
+        if (fabs(next - time) < ENCOUNTER_TIME_TOLERANCE) {
+            // report the last estimate, not the one before it; at orbital
+            // speeds, the tolerance alone is worth meters
+            range_rate(a, b, next, NULL, &encounter);
+            break;
+        }
+        time = next;
+    }
+    return encounter;
+}
+
+int encounter_search(Encounter* encounters, size_t max_encounters, Orbit* a, Orbit* b, double time_min, double time_max) {
+    if (a->primary != b->primary) {
+        return -1;
+    }
+    if (max_encounters == 0 || !(time_min < time_max)) {
+        return 0;
+    }
+
+    // bracket candidates between the apsides and mutual nodes of both orbits
+    glm::dvec3 normal_a = a->orientation * glm::dvec3(0., 0., 1.);
+    glm::dvec3 normal_b = b->orientation * glm::dvec3(0., 0., 1.);
+    glm::dvec3 node_line = glm::cross(normal_a, normal_b);
+    if (glm::length(node_line) < 1e-9) {  // coplanar
+        node_line = glm::dvec3(0.);
+    }
+
+    std::vector<double> times{time_min, time_max};
+    append_geometric_events(&times, a, node_line, time_min, time_max);
+    append_geometric_events(&times, b, node_line, time_min, time_max);
+    std::sort(times.begin(), times.end());
+
+    // the distance may still oscillate between two events
+    double step = (time_max - time_min) / ENCOUNTER_MIN_SAMPLES;
+    if (a->eccentricity < 1.) {
+        step = fmin(step, a->period / ENCOUNTER_SAMPLES_PER_REVOLUTION);
+    }
+    if (b->eccentricity < 1.) {
+        step = fmin(step, b->period / ENCOUNTER_SAMPLES_PER_REVOLUTION);
+    }
+
+    size_t n_encounters = 0;
+    double previous_time = time_min;
+    double previous_f = range_rate(a, b, time_min, NULL, NULL);
+    for (size_t i = 1; i < times.size(); i += 1) {
+        double gap = times[i] - times[i - 1];
+        if (gap <= 0.) {
+            continue;
+        }
+        double n_steps = ceil(gap / step);
+        for (double j = 1.; j <= n_steps; j += 1.) {
+            double time = j == n_steps ? times[i] : times[i - 1] + gap * j / n_steps;
+            double f = range_rate(a, b, time, NULL, NULL);
+
+            // the distance stops decreasing
+            if (previous_f < 0. && f >= 0.) {
+                encounters[n_encounters] = polish(a, b, previous_time, previous_f, time, f);
+                n_encounters += 1;
+                if (n_encounters == max_encounters) {
+                    return (int) n_encounters;
+                }
+            }
+
+            previous_time = time;
+            previous_f = f;
+        }
+    }
+    return (int) n_encounters;
+}
+
+int encounter_refine(Encounter* encounter, Orbit* a, Orbit* b, double time_min, double time_max) {
+    if (a->primary != b->primary) {
+        return -1;
+    }
+
+    double f_min = range_rate(a, b, time_min, NULL, NULL);
+    double f_max = range_rate(a, b, time_max, NULL, NULL);
+    if (!(f_min < 0. && f_max >= 0.)) {
+        return -1;
+    }
+    *encounter = polish(a, b, time_min, f_min, time_max, f_max);
+    return 0;
+}
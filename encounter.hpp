@@ -0,0 +1,23 @@
+#ifndef ENCOUNTER_HPP
+#define ENCOUNTER_HPP
+
+#include "orbit.hpp"
+
+#include <cstddef>
+
+struct Encounter {
+    double time;
+    double distance;
+    double relative_speed;
+};
+
+// list the closest approaches (local minima of the distance) between two
+// objects orbiting the same primary within [time_min, time_max], in
+// chronological order; writes at most max_encounters entries and returns
+// their number, or -1 when the orbits do not share a primary
+int encounter_search(Encounter* encounters, size_t max_encounters, Orbit* a, Orbit* b, double time_min, double time_max);
+// closest approach within (time_min, time_max], assumed short enough to hold
+// at most one; return -1 when there is none
+int encounter_refine(Encounter* encounter, Orbit* a, Orbit* b, double time_min, double time_max);
+
+#endif
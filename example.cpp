@@ -1,224 +1,12 @@
 #include "orbit.hpp"
 #include "load.hpp"
 #include "recipes.hpp"
-#include "lambert.hpp"
-
-#include <glm/ext/matrix_transform.hpp>
+#include "transfer.hpp"
 
 #include <cmath>
 #include <cstdio>
 #include <cstdlib>
 
-// primary                         common primary of origin and target
-// injection orbit                 orbit in origin's SoI used to escape
-// transfer orbit                  orbit around primary
-// insertion orbit                 orbit in target's SoI used to capture
-// escape                          when leaving origin SoI
-// encounter                       when entering target SoI
-
-double injection_prograde_at_escape_angle(CelestialBody* origin, double r0, double v_soi) {
-    /* Consider the injection orbit corresponding to the given velocity vector
-     * v_soi and return the angle formed by the position at periapsis and the
-     * velocity at escape
-     *
-     * Parameters:
-     *     origin  departed celestial body
-     *     r0      periapsis
-     *     v_soi   speed at escape
-     */
-    double mu = origin->gravitational_parameter;
-    double r_soi = origin->sphere_of_influence;
-
-    // speed at periapsis
-    double v0 = sqrt(v_soi*v_soi + 2.*mu/r0 - 2.*mu/r_soi);
-
-    // true anomaly at escape
-    double theta0;
-    {
-        double e = r0 * v0 * v0 / mu - 1.;  // injection orbit eccentricity
-        double a = r0 / (1. - e);  // injection orbit semi-major axis
-        theta0 = acos((a*(1.-e*e) - r_soi) / (e*r_soi));
-    }
-
-    // zenith angle at escape
-    double theta1 = asin(v0*r0 / (v_soi*r_soi));
-
-    return theta0 + theta1;
-}
-
-double injection_orbit_inclination_from_vsoi(CelestialBody* origin, double r0, glm::dvec3 v_soi) {
-    /* Determine the inclination required to reach a specific escape velocity
-     *
-     * Parameters:
-     *     origin  departed celestial body
-     *     r0      radius of the parking orbit
-     *     v_soi   desired velocity at escape
-     */
-
-    // determine the periapsis of the injection orbit by rotating the velocity at escape
-    double theta = injection_prograde_at_escape_angle(origin, r0, glm::length(v_soi));
-    // rotate v_soi around z by -theta and project on xy
-    double c = cos(-theta);
-    double s = sin(-theta);
-    glm::dvec3 p{
-        v_soi[0]*c - v_soi[1]*s,
-        v_soi[0]*s + v_soi[1]*c,
-        0.,
-    };
-
-    // normal of injection orbital plane
-    glm::dvec3 n = glm::cross(p, v_soi);
-
-    // angle between normals of injection orbital plane and of ecliptic plane
-    n /= glm::length(n);
-    return acos(n[2]);
-}
-
-double injection_cost(CelestialBody* origin, double parking_radius, glm::dvec3 v_escape) {
-    /* Return the Δv required to escape from an origin body and reach a specific
-     * relative velocity at escape
-     */
-
-    // inclination of the in-SoI transfer orbit
-    double injection_inclination = injection_orbit_inclination_from_vsoi(origin, parking_radius, v_escape);
-    return maneuver_orbit_to_escape_cost(origin, parking_radius, parking_radius, glm::length(v_escape), injection_inclination);
-}
-
-double insertion_cost(CelestialBody* target, double apsis1, double apsis2, glm::dvec3 v_encounter) {
-    /* Return the Δv required to insert into an orbit around a target body from
-     * a given relative velocity at encounter
-     *
-     * Parameters:
-     *     origin       celestial body to depart
-     *     r0           radius of parking orbit
-     *     v_encounter  velocity re. target at encounter
-     */
-    return maneuver_orbit_to_escape_cost(target, apsis1, apsis2, glm::length(v_encounter), 0.);
-}
-
-double rendez_vous_cost(CelestialBody* origin, CelestialBody* target, double time_at_departure, double transfer_duration, double parking_radius, double apsis1, double apsis2) {
-    /* Return the Δv required to transfer from origin to target departing at
-     * given time and taking the given time; this assumes a departure from a
-     * circular parking orbit at the origin, and an arrival into an elliptical
-     * orbit with the given apses at the raget */
-    double time_at_arrival = time_at_departure + transfer_duration;
-
-    // state of origin at departure
-    glm::dvec3 origin_position_at_departure = orbit_position_at_time(origin->orbit, time_at_departure);
-    glm::dvec3 origin_velocity_at_departure = orbit_velocity_at_time(origin->orbit, time_at_departure);
-
-    // state of target at arrival
-    glm::dvec3 target_position_at_arrival = orbit_position_at_time(target->orbit, time_at_arrival);
-    glm::dvec3 target_velocity_at_arrival = orbit_velocity_at_time(target->orbit, time_at_arrival);
-
-    // determine transfer orbit
-    glm::dvec3 transfer_velocity_at_escape, transfer_velocity_at_arrival;
-    double mu = origin->orbit->primary->gravitational_parameter;
-    lambert(transfer_velocity_at_escape, transfer_velocity_at_arrival, mu, origin_position_at_departure, target_position_at_arrival, transfer_duration, 0, 0);
-
-    // cost of injection into transfer orbit
-    glm::dvec3 v_escape = transfer_velocity_at_escape - origin_velocity_at_departure;
-    double injection_dv = injection_cost(origin, parking_radius, v_escape);
-
-    // cost of insertion into target orbit
-    glm::dvec3 v_encounter = transfer_velocity_at_arrival - target_velocity_at_arrival;
-    double insertion_dv = insertion_cost(target, apsis1, apsis2, v_encounter);
-
-    return injection_dv + insertion_dv;
-}
-
-// TODO
-static double f(Orbit* trajectory_at_escape, double true_anomaly_at_intercept, double relative_inclination, double x) {
-    double plane_change_angle = atan2(tan(relative_inclination), sin(true_anomaly_at_intercept - x));
-    double distance = orbit_distance_at_true_anomaly(trajectory_at_escape, x);
-    double speed = orbit_speed_at_distance(trajectory_at_escape, distance);
-    double dv = maneuver_plane_change_cost(speed, plane_change_angle);
-    return dv;
-}
-
-double rendez_vous_cost2(CelestialBody* origin, CelestialBody* target, double time_at_departure, double transfer_duration, double parking_radius, double apsis1, double apsis2) {
-    double time_at_arrival = time_at_departure + transfer_duration;
-
-    // state of origin at departure
-    glm::dvec3 origin_position_at_departure = orbit_position_at_time(origin->orbit, time_at_departure);
-    glm::dvec3 origin_velocity_at_departure = orbit_velocity_at_time(origin->orbit, time_at_departure);
-
-    // state of target at arrival
-    glm::dvec3 target_position_at_arrival = orbit_position_at_time(target->orbit, time_at_arrival);
-    glm::dvec3 target_velocity_at_arrival = orbit_velocity_at_time(target->orbit, time_at_arrival);
-
-    // determine rotation to bring target on origin's orbital plane
-    glm::dvec3 n = origin->orbit->orientation * glm::dvec3{0, 0, 1};
-    // angle between target_position_at_arrival and n
-    // TODO: just use glm::angle
-    double relative_inclination = asin(glm::dot(target_position_at_arrival, n) / glm::length(target_position_at_arrival));
-    glm::dvec3 rotation_axis = glm::cross(target_position_at_arrival, n);
-    glm::dmat3 plane_change_rotation = glm::rotate(glm::dmat4(1), -relative_inclination, rotation_axis);
-
-    // BEGIN BLOCK A
-    // use plane_change_rotation to rotate target_position_at_arrival in origin's orbital plane
-    glm::dvec3 target_position_at_arrival_projected_on_origin_plane = plane_change_rotation * target_position_at_arrival;
-    // determine transfer velocities
-    glm::dvec3 transfer_velocity_at_escape, transfer_velocity_at_arrival;
-    double mu = origin->orbit->primary->gravitational_parameter;
-    lambert(transfer_velocity_at_escape, transfer_velocity_at_arrival, mu, origin_position_at_departure, target_position_at_arrival_projected_on_origin_plane, transfer_duration, 0, 0);
-    // first part of transfer
-    Orbit trajectory_at_escape;
-    orbit_from_state(&trajectory_at_escape, origin->orbit->primary, origin_position_at_departure, transfer_velocity_at_escape, time_at_departure);
-    // find most efficient time to change plane
-    double true_anomaly_at_intercept = orbit_true_anomaly_at_distance(&trajectory_at_escape, glm::length(target_position_at_arrival));  // same as projected
-    // Golden Section search
-    double a = 0.;  // TODO
-    double b = M_PI;  // TODO
-    {
-#define INV_PHI 0.6180339887498949  // (1. / phi)
-#define INV_PHI_2 0.3819660112501051  // (1. / (phi*phi))
-        double h = b - a;
-        double c = a + INV_PHI_2 * h;
-        double d = a + INV_PHI * h;
-        double f_c = f(&trajectory_at_escape, true_anomaly_at_intercept, relative_inclination, c);
-        double f_d = f(&trajectory_at_escape, true_anomaly_at_intercept, relative_inclination, d);
-        for (int i = 0; i < 3; i += 1) {
-            if (f_c < f_d) {
-                b = d;
-                d = c;
-                f_d = f_c;
-                h *= INV_PHI;
-                c = a + INV_PHI_2 * h;
-                f_c = f(&trajectory_at_escape, true_anomaly_at_intercept, relative_inclination, c);
-            } else {
-                a = c;
-                c = d;
-                f_c = f_d;
-                h *= INV_PHI;
-                d = a + INV_PHI * h;
-                f_d = f(&trajectory_at_escape, true_anomaly_at_intercept, relative_inclination, d);
-            }
-        }
-        if (f_c < f_d) {
-            b = d;
-        } else {
-            a = c;
-        }
-    }
-    (void) b;
-    // END BLOCK A
-
-
-    double plane_change_dv = f(&trajectory_at_escape, true_anomaly_at_intercept, relative_inclination, a);  // TODO
-    // TODO: rotate transfer_velocity_at_arrival
-
-    // cost of injection into transfer orbit
-    glm::dvec3 v_escape = transfer_velocity_at_escape - origin_velocity_at_departure;
-    double injection_dv = injection_cost(origin, parking_radius, v_escape);
-
-    // cost of insertion into target orbit
-    glm::dvec3 v_encounter = transfer_velocity_at_arrival - target_velocity_at_arrival;
-    double insertion_dv = insertion_cost(target, apsis1, apsis2, v_encounter);
-
-    return injection_dv + plane_change_dv + insertion_dv;
-}
-
 int main(void) {
     /*
     const char* data_file = "data/solar_system.json";
@@ -267,6 +55,15 @@ int main(void) {
     double total_dv2 = rendez_vous_cost2(origin, target, time_at_departure, transfer_duration, parking_radius, apsis1, apsis2);
     printf("%.0f m/s\n", total_dv2);
 
+    // best window over the next synodic period
+    double synodic = synodic_period(origin->orbit, target->orbit);
+    double hohmann_time = maneuver_hohmann_time(origin->orbit->primary, origin->orbit->semi_major_axis, target->orbit->semi_major_axis);
+    TransferWindow window;
+    if (transfer_window_search(&window, origin, target, 0., synodic, .5 * hohmann_time, 1.5 * hohmann_time, parking_radius, apsis1, apsis2) < 0) {
+        exit(EXIT_FAILURE);
+    }
+    printf("%.0f m/s departing at %.0f s for %.0f s\n", window.cost, window.time_at_departure, window.transfer_duration);
+
     for (size_t i = 0; i < 1<<20; i += 1) {
         rendez_vous_cost2(origin, target, time_at_departure, transfer_duration, parking_radius, apsis1, apsis2);
     }
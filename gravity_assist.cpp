@@ -0,0 +1,318 @@
+#include "gravity_assist.hpp"
+
+#include "orbit.hpp"
+#include "recipes.hpp"
+#include "lambert.hpp"
+#include "transfer.hpp"
+#include "parallel.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <unordered_map>
+#include <unordered_set>
+
+// leg durations tried between two bodies, as fractions of the duration of
+// the Hohmann transfer between their orbits
+#define GRAVITY_ASSIST_DURATIONS 32
+#define GRAVITY_ASSIST_MIN_DURATION .2
+#define GRAVITY_ASSIST_MAX_DURATION 2.
+
+double flyby_maximum_turn_angle(CelestialBody* body, double v_infinity, double min_periapsis) {
+    double mu = body->gravitational_parameter;
+    return 2. * asin(1. / (1. + min_periapsis * v_infinity*v_infinity / mu));
+}
+
+double flyby_cost(CelestialBody* body, glm::dvec3 v_in, glm::dvec3 v_out, double min_periapsis) {
+    /* The incoming and outgoing hyperbolas share the same periapsis, where
+     * the burn happens; each contributes half of its own deflection; when
+     * gravity alone cannot provide the deflection, the rest is paid by a burn
+     * when leaving the sphere of influence
+     */
+    double mu = body->gravitational_parameter;
+    double a = glm::length(v_in);
+    double b = glm::length(v_out);
+    double turn = acos(fmax(-1., fmin(1., glm::dot(v_in, v_out) / (a * b))));
+
+    auto turn_at_periapsis = [&](double periapsis) {
+        return asin(1. / (1. + periapsis * a*a / mu)) + asin(1. / (1. + periapsis * b*b / mu));
+    };
+
+    double periapsis = min_periapsis;
+    double excess_turn = turn - turn_at_periapsis(min_periapsis);
+    if (excess_turn < 0.) {
+        // the deflection decreases with the periapsis; bracket, then bisect
+        double low = min_periapsis;
+        double high = min_periapsis;
+        while (turn_at_periapsis(high) > turn && high < 1e30) {
+            low = high;
+            high *= 2.;
+        }
+        for (int i = 0; i < 64; i += 1) {
+            double middle = (low + high) / 2.;
+            if (turn_at_periapsis(middle) > turn) {
+                low = middle;
+            } else {
+                high = middle;
+            }
+        }
+        periapsis = (low + high) / 2.;
+        excess_turn = 0.;
+    }
+
+    double periapsis_dv = fabs(sqrt(b*b + 2.*mu/periapsis) - sqrt(a*a + 2.*mu/periapsis));
+    return periapsis_dv + maneuver_plane_change_cost(b, excess_turn);
+}
+
+// times are expressed as a number of time steps after departure_min
+struct LegKey {
+    size_t from;
+    size_t to;
+    int64_t departure;
+    int64_t duration;
+
+    bool operator==(const LegKey& other) const {
+        return from == other.from && to == other.to && departure == other.departure && duration == other.duration;
+    }
+};
+
+struct LegKeyHash {
+    size_t operator()(const LegKey& key) const {
+        uint64_t h = 1469598103934665603ULL;  // FNV-1a
+        uint64_t values[] = {key.from, key.to, (uint64_t) key.departure, (uint64_t) key.duration};
+        for (uint64_t value : values) {
+            h = (h ^ value) * 1099511628211ULL;
+        }
+        return (size_t) h;
+    }
+};
+
+struct Leg {
+    bool valid;
+    glm::dvec3 v_escape;  // relative to departed body
+    glm::dvec3 v_encounter;  // relative to encountered body
+    double distance_at_encounter;  // from primary
+    double body_speed_at_encounter;  // relative to primary
+};
+
+struct GravityAssistNode {
+    size_t body;  // index in bodies
+    int64_t time;
+    glm::dvec3 v_encounter;  // undefined at departure
+    double cost;
+    double lower_bound;  // of the cost of any complete sequence from here
+    std::vector<size_t> sequence;
+    std::vector<int64_t> times;
+};
+
+int gravity_assist_search(GravityAssistSequence* best, CelestialBody* origin, CelestialBody* target, CelestialBody** candidates, size_t n_candidates, const GravityAssistOptions* options) {
+    /* Beam search over the sequences of encountered bodies and the durations
+     * of the legs, with branch-and-bound pruning against the best complete
+     * sequence; the Lambert problem of each leg is solved once and memoized,
+     * since different branches often share the same legs
+     */
+
+    // bodies[0] is origin, bodies[1] is target
+    std::vector<CelestialBody*> bodies{origin, target};
+    for (size_t i = 0; i < n_candidates; i += 1) {
+        if (std::find(bodies.begin(), bodies.end(), candidates[i]) == bodies.end()) {
+            bodies.push_back(candidates[i]);
+        }
+    }
+    if (origin->orbit == NULL) {
+        return -1;
+    }
+    CelestialBody* primary = origin->orbit->primary;
+    for (CelestialBody* body : bodies) {
+        if (body->orbit == NULL || body->orbit->primary != primary) {
+            return -1;
+        }
+    }
+    double step = options->time_step;
+    if (!(step > 0.) || !(options->departure_min <= options->departure_max) || options->beam_width == 0) {
+        return -1;
+    }
+    int64_t n_departures = 1 + (int64_t) floor((options->departure_max - options->departure_min) / step);
+    int64_t max_duration = (int64_t) floor(options->max_duration / step);
+
+    // leg durations between each pair of bodies
+    size_t n_bodies = bodies.size();
+    std::vector<std::vector<int64_t>> durations(n_bodies * n_bodies);
+    for (size_t i = 0; i < n_bodies; i += 1) {
+        for (size_t j = 0; j < n_bodies; j += 1) {
+            double r1 = bodies[i]->orbit->semi_major_axis;
+            double r2 = bodies[j]->orbit->semi_major_axis;
+            double hohmann_time = maneuver_hohmann_time(primary, r1, r2);
+            auto& list = durations[i * n_bodies + j];
+            for (size_t k = 0; k <= GRAVITY_ASSIST_DURATIONS; k += 1) {
+                double fraction = GRAVITY_ASSIST_MIN_DURATION + (GRAVITY_ASSIST_MAX_DURATION - GRAVITY_ASSIST_MIN_DURATION) * (double) k / GRAVITY_ASSIST_DURATIONS;
+                int64_t duration = (int64_t) fmax(1., round(fraction * hohmann_time / step));
+                if (duration <= max_duration && (list.empty() || list.back() != duration)) {
+                    list.push_back(duration);
+                }
+            }
+        }
+    }
+
+    // minimum Δv of capture, for the lower bound of incomplete sequences
+    double capture_floor = maneuver_orbit_to_escape_cost(target, options->apsis1, options->apsis2, 0., 0.);
+    // going outwards, the speed around the primary after a flyby is at most
+    // the speed of the body plus the relative speed, and must be enough to
+    // climb to the target; any deficit must be paid by the remaining burns
+    double mu = primary->gravitational_parameter;
+    double target_distance = target->orbit->periapsis;
+    auto remaining_floor = [&](const Leg& leg) {
+        double r = leg.distance_at_encounter;
+        if (r >= target_distance) {
+            return capture_floor;
+        }
+        double required_speed = sqrt(2. * mu * (1. / r - 1. / target_distance));
+        double reachable_speed = leg.body_speed_at_encounter + glm::length(leg.v_encounter);
+        return capture_floor + fmax(0., required_speed - reachable_speed);
+    };
+
+    std::unordered_map<LegKey, Leg, LegKeyHash> legs;
+    auto solve_leg = [&](const LegKey& key) {
+        double time_at_departure = options->departure_min + (double) key.departure * step;
+        double duration = (double) key.duration * step;
+        glm::dvec3 r1, v1, r2, v2;
+        orbit_state_at_time(bodies[key.from]->orbit, time_at_departure, &r1, &v1);
+        orbit_state_at_time(bodies[key.to]->orbit, time_at_departure + duration, &r2, &v2);
+        glm::dvec3 transfer_v1, transfer_v2;
+        lambert(transfer_v1, transfer_v2, primary->gravitational_parameter, r1, r2, duration, 0, 0);
+        Leg leg{true, transfer_v1 - v1, transfer_v2 - v2, glm::length(r2), glm::length(v2)};
+        if (isnan(glm::length(leg.v_escape) + glm::length(leg.v_encounter))) {
+            leg.valid = false;
+        }
+        return leg;
+    };
+
+    // legs that may follow a partial sequence
+    auto successors = [&](const GravityAssistNode& node) {
+        std::vector<LegKey> keys;
+        size_t depth = node.sequence.size() - 1;
+        for (size_t next = 1; next < n_bodies; next += 1) {
+            // keep the last leg for the target
+            if (next != 1 && depth >= options->max_flybys) {
+                continue;
+            }
+            for (int64_t duration : durations[node.body * n_bodies + next]) {
+                if (node.time + duration > node.times[0] + max_duration) {
+                    break;
+                }
+                keys.push_back({node.body, next, node.time, duration});
+            }
+        }
+        return keys;
+    };
+
+    double min_flyby_altitude = options->min_flyby_altitude;
+    auto expand = [&](const GravityAssistNode& node, double incumbent, std::vector<GravityAssistNode>& children) {
+        for (const LegKey& key : successors(node)) {
+            const Leg& leg = legs.at(key);
+            if (!leg.valid) {
+                continue;
+            }
+
+            double dv;
+            if (node.sequence.size() == 1) {
+                dv = injection_cost(origin, options->parking_radius, leg.v_escape);
+            } else {
+                CelestialBody* body = bodies[node.body];
+                dv = flyby_cost(body, node.v_encounter, leg.v_escape, body->radius + min_flyby_altitude);
+            }
+            double cost = node.cost + dv;
+            double lower_bound = cost;
+            if (key.to == 1) {
+                cost += insertion_cost(target, options->apsis1, options->apsis2, leg.v_encounter);
+                lower_bound = cost;
+            } else {
+                lower_bound += remaining_floor(leg);
+            }
+            // per-branch lower bound
+            if (isnan(lower_bound) || lower_bound >= incumbent) {
+                continue;
+            }
+
+            GravityAssistNode child{key.to, node.time + key.duration, leg.v_encounter, cost, lower_bound, node.sequence, node.times};
+            child.sequence.push_back(key.to);
+            child.times.push_back(child.time);
+            children.push_back(child);
+        }
+    };
+
+    // departures
+    std::vector<GravityAssistNode> beam;
+    for (int64_t i = 0; i < n_departures; i += 1) {
+        beam.push_back({0, i, {}, 0., 0., {0}, {i}});
+    }
+
+    double incumbent = INFINITY;
+    GravityAssistNode best_node;
+    for (size_t depth = 0; depth <= options->max_flybys && !beam.empty(); depth += 1) {
+        // solve the missing legs in parallel
+        std::unordered_set<LegKey, LegKeyHash> missing;
+        for (auto& node : beam) {
+            for (const LegKey& key : successors(node)) {
+                if (legs.find(key) == legs.end()) {
+                    missing.insert(key);
+                }
+            }
+        }
+        std::vector<LegKey> keys(missing.begin(), missing.end());
+        std::vector<Leg> solved(keys.size());
+        parallel_for(keys.size(), [&](size_t begin, size_t end) {
+            for (size_t i = begin; i < end; i += 1) {
+                solved[i] = solve_leg(keys[i]);
+            }
+        });
+        for (size_t i = 0; i < keys.size(); i += 1) {
+            legs[keys[i]] = solved[i];
+        }
+
+        // expand the beam in parallel, the memo being read-only
+        std::vector<std::vector<GravityAssistNode>> children(beam.size());
+        parallel_for(beam.size(), [&](size_t begin, size_t end) {
+            for (size_t i = begin; i < end; i += 1) {
+                expand(beam[i], incumbent, children[i]);
+            }
+        });
+
+        // complete sequences update the incumbent; keep the most promising others
+        std::vector<GravityAssistNode> next_beam;
+        for (auto& list : children) {
+            for (auto& child : list) {
+                if (child.body == 1) {
+                    if (child.cost < incumbent) {
+                        incumbent = child.cost;
+                        best_node = child;
+                    }
+                } else {
+                    next_beam.push_back(std::move(child));
+                }
+            }
+        }
+        next_beam.erase(std::remove_if(next_beam.begin(), next_beam.end(), [&](const GravityAssistNode& node) {
+            return node.lower_bound >= incumbent;
+        }), next_beam.end());
+        if (next_beam.size() > options->beam_width) {
+            std::partial_sort(next_beam.begin(), next_beam.begin() + (ptrdiff_t) options->beam_width, next_beam.end(), [](const GravityAssistNode& a, const GravityAssistNode& b) {
+                return a.lower_bound < b.lower_bound;
+            });
+            next_beam.resize(options->beam_width);
+        }
+        beam = std::move(next_beam);
+    }
+
+    if (isinf(incumbent)) {
+        return -1;
+    }
+    best->bodies.clear();
+    best->times.clear();
+    for (size_t i = 0; i < best_node.sequence.size(); i += 1) {
+        best->bodies.push_back(bodies[best_node.sequence[i]]);
+        best->times.push_back(options->departure_min + (double) best_node.times[i] * step);
+    }
+    best->cost = incumbent;
+    return 0;
+}
@@ -0,0 +1,42 @@
+#ifndef GRAVITY_ASSIST_HPP
+#define GRAVITY_ASSIST_HPP
+
+#include "body.hpp"
+
+#include <glm/glm.hpp>
+
+#include <vector>
+
+// largest deflection of the hyperbolic excess velocity for an unpowered
+// flyby whose periapsis is not lower than min_periapsis
+double flyby_maximum_turn_angle(CelestialBody* body, double v_infinity, double min_periapsis);
+// Δv of a powered flyby (single burn at periapsis) turning the relative
+// velocity v_in into v_out, with periapsis not lower than min_periapsis; when
+// the turn is too sharp, the excess is paid for by a plane change on escape
+double flyby_cost(CelestialBody* body, glm::dvec3 v_in, glm::dvec3 v_out, double min_periapsis);
+
+struct GravityAssistOptions {
+    double departure_min;
+    double departure_max;
+    double max_duration;  // from departure to arrival
+    double time_step;  // resolution of the departure time and of leg durations
+    size_t max_flybys;
+    size_t beam_width;  // number of partial sequences kept at each step
+    double min_flyby_altitude;
+    // same as in rendez_vous_cost()
+    double parking_radius;
+    double apsis1;
+    double apsis2;
+};
+
+struct GravityAssistSequence {
+    std::vector<CelestialBody*> bodies;  // from origin to target
+    std::vector<double> times;  // departure, then time at each encounter
+    double cost;
+};
+
+// search the cheapest sequence of flybys of the candidate bodies from origin
+// to target; all bodies must orbit the same primary; return -1 on failure
+int gravity_assist_search(GravityAssistSequence* best, CelestialBody* origin, CelestialBody* target, CelestialBody** candidates, size_t n_candidates, const GravityAssistOptions* options);
+
+#endif
@@ -5,6 +5,7 @@ extern "C" {
 }
 #include "load.hpp"
 #include "render.hpp"
+#include "job.hpp"
 #include "glm.hpp"
 
 #ifdef MSYS2
@@ -12,12 +13,19 @@ extern "C" {
 #endif
 #include <GL/glew.h>
 #include <GLFW/glfw3.h>
+#include <algorithm>
 #include <cstring>
 
 static const double SIMULATION_STEP = 1. / 128.;
 static const double TIMEWARP_FLOOR = 2.2250738585072014e-308;  // 0x1.0p-1022
 static const double TIMEWARP_CEILING = 8.98846567431158e+307;  // 0x1.0p980
 static const double THROTTLE_SPEED = .5;
+static const double ENCOUNTER_REVOLUTIONS = 10.;
+static const size_t ENCOUNTER_MAX_COUNT = 32;
+static const double ENCOUNTER_STATE_TOLERANCE = 1e-6;
+static const double MANEUVER_DELTA_V_SPEED = 10.;  // m/s per second
+static const double MANEUVER_TIME_SPEED = .05;  // revolutions per second
+static const double MANEUVER_FAST_FACTOR = 10.;  // with Shift
 
 // TODO
 static const time_t J2000 = 946728000UL;  // 2000-01-01T12:00:00Z
@@ -127,6 +135,13 @@ void key_callback(GLFWwindow* window, int key, int scancode, int action, int mod
             } else {
                 INFO("Wireframe mode disnabled");
             }
+        } else if (key == GLFW_KEY_B) {
+            state->body_impostors = !state->body_impostors;
+            if (state->body_impostors) {
+                INFO("Body impostors enabled");
+            } else {
+                INFO("Body impostors disabled");
+            }
         } else if (key == GLFW_KEY_COMMA) {
             if (state->target_timewarp / 2. >= TIMEWARP_FLOOR) {
                 state->target_timewarp /= 2.;
@@ -181,6 +196,35 @@ void key_callback(GLFWwindow* window, int key, int scancode, int action, int mod
                     INFO("Help disabled");
                 }
             }
+        } else if (key == GLFW_KEY_N) {
+            // after the last node, or a quarter of a revolution from now
+            double time = state->time;
+            if (!state->maneuver_nodes.empty()) {
+                time = state->maneuver_nodes.back().time;
+            }
+            Orbit* orbit = state->rocket.orbit;
+            time += orbit->eccentricity < 1. ? orbit->period / 4. : 600.;
+            state->maneuver_nodes.push_back({time, {0., 0., 0.}});
+            state->selected_node = state->maneuver_nodes.size() - 1;
+            INFO("Added maneuver node");
+        } else if (key == GLFW_KEY_BACKSPACE) {
+            if (!state->maneuver_nodes.empty()) {
+                state->maneuver_nodes.erase(state->maneuver_nodes.begin() + (long) state->selected_node);
+                if (state->selected_node > 0) {
+                    state->selected_node -= 1;
+                }
+                INFO("Removed maneuver node");
+            }
+        } else if (key == GLFW_KEY_ENTER) {
+            if (state->intercept_found) {
+                state->maneuver_nodes.push_back(state->intercept.node);
+                state->selected_node = state->maneuver_nodes.size() - 1;
+                INFO("Added maneuver node for the intercept");
+            }
+        } else if (key == GLFW_KEY_TAB) {
+            if (!state->maneuver_nodes.empty()) {
+                state->selected_node = (state->selected_node + 1) % state->maneuver_nodes.size();
+            }
         } else if (key == GLFW_KEY_EQUAL) {
             if (std::string(state->root->name) == "Sun") {
                 state->time = (double) (time(NULL) - J2000);
@@ -387,6 +431,272 @@ void update_rocket_soi(GlobalState* state) {
     orbit_from_state(rocket->orbit, primary, rocket->state.position, rocket->state.velocity, state->time);
 }
 
+struct EncounterSearch {
+    Job* job = NULL;
+    // snapshot of the parameters, since the job must not see further updates
+    Orbit orbit;
+    CelestialBody* target = NULL;
+    double time_min = INFINITY;
+    double time_max = -INFINITY;
+    std::vector<Encounter> results;
+};
+
+static bool rocket_deviates_from(GlobalState* state, Orbit* orbit) {
+    if (orbit->primary != state->rocket.orbit->primary) {
+        return true;
+    }
+
+    // the orbit is refitted every frame, so compare what it predicts instead
+    glm::dvec3 position, velocity;
+    orbit_state_at_time(orbit, state->time, &position, &velocity);
+    double position_error = glm::distance(position, state->rocket.state.position) / glm::length(position);
+    double velocity_error = glm::distance(velocity, state->rocket.state.velocity) / glm::length(velocity);
+    return position_error > ENCOUNTER_STATE_TOLERANCE || velocity_error > ENCOUNTER_STATE_TOLERANCE;
+}
+
+static bool encounter_search_outdated(GlobalState* state, EncounterSearch* search) {
+    if (search->target != state->target) {
+        return true;
+    }
+
+    // keep enough of the window ahead
+    if (state->time < search->time_min || state->time > (search->time_min + search->time_max) / 2.) {
+        return true;
+    }
+
+    return rocket_deviates_from(state, &search->orbit);
+}
+
+void update_encounters(GlobalState* state, EncounterSearch* search) {
+    // publish the results of the last search
+    if (search->job != NULL) {
+        if (!job_finished(search->job)) {
+            // do not show the encounters of the previous target meanwhile
+            if (search->target != state->target) {
+                state->encounters.clear();
+            }
+            return;
+        }
+        delete_job(search->job);
+        search->job = NULL;
+        if (search->target == state->target) {
+            state->encounters = search->results;
+        }
+    }
+
+    if (!encounter_search_outdated(state, search)) {
+        return;
+    }
+
+    if (search->target != state->target) {
+        state->encounters.clear();
+    }
+
+    Orbit* orbit = &search->orbit;
+    *orbit = *state->rocket.orbit;
+    search->target = state->target;
+    search->time_min = state->time;
+    search->time_max = INFINITY;
+
+    if (state->target == NULL || state->target->orbit == NULL || state->target->orbit->primary != orbit->primary) {
+        state->encounters.clear();
+        return;
+    }
+
+    // the next revolutions, or until the rocket leaves the sphere of influence
+    double time_max = state->time + ENCOUNTER_REVOLUTIONS * orbit->period;
+    double time_at_escape = orbit_time_at_escape(orbit);
+    if (!isnan(time_at_escape)) {
+        if (orbit->eccentricity < 1.) {
+            time_at_escape += ceil((state->time - time_at_escape) / orbit->period) * orbit->period;
+        }
+        if (!(time_max < time_at_escape)) {
+            time_max = time_at_escape;
+        }
+    }
+    search->time_max = time_max;
+
+    double time_min = search->time_min;
+    Orbit* target_orbit = state->target->orbit;
+    auto results = &search->results;
+    search->job = make_job([=](Job* job) {
+        (void) job;
+        results->resize(ENCOUNTER_MAX_COUNT);
+        int n = encounter_search(results->data(), results->size(), orbit, target_orbit, time_min, time_max);
+        results->resize(n < 0 ? 0 : (size_t) n);
+    });
+}
+
+struct FlightPlanner {
+    Job* job = NULL;
+    // only touched by the job while it runs
+    FlightPlan plan;
+    bool initialized = false;
+};
+
+static bool same_nodes(const std::vector<ManeuverNode>& a, const std::vector<ManeuverNode>& b) {
+    if (a.size() != b.size()) {
+        return false;
+    }
+    for (size_t i = 0; i < a.size(); i += 1) {
+        if (a[i].time != b[i].time || a[i].delta_v != b[i].delta_v) {
+            return false;
+        }
+    }
+    return true;
+}
+
+void edit_maneuver_node(GLFWwindow* window, GlobalState* state, double elapsed) {
+    if (state->maneuver_nodes.empty()) {
+        return;
+    }
+    ManeuverNode* node = &state->maneuver_nodes[state->selected_node];
+
+    double factor = glfwGetKey(window, GLFW_KEY_LEFT_SHIFT) == GLFW_PRESS ? MANEUVER_FAST_FACTOR : 1.;
+    double delta_v = MANEUVER_DELTA_V_SPEED * factor * elapsed;
+    Orbit* orbit = state->rocket.orbit;
+    double time_step = MANEUVER_TIME_SPEED * factor * elapsed * (orbit->eccentricity < 1. ? orbit->period : 3600.);
+
+    // prograde / retrograde
+    if (glfwGetKey(window, GLFW_KEY_UP) == GLFW_PRESS) {
+        node->delta_v[0] += delta_v;
+    }
+    if (glfwGetKey(window, GLFW_KEY_DOWN) == GLFW_PRESS) {
+        node->delta_v[0] -= delta_v;
+    }
+
+    // normal / anti-normal
+    if (glfwGetKey(window, GLFW_KEY_PAGE_UP) == GLFW_PRESS) {
+        node->delta_v[1] += delta_v;
+    }
+    if (glfwGetKey(window, GLFW_KEY_PAGE_DOWN) == GLFW_PRESS) {
+        node->delta_v[1] -= delta_v;
+    }
+
+    // radial out / in
+    if (glfwGetKey(window, GLFW_KEY_HOME) == GLFW_PRESS) {
+        node->delta_v[2] += delta_v;
+    }
+    if (glfwGetKey(window, GLFW_KEY_END) == GLFW_PRESS) {
+        node->delta_v[2] -= delta_v;
+    }
+
+    // later / earlier
+    if (glfwGetKey(window, GLFW_KEY_RIGHT) == GLFW_PRESS) {
+        node->time += time_step;
+    }
+    if (glfwGetKey(window, GLFW_KEY_LEFT) == GLFW_PRESS) {
+        node->time = std::max(node->time - time_step, state->time);
+    }
+}
+
+void update_flight_plan(GlobalState* state, FlightPlanner* planner) {
+    // publish the results of the last computation
+    if (planner->job != NULL) {
+        if (!job_finished(planner->job)) {
+            return;
+        }
+        delete_job(planner->job);
+        planner->job = NULL;
+        state->flight_plan = planner->plan;
+        state->flight_plan_revision += 1;
+    }
+
+    // forget the nodes that have been passed
+    auto& nodes = state->maneuver_nodes;
+    while (!nodes.empty() && nodes[0].time < state->time) {
+        nodes.erase(nodes.begin());
+        state->selected_node = state->selected_node > 0 ? state->selected_node - 1 : 0;
+    }
+
+    // keep them chronological, and the same one selected
+    if (!nodes.empty()) {
+        ManeuverNode selected = nodes[state->selected_node];
+        std::sort(nodes.begin(), nodes.end(), [](const ManeuverNode& a, const ManeuverNode& b) {
+            return a.time < b.time;
+        });
+        for (size_t i = 0; i < nodes.size(); i += 1) {
+            if (nodes[i].time == selected.time && nodes[i].delta_v == selected.delta_v) {
+                state->selected_node = i;
+            }
+        }
+    }
+
+    // restart from the current orbit when the rocket does not follow the plan
+    // anymore; otherwise, only the legs after the edited node are recomputed
+    FlightPlan* plan = &planner->plan;
+    if (!planner->initialized || rocket_deviates_from(state, &plan->initial_orbit)) {
+        flight_plan_init(plan, state->rocket.orbit, state->time);
+        planner->initialized = true;
+    } else if (same_nodes(plan->nodes, nodes) && plan->legs.size() == nodes.size() + 1) {
+        return;
+    }
+
+    std::vector<ManeuverNode> snapshot = nodes;
+    planner->job = make_job([=](Job* job) {
+        (void) job;
+        flight_plan_update(plan, snapshot);
+    });
+}
+
+struct InterceptPlanner {
+    Job* job = NULL;
+    // only touched by the job while it runs
+    InterceptSearch search;
+    bool initialized = false;
+    bool searching = false;  // some passes remain
+};
+
+static bool intercept_search_outdated(GlobalState* state, InterceptPlanner* planner) {
+    if (!planner->initialized || planner->search.target != state->target) {
+        return true;
+    }
+
+    // the suggested burn has been missed
+    if (state->intercept_found && state->intercept.node.time < state->time) {
+        return true;
+    }
+
+    return rocket_deviates_from(state, &planner->search.orbit);
+}
+
+void update_intercept(GlobalState* state, InterceptPlanner* planner) {
+    InterceptSearch* search = &planner->search;
+    bool outdated = intercept_search_outdated(state, planner);
+
+    // publish the results of the last pass, or drop them
+    if (planner->job != NULL) {
+        if (outdated) {
+            job_cancel(planner->job);
+        } else if (!job_finished(planner->job)) {
+            return;
+        }
+        bool cancelled = job_cancelled(planner->job);
+        delete_job(planner->job);
+        planner->job = NULL;
+        if (!cancelled && search->found) {
+            state->intercept = search->best;
+            state->intercept_found = true;
+        }
+    }
+
+    if (outdated) {
+        state->intercept_found = false;
+        planner->searching = intercept_search_init(search, state->rocket.orbit, state->target, state->time) == 0;
+        planner->initialized = true;
+    }
+    if (!planner->searching) {
+        return;
+    }
+
+    // one pass per job, so that intermediate results are shown early
+    planner->job = make_job([=](Job* job) {
+        if (intercept_search_pass(search, [=]() { return job_cancelled(job); }) < 0) {
+            planner->searching = false;
+        }
+    });
+}
+
 void usage(const char* name) {
     INFO("%s [--system (solar|kerbol)]", name);
 }
@@ -438,11 +748,10 @@ int main(int argc, char** argv) {
     state.render_state = make_render_state(state.bodies, config.system.textures_directory);
 
     state.star_temperature = config.system.star_temperature;
+    state.thumbnail_refresh_rate = config.thumbnail_refresh_rate;
     state.focus = state.bodies.at(config.system.default_focus);
     state.root = state.bodies.at(config.system.root);
 
-    reset_matrices(&state);
-
     state.time = 0;
     if (std::string(state.root->name) == "Sun") {
         state.time = (double) (time(NULL) - J2000);
@@ -473,9 +782,22 @@ int main(int argc, char** argv) {
 
     glfwSwapInterval(state.enable_vsync);
 
+    EncounterSearch encounters;
+    FlightPlanner flight_planner;
+    InterceptPlanner intercept_planner;
+
+    double last_frame = real_clock();
+
     // main loop
     while (!glfwWindowShouldClose(window)) {
+        double frame_time = real_clock() - last_frame;
+        last_frame += frame_time;
+        edit_maneuver_node(window, &state, frame_time);
+
         if (state.paused) {
+            update_encounters(&state, &encounters);
+            update_flight_plan(&state, &flight_planner);
+            update_intercept(&state, &intercept_planner);
             render(&state);
             glfwSwapBuffers(window);
             glfwPollEvents();
@@ -513,6 +835,9 @@ int main(int argc, char** argv) {
         state.rocket.orientation *= pow(state.rocket.angular_velocity_quat, k);
 
         update_rocket_soi(&state);
+        update_encounters(&state, &encounters);
+        update_flight_plan(&state, &flight_planner);
+        update_intercept(&state, &intercept_planner);
 
         if (unprocessed_time >= SIMULATION_STEP) {  // we had to interrupt the simulation
             // update time-warp measure every second
@@ -606,6 +931,9 @@ int main(int argc, char** argv) {
         state.n_frames_since_last += 1;
     }
 
+    delete_job(encounters.job);
+    delete_job(flight_planner.job);
+    delete_job(intercept_planner.job);
     glfwTerminate();
     return 0;
 }
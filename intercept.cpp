@@ -0,0 +1,207 @@
+#include "intercept.hpp"
+
+#include "recipes.hpp"
+#include "lambert.hpp"
+#include "transfer.hpp"
+#include "optimize.hpp"
+
+#include <cmath>
+
+// the grid of pass k has INTERCEPT_GRID << k departures and as many durations
+#define INTERCEPT_GRID 8
+#define INTERCEPT_PASSES 5
+// revolutions of the orbit over which departures are searched, at most
+#define INTERCEPT_MAX_REVOLUTIONS 10.
+#define INTERCEPT_REFINE_TOLERANCE 1e-9
+// altitude of the orbit assumed at arrival, when capturing at the target
+#define INTERCEPT_CAPTURE_ALTITUDE 100e3
+// samples of the parking orbit when placing an escape burn
+#define INTERCEPT_EJECTION_SAMPLES 64
+
+static double arrival_cost(CelestialBody* target, glm::dvec3 v_encounter) {
+    if (target->gravitational_parameter > 0. && target->sphere_of_influence > 0.) {
+        double apsis = target->radius + INTERCEPT_CAPTURE_ALTITUDE;
+        return insertion_cost(target, apsis, apsis, v_encounter);
+    }
+    return glm::length(v_encounter);
+}
+
+static double transfer(InterceptSearch* search, double time_at_departure, double transfer_duration, glm::dvec3* delta_v) {
+    /* Δv of the transfer, from the orbit itself or from its primary */
+    Orbit* orbit = &search->orbit;
+    CelestialBody* target = search->target;
+    if (!(transfer_duration > 0.)) {
+        return INFINITY;
+    }
+
+    // state at departure
+    glm::dvec3 position, velocity;
+    if (search->escape) {
+        orbit_state_at_time(orbit->primary->orbit, time_at_departure, &position, &velocity);
+    } else {
+        orbit_state_at_time(orbit, time_at_departure, &position, &velocity);
+    }
+
+    // state of target at arrival
+    glm::dvec3 target_position, target_velocity;
+    orbit_state_at_time(target->orbit, time_at_departure + transfer_duration, &target_position, &target_velocity);
+
+    glm::dvec3 v1, v2;
+    double mu = target->orbit->primary->gravitational_parameter;
+    lambert(v1, v2, mu, position, target_position, transfer_duration, 0, 0);
+    *delta_v = v1 - velocity;
+
+    double departure_cost;
+    if (search->escape) {
+        departure_cost = injection_cost(orbit->primary, orbit->semi_major_axis, *delta_v);
+    } else {
+        departure_cost = glm::length(*delta_v);
+    }
+    double cost = departure_cost + arrival_cost(target, v2 - target_velocity);
+    return std::isnan(cost) ? INFINITY : cost;
+}
+
+static double ejection_error(Orbit* orbit, double time, glm::dvec3 v_escape, double* delta_v) {
+    /* Angle between the escape velocity after a prograde burn and v_escape */
+    glm::dvec3 position, velocity;
+    orbit_state_at_time(orbit, time, &position, &velocity);
+    double mu = orbit->primary->gravitational_parameter;
+    double r_soi = orbit->primary->sphere_of_influence;
+    double v_soi = glm::length(v_escape);
+    double speed = sqrt(v_soi * v_soi + 2. * mu / glm::length(position) - 2. * mu / r_soi);
+    *delta_v = speed - glm::length(velocity);
+
+    Orbit injection;
+    if (orbit_from_state(&injection, orbit->primary, position, speed * glm::normalize(velocity), time) < 0) {
+        return INFINITY;
+    }
+    glm::dvec3 velocity_at_escape = orbit_velocity_at_escape(&injection);
+    double cosine = glm::dot(glm::normalize(velocity_at_escape), glm::normalize(v_escape));
+    double error = acos(fmax(-1., fmin(cosine, 1.)));
+    return std::isnan(error) ? INFINITY : error;
+}
+
+static ManeuverNode ejection_node(Orbit* orbit, double time_min, double time_at_departure, glm::dvec3 v_escape) {
+    /* Prograde burn on the parking orbit, within a revolution of the
+     * departure time but not before time_min, that best aligns the escape
+     * with v_escape */
+    double delta_v;
+    double best_time = time_at_departure;
+    double best_error = INFINITY;
+    double step = orbit->period / INTERCEPT_EJECTION_SAMPLES;
+    double start = fmax(time_at_departure - orbit->period / 2., time_min);
+    for (int i = 0; i < INTERCEPT_EJECTION_SAMPLES; i += 1) {
+        double time = start + (double) i * step;
+        double error = ejection_error(orbit, time, v_escape, &delta_v);
+        if (error < best_error) {
+            best_error = error;
+            best_time = time;
+        }
+    }
+    double time = minimize_brent([&](double t) {
+        return ejection_error(orbit, t, v_escape, &delta_v);
+    }, fmax(best_time - step, time_min), best_time + step, INTERCEPT_REFINE_TOLERANCE, NULL);
+    ejection_error(orbit, time, v_escape, &delta_v);
+    return {time, {delta_v, 0., 0.}};
+}
+
+int intercept_search_init(InterceptSearch* search, Orbit* orbit, CelestialBody* target, double time) {
+    search->orbit = *orbit;
+    search->target = target;
+    search->pass = 0;
+    search->found = false;
+    search->best = {0., 0., INFINITY, {0., glm::dvec3(0.)}};
+    if (target == NULL || target->orbit == NULL || !(orbit->eccentricity < 1.)) {
+        return -1;
+    }
+
+    // orbits between which to transfer
+    Orbit* origin;
+    CelestialBody* primary = orbit->primary;
+    if (target->orbit->primary == primary) {
+        search->escape = false;
+        origin = orbit;
+    } else if (primary->orbit != NULL && target->orbit->primary == primary->orbit->primary && target != primary) {
+        search->escape = true;
+        origin = primary->orbit;
+    } else {
+        return -1;
+    }
+    Orbit* destination = target->orbit;
+    if (!(destination->eccentricity < 1.)) {
+        return -1;
+    }
+
+    // the relative configuration repeats with the synodic period
+    double departure_range = fmax(synodic_period(origin, destination), origin->period);
+    departure_range = fmin(departure_range, INTERCEPT_MAX_REVOLUTIONS * fmax(origin->period, destination->period));
+    search->departure_min = time;
+    search->departure_max = time + departure_range;
+
+    double hohmann_time = maneuver_hohmann_time(destination->primary, origin->semi_major_axis, destination->semi_major_axis);
+    search->duration_min = .5 * hohmann_time;
+    search->duration_max = 1.5 * hohmann_time;
+    return 0;
+}
+
+int intercept_search_pass(InterceptSearch* search, const std::function<bool(void)>& cancelled) {
+    if (search->pass >= INTERCEPT_PASSES) {
+        return -1;
+    }
+    size_t n = (size_t) INTERCEPT_GRID << search->pass;
+    double departure_step = (search->departure_max - search->departure_min) / (double) n;
+    double duration_step = (search->duration_max - search->duration_min) / (double) n;
+    glm::dvec3 delta_v;
+
+    // grid, with the incumbent as the starting point
+    double best_cost = search->found ? search->best.cost : INFINITY;
+    glm::dvec2 best(search->best.time_at_departure, search->best.transfer_duration);
+    for (size_t i = 0; i <= n; i += 1) {
+        if (cancelled && cancelled()) {
+            return -1;
+        }
+        double time_at_departure = search->departure_min + (double) i * departure_step;
+        for (size_t j = 0; j <= n; j += 1) {
+            double transfer_duration = search->duration_min + (double) j * duration_step;
+            double cost = transfer(search, time_at_departure, transfer_duration, &delta_v);
+            if (cost < best_cost) {
+                best_cost = cost;
+                best = {time_at_departure, transfer_duration};
+            }
+        }
+    }
+    if (std::isinf(best_cost)) {
+        search->pass += 1;
+        return 0;
+    }
+
+    // refine the best point, within the search ranges
+    auto f = [&](glm::dvec2 x) -> double {
+        if (x.x < search->departure_min || x.x > search->departure_max) {
+            return INFINITY;
+        }
+        return transfer(search, x.x, x.y, &delta_v);
+    };
+    double cost;
+    glm::dvec2 step(departure_step, duration_step);
+    glm::dvec2 x = minimize_nelder_mead(f, best, step, INTERCEPT_REFINE_TOLERANCE, &cost);
+    if (cost < best_cost) {
+        best_cost = cost;
+        best = x;
+    }
+
+    if (!search->found || best_cost < search->best.cost) {
+        Intercept* intercept = &search->best;
+        intercept->time_at_departure = best.x;
+        intercept->transfer_duration = best.y;
+        intercept->cost = transfer(search, best.x, best.y, &delta_v);
+        if (search->escape) {
+            intercept->node = ejection_node(&search->orbit, search->departure_min, best.x, delta_v);
+        } else {
+            intercept->node = maneuver_node_from_delta_v(&search->orbit, best.x, delta_v);
+        }
+        search->found = true;
+    }
+    search->pass += 1;
+    return 0;
+}
@@ -0,0 +1,39 @@
+#ifndef INTERCEPT_HPP
+#define INTERCEPT_HPP
+
+#include "maneuver.hpp"
+
+#include <functional>
+
+struct Intercept {
+    double time_at_departure;
+    double transfer_duration;
+    double cost;  // departure burn, and matching the velocity of the target
+    ManeuverNode node;  // departure burn, on the orbit of the search
+};
+
+// progressive search of the cheapest transfer from an orbit to a target;
+// the target must orbit the same primary, or the primary of the primary (the
+// departure is then an escape from a parking orbit, as in
+// rendez_vous_cost())
+struct InterceptSearch {
+    Orbit orbit;
+    CelestialBody* target;
+    bool escape;
+    double departure_min;
+    double departure_max;
+    double duration_min;
+    double duration_max;
+    int pass;  // next one
+    bool found;
+    Intercept best;
+};
+
+// return -1 when the target is out of reach of the search
+int intercept_search_init(InterceptSearch* search, Orbit* orbit, CelestialBody* target, double time);
+// run the next pass, on a finer grid than the previous ones; the best
+// intercept found so far is kept in search->best; return -1 when the search
+// is complete, or when cancelled() returned true
+int intercept_search_pass(InterceptSearch* search, const std::function<bool(void)>& cancelled);
+
+#endif
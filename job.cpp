@@ -0,0 +1,54 @@
+#include "job.hpp"
+
+#include <atomic>
+
+// MinGW's win32 thread model does not provide std::thread
+#if defined(_GLIBCXX_HAS_GTHREADS) || !defined(__GLIBCXX__)
+#define HAVE_THREADS
+#include <thread>
+#endif
+
+struct Job {
+    std::atomic<bool> cancelled{false};
+    std::atomic<bool> finished{false};
+#ifdef HAVE_THREADS
+    std::thread thread;
+#endif
+};
+
+Job* make_job(const std::function<void(Job*)>& work) {
+    Job* job = new Job;
+#ifdef HAVE_THREADS
+    job->thread = std::thread([job, work]() {
+        work(job);
+        job->finished.store(true, std::memory_order_release);
+    });
+#else
+    work(job);
+    job->finished.store(true, std::memory_order_release);
+#endif
+    return job;
+}
+
+void delete_job(Job* job) {
+    if (job == NULL) {
+        return;
+    }
+    job_cancel(job);
+#ifdef HAVE_THREADS
+    job->thread.join();
+#endif
+    delete job;
+}
+
+void job_cancel(Job* job) {
+    job->cancelled.store(true, std::memory_order_relaxed);
+}
+
+bool job_cancelled(Job* job) {
+    return job->cancelled.load(std::memory_order_relaxed);
+}
+
+bool job_finished(Job* job) {
+    return job->finished.load(std::memory_order_acquire);
+}
@@ -0,0 +1,20 @@
+#ifndef JOB_HPP
+#define JOB_HPP
+
+#include <functional>
+
+struct Job;
+
+// run work(job) on a background thread; work should return early once
+// job_cancelled(job) is true; without thread support, work runs synchronously
+// inside make_job()
+Job* make_job(const std::function<void(Job*)>& work);
+// cancel the job and wait for it to return
+void delete_job(Job* job);
+
+void job_cancel   (Job* job);
+bool job_cancelled(Job* job);
+// once true, everything written by work is visible to the caller
+bool job_finished (Job* job);
+
+#endif
@@ -1,177 +1,910 @@
 #include "load.hpp"
 
+#include "arena.hpp"
 #include "body.hpp"
+#include "parallel.hpp"
 
+#include <clocale>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
 #include <cstring>
-
-#include <cjson/cJSON.h>
+#include <unordered_map>
+#include <vector>
 
 extern "C" {
 #include "util.h"
 #include "logging.h"
 }
 
-static double get_param_required(cJSON* json, const char* object_name, const char* param_name);
-static double get_param_optional(cJSON* json, const char* object_name, const char* param_name);
+// below this, the bodies are not worth spreading over threads
+#define LOAD_PARALLEL_MIN_BODIES 1024
+// longest number literal
+#define LOAD_MAX_NUMBER_LENGTH 64
+#define LOAD_COMPILED_MAGIC "KEPLSYS"  // with the terminating NUL
+#define LOAD_COMPILED_VERSION 1
+#define LOAD_COMPILED_ALIGNMENT 64
+
+// The system is read with a streaming parser that knows the schema: the
+// entries at the root are first delimited without being decoded, then each
+// one is read into a record (in parallel for large catalogs); the bodies,
+// orbits, poles and names are last laid out in arrays of the arena of the
+// system, primaries first.
+
+struct Reader {
+    const char* begin;  // of the document, for error messages
+    const char* cursor;
+    const char* end;
+};
+
+// orbit of an entry, until its primary is known
+struct OrbitRecord {
+    std::string primary;
+    double semi_major_axis;
+    double eccentricity;
+    double longitude_of_ascending_node;
+    double inclination;
+    double argument_of_periapsis;
+    double epoch;
+    double mean_anomaly_at_epoch;
+};
+
+struct Entry {
+    const char* begin;  // of the name
+    bool valid;  // false when it could not be read
+    std::string name;
+    double radius;
+    double gravitational_parameter;
+    double mass;
+    double rotational_period;
+    bool has_positive_pole;
+    CelestialCoordinates positive_pole;
+    bool has_orbit;
+    OrbitRecord orbit;
+};
 
-static CelestialBody* parse_body(Dict* bodies, cJSON* jbodies, const char* name);
-static CelestialCoordinates* parse_coordinates(cJSON* jcoordinates, const char* body_name);
-static Orbit* parse_orbit(Dict* bodies, cJSON* jbodies, cJSON* jorbit, const char* body_name);
+static int syntax_error(Reader* r) {
+    CRITICAL("Failed to parse JSON (unexpected %s at offset %zu)", r->cursor < r->end ? "character" : "end", (size_t) (r->cursor - r->begin));
+    return -1;
+}
 
-static double get_param_required(cJSON* json, const char* object_name, const char* param_name) {
-    cJSON* jparam = cJSON_GetObjectItemCaseSensitive(json, param_name);
-    if (jparam == NULL) {
-        CRITICAL("'%s' is missing required parameter '%s'", object_name, param_name);
-        exit(EXIT_FAILURE);
+static void skip_whitespace(Reader* r) {
+    while (r->cursor < r->end && (*r->cursor == ' ' || *r->cursor == '\t' || *r->cursor == '\n' || *r->cursor == '\r')) {
+        r->cursor += 1;
     }
-    if (!cJSON_IsNumber(jparam)) {
-        CRITICAL("The required parameter '%s' of '%s' is not a number", param_name, object_name);
-        exit(EXIT_FAILURE);
+}
+
+static int expect(Reader* r, char c) {
+    skip_whitespace(r);
+    if (r->cursor >= r->end || *r->cursor != c) {
+        return syntax_error(r);
+    }
+    r->cursor += 1;
+    return 0;
+}
+
+static bool peek(Reader* r, char c) {
+    skip_whitespace(r);
+    return r->cursor < r->end && *r->cursor == c;
+}
+
+static void append_utf8(std::string* out, unsigned long c) {
+    if (c < 0x80) {
+        out->push_back((char) c);
+    } else if (c < 0x800) {
+        out->push_back((char) (0xC0 | (c >> 6)));
+        out->push_back((char) (0x80 | (c & 0x3F)));
+    } else if (c < 0x10000) {
+        out->push_back((char) (0xE0 | (c >> 12)));
+        out->push_back((char) (0x80 | ((c >> 6) & 0x3F)));
+        out->push_back((char) (0x80 | (c & 0x3F)));
+    } else {
+        out->push_back((char) (0xF0 | (c >> 18)));
+        out->push_back((char) (0x80 | ((c >> 12) & 0x3F)));
+        out->push_back((char) (0x80 | ((c >> 6) & 0x3F)));
+        out->push_back((char) (0x80 | (c & 0x3F)));
+    }
+}
+
+static int read_hex4(Reader* r, unsigned long* c) {
+    if (r->end - r->cursor < 4) {
+        return syntax_error(r);
+    }
+    char digits[5] = {0};
+    memcpy(digits, r->cursor, 4);
+    char* end;
+    *c = strtoul(digits, &end, 16);
+    if (end != digits + 4) {
+        return syntax_error(r);
+    }
+    r->cursor += 4;
+    return 0;
+}
+
+static int read_string(Reader* r, std::string* out) {
+    if (expect(r, '"') < 0) {
+        return -1;
+    }
+    out->clear();
+    while (r->cursor < r->end && *r->cursor != '"') {
+        char c = *r->cursor;
+        r->cursor += 1;
+        if (c != '\\') {
+            out->push_back(c);
+            continue;
+        }
+        if (r->cursor >= r->end) {
+            return syntax_error(r);
+        }
+        c = *r->cursor;
+        r->cursor += 1;
+        switch (c) {
+            case 'b': out->push_back('\b'); break;
+            case 'f': out->push_back('\f'); break;
+            case 'n': out->push_back('\n'); break;
+            case 'r': out->push_back('\r'); break;
+            case 't': out->push_back('\t'); break;
+            case 'u': {
+                unsigned long code;
+                if (read_hex4(r, &code) < 0) {
+                    return -1;
+                }
+                // surrogate pair
+                if (code >= 0xD800 && code < 0xDC00 && r->end - r->cursor >= 6 && r->cursor[0] == '\\' && r->cursor[1] == 'u') {
+                    r->cursor += 2;
+                    unsigned long low;
+                    if (read_hex4(r, &low) < 0) {
+                        return -1;
+                    }
+                    code = 0x10000 + ((code - 0xD800) << 10) + (low - 0xDC00);
+                }
+                append_utf8(out, code);
+                break;
+            }
+            default: out->push_back(c); break;
+        }
+    }
+    return expect(r, '"');
+}
+
+static int skip_string(Reader* r) {
+    if (expect(r, '"') < 0) {
+        return -1;
+    }
+    while (r->cursor < r->end && *r->cursor != '"') {
+        r->cursor += *r->cursor == '\\' ? 2 : 1;
+    }
+    if (r->cursor >= r->end) {
+        return syntax_error(r);
+    }
+    r->cursor += 1;
+    return 0;
+}
+
+static int skip_value(Reader* r) {
+    /* Skip over a value without decoding it */
+    skip_whitespace(r);
+    if (r->cursor >= r->end) {
+        return syntax_error(r);
+    }
+    if (*r->cursor == '"') {
+        return skip_string(r);
+    }
+    if (*r->cursor != '{' && *r->cursor != '[') {
+        // literal or number
+        const char* start = r->cursor;
+        while (r->cursor < r->end && strchr(",:{}[]\" \t\n\r", *r->cursor) == NULL) {
+            r->cursor += 1;
+        }
+        return r->cursor > start ? 0 : syntax_error(r);
+    }
+
+    // nested objects and arrays, by tracking the depth
+    size_t depth = 0;
+    do {
+        char c = *r->cursor;
+        if (c == '"') {
+            if (skip_string(r) < 0) {
+                return -1;
+            }
+            continue;
+        }
+        if (c == '{' || c == '[') {
+            depth += 1;
+        } else if (c == '}' || c == ']') {
+            depth -= 1;
+        }
+        r->cursor += 1;
+    } while (depth > 0 && r->cursor < r->end);
+    return depth == 0 ? 0 : syntax_error(r);
+}
+
+static int read_number(Reader* r, double* value) {
+    /* Returns 1 when the value is not a number, without consuming it */
+    skip_whitespace(r);
+    char buffer[LOAD_MAX_NUMBER_LENGTH];
+    size_t n = 0;
+    while (r->cursor + n < r->end && strchr("+-.0123456789eE", r->cursor[n]) != NULL && r->cursor[n] != '\0') {
+        if (n + 1 >= sizeof(buffer)) {
+            return syntax_error(r);
+        }
+        // the decimal point of strtod() follows the locale
+        buffer[n] = r->cursor[n] == '.' ? localeconv()->decimal_point[0] : r->cursor[n];
+        n += 1;
+    }
+    if (n == 0) {
+        return 1;
+    }
+    buffer[n] = '\0';
+    char* end;
+    *value = strtod(buffer, &end);
+    if (end != buffer + n) {
+        return syntax_error(r);
+    }
+    r->cursor += n;
+    return 0;
+}
+
+template<typename F>
+static int read_object(Reader* r, F on_member) {
+    /* Call on_member(key) for each member, with the reader on the value, which
+     * on_member must consume */
+    if (expect(r, '{') < 0) {
+        return -1;
+    }
+    if (peek(r, '}')) {
+        r->cursor += 1;
+        return 0;
+    }
+    std::string key;
+    while (1) {
+        if (read_string(r, &key) < 0 || expect(r, ':') < 0) {
+            return -1;
+        }
+        if (on_member(key) < 0) {
+            return -1;
+        }
+        if (peek(r, ',')) {
+            r->cursor += 1;
+            continue;
+        }
+        return expect(r, '}');
     }
-    return jparam->valuedouble;
 }
 
-static double get_param_optional(cJSON* json, const char* object_name, const char* param_name) {
-    cJSON* jparam = cJSON_GetObjectItemCaseSensitive(json, param_name);
-    if (jparam == NULL) {
-        return 0.;
+static int read_param_required(Reader* r, const char* object_name, const char* param_name, double* value) {
+    int ret = read_number(r, value);
+    if (ret > 0) {
+        CRITICAL("The required parameter '%s' of '%s' is not a number", param_name, object_name);
+        return -1;
     }
-    if (!cJSON_IsNumber(jparam)) {
+    return ret;
+}
+
+static int read_param_optional(Reader* r, const char* object_name, const char* param_name, double* value) {
+    int ret = read_number(r, value);
+    if (ret > 0) {
         ERROR("The optional parameter '%s' of '%s' is not a number", param_name, object_name);
-        return 0.;
+        *value = 0.;
+        return skip_value(r);
     }
-    return jparam->valuedouble;
+    return ret;
 }
 
-static Orbit* parse_orbit(Dict* bodies, cJSON* jbodies, cJSON* jorbit, const char* body_name) {
-    if (jorbit == NULL) {
-        return NULL;
+static int read_orbit(Reader* r, OrbitRecord* orbit, const char* body_name) {
+    *orbit = {"", NAN, 0., 0., 0., 0., 0., 0.};
+    bool has_primary = false;
+    int ret = read_object(r, [&](const std::string& key) {
+        if (key == "primary") {
+            if (!peek(r, '"')) {
+                CRITICAL("The name of the primary of '%s' is not a string", body_name);
+                return -1;
+            }
+            has_primary = true;
+            return read_string(r, &orbit->primary);
+        }
+        if (key == "semi_major_axis") {
+            return read_param_required(r, body_name, "semi_major_axis", &orbit->semi_major_axis);
+        }
+        if (key == "eccentricity") {
+            return read_param_optional(r, body_name, "eccentricity", &orbit->eccentricity);
+        }
+        if (key == "longitude_of_ascending_node") {
+            return read_param_optional(r, body_name, "longitude_of_ascending_node", &orbit->longitude_of_ascending_node);
+        }
+        if (key == "inclination") {
+            return read_param_optional(r, body_name, "inclination", &orbit->inclination);
+        }
+        if (key == "argument_of_periapsis") {
+            return read_param_optional(r, body_name, "argument_of_periapsis", &orbit->argument_of_periapsis);
+        }
+        if (key == "epoch") {
+            return read_param_optional(r, body_name, "epoch", &orbit->epoch);
+        }
+        if (key == "mean_anomaly_at_epoch") {
+            return read_param_optional(r, body_name, "mean_anomaly_at_epoch", &orbit->mean_anomaly_at_epoch);
+        }
+        return skip_value(r);
+    });
+    if (ret < 0) {
+        return -1;
     }
 
-    // primary
-    cJSON* jprimary = cJSON_GetObjectItemCaseSensitive(jorbit, "primary");
-    if (jprimary == NULL) {
+    if (!has_primary) {
         CRITICAL("'%s' has an orbit but no primary", body_name);
-        exit(EXIT_FAILURE);
-    }
-    if (!cJSON_IsString(jprimary)) {
-        CRITICAL("The name of the primary of '%s' is not a string", body_name);
-        exit(EXIT_FAILURE);
-    }
-    CelestialBody* primary = parse_body(bodies, jbodies, jprimary->valuestring);
-
-    double semi_major_axis             = get_param_required(jorbit, body_name, "semi_major_axis");
-    double eccentricity                = get_param_optional(jorbit, body_name, "eccentricity");
-    double longitude_of_ascending_node = get_param_optional(jorbit, body_name, "longitude_of_ascending_node");
-    double inclination                 = get_param_optional(jorbit, body_name, "inclination");
-    double argument_of_periapsis       = get_param_optional(jorbit, body_name, "argument_of_periapsis");
-    double epoch                       = get_param_optional(jorbit, body_name, "epoch");
-    double mean_anomaly_at_epoch       = get_param_optional(jorbit, body_name, "mean_anomaly_at_epoch");
-
-    // create Orbit object
-    Orbit* ret = new Orbit;
-    orbit_from_semi_major(ret, primary, semi_major_axis, eccentricity);
-    orbit_orientate(ret, longitude_of_ascending_node, inclination, argument_of_periapsis, epoch, mean_anomaly_at_epoch);
-    return ret;
+        return -1;
+    }
+    if (std::isnan(orbit->semi_major_axis)) {
+        CRITICAL("'%s' is missing required parameter '%s'", body_name, "semi_major_axis");
+        return -1;
+    }
+    return 0;
 }
 
-static CelestialCoordinates* parse_coordinates(cJSON* jcoordinates, const char* body_name) {
-    if (jcoordinates == NULL) {
-        return NULL;
+static int read_coordinates(Reader* r, CelestialCoordinates* coordinates, const char* body_name) {
+    double right_ascension = NAN;
+    double declination = NAN;
+    double distance = 0.;
+    int ret = read_object(r, [&](const std::string& key) {
+        if (key == "right_ascension") {
+            return read_param_required(r, body_name, "right_ascension", &right_ascension);
+        }
+        if (key == "declination") {
+            return read_param_required(r, body_name, "declination", &declination);
+        }
+        if (key == "distance") {
+            return read_param_optional(r, body_name, "distance", &distance);
+        }
+        return skip_value(r);
+    });
+    if (ret < 0) {
+        return -1;
     }
 
-    double right_ascension = get_param_required(jcoordinates, body_name, "right_ascension");
-    double declination     = get_param_required(jcoordinates, body_name, "declination");
-    double distance        = get_param_optional(jcoordinates, body_name, "distance");
-    CelestialCoordinates* coordinates = new CelestialCoordinates;
+    if (std::isnan(right_ascension) || std::isnan(declination)) {
+        const char* missing = std::isnan(right_ascension) ? "right_ascension" : "declination";
+        CRITICAL("'%s' is missing required parameter '%s'", body_name, missing);
+        return -1;
+    }
     *coordinates = CelestialCoordinates::from_equatorial(right_ascension, declination, distance);
-    return coordinates;
+    return 0;
 }
 
-static CelestialBody* parse_body(Dict* bodies, cJSON* jbodies, const char* name) {
-    auto search = bodies->find(name);
-    if (search != bodies->end()) {
-        return search->second;
+static int read_body(Reader* r, Entry* entry) {
+    /* Everything but the orbit, which needs the primary */
+    if (read_string(r, &entry->name) < 0 || expect(r, ':') < 0) {
+        return -1;
     }
+    const char* body_name = entry->name.c_str();
 
-    cJSON* jbody = cJSON_GetObjectItemCaseSensitive(jbodies, name);
-    if (jbody == NULL) {
-        CRITICAL("Body '%s' not found", name);
-        exit(EXIT_FAILURE);
-    }
+    entry->radius = 0.;
+    entry->gravitational_parameter = 0.;
+    entry->mass = 0.;
+    entry->rotational_period = 0.;
+    entry->has_positive_pole = false;
+    entry->has_orbit = false;
+    return read_object(r, [&](const std::string& key) {
+        if (key == "radius") {
+            return read_param_optional(r, body_name, "radius", &entry->radius);
+        }
+        if (key == "gravitational_parameter") {
+            return read_param_optional(r, body_name, "gravitational_parameter", &entry->gravitational_parameter);
+        }
+        if (key == "mass") {
+            return read_param_optional(r, body_name, "mass", &entry->mass);
+        }
+        if (key == "rotational_period") {
+            return read_param_optional(r, body_name, "rotational_period", &entry->rotational_period);
+        }
+        if (key == "positive_pole") {
+            entry->has_positive_pole = true;
+            return read_coordinates(r, &entry->positive_pole, body_name);
+        }
+        if (key == "orbit") {
+            entry->has_orbit = true;
+            return read_orbit(r, &entry->orbit, body_name);
+        }
+        return skip_value(r);
+    });
+}
 
-    CelestialBody* ret = new CelestialBody;
-    (*bodies)[name] = ret;
-    body_init(ret);
-    body_set_name(ret, strdup(name));
+static void place_body(CelestialBody* body, Entry* entry, char* name, CelestialCoordinates* positive_pole) {
+    /* Set up the body from its record, except for the orbit */
+    body_init(body);
+    body_set_name(body, strcpy(name, entry->name.c_str()));
+    const char* body_name = body->name;
 
-    double radius = get_param_optional(jbody, name, "radius");
-    if (radius != 0.) {
-        body_set_radius(ret, radius);
+    if (entry->radius != 0.) {
+        body_set_radius(body, entry->radius);
     } else {
-        WARNING("'%s' has no radius!", name);
+        WARNING("'%s' has no radius!", body_name);
     }
 
-    double gravitational_parameter = get_param_optional(jbody, name, "gravitational_parameter");
-    double mass = get_param_optional(jbody, name, "mass");
-    if (gravitational_parameter != 0.) {
-        body_set_gravparam(ret, gravitational_parameter);
-    } else if (mass != 0.) {
-        body_set_mass(ret, mass);
+    if (entry->gravitational_parameter != 0.) {
+        body_set_gravparam(body, entry->gravitational_parameter);
+    } else if (entry->mass != 0.) {
+        body_set_mass(body, entry->mass);
     } else {
-        WARNING("'%s' has neither mass or gravitational_parameter", name);
+        WARNING("'%s' has neither mass or gravitational_parameter", body_name);
     }
 
-    double rotational_period = get_param_optional(jbody, name, "rotational_period");
-    if (rotational_period != 0.) {
-        body_set_rotation(ret, rotational_period);
+    if (entry->rotational_period != 0.) {
+        body_set_rotation(body, entry->rotational_period);
     }
 
-    cJSON* jpositive_pole = cJSON_GetObjectItemCaseSensitive(jbody, "positive_pole");
-    CelestialCoordinates* positive_pole = parse_coordinates(jpositive_pole, name);
     if (positive_pole != NULL) {
-        body_set_axis(ret, positive_pole);
+        *positive_pole = entry->positive_pole;
+        body_set_axis(body, positive_pole);
     }
+}
 
-    cJSON* jorbit = cJSON_GetObjectItemCaseSensitive(jbody, "orbit");
-    body_set_orbit(ret, parse_orbit(bodies, jbodies, jorbit, name));
+static int delimit_entries(Reader* r, std::vector<Entry>* entries) {
+    /* Find where each entry at the root starts, without decoding them */
+    if (expect(r, '{') < 0) {
+        return -1;
+    }
+    if (peek(r, '}')) {
+        r->cursor += 1;
+    } else {
+        while (1) {
+            skip_whitespace(r);
+            entries->push_back({r->cursor, false, {}, 0., 0., 0., 0., false, {}, false, {}});
+            if (skip_string(r) < 0 || expect(r, ':') < 0 || skip_value(r) < 0) {
+                return -1;
+            }
+            if (peek(r, ',')) {
+                r->cursor += 1;
+                continue;
+            }
+            if (expect(r, '}') < 0) {
+                return -1;
+            }
+            break;
+        }
+    }
+    skip_whitespace(r);
+    if (r->cursor != r->end) {
+        return syntax_error(r);
+    }
+    return 0;
+}
 
-    return ret;
+static int order_bodies(std::vector<size_t>* order, const std::vector<size_t>& primaries) {
+    /* Primaries before their satellites, otherwise in the order of the file */
+    size_t n = primaries.size();
+    std::vector<int> state(n, 0);  // 0: not seen, 1: in progress, 2: ordered
+    std::vector<size_t> chain;
+    order->reserve(n);
+    for (size_t i = 0; i < n; i += 1) {
+        // go up to the first ordered ancestor
+        size_t j = i;
+        while (j != SIZE_MAX && state[j] == 0) {
+            state[j] = 1;
+            chain.push_back(j);
+            j = primaries[j];
+        }
+        if (j != SIZE_MAX && state[j] == 1) {
+            return -1;
+        }
+
+        // then down
+        while (!chain.empty()) {
+            state[chain.back()] = 2;
+            order->push_back(chain.back());
+            chain.pop_back();
+        }
+    }
+    return 0;
 }
 
-int parse_bodies(Dict* bodies, const char* json) {
-    cJSON* jbodies = cJSON_Parse(json);
-    if (jbodies == NULL) {
-        CRITICAL("Failed to parse JSON (%s)", cJSON_GetErrorPtr());
+static int parse_range(Dict* bodies, const char* begin, const char* end, std::vector<CelestialBody*>* loaded) {
+    Reader root = {begin, begin, end};
+    std::vector<Entry> entries;
+    if (delimit_entries(&root, &entries) < 0) {
+        return -1;
+    }
+    size_t n = entries.size();
+
+    // read the entries, independently
+    auto read_entries = [&](size_t first, size_t last) {
+        for (size_t i = first; i < last; i += 1) {
+            Reader r = {begin, entries[i].begin, end};
+            entries[i].valid = read_body(&r, &entries[i]) == 0;
+        }
+    };
+    if (n < LOAD_PARALLEL_MIN_BODIES) {
+        read_entries(0, n);
+    } else {
+        parallel_for(n, read_entries);
+    }
+    for (auto& entry : entries) {
+        if (!entry.valid) {
+            return -1;
+        }
+    }
+
+    // index the bodies by name, keeping the first of duplicates
+    std::unordered_map<std::string, size_t> index;
+    index.reserve(n);
+    std::vector<bool> duplicate(n, false);
+    for (size_t i = 0; i < n; i += 1) {
+        duplicate[i] = !index.emplace(entries[i].name, i).second;
+    }
+
+    // resolve primaries
+    std::vector<size_t> primaries(n, SIZE_MAX);
+    for (size_t i = 0; i < n; i += 1) {
+        if (!entries[i].has_orbit) {
+            continue;
+        }
+        auto search = index.find(entries[i].orbit.primary);
+        if (search == index.end()) {
+            CRITICAL("Body '%s' not found", entries[i].orbit.primary.c_str());
+            return -1;
+        }
+        primaries[i] = search->second;
+    }
+    std::vector<size_t> order;
+    if (order_bodies(&order, primaries) < 0) {
+        CRITICAL("The primaries of some bodies orbit them in turn");
+        return -1;
+    }
+
+    // one array per type, in load order
+    size_t n_bodies = 0;
+    size_t n_orbits = 0;
+    size_t n_poles = 0;
+    size_t names_size = 0;
+    for (size_t i = 0; i < n; i += 1) {
+        if (!duplicate[i]) {
+            n_bodies += 1;
+            n_orbits += entries[i].has_orbit ? 1 : 0;
+            n_poles += entries[i].has_positive_pole ? 1 : 0;
+            names_size += entries[i].name.size() + 1;
+        }
+    }
+    Arena* arena = &bodies->arena;
+    CelestialBody* placed = arena_new<CelestialBody>(arena, n_bodies);
+    Orbit* orbits = arena_new<Orbit>(arena, n_orbits);
+    CelestialCoordinates* poles = arena_new<CelestialCoordinates>(arena, n_poles);
+    CelestialBody** satellites = arena_new<CelestialBody*>(arena, n_orbits);
+    char* names = arena_new<char>(arena, names_size);
+
+    // set the orbits, primaries first
+    std::vector<CelestialBody*> entry_bodies(n, NULL);
+    bodies->reserve(bodies->size() + n_bodies);
+    loaded->reserve(n_bodies);
+    for (size_t i : order) {
+        Entry* entry = &entries[i];
+        if (duplicate[i]) {
+            continue;
+        }
+        CelestialBody* body = placed;
+        placed += 1;
+        place_body(body, entry, names, entry->has_positive_pole ? poles : NULL);
+        names += entry->name.size() + 1;
+        poles += entry->has_positive_pole ? 1 : 0;
+        if (entry->has_orbit) {
+            OrbitRecord* record = &entry->orbit;
+            Orbit* orbit = orbits;
+            orbits += 1;
+            orbit_from_semi_major(orbit, entry_bodies[primaries[i]], record->semi_major_axis, record->eccentricity);
+            orbit_orientate(orbit, record->longitude_of_ascending_node, record->inclination, record->argument_of_periapsis, record->epoch, record->mean_anomaly_at_epoch);
+            body_set_orbit(body, orbit);
+        }
+        entry_bodies[i] = body;
+        (*bodies)[body->name] = body;
+        loaded->push_back(body);
+    }
+
+    // the lists of satellites move to the arena once complete
+    for (auto body : *loaded) {
+        if (body->satellites_capacity > 0) {
+            memcpy(satellites, body->satellites, sizeof(CelestialBody*) * body->n_satellites);
+            free(body->satellites);
+            body->satellites = satellites;
+            body->satellites_capacity = 0;
+            satellites += body->n_satellites;
+        }
+    }
+    return 0;
+}
+
+// Compiled systems are the bodies, orbits and poles as laid out in memory,
+// each in an aligned array, followed by the satellite lists and the names;
+// pointers are stored as indices or offsets, and fixed in place once the file
+// is mapped. The layout of the structures is part of the header, so that a
+// file compiled elsewhere is simply ignored.
+
+struct CompiledHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t pointer_size;
+    uint32_t body_size;
+    uint32_t orbit_size;
+    uint32_t coordinates_size;
+    uint32_t reserved;
+    uint64_t content_hash;  // of the source
+    uint64_t file_size;
+    uint64_t n_bodies;
+    uint64_t bodies_offset;
+    uint64_t n_orbits;
+    uint64_t orbits_offset;
+    uint64_t n_poles;
+    uint64_t poles_offset;
+    uint64_t n_satellites;
+    uint64_t satellites_offset;
+    uint64_t strings_size;
+    uint64_t strings_offset;
+};
+
+struct CompiledSystem {
+    char* data;
+    size_t length;
+};
+
+static uint64_t content_hash(const char* data, size_t length) {
+    /* FNV-1a */
+    uint64_t hash = 0xcbf29ce484222325ULL;
+    for (size_t i = 0; i < length; i += 1) {
+        hash ^= (unsigned char) data[i];
+        hash *= 0x100000001b3ULL;
+    }
+    return hash;
+}
+
+static uint64_t align(uint64_t offset) {
+    return (offset + LOAD_COMPILED_ALIGNMENT - 1) / LOAD_COMPILED_ALIGNMENT * LOAD_COMPILED_ALIGNMENT;
+}
+
+static CompiledHeader compiled_header(uint64_t hash) {
+    CompiledHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, LOAD_COMPILED_MAGIC, sizeof(header.magic));
+    header.version = LOAD_COMPILED_VERSION;
+    header.pointer_size = (uint32_t) sizeof(void*);
+    header.body_size = (uint32_t) sizeof(CelestialBody);
+    header.orbit_size = (uint32_t) sizeof(Orbit);
+    header.coordinates_size = (uint32_t) sizeof(CelestialCoordinates);
+    header.content_hash = hash;
+    return header;
+}
+
+template<typename T>
+static T* encode(uint64_t value) {
+    return reinterpret_cast<T*>((uintptr_t) value);
+}
+
+template<typename T>
+static uint64_t decode(T* pointer) {
+    return (uint64_t) reinterpret_cast<uintptr_t>(pointer);
+}
+
+static int write_padding(FILE* f, uint64_t offset) {
+    static const char zeros[LOAD_COMPILED_ALIGNMENT] = {0};
+    size_t n = (size_t) (align(offset) - offset);
+    return fwrite(zeros, 1, n, f) == n ? 0 : -1;
+}
+
+static int compile_bodies(const char* filename, const std::vector<CelestialBody*>& bodies, uint64_t hash) {
+    /* Bodies are in load order, primaries first */
+    std::unordered_map<CelestialBody*, uint64_t> index;
+    index.reserve(bodies.size());
+    for (size_t i = 0; i < bodies.size(); i += 1) {
+        index[bodies[i]] = i;
+    }
+
+    // everything but the header, already encoded
+    std::vector<CelestialBody> compiled_bodies(bodies.size());
+    std::vector<Orbit> orbits;
+    std::vector<CelestialCoordinates> poles;
+    std::vector<uint64_t> satellites;
+    std::string strings;
+    for (size_t i = 0; i < bodies.size(); i += 1) {
+        CelestialBody* body = &compiled_bodies[i];
+        *body = *bodies[i];
+        body->name = encode<const char>(strings.size());
+        strings.append(bodies[i]->name, strlen(bodies[i]->name) + 1);
+
+        body->satellites = encode<CelestialBody*>(satellites.size());
+        body->satellites_capacity = 0;
+        body->n_satellites = 0;
+        for (size_t j = 0; j < bodies[i]->n_satellites; j += 1) {
+            auto search = index.find(bodies[i]->satellites[j]);
+            if (search != index.end()) {
+                satellites.push_back(search->second);
+                body->n_satellites += 1;
+            }
+        }
+
+        // 0 for none
+        if (bodies[i]->orbit != NULL) {
+            orbits.push_back(*bodies[i]->orbit);
+            orbits.back().primary = encode<CelestialBody>(index.at(bodies[i]->orbit->primary));
+            body->orbit = encode<Orbit>(orbits.size());
+        }
+        if (bodies[i]->positive_pole != NULL) {
+            poles.push_back(*bodies[i]->positive_pole);
+            body->positive_pole = encode<CelestialCoordinates>(poles.size());
+        }
+    }
+
+    CompiledHeader header = compiled_header(hash);
+    header.n_bodies = compiled_bodies.size();
+    header.bodies_offset = align(sizeof(header));
+    header.n_orbits = orbits.size();
+    header.orbits_offset = align(header.bodies_offset + header.n_bodies * sizeof(CelestialBody));
+    header.n_poles = poles.size();
+    header.poles_offset = align(header.orbits_offset + header.n_orbits * sizeof(Orbit));
+    header.n_satellites = satellites.size();
+    header.satellites_offset = align(header.poles_offset + header.n_poles * sizeof(CelestialCoordinates));
+    header.strings_size = strings.size();
+    header.strings_offset = align(header.satellites_offset + header.n_satellites * sizeof(CelestialBody*));
+    header.file_size = header.strings_offset + header.strings_size;
+
+    // write it aside, so that readers never see a partial file
+    std::string tmp_filename = std::string(filename) + ".tmp";
+    FILE* f = fopen(tmp_filename.c_str(), "wb");
+    if (f == NULL) {
+        return -1;
+    }
+    std::vector<CelestialBody*> satellite_slots(satellites.size());
+    for (size_t i = 0; i < satellites.size(); i += 1) {
+        satellite_slots[i] = encode<CelestialBody>(satellites[i]);
+    }
+    bool ok =
+        fwrite(&header, sizeof(header), 1, f) == 1 &&
+        write_padding(f, sizeof(header)) == 0 &&
+        fwrite(compiled_bodies.data(), sizeof(CelestialBody), compiled_bodies.size(), f) == compiled_bodies.size() &&
+        write_padding(f, header.bodies_offset + header.n_bodies * sizeof(CelestialBody)) == 0 &&
+        fwrite(orbits.data(), sizeof(Orbit), orbits.size(), f) == orbits.size() &&
+        write_padding(f, header.orbits_offset + header.n_orbits * sizeof(Orbit)) == 0 &&
+        fwrite(poles.data(), sizeof(CelestialCoordinates), poles.size(), f) == poles.size() &&
+        write_padding(f, header.poles_offset + header.n_poles * sizeof(CelestialCoordinates)) == 0 &&
+        fwrite(satellite_slots.data(), sizeof(CelestialBody*), satellite_slots.size(), f) == satellite_slots.size() &&
+        write_padding(f, header.satellites_offset + header.n_satellites * sizeof(CelestialBody*)) == 0 &&
+        fwrite(strings.data(), 1, strings.size(), f) == strings.size();
+    if (fclose(f) != 0 || !ok) {
+        remove(tmp_filename.c_str());
         return -1;
     }
+    if (rename(tmp_filename.c_str(), filename) != 0) {
+        // Windows does not replace existing files
+        remove(filename);
+        if (rename(tmp_filename.c_str(), filename) != 0) {
+            remove(tmp_filename.c_str());
+            return -1;
+        }
+    }
+    return 0;
+}
+
+static bool section_fits(uint64_t offset, uint64_t count, uint64_t size, uint64_t file_size) {
+    return offset % LOAD_COMPILED_ALIGNMENT == 0 && offset <= file_size && count <= (file_size - offset) / size;
+}
 
-    if (!cJSON_IsObject(jbodies)) {
-        CRITICAL("Expected JSON object at root");
+static int fix_compiled(char* data, size_t length, uint64_t hash) {
+    /* Check the file, and turn indices and offsets back into pointers */
+    if (length < sizeof(CompiledHeader)) {
+        return -1;
+    }
+    CompiledHeader* header = (CompiledHeader*) data;
+    CompiledHeader expected = compiled_header(hash);
+    if (memcmp(header, &expected, offsetof(CompiledHeader, file_size)) != 0 || header->file_size != length) {
+        return -1;
+    }
+    if (!section_fits(header->bodies_offset, header->n_bodies, sizeof(CelestialBody), length) ||
+        !section_fits(header->orbits_offset, header->n_orbits, sizeof(Orbit), length) ||
+        !section_fits(header->poles_offset, header->n_poles, sizeof(CelestialCoordinates), length) ||
+        !section_fits(header->satellites_offset, header->n_satellites, sizeof(CelestialBody*), length) ||
+        !section_fits(header->strings_offset, header->strings_size, 1, length)) {
         return -1;
     }
+    CelestialBody* bodies = (CelestialBody*) (data + header->bodies_offset);
+    Orbit* orbits = (Orbit*) (data + header->orbits_offset);
+    CelestialCoordinates* poles = (CelestialCoordinates*) (data + header->poles_offset);
+    CelestialBody** satellites = (CelestialBody**) (data + header->satellites_offset);
+    const char* strings = data + header->strings_offset;
+    if (header->strings_size == 0 || strings[header->strings_size - 1] != '\0') {
+        return -1;
+    }
+
+    for (uint64_t i = 0; i < header->n_satellites; i += 1) {
+        uint64_t k = decode(satellites[i]);
+        if (k >= header->n_bodies) {
+            return -1;
+        }
+        satellites[i] = &bodies[k];
+    }
+    for (uint64_t i = 0; i < header->n_orbits; i += 1) {
+        uint64_t k = decode(orbits[i].primary);
+        if (k >= header->n_bodies) {
+            return -1;
+        }
+        orbits[i].primary = &bodies[k];
+    }
+    for (uint64_t i = 0; i < header->n_bodies; i += 1) {
+        CelestialBody* body = &bodies[i];
+        uint64_t name = decode(body->name);
+        uint64_t first_satellite = decode(body->satellites);
+        uint64_t orbit = decode(body->orbit);
+        uint64_t pole = decode(body->positive_pole);
+        if (name >= header->strings_size || first_satellite > header->n_satellites || body->n_satellites > header->n_satellites - first_satellite || orbit > header->n_orbits || pole > header->n_poles) {
+            return -1;
+        }
+        body->name = strings + name;
+        body->satellites = body->n_satellites == 0 ? NULL : &satellites[first_satellite];
+        body->satellites_capacity = 0;
+        body->orbit = orbit == 0 ? NULL : &orbits[orbit - 1];
+        body->positive_pole = pole == 0 ? NULL : &poles[pole - 1];
+    }
+    return 0;
+}
 
-    for (cJSON* body = jbodies->child; body != NULL; body = body->next) {
-        parse_body(bodies, jbodies, body->string);
+static int map_compiled(Dict* bodies, const char* filename, uint64_t hash) {
+    size_t length;
+    char* data = map_file(filename, &length);
+    if (data == NULL) {
+        return -1;
+    }
+    if (fix_compiled(data, length, hash) < 0) {
+        unmap_file(data, length);
+        return -1;
     }
 
-    cJSON_Delete(jbodies);
+    CompiledHeader* header = (CompiledHeader*) data;
+    CelestialBody* compiled_bodies = (CelestialBody*) (data + header->bodies_offset);
+    bodies->reserve(bodies->size() + header->n_bodies);
+    for (uint64_t i = 0; i < header->n_bodies; i += 1) {
+        bodies->emplace(compiled_bodies[i].name, &compiled_bodies[i]);
+    }
+    bodies->compiled = new CompiledSystem{data, length};
     return 0;
 }
 
+int parse_bodies(Dict* bodies, const char* json) {
+    std::vector<CelestialBody*> loaded;
+    return parse_range(bodies, json, json + strlen(json), &loaded);
+}
+
 int load_bodies(Dict* bodies, const char* filename) {
-    char* json = load_file(filename);
+    size_t length;
+    char* json = map_file(filename, &length);
     if (json == NULL) {
         CRITICAL("Failed to open '%s'", filename);
         return -1;
     }
-    int ret = parse_bodies(bodies, json);
-    free(json);
+
+    // a Dict only holds one compiled system
+    uint64_t hash = content_hash(json, length);
+    std::string compiled_filename = std::string(filename) + ".bin";
+    if (bodies->compiled == NULL && map_compiled(bodies, compiled_filename.c_str(), hash) == 0) {
+        INFO("Using compiled system from '%s'", compiled_filename.c_str());
+        unmap_file(json, length);
+        return 0;
+    }
+
+    std::vector<CelestialBody*> loaded;
+    int ret = parse_range(bodies, json, json + length, &loaded);
+    unmap_file(json, length);
+    if (ret == 0 && compile_bodies(compiled_filename.c_str(), loaded, hash) < 0) {
+        WARNING("Failed to write compiled system to '%s'", compiled_filename.c_str());
+    }
     return ret;
 }
 
 void unload_bodies(Dict* bodies) {
+    // only the lists of satellites that grew since loading are owned by the
+    // bodies themselves
     for (auto i : *bodies) {
         body_clear(i.second);
     }
+    if (bodies->compiled != NULL) {
+        unmap_file(bodies->compiled->data, bodies->compiled->length);
+        delete bodies->compiled;
+        bodies->compiled = NULL;
+    }
+    arena_clear(&bodies->arena);
+    bodies->clear();
 }
@@ -1,15 +1,26 @@
 #ifndef LOAD_HPP
 #define LOAD_HPP
 
+#include "arena.hpp"
 #include "body.hpp"
 
-#include <map>
 #include <string>
+#include <unordered_map>
 
-using Dict = std::map<std::string, CelestialBody*>;
+struct CompiledSystem;
+
+// bodies by name; they live in the mapping of the compiled file when the
+// system was loaded from its compiled form, and in the arena otherwise, so
+// that unloading releases them all at once
+struct Dict : std::unordered_map<std::string, CelestialBody*> {
+    CompiledSystem* compiled = NULL;
+    Arena arena = {NULL, NULL, NULL};
+};
 
 int parse_bodies(Dict* bodies, const char* json);
 
+// the compiled form of the system is cached next to the file, and used while
+// it matches the content of the file
 int load_bodies(Dict* bodies, const char* filename);
 
 void unload_bodies(Dict* bodies);
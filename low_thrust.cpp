@@ -0,0 +1,79 @@
+#include "load.hpp"
+#include "orbit.hpp"
+#include "sims_flanagan.hpp"
+
+extern "C" {
+#include "util.h"
+#include "logging.h"
+}
+
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+
+// rendez-vous between two bodies orbiting the same primary with a low-thrust
+// spacecraft, departing and arriving with their velocities
+
+#define DEFAULT_SEGMENTS 40
+#define DEFAULT_MASS 1000.
+#define DEFAULT_THRUST 1.
+#define DEFAULT_SPECIFIC_IMPULSE 3000.
+
+int main(int argc, char** argv) {
+    // the spacecraft is given in full, or not at all
+    if (argc < 6 || argc == 8 || argc == 9 || argc > 10) {
+        fprintf(stderr, "Usage: %s SYSTEM_FILE ORIGIN TARGET DEPARTURE DURATION [N_SEGMENTS [MASS THRUST SPECIFIC_IMPULSE]]\n", argv[0]);
+        exit(EXIT_FAILURE);
+    }
+
+    Dict bodies;
+    if (load_bodies(&bodies, argv[1]) < 0) {
+        exit(EXIT_FAILURE);
+    }
+    auto origin_search = bodies.find(argv[2]);
+    auto target_search = bodies.find(argv[3]);
+    if (origin_search == bodies.end() || target_search == bodies.end()) {
+        CRITICAL("Unknown body");
+        exit(EXIT_FAILURE);
+    }
+    CelestialBody* origin = origin_search->second;
+    CelestialBody* target = target_search->second;
+    if (origin->orbit == NULL || target->orbit == NULL || origin->orbit->primary != target->orbit->primary) {
+        CRITICAL("'%s' and '%s' do not orbit the same primary", origin->name, target->name);
+        exit(EXIT_FAILURE);
+    }
+
+    double departure_time = strtod(argv[4], NULL);
+    double duration = strtod(argv[5], NULL);
+    size_t n_segments = argc > 6 ? (size_t) strtoul(argv[6], NULL, 10) : DEFAULT_SEGMENTS;
+
+    glm::dvec3 departure_position, departure_velocity;
+    orbit_state_at_time(origin->orbit, departure_time, &departure_position, &departure_velocity);
+    glm::dvec3 arrival_position, arrival_velocity;
+    orbit_state_at_time(target->orbit, departure_time + duration, &arrival_position, &arrival_velocity);
+
+    SimsFlanaganLeg leg;
+    sims_flanagan_init(&leg, origin->orbit->primary, departure_time, departure_position, departure_velocity, departure_time + duration, arrival_position, arrival_velocity, n_segments);
+    leg.mass = argc > 9 ? strtod(argv[7], NULL) : DEFAULT_MASS;
+    leg.max_thrust = argc > 9 ? strtod(argv[8], NULL) : DEFAULT_THRUST;
+    leg.specific_impulse = argc > 9 ? strtod(argv[9], NULL) : DEFAULT_SPECIFIC_IMPULSE;
+
+    int ret = sims_flanagan_optimize(&leg, 1e-9, 100);
+
+    glm::dvec3 position_mismatch, velocity_mismatch;
+    sims_flanagan_mismatch(&leg, &position_mismatch, &velocity_mismatch);
+    std::vector<double> max_dv;
+    sims_flanagan_max_impulses(&leg, &max_dv);
+    double dt = duration / (double) n_segments;
+    printf("segment\ttime\tdv_x\tdv_y\tdv_z\tthrottle\n");
+    for (size_t i = 0; i < n_segments; i += 1) {
+        glm::dvec3 dv{leg.dv_x[i], leg.dv_y[i], leg.dv_z[i]};
+        double time = departure_time + ((double) i + .5) * dt;
+        printf("%zu\t%.0f\t%.3f\t%.3f\t%.3f\t%.3f\n", i, time, dv.x, dv.y, dv.z, glm::length(dv) / max_dv[i]);
+    }
+    printf("%s\n", ret < 0 ? "infeasible" : "feasible");
+    printf("total Δv: %.1f m/s\n", sims_flanagan_total_dv(&leg));
+    printf("final mass: %.1f kg\n", sims_flanagan_final_mass(&leg));
+    printf("mismatch: %.3g m, %.3g m/s\n", glm::length(position_mismatch), glm::length(velocity_mismatch));
+    return ret < 0 ? EXIT_FAILURE : EXIT_SUCCESS;
+}
@@ -0,0 +1,221 @@
+#include "maneuver.hpp"
+
+#include "encounter.hpp"
+
+#include <algorithm>
+#include <cmath>
+
+// sphere of influence changes followed by a leg
+#define MANEUVER_MAX_TRANSITIONS 8
+#define MANEUVER_MAX_ENCOUNTERS 64
+#define MANEUVER_MAX_ITERATIONS 100
+#define MANEUVER_TIME_TOLERANCE 1e-3
+// an open orbit that does not escape is followed for as long as it would take
+// to go this many times further than its distance to the primary, at the
+// starting speed
+#define MANEUVER_OPEN_DISTANCE_FACTOR 10.
+
+static glm::dmat3 maneuver_frame(Orbit* o, double time) {
+    /* Columns are the prograde, normal and radial-out directions */
+    glm::dvec3 position, velocity;
+    orbit_state_at_time(o, time, &position, &velocity);
+    glm::dvec3 prograde = glm::normalize(velocity);
+    glm::dvec3 normal = glm::normalize(glm::cross(position, velocity));
+    glm::dvec3 radial = glm::cross(prograde, normal);
+    return glm::dmat3(prograde, normal, radial);
+}
+
+glm::dvec3 maneuver_node_delta_v(ManeuverNode* node, Orbit* o) {
+    return maneuver_frame(o, node->time) * node->delta_v;
+}
+
+ManeuverNode maneuver_node_from_delta_v(Orbit* o, double time, glm::dvec3 delta_v) {
+    // the frame is orthonormal
+    return {time, glm::transpose(maneuver_frame(o, time)) * delta_v};
+}
+
+static double next_escape(Orbit* o, double time) {
+    if (o->primary->orbit == NULL || !std::isfinite(o->primary->sphere_of_influence)) {
+        return INFINITY;
+    }
+    double time_at_escape = orbit_time_at_escape(o);
+    if (std::isnan(time_at_escape)) {
+        return INFINITY;
+    }
+    if (o->eccentricity < 1.) {
+        time_at_escape += ceil((time - time_at_escape) / o->period) * o->period;
+    }
+    return time_at_escape > time ? time_at_escape : INFINITY;
+}
+
+static double satellite_distance_margin(Orbit* o, CelestialBody* satellite, double time) {
+    glm::dvec3 position = orbit_position_at_time(o, time);
+    glm::dvec3 satellite_position = orbit_position_at_time(satellite->orbit, time);
+    return glm::distance(position, satellite_position) - satellite->sphere_of_influence;
+}
+
+static double entry_time(Orbit* o, CelestialBody* satellite, double low, double high) {
+    /* Bisect between outside (low) and inside (high) of the sphere of influence */
+    for (int i = 0; i < MANEUVER_MAX_ITERATIONS && high - low > MANEUVER_TIME_TOLERANCE; i += 1) {
+        double middle = (low + high) / 2.;
+        if (satellite_distance_margin(o, satellite, middle) < 0.) {
+            high = middle;
+        } else {
+            low = middle;
+        }
+    }
+    // inside, so that the new frame is consistent
+    return high;
+}
+
+static double next_entry(Orbit* o, double time_min, double time_max, CelestialBody** entered) {
+    double best = time_max;
+    *entered = NULL;
+
+    double apoapsis = o->eccentricity < 1. ? o->apoapsis : INFINITY;
+    CelestialBody* primary = o->primary;
+    Encounter encounters[MANEUVER_MAX_ENCOUNTERS];
+    for (size_t i = 0; i < primary->n_satellites; i += 1) {
+        CelestialBody* satellite = primary->satellites[i];
+        Orbit* satellite_orbit = satellite->orbit;
+        double radius = satellite->sphere_of_influence;
+        if (satellite_orbit == NULL || !(radius > 0.)) {
+            continue;
+        }
+
+        // the distances to the primary never get close enough
+        if (o->periapsis > satellite_orbit->apoapsis + radius || apoapsis < satellite_orbit->periapsis - radius) {
+            continue;
+        }
+
+        // already inside
+        if (satellite_distance_margin(o, satellite, time_min) < 0.) {
+            continue;
+        }
+
+        int n = encounter_search(encounters, MANEUVER_MAX_ENCOUNTERS, o, satellite_orbit, time_min, best);
+        for (int k = 0; k < n; k += 1) {
+            if (encounters[k].distance < radius) {
+                double low = k == 0 ? time_min : encounters[k - 1].time;
+                best = entry_time(o, satellite, low, encounters[k].time);
+                *entered = satellite;
+                break;
+            }
+        }
+    }
+    return best;
+}
+
+static double horizon(Orbit* o, double time, double escape) {
+    if (o->eccentricity < 1.) {
+        return time + o->period;
+    }
+    if (std::isfinite(escape)) {
+        return escape;
+    }
+    glm::dvec3 position, velocity;
+    orbit_state_at_time(o, time, &position, &velocity);
+    return time + MANEUVER_OPEN_DISTANCE_FACTOR * glm::length(position) / glm::length(velocity);
+}
+
+void patched_conics(std::vector<ConicSegment>* segments, Orbit* orbit, double time_start, double time_end) {
+    Orbit o = *orbit;
+    for (int i = 0; i <= MANEUVER_MAX_TRANSITIONS; i += 1) {
+        double escape = next_escape(&o, time_start);
+        double end = std::isfinite(time_end) ? time_end : horizon(&o, time_start, escape);
+        CelestialBody* entered = NULL;
+        double entry = next_entry(&o, time_start, fmin(end, escape), &entered);
+
+        double time = fmin(end, fmin(escape, entry));
+        segments->push_back({o, time_start, time});
+        if (time == end && entered == NULL && escape > end) {
+            return;
+        }
+
+        // change reference frame
+        glm::dvec3 position, velocity;
+        orbit_state_at_time(&o, time, &position, &velocity);
+        CelestialBody* primary;
+        if (entered != NULL && entry <= escape) {
+            glm::dvec3 satellite_position, satellite_velocity;
+            orbit_state_at_time(entered->orbit, time, &satellite_position, &satellite_velocity);
+            position -= satellite_position;
+            velocity -= satellite_velocity;
+            primary = entered;
+        } else {
+            CelestialBody* previous = o.primary;
+            glm::dvec3 primary_position, primary_velocity;
+            orbit_state_at_time(previous->orbit, time, &primary_position, &primary_velocity);
+            position += primary_position;
+            velocity += primary_velocity;
+            primary = previous->orbit->primary;
+        }
+        if (orbit_from_state(&o, primary, position, velocity, time) < 0) {
+            return;
+        }
+        time_start = time;
+    }
+}
+
+void flight_plan_init(FlightPlan* plan, Orbit* initial_orbit, double time_start) {
+    plan->initial_orbit = *initial_orbit;
+    plan->time_start = time_start;
+    plan->nodes.clear();
+    plan->legs.clear();
+}
+
+static size_t first_outdated_leg(FlightPlan* plan, const std::vector<ManeuverNode>& nodes) {
+    /* Leg k depends on the nodes before it, and on the time of node k */
+    if (plan->legs.size() != plan->nodes.size() + 1) {
+        return 0;
+    }
+    size_t n = std::min(nodes.size(), plan->nodes.size());
+    for (size_t k = 0; k < n; k += 1) {
+        if (nodes[k].time != plan->nodes[k].time) {
+            return k;
+        }
+        if (nodes[k].delta_v != plan->nodes[k].delta_v) {
+            return k + 1;
+        }
+    }
+    if (nodes.size() != plan->nodes.size()) {
+        return n;
+    }
+    return plan->legs.size();
+}
+
+size_t flight_plan_update(FlightPlan* plan, const std::vector<ManeuverNode>& nodes) {
+    size_t first = first_outdated_leg(plan, nodes);
+    if (first == plan->legs.size() && nodes.size() + 1 == plan->legs.size()) {
+        return first;
+    }
+
+    plan->nodes = nodes;
+    plan->legs.resize(first);
+    for (size_t k = first; k <= nodes.size(); k += 1) {
+        Orbit orbit;
+        double time_start;
+        if (k == 0) {
+            orbit = plan->initial_orbit;
+            time_start = plan->time_start;
+        } else {
+            // burn at the previous node
+            ManeuverNode node = nodes[k - 1];
+            ConicSegment* last = &plan->legs[k - 1].back();
+            glm::dvec3 position, velocity;
+            orbit_state_at_time(&last->orbit, last->time_end, &position, &velocity);
+            node.time = last->time_end;
+            velocity += maneuver_node_delta_v(&node, &last->orbit);
+            if (orbit_from_state(&orbit, last->orbit.primary, position, velocity, last->time_end) < 0) {
+                orbit = last->orbit;
+            }
+            time_start = last->time_end;
+        }
+
+        // nodes before the start of the leg are applied immediately
+        double time_end = k < nodes.size() ? fmax(nodes[k].time, time_start) : INFINITY;
+        plan->legs.push_back({});
+        patched_conics(&plan->legs.back(), &orbit, time_start, time_end);
+    }
+    return first;
+}
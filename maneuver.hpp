@@ -0,0 +1,47 @@
+#ifndef MANEUVER_HPP
+#define MANEUVER_HPP
+
+#include "orbit.hpp"
+
+#include <vector>
+
+struct ManeuverNode {
+    double time;
+    glm::dvec3 delta_v;  // along prograde, normal and radial-out directions
+};
+
+// part of a trajectory within a single sphere of influence
+struct ConicSegment {
+    Orbit orbit;
+    double time_start;
+    double time_end;
+};
+
+// trajectory with impulsive maneuvers, in patched conics; legs[k] is the part
+// of the trajectory before nodes[k], and the last leg the one after the last
+// node; each leg can cross several spheres of influence
+struct FlightPlan {
+    Orbit initial_orbit;
+    double time_start;
+    std::vector<ManeuverNode> nodes;  // chronological
+    std::vector<std::vector<ConicSegment>> legs;
+};
+
+// change of velocity of the node in the frame of the primary of o
+glm::dvec3 maneuver_node_delta_v(ManeuverNode* node, Orbit* o);
+// node for a change of velocity given in the frame of the primary of o
+ManeuverNode maneuver_node_from_delta_v(Orbit* o, double time, glm::dvec3 delta_v);
+
+// follow the orbit from time_start to time_end through the spheres of
+// influence; with an infinite time_end, stop after one revolution of the last
+// conic, or when it leaves for deep space
+void patched_conics(std::vector<ConicSegment>* segments, Orbit* orbit, double time_start, double time_end);
+
+// reset the plan to start from the given orbit, without any node
+void flight_plan_init(FlightPlan* plan, Orbit* initial_orbit, double time_start);
+// update the plan for the nodes (chronological); legs that only depend on
+// unchanged nodes are kept; return the index of the first recomputed leg, or
+// the number of legs when nothing changed
+size_t flight_plan_update(FlightPlan* plan, const std::vector<ManeuverNode>& nodes);
+
+#endif
@@ -3,8 +3,12 @@
 extern "C" {
 #include "util.h"
 #include "logging.h"
+#include "shaders.h"
 }
 
+#include "program.hpp"
+#include "stream.hpp"
+
 #ifdef MSYS2
 #include <windef.h>
 #endif
@@ -19,61 +23,52 @@ Mesh::Mesh(unsigned mode_, int length_, bool is_3d_) :
     is_3d{is_3d_}
 {
     glGenBuffers(1, &this->vbo);
+
+    // the layout is fixed, only the content of the buffer changes
+    glGenVertexArrays(1, &this->vao);
+    glBindVertexArray(this->vao);
+    glBindBuffer(GL_ARRAY_BUFFER, this->vbo);
+    if (this->is_3d) {
+        glEnableVertexAttribArray(ATTRIBUTE_POSITION);
+        glVertexAttribPointer(ATTRIBUTE_POSITION, 3, GL_FLOAT, GL_FALSE, 8 * (GLsizei) sizeof(float), NULL);
+        glEnableVertexAttribArray(ATTRIBUTE_TEXCOORD);
+        glVertexAttribPointer(ATTRIBUTE_TEXCOORD, 2, GL_FLOAT, GL_FALSE, 8 * (GLsizei) sizeof(float), (GLvoid*)(3 * sizeof(float)));
+        glEnableVertexAttribArray(ATTRIBUTE_NORMAL);
+        glVertexAttribPointer(ATTRIBUTE_NORMAL, 3, GL_FLOAT, GL_FALSE, 8 * (GLsizei) sizeof(float), (GLvoid*)(5 * sizeof(float)));
+    } else {
+        glEnableVertexAttribArray(ATTRIBUTE_POSITION);
+        glVertexAttribPointer(ATTRIBUTE_POSITION, 3, GL_FLOAT, GL_FALSE, 0, NULL);
+    }
+    glBindVertexArray(0);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
 }
 
 Mesh::~Mesh(void) {
+    glDeleteVertexArrays(1, &this->vao);
     glDeleteBuffers(1, &this->vbo);
 }
 
 void Mesh::bind(void) {
-    GLint program;
-    glGetIntegerv(GL_CURRENT_PROGRAM, &program);
-    glBindBuffer(GL_ARRAY_BUFFER, this->vbo);
-
-    if (this->is_3d) {
-        GLint var = glGetAttribLocation(program, "v_position");
-        glEnableVertexAttribArray(var);
-        glVertexAttribPointer(var, 3, GL_FLOAT, GL_FALSE, 8 * (GLsizei) sizeof(float), NULL);
-
-        var = glGetAttribLocation(program, "v_texcoord");
-        if (var >= 0) {
-            glEnableVertexAttribArray(var);
-            glVertexAttribPointer(var, 2, GL_FLOAT, GL_FALSE, 8 * (GLsizei) sizeof(float), (GLvoid*)(3 * sizeof(float)));
-        }
-
-        var = glGetAttribLocation(program, "v_normal");
-        if (var >= 0) {
-            glEnableVertexAttribArray(var);
-            glVertexAttribPointer(var, 3, GL_FLOAT, GL_FALSE, 8 * (GLsizei) sizeof(float), (GLvoid*)(5 * sizeof(float)));
-        }
-    } else {
-        GLint var = glGetAttribLocation(program, "v_position");
-        glEnableVertexAttribArray(var);
-        glVertexAttribPointer(var, 3, GL_FLOAT, GL_FALSE, 0, NULL);
-
-        var = glGetAttribLocation(program, "v_texcoord");
-        if (var >= 0) {
-            glDisableVertexAttribArray(var);
-        }
-
-        var = glGetAttribLocation(program, "v_normal");
-        if (var >= 0) {
-            glDisableVertexAttribArray(var);
-        }
-    }
-
-    glBindBuffer(GL_ARRAY_BUFFER, 0);
+    glBindVertexArray(this->vao);
 }
 
 void Mesh::draw(void) {
     this->bind();
+    uniform_blocks_flush();
     glDrawArrays(this->mode, 0, this->length);
 }
 
+void Mesh::draw_instanced(int n_instances) {
+    this->bind();
+    uniform_blocks_flush();
+    glDrawArraysInstanced(this->mode, 0, this->length, n_instances);
+}
+
 PointMesh::PointMesh(void) :
     Mesh(GL_POINTS, 1, true)
 {
-    float data[] = {0, 0, 0};
+    // position, texcoord and normal
+    float data[] = {0, 0, 0, 0, 0, 0, 0, 0};
 
     glBindBuffer(GL_ARRAY_BUFFER, this->vbo);
     glBufferData(GL_ARRAY_BUFFER, sizeof(data), data, GL_STATIC_DRAW);
@@ -371,191 +366,31 @@ IcoSphereMesh::IcoSphereMesh(float radius, int lod) :
     this->length = (int) data.size() / 8;
 }
 
-OrbitMesh::OrbitMesh(Orbit* orbit, double time, bool focused) :
+OrbitArcMesh::OrbitArcMesh(Orbit* orbit, double time_start, double time_end) :
     Mesh(GL_LINE_STRIP, 0, false)
 {
-    // issues when drawing the orbit of a focused body:
-    // 1. moving to system center and back close to camera induces
-    //    loss of significance and produces jitter
-    // 2. drawing the orbit as segments may put the body visibly out
-    //    of the line when zooming in
-    // 3. line breaks may be visible close to the camera
-
-    // draw the orbit from the body rather than from the orbit focus (1.)
-    glm::dvec3 offset_from_focus{0, 0, 0};
-    if (focused) {
-        offset_from_focus = orbit_position_at_time(orbit, time);
-    }
-
-    std::vector<float> data;
-
-    if (orbit->apoapsis > orbit->primary->sphere_of_influence || orbit->eccentricity > 1.) {  // escaping orbit
-        double object_mean_anomaly = orbit_mean_anomaly_at_time(orbit, time);
-        double object_eccentric_anomaly = orbit_eccentric_anomaly_at_mean_anomaly(orbit, object_mean_anomaly);
-        double object_true_anomaly = orbit_true_anomaly_at_eccentric_anomaly(orbit, object_eccentric_anomaly);
-
-        // bring to [-PI, PI]
-        object_true_anomaly = fmod2(object_true_anomaly, 2 * M_PI);
-        if (object_true_anomaly > M_PI) {
-            object_true_anomaly -= 2 * M_PI;
-        }
-
-        // stop drawing at SoI
-        // TODO: handle no sphere of influence
-        double escape_true_anomaly = orbit_true_anomaly_at_escape(orbit);
-
-        // point at object
-        {
-            // TODO: we can probably do better precision-wise
-            auto pos = orbit_position_at_true_anomaly(orbit, object_true_anomaly) - offset_from_focus;
-            data.push_back((float) pos[0]);
-            data.push_back((float) pos[1]);
-            data.push_back((float) pos[2]);
-        }
-
-        // ensure the body will be on the line (2.)
-        // more points close to the camera (3.)
-        size_t n_points = 64;
-        for (size_t i = 1; i < n_points; i += 1) {
-            double t = (double) i / (double) n_points;
-            double true_anomaly = lerp(object_true_anomaly, escape_true_anomaly, t);
-
-            auto pos = orbit_position_at_true_anomaly(orbit, true_anomaly) - offset_from_focus;
-            data.push_back((float) pos[0]);
-            data.push_back((float) pos[1]);
-            data.push_back((float) pos[2]);
-        }
-
-        // point at escape
-        {
-            auto pos = orbit_position_at_escape(orbit) - offset_from_focus;
-            data.push_back((float) pos[0]);
-            data.push_back((float) pos[1]);
-            data.push_back((float) pos[2]);
-        }
-
-        this->mode = GL_LINE_STRIP;
-    } else {  // non-escaping closed orbit
-        double mean_anomaly = orbit_mean_anomaly_at_time(orbit, time);
-        double eccentric_anomaly = orbit_eccentric_anomaly_at_mean_anomaly(orbit, mean_anomaly);
-
-        auto transform = glm::mat4(1.0f);
-        transform = glm::rotate(transform, float(orbit->longitude_of_ascending_node), glm::vec3(0.f, 0.f, 1.f));
-        transform = glm::rotate(transform, float(orbit->inclination),                 glm::vec3(1.f, 0.f, 0.f));
-        transform = glm::rotate(transform, float(orbit->argument_of_periapsis),       glm::vec3(0.f, 0.f, 1.f));
-        if (!focused) {
-            transform = glm::translate(transform, glm::vec3(-orbit->focus, 0.f, 0.f));
-        }
-        transform = glm::scale(transform, glm::vec3(orbit->semi_major_axis, orbit->semi_minor_axis, 1.0f));
-        if (focused) {
-            transform = glm::rotate(transform, float(eccentric_anomaly - M_PI), glm::vec3(0.f, 0.f, 1.f));
-        }
-
-        size_t n_points = 256;
-        for (size_t j = 0; j < n_points; j += 1) {
-            glm::vec4 v;
-            if (focused) {
-                // the first point of circle_through_origin is (0,0) (2.)
-                // more points are located near the origin (3.)
-                float x = 2.f * float(j) / float(n_points) - 1.f;
-                float theta = M_PIf32 * powf(x, 3.f);
-                v = glm::vec4(1.f - cosf(theta), sinf(theta), 0.f, 0.f);
-            } else {
-                float theta = M_PIf32 * (2.f * float(j) / float(n_points) - 1.f);
-                v = glm::vec4{cosf(theta), sinf(theta), 0.f, 1.f};
-            }
-
-            v = transform * v;
-            data.push_back(v[0]);
-            data.push_back(v[1]);
-            data.push_back(v[2]);
-        }
-
-        this->mode = GL_LINE_LOOP;
-    }
-
-    glBindBuffer(GL_ARRAY_BUFFER, this->vbo);
-    glBufferData(GL_ARRAY_BUFFER, data.size() * sizeof(float), data.data(), GL_STATIC_DRAW);
-    glBindBuffer(GL_ARRAY_BUFFER, 0);
-
-    this->length = (int) data.size() / 3;
-}
-
-OrbitApsesMesh::OrbitApsesMesh(Orbit* orbit, double time, bool focused) :
-    Mesh(GL_POINTS, 0, false)
-{
-    auto periapsis = orbit_position_at_true_anomaly(orbit, 0.);
-    auto apoapsis  = orbit_position_at_true_anomaly(orbit, M_PI);
-    double dn_true_anomaly = 2 * M_PI - orbit->argument_of_periapsis;
-    double an_true_anomaly = 3 * M_PI - orbit->argument_of_periapsis;
-    an_true_anomaly = fmod(an_true_anomaly, 2 * M_PI);
-    auto ascending_node  = orbit_position_at_true_anomaly(orbit, dn_true_anomaly);
-    auto descending_node = orbit_position_at_true_anomaly(orbit, an_true_anomaly);
-
-    if (focused) {
-        auto offset_from_focus = orbit_position_at_time(orbit, time);
-        periapsis -= offset_from_focus;
-        apoapsis -= offset_from_focus;
-        ascending_node -= offset_from_focus;
-        descending_node -= offset_from_focus;
+    // spread the points evenly in eccentric anomaly rather than in time, so
+    // that they do not get sparse near the periapsis; closed orbits are
+    // unwrapped so that the arc can go around several times
+    double mean_anomaly_start = orbit_mean_anomaly_at_time(orbit, time_start);
+    double mean_anomaly_end = orbit_mean_anomaly_at_time(orbit, time_end);
+    double eccentric_anomaly_start = orbit_eccentric_anomaly_at_mean_anomaly(orbit, mean_anomaly_start);
+    double eccentric_anomaly_end = orbit_eccentric_anomaly_at_mean_anomaly(orbit, mean_anomaly_end);
+    if (orbit->eccentricity < 1.) {
+        eccentric_anomaly_start += mean_anomaly_start - fmod2(mean_anomaly_start, 2 * M_PI);
+        eccentric_anomaly_end += mean_anomaly_end - fmod2(mean_anomaly_end, 2 * M_PI);
     }
 
     std::vector<float> data;
-
-    if (orbit->apoapsis > orbit->primary->sphere_of_influence || orbit->eccentricity > 1.) {  // escaping orbit
-        // NOTE: 0 ≤ ν < 2π with q at 0 and Q at π
-        double mean_anomaly = orbit_mean_anomaly_at_time(orbit, time);
-        double eccentric_anomaly = orbit_eccentric_anomaly_at_mean_anomaly(orbit, mean_anomaly);
+    size_t n_points = 128;
+    for (size_t i = 0; i <= n_points; i += 1) {
+        double t = (double) i / (double) n_points;
+        double eccentric_anomaly = lerp(eccentric_anomaly_start, eccentric_anomaly_end, t);
         double true_anomaly = orbit_true_anomaly_at_eccentric_anomaly(orbit, eccentric_anomaly);
-        double escape_true_anomaly = orbit_true_anomaly_at_escape(orbit);
-
-        // only show periapsis if on remaining trajectory
-        if (true_anomaly > M_PI) {
-            data.push_back((float) periapsis[0]);
-            data.push_back((float) periapsis[1]);
-            data.push_back((float) periapsis[2]);
-        }
-
-        // only show ascending node if on remaining trajectory
-        if (true_anomaly < M_PI ?
-                true_anomaly < dn_true_anomaly && dn_true_anomaly < escape_true_anomaly :
-                true_anomaly < dn_true_anomaly || dn_true_anomaly < escape_true_anomaly
-        ) {
-            data.push_back((float) ascending_node[0]);
-            data.push_back((float) ascending_node[1]);
-            data.push_back((float) ascending_node[2]);
-        }
-
-        // only show decending node if on remaining trajectory
-        if (true_anomaly < M_PI ?
-                true_anomaly < an_true_anomaly && an_true_anomaly < escape_true_anomaly :
-                true_anomaly < an_true_anomaly || an_true_anomaly < escape_true_anomaly
-        ) {
-            data.push_back((float) descending_node[0]);
-            data.push_back((float) descending_node[1]);
-            data.push_back((float) descending_node[2]);
-        }
-
-    } else {  // non-escaping closed orbit
-        if (orbit->eccentricity >= 5e-4) {  // not an almost circular orbit
-            data.push_back((float) periapsis[0]);
-            data.push_back((float) periapsis[1]);
-            data.push_back((float) periapsis[2]);
-
-            data.push_back((float) apoapsis[0]);
-            data.push_back((float) apoapsis[1]);
-            data.push_back((float) apoapsis[2]);
-        }
-
-        if (orbit->inclination >= 5e-4) {  // somewhat inclined orbit
-            data.push_back((float) ascending_node[0]);
-            data.push_back((float) ascending_node[1]);
-            data.push_back((float) ascending_node[2]);
-
-            data.push_back((float) descending_node[0]);
-            data.push_back((float) descending_node[1]);
-            data.push_back((float) descending_node[2]);
-        }
+        auto pos = orbit_position_at_true_anomaly(orbit, true_anomaly);
+        data.push_back((float) pos[0]);
+        data.push_back((float) pos[1]);
+        data.push_back((float) pos[2]);
     }
 
     glBindBuffer(GL_ARRAY_BUFFER, this->vbo);
@@ -579,16 +414,22 @@ static void append_object_and_children_coordinates(std::vector<float>& positions
     }
 }
 
-OrbitSystem::OrbitSystem(CelestialBody* root, const glm::dvec3& scene_origin, double time) :
+OrbitSystem::OrbitSystem(void) :
     // TODO: mode = GL_LINE_LOOP if orbit.eccentricity < 1. else GL_LINE_STRIP
     Mesh(GL_POINTS, 0, false)
 {
-    std::vector<float> data;
-    append_object_and_children_coordinates(data, scene_origin, time, root);
+}
 
-    glBindBuffer(GL_ARRAY_BUFFER, this->vbo);
-    glBufferData(GL_ARRAY_BUFFER, data.size() * sizeof(float), data.data(), GL_STATIC_DRAW);
+void OrbitSystem::update(CelestialBody* root, const glm::dvec3& scene_origin, double time) {
+    this->positions.clear();
+    append_object_and_children_coordinates(this->positions, scene_origin, time, root);
+    size_t offset = stream_write(this->positions.data(), this->positions.size() * sizeof(float), sizeof(float));
+
+    glBindVertexArray(this->vao);
+    glBindBuffer(GL_ARRAY_BUFFER, stream_buffer());
+    glVertexAttribPointer(ATTRIBUTE_POSITION, 3, GL_FLOAT, GL_FALSE, 0, (GLvoid*) offset);
+    glBindVertexArray(0);
     glBindBuffer(GL_ARRAY_BUFFER, 0);
 
-    this->length = (int) data.size() / 3;
+    this->length = (int) this->positions.size() / 3;
 }
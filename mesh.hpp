@@ -3,16 +3,21 @@
 
 #include "orbit.hpp"
 
+#include <vector>
+
 struct Mesh {
     Mesh(unsigned mode, int length, bool is_3d);
     ~Mesh(void);
     void bind(void);
     void draw(void);
+    // the per-instance attributes must have been set on the vertex array
+    void draw_instanced(int n_instances);
 
     unsigned mode;
     int length;
     bool is_3d;
     unsigned vbo;
+    unsigned vao;
 };
 
 struct PointMesh : public Mesh {
@@ -39,16 +44,17 @@ struct IcoSphereMesh : public Mesh {
     IcoSphereMesh(float radius, int lod);
 };
 
-struct OrbitMesh : public Mesh {
-    OrbitMesh(Orbit* orbit, double time=0., bool focused=false);
-};
-
-struct OrbitApsesMesh : public Mesh {
-    OrbitApsesMesh(Orbit* orbit, double time=0., bool focused=false);
+// part of an orbit between two times, relative to the primary
+struct OrbitArcMesh : public Mesh {
+    OrbitArcMesh(Orbit* orbit, double time_start, double time_end);
 };
 
+// positions of the bodies, rewritten to the stream buffer on each update
 struct OrbitSystem : public Mesh {
-    OrbitSystem(CelestialBody* root, const glm::dvec3& scene_origin, double time);
+    OrbitSystem(void);
+    void update(CelestialBody* root, const glm::dvec3& scene_origin, double time);
+
+    std::vector<float> positions;  // reused between frames
 };
 
 #endif
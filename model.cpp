@@ -3,8 +3,11 @@
 extern "C" {
 #include "texture.h"
 #include "logging.h"
+#include "shaders.h"
 }
 
+#include "program.hpp"
+
 #include <assimp/Importer.hpp>
 #include <assimp/postprocess.h>
 #include <GL/glew.h>
@@ -14,6 +17,10 @@ Mesh2::Mesh2(const vector<Vertex>& vertices_, const vector<unsigned int>& indice
     indices{indices_},
     diffuse_map{diffuse_map_}
 {
+    // the index buffer is part of the state of the vertex array
+    glGenVertexArrays(1, &this->vao);
+    glBindVertexArray(this->vao);
+
     glGenBuffers(1, &this->vbo);
     glBindBuffer(GL_ARRAY_BUFFER, this->vbo);
     glBufferData(GL_ARRAY_BUFFER, this->vertices.size() * sizeof(Vertex), this->vertices.data(), GL_STATIC_DRAW);
@@ -21,48 +28,28 @@ Mesh2::Mesh2(const vector<Vertex>& vertices_, const vector<unsigned int>& indice
     glGenBuffers(1, &this->ibo);
     glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, this->ibo);
     glBufferData(GL_ELEMENT_ARRAY_BUFFER, this->indices.size() * sizeof(unsigned int), this->indices.data(), GL_STATIC_DRAW);
+
+    glEnableVertexAttribArray(ATTRIBUTE_POSITION);
+    glVertexAttribPointer(ATTRIBUTE_POSITION, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, position));
+    glEnableVertexAttribArray(ATTRIBUTE_NORMAL);
+    glVertexAttribPointer(ATTRIBUTE_NORMAL, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, normal));
+    glEnableVertexAttribArray(ATTRIBUTE_TEXCOORD);
+    glVertexAttribPointer(ATTRIBUTE_TEXCOORD, 2, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, texcoords));
+    glEnableVertexAttribArray(ATTRIBUTE_TANGENT);
+    glVertexAttribPointer(ATTRIBUTE_TANGENT, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, tangent));
+    glEnableVertexAttribArray(ATTRIBUTE_BITANGENT);
+    glVertexAttribPointer(ATTRIBUTE_BITANGENT, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, bitangent));
+
+    glBindVertexArray(0);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
 }
 
 void Mesh2::draw(void) {
-    glBindBuffer(GL_ARRAY_BUFFER, this->vbo);
-    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, this->ibo);
-
-    GLint program;
-    glGetIntegerv(GL_CURRENT_PROGRAM, &program);
-
-    GLint var = glGetAttribLocation(program, "v_position");
-    glEnableVertexAttribArray(var);
-    glVertexAttribPointer(var, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, position));
-
-    var = glGetAttribLocation(program, "v_normal");
-    if (var >= 0) {
-        glEnableVertexAttribArray(var);
-        glVertexAttribPointer(var, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, normal));
-    }
-
-    var = glGetAttribLocation(program, "v_texcoord");
-    if (var >= 0) {
-        glEnableVertexAttribArray(var);
-        glVertexAttribPointer(var, 2, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, texcoords));
-    }
-
-    var = glGetAttribLocation(program, "v_tangent");
-    if (var >= 0) {
-        glEnableVertexAttribArray(var);
-        glVertexAttribPointer(var, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, tangent));
-    }
-
-    var = glGetAttribLocation(program, "v_bitangent");
-    if (var >= 0) {
-        glEnableVertexAttribArray(var);
-        glVertexAttribPointer(var, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, bitangent));
-    }
-
+    glBindVertexArray(this->vao);
     glBindTexture(GL_TEXTURE_2D, this->diffuse_map);
+    uniform_blocks_flush();
     glDrawRangeElements(GL_TRIANGLES, 0, (GLsizei) this->vertices.size() - 1, (GLsizei) indices.size(), GL_UNSIGNED_INT, 0);
     glBindTexture(GL_TEXTURE_2D, 0);
-    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
-    glBindBuffer(GL_ARRAY_BUFFER, 0);
 }
 
 GLuint Model::load_material_texture(aiMaterial *mat, aiTextureType type) {
@@ -26,6 +26,7 @@ private:
     unsigned int diffuse_map;
     unsigned int vbo;
     unsigned int ibo;
+    unsigned int vao;
 };
 
 struct Model {
@@ -0,0 +1,746 @@
+#include "moid.hpp"
+
+#include "parallel.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <complex>
+
+// between ellipses, the stationary points of the distance are found as the
+// roots of a resultant (after Gronchi); the resultant is a trigonometric
+// polynomial in the eccentric anomaly on the first orbit, of degree at most
+// MOID_RESULTANT_DEGREE (16 in the tangent of the half-angle, as shown by
+// Gronchi), recovered from MOID_RESULTANT_SAMPLES values
+#define MOID_RESULTANT_DEGREE 8
+#define MOID_RESULTANT_SAMPLES 24
+#define MOID_ROOT_ITERATIONS 200
+// roots whose modulus is this close to 1, in logarithm, are taken as real
+// angles; spurious ones only cost a polishing
+#define MOID_ROOT_MODULUS .05
+// otherwise (open orbits, or when the stationary points are not isolated), the
+// curves are sampled on a grid of true anomalies, and each local minimum of the
+// grid is polished
+#define MOID_GRID 36
+#define MOID_MAX_ITERATIONS 30
+#define MOID_TOLERANCE 1e-12
+#define MOID_BLOCKS_PER_THREAD 64
+
+typedef std::complex<double> Complex;
+
+struct Conic {
+    double semi_latus_rectum;
+    double eccentricity;
+    glm::dvec3 p;  // towards periapsis
+    glm::dvec3 q;  // a quarter of a turn further
+};
+
+// sampled positions of a conic, by component
+struct ConicGrid {
+    double x[MOID_GRID];
+    double y[MOID_GRID];
+    double z[MOID_GRID];
+    bool valid[MOID_GRID];  // false beyond the asymptotes of an open orbit
+    double spacing;  // largest distance between consecutive valid points
+};
+
+static const struct GridTables {
+    double cos[MOID_GRID];
+    double sin[MOID_GRID];
+    size_t neighbours[MOID_GRID][3];  // wrapping around
+    GridTables(void) {
+        for (size_t k = 0; k < MOID_GRID; k += 1) {
+            double f = 2. * M_PI * (double) k / MOID_GRID;
+            this->cos[k] = ::cos(f);
+            this->sin[k] = ::sin(f);
+            this->neighbours[k][0] = (k + MOID_GRID - 1) % MOID_GRID;
+            this->neighbours[k][1] = k;
+            this->neighbours[k][2] = (k + 1) % MOID_GRID;
+        }
+    }
+} grid_tables;
+
+static Conic conic_from_orbit(Orbit* o) {
+    return {
+        o->semi_latus_rectum,
+        o->eccentricity,
+        o->orientation * glm::dvec3(1., 0., 0.),
+        o->orientation * glm::dvec3(0., 1., 0.),
+    };
+}
+
+static Conic conic_from_batch(const MoidBatch* batch, size_t i) {
+    return {
+        batch->semi_latus_rectum[i],
+        batch->eccentricity[i],
+        glm::dvec3(batch->px[i], batch->py[i], batch->pz[i]),
+        glm::dvec3(batch->qx[i], batch->qy[i], batch->qz[i]),
+    };
+}
+
+static void conic_grid(const Conic& c, ConicGrid* grid) {
+    for (size_t k = 0; k < MOID_GRID; k += 1) {
+        double cos_f = grid_tables.cos[k];
+        double sin_f = grid_tables.sin[k];
+        double denominator = 1. + c.eccentricity * cos_f;
+        grid->valid[k] = denominator > 0.;
+        double distance = grid->valid[k] ? c.semi_latus_rectum / denominator : 0.;
+        glm::dvec3 point = distance * (cos_f * c.p + sin_f * c.q);
+        grid->x[k] = point[0];
+        grid->y[k] = point[1];
+        grid->z[k] = point[2];
+    }
+
+    grid->spacing = 0.;
+    for (size_t k = 0; k < MOID_GRID; k += 1) {
+        size_t l = grid_tables.neighbours[k][2];
+        if (grid->valid[k] && grid->valid[l]) {
+            glm::dvec3 d(grid->x[l] - grid->x[k], grid->y[l] - grid->y[k], grid->z[l] - grid->z[k]);
+            grid->spacing = fmax(grid->spacing, glm::length(d));
+        }
+    }
+}
+
+static bool conic_derivatives(const Conic& c, double f, glm::dvec3* r, glm::dvec3* dr, glm::dvec3* ddr) {
+    /* Position and its first two derivatives with respect to true anomaly */
+    double cos_f = cos(f);
+    double sin_f = sin(f);
+    double denominator = 1. + c.eccentricity * cos_f;
+    if (denominator <= 0.) {
+        return false;
+    }
+
+    double distance = c.semi_latus_rectum / denominator;
+    glm::dvec3 u = cos_f * c.p + sin_f * c.q;
+    glm::dvec3 w = -sin_f * c.p + (c.eccentricity + cos_f) * c.q;
+    double k = distance * distance / c.semi_latus_rectum;
+    double dk = 2. * k * distance * c.eccentricity * sin_f / c.semi_latus_rectum;
+
+    *r = distance * u;
+    *dr = k * w;
+    *ddr = dk * w - k * u;
+    return true;
+}
+
+static double half_squared_distance(const Conic& a, const Conic& b, double fa, double fb) {
+    glm::dvec3 ra, dra, ddra, rb, drb, ddrb;
+    if (!conic_derivatives(a, fa, &ra, &dra, &ddra) || !conic_derivatives(b, fb, &rb, &drb, &ddrb)) {
+        return INFINITY;
+    }
+    glm::dvec3 d = ra - rb;
+    return glm::dot(d, d) / 2.;
+}
+
+static double refine(const Conic& a, const Conic& b, double* fa, double* fb) {
+    /* Damped Newton on the gradient of the squared distance */
+    double max_step = 2. * M_PI / MOID_GRID;
+    double value = half_squared_distance(a, b, *fa, *fb);
+    for (int i = 0; i < MOID_MAX_ITERATIONS; i += 1) {
+        glm::dvec3 ra, dra, ddra, rb, drb, ddrb;
+        conic_derivatives(a, *fa, &ra, &dra, &ddra);
+        conic_derivatives(b, *fb, &rb, &drb, &ddrb);
+        glm::dvec3 d = ra - rb;
+
+        double ga = glm::dot(d, dra);
+        double gb = -glm::dot(d, drb);
+        double haa = glm::dot(dra, dra) + glm::dot(d, ddra);
+        double hbb = glm::dot(drb, drb) - glm::dot(d, ddrb);
+        double hab = -glm::dot(dra, drb);
+        double det = haa * hbb - hab * hab;
+        if (!(haa > 0. && det > 0.)) {
+            // use the Gauss-Newton approximation away from the minimum
+            haa = glm::dot(dra, dra);
+            hbb = glm::dot(drb, drb);
+            det = haa * hbb - hab * hab;
+        }
+
+        double step_a, step_b;
+        if (det > 1e-12 * haa * hbb) {
+            step_a = -(hbb * ga - hab * gb) / det;
+            step_b = -(haa * gb - hab * ga) / det;
+        } else {  // parallel tangents
+            step_a = -ga / haa;
+            step_b = -gb / hbb;
+        }
+
+        // stay within the basin found on the grid
+        double length = fmax(fabs(step_a), fabs(step_b));
+        if (length > max_step) {
+            step_a *= max_step / length;
+            step_b *= max_step / length;
+        }
+
+        // backtrack when overshooting
+        double next = half_squared_distance(a, b, *fa + step_a, *fb + step_b);
+        for (int j = 0; j < 10 && !(next <= value); j += 1) {
+            step_a /= 2.;
+            step_b /= 2.;
+            next = half_squared_distance(a, b, *fa + step_a, *fb + step_b);
+        }
+        if (!(next <= value)) {
+            break;
+        }
+
+        *fa += step_a;
+        *fb += step_b;
+        value = next;
+        if (fabs(step_a) + fabs(step_b) < MOID_TOLERANCE) {
+            break;
+        }
+    }
+    return sqrt(2. * value);
+}
+
+static void grid_squared_distances(const ConicGrid& grid_a, const ConicGrid& grid_b, double squared_distances[MOID_GRID][MOID_GRID]) {
+    for (size_t i = 0; i < MOID_GRID; i += 1) {
+        double* row = squared_distances[i];
+        for (size_t j = 0; j < MOID_GRID; j += 1) {
+            double dx = grid_a.x[i] - grid_b.x[j];
+            double dy = grid_a.y[i] - grid_b.y[j];
+            double dz = grid_a.z[i] - grid_b.z[j];
+            row[j] = dx * dx + dy * dy + dz * dz;
+        }
+    }
+
+    // open orbits
+    for (size_t k = 0; k < MOID_GRID; k += 1) {
+        if (!grid_a.valid[k]) {
+            std::fill(squared_distances[k], squared_distances[k] + MOID_GRID, INFINITY);
+        }
+        if (!grid_b.valid[k]) {
+            for (size_t i = 0; i < MOID_GRID; i += 1) {
+                squared_distances[i][k] = INFINITY;
+            }
+        }
+    }
+}
+
+static double grid_slack(const ConicGrid& grid_a, const ConicGrid& grid_b) {
+    // the closest points are at most half a spacing away from samples (with
+    // some margin since arcs are longer than chords)
+    return .6 * (grid_a.spacing + grid_b.spacing);
+}
+
+static double grid_lower_bound(const ConicGrid& grid_a, const ConicGrid& grid_b) {
+    double squared_distances[MOID_GRID][MOID_GRID];
+    grid_squared_distances(grid_a, grid_b, squared_distances);
+    double closest = INFINITY;
+    for (size_t i = 0; i < MOID_GRID; i += 1) {
+        closest = fmin(closest, *std::min_element(squared_distances[i], squared_distances[i] + MOID_GRID));
+    }
+    return sqrt(closest) - grid_slack(grid_a, grid_b);
+}
+
+static double grid_moid(const Conic& a, const ConicGrid& grid_a, const Conic& b, const ConicGrid& grid_b, double* fa, double* fb) {
+    /* Polish the local minima of the grid */
+    double squared_distances[MOID_GRID][MOID_GRID];
+    grid_squared_distances(grid_a, grid_b, squared_distances);
+
+    // local minima of the grid, among their neighbours; on a plateau, every
+    // sample can be one
+    struct Candidate {
+        double squared_distance;
+        size_t i;
+        size_t j;
+    };
+    std::vector<Candidate> candidates;
+    for (size_t i = 0; i < MOID_GRID; i += 1) {
+        const double* row = squared_distances[i];
+        for (size_t j = 0; j < MOID_GRID; j += 1) {
+            double d2 = row[j];
+            if (d2 == INFINITY) {
+                continue;
+            }
+
+            bool minimum = true;
+            for (size_t di = 0; di < 3 && minimum; di += 1) {
+                const double* other = squared_distances[grid_tables.neighbours[i][di]];
+                for (size_t dj = 0; dj < 3; dj += 1) {
+                    if (other[grid_tables.neighbours[j][dj]] < d2) {
+                        minimum = false;
+                        break;
+                    }
+                }
+            }
+            if (minimum) {
+                candidates.push_back({d2, i, j});
+            }
+        }
+    }
+    std::sort(candidates.begin(), candidates.end(), [](const Candidate& x, const Candidate& y) {
+        return x.squared_distance < y.squared_distance;
+    });
+
+    double slack = grid_slack(grid_a, grid_b);
+    double best = INFINITY;
+    for (size_t k = 0; k < candidates.size(); k += 1) {
+        if (sqrt(candidates[k].squared_distance) - slack > best) {
+            break;
+        }
+
+        double candidate_a = 2. * M_PI * (double) candidates[k].i / MOID_GRID;
+        double candidate_b = 2. * M_PI * (double) candidates[k].j / MOID_GRID;
+        double distance = refine(a, b, &candidate_a, &candidate_b);
+        if (distance < best) {
+            best = distance;
+            if (fa != NULL) {
+                *fa = candidate_a;
+            }
+            if (fb != NULL) {
+                *fb = candidate_b;
+            }
+        }
+    }
+    return best;
+}
+
+static Complex divide(Complex a, Complex b) {
+    // without the care for infinities of the / operator, which is much slower
+    return a * std::conj(b) / std::norm(b);
+}
+
+static void polynomial_roots(const Complex* coefficients, size_t degree, Complex* roots) {
+    /* Aberth-Ehrlich iteration; coefficients are by increasing power, and
+     * the leading one must not vanish */
+    double moduli[2 * MOID_RESULTANT_DEGREE + 1];
+    double logarithms[2 * MOID_RESULTANT_DEGREE + 1];
+    for (size_t k = 0; k <= degree; k += 1) {
+        moduli[k] = abs(coefficients[k]);
+        logarithms[k] = log(moduli[k]);
+    }
+
+    // start on circles given by the Newton polygon of the coefficients (after
+    // Bini), since the moduli of the roots can be far apart
+    size_t hull[2 * MOID_RESULTANT_DEGREE + 1];
+    size_t n_hull = 0;
+    for (size_t k = 0; k <= degree; k += 1) {
+        if (moduli[k] == 0.) {
+            continue;
+        }
+        while (n_hull >= 2) {
+            size_t i = hull[n_hull - 2];
+            size_t j = hull[n_hull - 1];
+            // drop j when it is below the segment from i to k
+            if ((logarithms[j] - logarithms[i]) * (double) (k - i) > (logarithms[k] - logarithms[i]) * (double) (j - i)) {
+                break;
+            }
+            n_hull -= 1;
+        }
+        hull[n_hull] = k;
+        n_hull += 1;
+    }
+    size_t n_roots = 0;
+    for (size_t h = 1; h < n_hull; h += 1) {
+        size_t count = hull[h] - hull[h - 1];
+        double radius = exp((logarithms[hull[h - 1]] - logarithms[hull[h]]) / (double) count);
+        for (size_t k = 0; k < count; k += 1) {
+            double angle = 2. * M_PI * (double) k / (double) count + 2. * M_PI * (double) h / (double) degree + .4;
+            roots[n_roots] = std::polar(radius, angle);
+            n_roots += 1;
+        }
+    }
+
+    bool converged[2 * MOID_RESULTANT_DEGREE] = {};
+    size_t n_converged = 0;
+    for (int iteration = 0; iteration < MOID_ROOT_ITERATIONS && n_converged < degree; iteration += 1) {
+        for (size_t k = 0; k < degree; k += 1) {
+            if (converged[k]) {
+                continue;
+            }
+            Complex z = roots[k];
+            double modulus = sqrt(std::norm(z));
+            Complex value = coefficients[degree];
+            Complex derivative = 0.;
+            double magnitude = moduli[degree];
+            for (size_t l = degree; l-- > 0;) {
+                derivative = derivative * z + value;
+                value = value * z + coefficients[l];
+                magnitude = magnitude * modulus + moduli[l];
+            }
+            // the value is only rounding errors
+            if (std::norm(value) <= 1e-28 * magnitude * magnitude) {
+                converged[k] = true;
+                n_converged += 1;
+                continue;
+            }
+
+            Complex repulsion = 0.;
+            for (size_t j = 0; j < degree; j += 1) {
+                if (j != k) {
+                    Complex difference = z - roots[j];
+                    repulsion += std::conj(difference) / std::norm(difference);
+                }
+            }
+            Complex step;
+            if (derivative == 0.) {
+                step = divide(-1., repulsion);
+            } else {
+                Complex newton = divide(value, derivative);
+                step = divide(newton, 1. - newton * repulsion);
+            }
+            if (!std::isfinite(step.real()) || !std::isfinite(step.imag())) {
+                continue;
+            }
+            roots[k] = z - step;
+            if (std::norm(step) < MOID_TOLERANCE * MOID_TOLERANCE * fmax(std::norm(z), 1.)) {
+                converged[k] = true;
+                n_converged += 1;
+            }
+        }
+    }
+}
+
+static size_t unit_circle_roots(Complex* coefficients, size_t degree, double* angles) {
+    /* Arguments of the roots of modulus close to 1 */
+    double largest = 0.;
+    for (size_t k = 0; k <= degree; k += 1) {
+        largest = fmax(largest, abs(coefficients[k]));
+    }
+    // vanishing coefficients are roots at 0 or at infinity
+    size_t low = 0;
+    while (low < degree && abs(coefficients[low]) <= 1e-12 * largest) {
+        low += 1;
+    }
+    while (degree > low && abs(coefficients[degree]) <= 1e-12 * largest) {
+        degree -= 1;
+    }
+    if (degree == low) {
+        return 0;
+    }
+
+    Complex roots[2 * MOID_RESULTANT_DEGREE];
+    polynomial_roots(coefficients + low, degree - low, roots);
+    size_t n_angles = 0;
+    for (size_t k = 0; k < degree - low; k += 1) {
+        if (fabs(log(abs(roots[k]))) < MOID_ROOT_MODULUS) {
+            angles[n_angles] = arg(roots[k]);
+            n_angles += 1;
+        }
+    }
+    return n_angles;
+}
+
+static double determinant(double* m, size_t n) {
+    /* Gaussian elimination with partial pivoting; m is overwritten */
+    double ret = 1.;
+    for (size_t k = 0; k < n; k += 1) {
+        size_t pivot = k;
+        for (size_t i = k + 1; i < n; i += 1) {
+            if (fabs(m[i * n + k]) > fabs(m[pivot * n + k])) {
+                pivot = i;
+            }
+        }
+        if (m[pivot * n + k] == 0.) {
+            return 0.;
+        }
+        if (pivot != k) {
+            std::swap_ranges(m + k * n, m + k * n + n, m + pivot * n);
+            ret = -ret;
+        }
+        ret *= m[k * n + k];
+        for (size_t i = k + 1; i < n; i += 1) {
+            double factor = m[i * n + k] / m[k * n + k];
+            for (size_t j = k; j < n; j += 1) {
+                m[i * n + j] -= factor * m[k * n + j];
+            }
+        }
+    }
+    return ret;
+}
+
+// ellipse in terms of the eccentric anomaly E, r(E) = a (cos E - e) p + b sin E q
+struct Ellipse {
+    double a;
+    double b;
+    double e;
+    glm::dvec3 p;
+    glm::dvec3 q;
+};
+
+static Ellipse ellipse_from_conic(const Conic& c, double scale) {
+    double a = c.semi_latus_rectum / (1. - c.eccentricity * c.eccentricity) / scale;
+    return {a, a * sqrt(1. - c.eccentricity * c.eccentricity), c.eccentricity, c.p, c.q};
+}
+
+static glm::dvec3 ellipse_position(const Ellipse& c, double E) {
+    return c.a * (cos(E) - c.e) * c.p + c.b * sin(E) * c.q;
+}
+
+static double true_anomaly(const Ellipse& c, double E) {
+    return 2. * atan2(sqrt(1. + c.e) * sin(E / 2.), sqrt(1. - c.e) * cos(E / 2.));
+}
+
+static double closest_point(const Ellipse& c, glm::dvec3 point, double* E) {
+    /* Closest point of the ellipse to point, among the stationary points of
+     * the distance, which are the roots of a quartic in exp(i E) */
+    // (point - r(E)) . r'(E) = α cos E + β sin E + γ sin E cos E
+    double alpha = c.b * glm::dot(point, c.q);
+    double beta = -c.a * glm::dot(point, c.p) - c.a * c.a * c.e;
+    double gamma = c.a * c.a * c.e * c.e;
+    Complex i(0., 1.);
+    Complex coefficients[5] = {
+        -gamma / (4. * i),
+        alpha / 2. - beta / (2. * i),
+        0.,
+        alpha / 2. + beta / (2. * i),
+        gamma / (4. * i),
+    };
+    double angles[4];
+    size_t n_angles = unit_circle_roots(coefficients, 4, angles);
+
+    *E = 0.;
+    double best = INFINITY;
+    for (size_t k = 0; k < n_angles; k += 1) {
+        double distance = glm::distance(point, ellipse_position(c, angles[k]));
+        if (distance < best) {
+            best = distance;
+            *E = angles[k];
+        }
+    }
+    if (n_angles == 0) {  // every point of a circle, seen from its axis
+        *E = 0.;
+        best = glm::distance(point, ellipse_position(c, 0.));
+    }
+    return best;
+}
+
+static double resultant(const Ellipse& a, const Ellipse& b, double Ea, double* bound) {
+    /* Resultant in tan(Eb/2) of the derivatives of the squared distance with
+     * respect to Ea and Eb; bound receives Hadamard's bound of its value */
+    glm::dvec3 ra = ellipse_position(a, Ea);
+    glm::dvec3 dra = -a.a * sin(Ea) * a.p + a.b * cos(Ea) * a.q;
+
+    // (ra - rb) . rb' = α cos Eb + β sin Eb + γ sin Eb cos Eb, quartic in t
+    double alpha = b.b * glm::dot(ra, b.q);
+    double beta = -b.a * glm::dot(ra, b.p) - b.a * b.a * b.e;
+    double gamma = b.a * b.a * b.e * b.e;
+    double p[5] = {alpha, 2. * (beta + gamma), 0., 2. * (beta - gamma), -alpha};
+
+    // (ra - rb) . ra' = c0 + c1 cos Eb + c2 sin Eb, quadratic in t
+    double c0 = glm::dot(ra, dra) + b.a * b.e * glm::dot(b.p, dra);
+    double c1 = -b.a * glm::dot(b.p, dra);
+    double c2 = -b.b * glm::dot(b.q, dra);
+    double q[3] = {c0 + c1, 2. * c2, c0 - c1};
+
+    // Sylvester matrix
+    double m[6 * 6] = {};
+    for (size_t row = 0; row < 2; row += 1) {
+        for (size_t k = 0; k < 5; k += 1) {
+            m[row * 6 + row + k] = p[4 - k];
+        }
+    }
+    for (size_t row = 0; row < 4; row += 1) {
+        for (size_t k = 0; k < 3; k += 1) {
+            m[(row + 2) * 6 + row + k] = q[2 - k];
+        }
+    }
+
+    double norm_p = 0.;
+    double norm_q = 0.;
+    for (size_t k = 0; k < 5; k += 1) {
+        norm_p += p[k] * p[k];
+    }
+    for (size_t k = 0; k < 3; k += 1) {
+        norm_q += q[k] * q[k];
+    }
+    *bound = norm_p * norm_q * norm_q;
+    return determinant(m, 6);
+}
+
+static double algebraic_moid(const Conic& a, const Conic& b, double* fa, double* fb) {
+    /* MOID between ellipses; NAN when the stationary points are not isolated
+     * (e.g. coplanar circles) */
+    double scale = fmax(a.semi_latus_rectum / (1. - a.eccentricity * a.eccentricity), b.semi_latus_rectum / (1. - b.eccentricity * b.eccentricity));
+    Ellipse ea = ellipse_from_conic(a, scale);
+    Ellipse eb = ellipse_from_conic(b, scale);
+
+    // sample the resultant
+    double values[MOID_RESULTANT_SAMPLES];
+    double largest = 0.;
+    double bound = 0.;
+    for (size_t j = 0; j < MOID_RESULTANT_SAMPLES; j += 1) {
+        double sample_bound;
+        values[j] = resultant(ea, eb, 2. * M_PI * (double) j / MOID_RESULTANT_SAMPLES, &sample_bound);
+        largest = fmax(largest, fabs(values[j]));
+        bound = fmax(bound, sample_bound);
+    }
+    if (!(largest > 1e-10 * bound)) {
+        return NAN;
+    }
+
+    // recover the coefficients in exp(i Ea), and find its roots
+    Complex twiddles[MOID_RESULTANT_SAMPLES];
+    for (size_t j = 0; j < MOID_RESULTANT_SAMPLES; j += 1) {
+        twiddles[j] = std::polar(1. / MOID_RESULTANT_SAMPLES, -2. * M_PI * (double) j / MOID_RESULTANT_SAMPLES);
+    }
+    Complex coefficients[2 * MOID_RESULTANT_DEGREE + 1];
+    for (size_t k = 0; k <= 2 * MOID_RESULTANT_DEGREE; k += 1) {
+        // frequency k - MOID_RESULTANT_DEGREE
+        size_t frequency = k + MOID_RESULTANT_SAMPLES - MOID_RESULTANT_DEGREE;
+        Complex c = 0.;
+        for (size_t j = 0; j < MOID_RESULTANT_SAMPLES; j += 1) {
+            c += values[j] * twiddles[frequency * j % MOID_RESULTANT_SAMPLES];
+        }
+        coefficients[k] = c;
+    }
+    double angles[2 * MOID_RESULTANT_DEGREE];
+    size_t n_angles = unit_circle_roots(coefficients, 2 * MOID_RESULTANT_DEGREE, angles);
+
+    // the closest points are among the stationary points, polished to
+    // absorb the error on the roots
+    double best = INFINITY;
+    for (size_t k = 0; k < n_angles; k += 1) {
+        double Eb = 0.;
+        closest_point(eb, ellipse_position(ea, angles[k]), &Eb);
+        double candidate_a = true_anomaly(ea, angles[k]);
+        double candidate_b = true_anomaly(eb, Eb);
+        double distance = refine(a, b, &candidate_a, &candidate_b);
+        if (distance < best) {
+            best = distance;
+            *fa = candidate_a;
+            *fb = candidate_b;
+        }
+    }
+    // e.g. no root, or only NaN distances: the anomalies were not set
+    return std::isfinite(best) ? best : NAN;
+}
+
+static double conic_moid(const Conic& a, const ConicGrid& grid_a, const Conic& b, const ConicGrid& grid_b, double max_distance, double* fa, double* fb) {
+    /* Return INFINITY when the MOID is known to exceed max_distance */
+    if (max_distance < INFINITY && grid_lower_bound(grid_a, grid_b) > max_distance) {
+        return INFINITY;
+    }
+
+    if (a.eccentricity < 1. && b.eccentricity < 1.) {
+        double candidate_a, candidate_b;
+        double ret = algebraic_moid(a, b, &candidate_a, &candidate_b);
+        if (!std::isnan(ret)) {
+            if (fa != NULL) {
+                *fa = candidate_a;
+            }
+            if (fb != NULL) {
+                *fb = candidate_b;
+            }
+            return ret;
+        }
+    }
+    return grid_moid(a, grid_a, b, grid_b, fa, fb);
+}
+
+double moid(Orbit* a, Orbit* b, double* true_anomaly_a, double* true_anomaly_b) {
+    Conic conic_a = conic_from_orbit(a);
+    Conic conic_b = conic_from_orbit(b);
+    ConicGrid grid_a, grid_b;
+    conic_grid(conic_a, &grid_a);
+    conic_grid(conic_b, &grid_b);
+
+    double fa, fb;
+    double ret = conic_moid(conic_a, grid_a, conic_b, grid_b, INFINITY, &fa, &fb);
+    if (true_anomaly_a != NULL) {
+        *true_anomaly_a = remainder(fa, 2. * M_PI);
+    }
+    if (true_anomaly_b != NULL) {
+        *true_anomaly_b = remainder(fb, 2. * M_PI);
+    }
+    return ret;
+}
+
+void moid_batch_init(MoidBatch* batch, Orbit** orbits, size_t n_orbits) {
+    batch->n_orbits = n_orbits;
+    batch->semi_latus_rectum.resize(n_orbits);
+    batch->eccentricity.resize(n_orbits);
+    batch->periapsis.resize(n_orbits);
+    batch->apoapsis.resize(n_orbits);
+    batch->px.resize(n_orbits);
+    batch->py.resize(n_orbits);
+    batch->pz.resize(n_orbits);
+    batch->qx.resize(n_orbits);
+    batch->qy.resize(n_orbits);
+    batch->qz.resize(n_orbits);
+
+    for (size_t i = 0; i < n_orbits; i += 1) {
+        Orbit* o = orbits[i];
+        Conic c = conic_from_orbit(o);
+        batch->semi_latus_rectum[i] = c.semi_latus_rectum;
+        batch->eccentricity[i] = c.eccentricity;
+        batch->periapsis[i] = o->periapsis;
+        batch->apoapsis[i] = o->eccentricity < 1. ? o->apoapsis : INFINITY;
+        batch->px[i] = c.p[0];
+        batch->py[i] = c.p[1];
+        batch->pz[i] = c.p[2];
+        batch->qx[i] = c.q[0];
+        batch->qy[i] = c.q[1];
+        batch->qz[i] = c.q[2];
+    }
+}
+
+void moid_all_vs_one(const MoidBatch* batch, Orbit* orbit, double max_distance, double* moids) {
+    Conic conic = conic_from_orbit(orbit);
+    ConicGrid grid;
+    conic_grid(conic, &grid);
+    double periapsis = orbit->periapsis;
+    double apoapsis = orbit->eccentricity < 1. ? orbit->apoapsis : INFINITY;
+
+    parallel_for(batch->n_orbits, [&](size_t begin, size_t end) {
+        for (size_t i = begin; i < end; i += 1) {
+            // the shells of distances to the primary do not overlap
+            if (batch->periapsis[i] > apoapsis + max_distance || periapsis > batch->apoapsis[i] + max_distance) {
+                moids[i] = INFINITY;
+                continue;
+            }
+
+            Conic other = conic_from_batch(batch, i);
+            ConicGrid other_grid;
+            conic_grid(other, &other_grid);
+            moids[i] = conic_moid(other, other_grid, conic, grid, max_distance, NULL, NULL);
+        }
+    });
+}
+
+void moid_all_pairs(const MoidBatch* batch, double max_distance, std::vector<MoidPair>* pairs) {
+    // sweep by increasing periapsis: the shell of orbit i can only overlap
+    // those of the next orbits whose periapsis is below its apoapsis
+    size_t n = batch->n_orbits;
+    std::vector<size_t> order(n);
+    for (size_t i = 0; i < n; i += 1) {
+        order[i] = i;
+    }
+    std::sort(order.begin(), order.end(), [batch](size_t i, size_t j) {
+        return batch->periapsis[i] < batch->periapsis[j];
+    });
+
+    std::vector<ConicGrid> grids(n);
+    parallel_for(n, [&](size_t begin, size_t end) {
+        for (size_t i = begin; i < end; i += 1) {
+            conic_grid(conic_from_batch(batch, i), &grids[i]);
+        }
+    });
+
+    // each block of the sweep collects its own pairs
+    size_t n_blocks = std::min(n, (size_t) parallel_concurrency() * MOID_BLOCKS_PER_THREAD);
+    std::vector<std::vector<MoidPair>> block_pairs(n_blocks);
+    parallel_for(n_blocks, [&](size_t begin, size_t end) {
+        for (size_t block = begin; block < end; block += 1) {
+            for (size_t k = block; k < n; k += n_blocks) {
+                size_t i = order[k];
+                Conic conic_i = conic_from_batch(batch, i);
+                double limit = batch->apoapsis[i] + max_distance;
+                for (size_t l = k + 1; l < n && batch->periapsis[order[l]] <= limit; l += 1) {
+                    size_t j = order[l];
+                    Conic conic_j = conic_from_batch(batch, j);
+                    double distance = conic_moid(conic_i, grids[i], conic_j, grids[j], max_distance, NULL, NULL);
+                    if (distance < max_distance) {
+                        block_pairs[block].push_back({std::min(i, j), std::max(i, j), distance});
+                    }
+                }
+            }
+        }
+    });
+
+    pairs->clear();
+    for (auto& v : block_pairs) {
+        pairs->insert(pairs->end(), v.begin(), v.end());
+    }
+    std::sort(pairs->begin(), pairs->end(), [](const MoidPair& x, const MoidPair& y) {
+        return x.i < y.i || (x.i == y.i && x.j < y.j);
+    });
+}
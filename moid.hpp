@@ -0,0 +1,47 @@
+#ifndef MOID_HPP
+#define MOID_HPP
+
+#include "orbit.hpp"
+
+#include <vector>
+
+// minimum orbit intersection distance: the smallest distance between the
+// curves of two orbits around the same primary, wherever the objects are on
+// them; the true anomalies of the closest points are written when not NULL
+double moid(Orbit* a, Orbit* b, double* true_anomaly_a, double* true_anomaly_b);
+
+// orbit geometries laid out for screening many orbits at once; all orbits
+// must share the same primary
+struct MoidBatch {
+    size_t n_orbits;
+    std::vector<double> semi_latus_rectum;
+    std::vector<double> eccentricity;
+    std::vector<double> periapsis;
+    std::vector<double> apoapsis;  // INFINITY for open orbits
+    // unit vector towards periapsis, by component
+    std::vector<double> px;
+    std::vector<double> py;
+    std::vector<double> pz;
+    // unit vector a quarter of a turn further, by component
+    std::vector<double> qx;
+    std::vector<double> qy;
+    std::vector<double> qz;
+};
+
+struct MoidPair {
+    size_t i;
+    size_t j;
+    double moid;
+};
+
+void moid_batch_init(MoidBatch* batch, Orbit** orbits, size_t n_orbits);
+
+// MOID of every orbit of the batch with orbit; when the periapsis/apoapsis
+// shells of a pair are further than max_distance apart, the pair is skipped
+// and gets INFINITY
+void moid_all_vs_one(const MoidBatch* batch, Orbit* orbit, double max_distance, double* moids);
+// pairs (i < j) of orbits of the batch closer than max_distance, ordered by i
+// then j
+void moid_all_pairs(const MoidBatch* batch, double max_distance, std::vector<MoidPair>* pairs);
+
+#endif
@@ -0,0 +1,164 @@
+#ifndef OPTIMIZE_HPP
+#define OPTIMIZE_HPP
+
+#include <glm/glm.hpp>
+
+#include <cmath>
+#include <utility>
+
+#define INV_PHI 0.6180339887498949  // (1. / phi)
+#define INV_PHI_2 0.3819660112501051  // (1. / (phi*phi))
+
+// minimize f over [a, b] using Brent's method (golden section search with
+// parabolic interpolation steps); return the argument of the minimum and
+// store the minimum in *f_min when not NULL
+template<typename F>
+double minimize_brent(F f, double a, double b, double tolerance, double* f_min, int max_iterations=100) {
+    // x: best point so far, w: second best, v: previous value of w
+    double x = a + INV_PHI_2 * (b - a);
+    double w = x;
+    double v = x;
+    double f_x = f(x);
+    double f_w = f_x;
+    double f_v = f_x;
+    double step = 0.;  // last step
+    double step2 = 0.;  // step before last
+
+    for (int i = 0; i < max_iterations; i += 1) {
+        double m = (a + b) / 2.;
+        double tol1 = tolerance * fabs(x) + 1e-10;
+        double tol2 = 2. * tol1;
+        if (fabs(x - m) <= tol2 - (b - a) / 2.) {
+            break;
+        }
+
+        double u;
+        bool golden = true;
+        if (fabs(step2) > tol1) {
+            // try a parabolic fit through x, w and v
+            double r = (x - w) * (f_x - f_v);
+            double q = (x - v) * (f_x - f_w);
+            double p = (x - v) * q - (x - w) * r;
+            q = 2. * (q - r);
+            if (q > 0.) {
+                p = -p;
+            }
+            q = fabs(q);
+            // accept only if it falls within [a, b] and moves less than half
+            // the step before last
+            if (fabs(p) < fabs(q * step2 / 2.) && p > q * (a - x) && p < q * (b - x)) {
+                step2 = step;
+                step = p / q;
+                u = x + step;
+                if (u - a < tol2 || b - u < tol2) {
+                    step = x < m ? tol1 : -tol1;
+                }
+                golden = false;
+            }
+        }
+        if (golden) {
+            step2 = x < m ? b - x : a - x;
+            step = INV_PHI_2 * step2;
+        }
+
+        // do not evaluate closer than tol1 from x
+        u = fabs(step) >= tol1 ? x + step : x + (step > 0. ? tol1 : -tol1);
+        double f_u = f(u);
+
+        // update the bracket and the three best points
+        if (f_u <= f_x) {
+            if (u < x) {
+                b = x;
+            } else {
+                a = x;
+            }
+            v = w; f_v = f_w;
+            w = x; f_w = f_x;
+            x = u; f_x = f_u;
+        } else {
+            if (u < x) {
+                a = u;
+            } else {
+                b = u;
+            }
+            if (f_u <= f_w || w == x) {
+                v = w; f_v = f_w;
+                w = u; f_w = f_u;
+            } else if (f_u <= f_v || v == x || v == w) {
+                v = u; f_v = f_u;
+            }
+        }
+    }
+
+    if (f_min != NULL) {
+        *f_min = f_x;
+    }
+    return x;
+}
+
+// minimize f over the plane using the Nelder-Mead method, starting from the
+// simplex (x0, x0 + (step.x, 0), x0 + (0, step.y)); stop when the values at
+// the vertices of the simplex are within tolerance of each other; return the
+// argument of the minimum and store the minimum in *f_min when not NULL
+template<typename F>
+glm::dvec2 minimize_nelder_mead(F f, glm::dvec2 x0, glm::dvec2 step, double tolerance, double* f_min, int max_iterations=200) {
+    glm::dvec2 x[3] = {x0, x0 + glm::dvec2{step.x, 0.}, x0 + glm::dvec2{0., step.y}};
+    double f_x[3] = {f(x[0]), f(x[1]), f(x[2])};
+
+    for (int i = 0; i < max_iterations; i += 1) {
+        // order vertices so that f_x[0] <= f_x[1] <= f_x[2]
+        for (int j = 1; j < 3; j += 1) {
+            for (int k = j; k > 0 && !(f_x[k-1] <= f_x[k]); k -= 1) {
+                std::swap(x[k-1], x[k]);
+                std::swap(f_x[k-1], f_x[k]);
+            }
+        }
+        if (fabs(f_x[2] - f_x[0]) <= tolerance * (fabs(f_x[0]) + 1e-10)) {
+            break;
+        }
+
+        glm::dvec2 centroid = (x[0] + x[1]) / 2.;
+
+        // reflection
+        glm::dvec2 r = centroid + (centroid - x[2]);
+        double f_r = f(r);
+        if (f_r < f_x[0]) {
+            // expansion
+            glm::dvec2 e = centroid + 2. * (centroid - x[2]);
+            double f_e = f(e);
+            if (f_e < f_r) {
+                x[2] = e; f_x[2] = f_e;
+            } else {
+                x[2] = r; f_x[2] = f_r;
+            }
+        } else if (f_r < f_x[1]) {
+            x[2] = r; f_x[2] = f_r;
+        } else {
+            // contraction
+            glm::dvec2 c = centroid + (x[2] - centroid) / 2.;
+            double f_c = f(c);
+            if (f_c < f_x[2]) {
+                x[2] = c; f_x[2] = f_c;
+            } else {
+                // shrink towards the best vertex
+                for (int j = 1; j < 3; j += 1) {
+                    x[j] = x[0] + (x[j] - x[0]) / 2.;
+                    f_x[j] = f(x[j]);
+                }
+            }
+        }
+    }
+
+    int best = 0;
+    for (int j = 1; j < 3; j += 1) {
+        if (f_x[j] < f_x[best]) {
+            best = j;
+        }
+    }
+    if (f_min != NULL) {
+        *f_min = f_x[best];
+    }
+    return x[best];
+}
+
+#endif
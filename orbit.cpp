@@ -245,8 +245,10 @@ double orbit_eccentric_anomaly_at_mean_anomaly(Orbit* o, double mean_anomaly) {
             return M / (e - 1.);
         }
 
-        // Newton's method
-        double E = 1.;
+        // Newton's method; starting from E = 1 needs about one iteration per
+        // unit of E far from the periapsis, so start from the asymptotic
+        // solution instead
+        double E = copysign(log(2. * fabs(M) / e + 1.8), M);
         double previous_E = 0.;
         for (int i = 0; i < 30; i++) {
             double previous_previous_E = previous_E;
@@ -397,6 +399,15 @@ glm::dvec3 orbit_velocity_at_time(Orbit* o, double time) {
     return orbit_velocity_at_true_anomaly(o, f);
 }
 
+void orbit_state_at_time(Orbit* o, double time, glm::dvec3* position, glm::dvec3* velocity) {
+    double M = orbit_mean_anomaly_at_time(o, time);
+    double E = orbit_eccentric_anomaly_at_mean_anomaly(o, M);
+    double f = orbit_true_anomaly_at_eccentric_anomaly(o, E);
+    double distance = orbit_distance_at_true_anomaly(o, f);
+    *position = _position_from_distance_true_anomaly(o, distance, f);
+    *velocity = _velocity_from_distance_true_anomaly(o, distance, f);
+}
+
 double orbit_true_anomaly_at_escape(Orbit* o) {
     return orbit_true_anomaly_at_distance(o, o->primary->sphere_of_influence);
 }
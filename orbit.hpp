@@ -64,6 +64,8 @@ glm::dvec3 orbit_position_at_true_anomaly(Orbit* o, double true_anomaly);
 glm::dvec3 orbit_velocity_at_true_anomaly(Orbit* o, double true_anomaly);
 glm::dvec3 orbit_position_at_time        (Orbit* o, double time);
 glm::dvec3 orbit_velocity_at_time        (Orbit* o, double time);
+// solves Kepler's equation only once for both position and velocity
+void       orbit_state_at_time           (Orbit* o, double time, glm::dvec3* position, glm::dvec3* velocity);
 
 // more accuracy at edge of sphere of influence (especially for open orbits)
 double     orbit_true_anomaly_at_escape(Orbit* o);
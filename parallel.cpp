@@ -0,0 +1,56 @@
+#include "parallel.hpp"
+
+#include <algorithm>
+#include <vector>
+
+// MinGW's win32 thread model does not provide std::thread
+#if defined(_GLIBCXX_HAS_GTHREADS) || !defined(__GLIBCXX__)
+#define HAVE_THREADS
+#include <atomic>
+#include <thread>
+#endif
+
+unsigned parallel_concurrency(void) {
+#ifdef HAVE_THREADS
+    unsigned n = std::thread::hardware_concurrency();
+    return n == 0 ? 1 : n;
+#else
+    return 1;
+#endif
+}
+
+void parallel_for(size_t n, const std::function<void(size_t, size_t)>& f) {
+    if (n == 0) {
+        return;
+    }
+
+    unsigned n_threads = (unsigned) std::min((size_t) parallel_concurrency(), n);
+    if (n_threads <= 1) {
+        f(0, n);
+        return;
+    }
+
+#ifdef HAVE_THREADS
+    // several chunks per thread, for load balancing
+    size_t chunk = std::max((size_t) 1, n / (n_threads * 8));
+    std::atomic<size_t> next{0};
+    auto worker = [&]() {
+        while (1) {
+            size_t begin = next.fetch_add(chunk);
+            if (begin >= n) {
+                break;
+            }
+            f(begin, std::min(begin + chunk, n));
+        }
+    };
+
+    std::vector<std::thread> threads;
+    for (unsigned i = 1; i < n_threads; i += 1) {
+        threads.emplace_back(worker);
+    }
+    worker();
+    for (auto& thread : threads) {
+        thread.join();
+    }
+#endif
+}
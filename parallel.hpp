@@ -0,0 +1,15 @@
+#ifndef PARALLEL_HPP
+#define PARALLEL_HPP
+
+#include <cstddef>
+#include <functional>
+
+// number of threads used by parallel_for()
+unsigned parallel_concurrency(void);
+
+// call f(begin, end) on disjoint chunks covering [0, n); chunks are handed
+// out dynamically so that uneven workloads stay balanced; f must be
+// thread-safe; without thread support, this falls back to a single call
+void parallel_for(size_t n, const std::function<void(size_t, size_t)>& f);
+
+#endif
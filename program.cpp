@@ -0,0 +1,133 @@
+#include "program.hpp"
+
+#include "stream.hpp"
+
+extern "C" {
+#include "logging.h"
+}
+
+#include <vector>
+
+static Program* current_program = NULL;
+
+static struct {
+    size_t alignment;  // of the offsets of the blocks in the stream buffer
+    bool object_changed;
+    ObjectBlock object;
+} blocks;
+
+static void reflect_uniforms(Program* program) {
+    GLint n;
+    glGetProgramiv(program->id, GL_ACTIVE_UNIFORMS, &n);
+    GLint max_length;
+    glGetProgramiv(program->id, GL_ACTIVE_UNIFORM_MAX_LENGTH, &max_length);
+    std::vector<GLchar> name((size_t) max_length + 1);
+    for (GLint i = 0; i < n; i += 1) {
+        GLsizei length;
+        GLint size;
+        GLenum type;
+        glGetActiveUniform(program->id, (GLuint) i, (GLsizei) name.size(), &length, &size, &type, name.data());
+        std::string key(name.data(), (size_t) length);
+        GLint location = glGetUniformLocation(program->id, key.c_str());
+        program->uniforms[key] = location;
+        // arrays are listed as their first element
+        if (key.size() > 3 && key.compare(key.size() - 3, 3, "[0]") == 0) {
+            program->uniforms[key.substr(0, key.size() - 3)] = location;
+        }
+    }
+}
+
+static void bind_block(Program* program, const char* name, GLuint binding) {
+    GLuint index = glGetUniformBlockIndex(program->id, name);
+    if (index != GL_INVALID_INDEX) {
+        glUniformBlockBinding(program->id, index, binding);
+    }
+}
+
+static void reflect_attributes(Program* program) {
+    GLint n;
+    glGetProgramiv(program->id, GL_ACTIVE_ATTRIBUTES, &n);
+    GLint max_length;
+    glGetProgramiv(program->id, GL_ACTIVE_ATTRIBUTE_MAX_LENGTH, &max_length);
+    std::vector<GLchar> name((size_t) max_length + 1);
+    for (GLint i = 0; i < n; i += 1) {
+        GLsizei length;
+        GLint size;
+        GLenum type;
+        glGetActiveAttrib(program->id, (GLuint) i, (GLsizei) name.size(), &length, &size, &type, name.data());
+        std::string key(name.data(), (size_t) length);
+        program->attributes[key] = glGetAttribLocation(program->id, key.c_str());
+    }
+}
+
+Program* reflect_program(GLuint id) {
+    auto program = new Program;
+    program->id = id;
+    reflect_uniforms(program);
+    reflect_attributes(program);
+    bind_block(program, "View", BLOCK_VIEW);
+    bind_block(program, "Object", BLOCK_OBJECT);
+    DEBUG("[GLSL] Program %u has %zu uniforms and %zu attributes", id, program->uniforms.size(), program->attributes.size());
+    return program;
+}
+
+void delete_program(Program* program) {
+    if (program == NULL) {
+        return;
+    }
+    if (current_program == program) {
+        glUseProgram(0);
+        current_program = NULL;
+    }
+    glDeleteProgram(program->id);
+    delete program;
+}
+
+GLint program_uniform(Program* program, const char* name) {
+    auto search = program->uniforms.find(name);
+    return search == program->uniforms.end() ? -1 : search->second;
+}
+
+GLint program_attribute(Program* program, const char* name) {
+    auto search = program->attributes.find(name);
+    return search == program->attributes.end() ? -1 : search->second;
+}
+
+void program_use(Program* program) {
+    if (program == current_program) {
+        return;
+    }
+    glUseProgram(program == NULL ? 0 : program->id);
+    current_program = program;
+}
+
+Program* program_current(void) {
+    return current_program;
+}
+
+void uniform_blocks_init(void) {
+    GLint alignment;
+    glGetIntegerv(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &alignment);
+    blocks.alignment = (size_t) alignment;
+    blocks.object_changed = true;
+    blocks.object = {glm::mat4(1.f), glm::mat4(1.f), glm::vec4(1.f)};
+}
+
+void uniform_blocks_set_view(const ViewBlock* view) {
+    size_t offset = stream_write(view, sizeof(ViewBlock), blocks.alignment);
+    glBindBufferRange(GL_UNIFORM_BUFFER, BLOCK_VIEW, stream_buffer(), (GLintptr) offset, sizeof(ViewBlock));
+}
+
+ObjectBlock* uniform_blocks_object(void) {
+    blocks.object_changed = true;
+    return &blocks.object;
+}
+
+void uniform_blocks_flush(void) {
+    if (!blocks.object_changed) {
+        return;
+    }
+    size_t offset = stream_write(&blocks.object, sizeof(ObjectBlock), blocks.alignment);
+    glBindBufferRange(GL_UNIFORM_BUFFER, BLOCK_OBJECT, stream_buffer(), (GLintptr) offset, sizeof(ObjectBlock));
+    blocks.object_changed = false;
+}
@@ -0,0 +1,63 @@
+#ifndef PROGRAM_HPP
+#define PROGRAM_HPP
+
+#ifdef MSYS2
+#include <windef.h>
+#endif
+#include <GL/glew.h>
+
+#include <glm/glm.hpp>
+#include <string>
+#include <unordered_map>
+
+// linked program, with the locations of its active uniforms and attributes
+// reflected once; a location is -1 when the program does not use it
+struct Program {
+    GLuint id;
+    std::unordered_map<std::string, GLint> uniforms;
+    std::unordered_map<std::string, GLint> attributes;
+};
+
+// take ownership of a program returned by make_program()
+Program* reflect_program(GLuint id);
+void delete_program(Program* program);
+
+GLint program_uniform  (Program* program, const char* name);
+GLint program_attribute(Program* program, const char* name);
+
+// programs are only bound through program_use(), so that the bound one is
+// known without asking the driver; binding it again is free
+void     program_use(Program* program);
+Program* program_current(void);
+
+// binding points of the uniform blocks declared in data/shaders/uniforms.glsl
+#define BLOCK_VIEW   0
+#define BLOCK_OBJECT 1
+
+// std140 layout of the View block
+struct ViewBlock {
+    glm::mat4 view_matrix;
+    glm::mat4 projection_matrix;
+    glm::vec4 lighting_source;  // in view coordinates
+};
+
+// std140 layout of the Object block
+struct ObjectBlock {
+    glm::mat4 model_view_matrix;
+    glm::mat4 model_view_projection_matrix;
+    glm::vec4 color;
+};
+
+// the blocks are written to the stream buffer (see stream.hpp), which must
+// be initialized first
+void uniform_blocks_init(void);
+// write a view and bind it; meant to be done once per view and per frame,
+// whatever the programs used to draw it
+void uniform_blocks_set_view(const ViewBlock* view);
+// values of the Object block for the next draws, marked as changed
+ObjectBlock* uniform_blocks_object(void);
+// write the Object block if it changed since the last draw, and bind it at
+// its offset; to be called before each draw
+void uniform_blocks_flush(void);
+
+#endif
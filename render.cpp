@@ -10,11 +10,18 @@ extern "C" {
 
 #include "mesh.hpp"
 #include "model.hpp"
+#include "program.hpp"
+#include "stream.hpp"
 #include "text_panel.hpp"
 
 #define GLM_ENABLE_EXPERIMENTAL
 #include <glm/gtx/vector_angle.hpp>
 #include <glm/gtc/type_ptr.hpp>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <map>
+#include <tuple>
 #include <vector>
 
 using std::map;
@@ -29,26 +36,113 @@ static const float NEELDLE_MAX_ANGLE = (float) radians(-45.);
 static const int THUMBNAIL_SIZE = 250;
 static const double THUMBNAIL_RATIO_THRESHOLD = 50.;
 static const double THUMBNAIL_ALTITUDE_FACTOR = 3.;
+static const int THUMBNAIL_MARGIN = 10;
+static const int THUMBNAIL_SAMPLES = 4;  // as the window
+
+static const size_t HUD_ENCOUNTERS = 3;
+
+// levels of detail of the spheres of the bodies, coarsest first
+static const int BODY_LODS = 4;
+// projected diameters, in pixels, from which each finer level is used
+static const float BODY_LOD_PIXELS[BODY_LODS - 1] = {32.f, 128.f, 512.f};
+// bodies smaller than this on screen are drawn as points instead, and their
+// satellites are not drawn when their whole system is
+static const float BODY_MARKER_PIXELS = 2.f;
+static const float BODY_MARKER_SIZE = 3.f;
+
+// objects are picked up to this distance from the cursor, in pixels
+static const double PICK_TOLERANCE = 20.;
+static const int PICK_ORBIT_SEGMENTS = 128;
+
+// orbits are drawn with this many segments, from the vertex shader
+static const int ORBIT_SEGMENTS = 256;
+// flags and markers of an orbit instance, as in data/shaders/orbit.vert
+static const int ORBIT_OPEN = 1;
+static const int ORBIT_FOCUSED = 2;
+static const int ORBIT_MARKER_PERIAPSIS = 1;
+static const int ORBIT_MARKER_APOAPSIS = 2;
+static const int ORBIT_MARKER_ASCENDING_NODE = 4;
+static const int ORBIT_MARKER_DESCENDING_NODE = 8;
+
+// size of the ring buffer from which per-frame data is sub-allocated
+static const size_t STREAM_SIZE = 4 << 20;
+
+// per-instance attributes of a body, see data/shaders/body.vert
+struct BodyInstance {
+    glm::mat4 model;
+    float layer;
+};
+
+// bodies drawn with a single instanced call, their textures being layers of
+// a same array; bodies without any texture are batched with none
+struct BodyBatch {
+    bool cubemaps;  // six layers per body
+    GLuint texture_array;
+    std::vector<CelestialBody*> bodies;  // by layer
+    // visible bodies, by level of detail, rebuilt for each view
+    std::vector<BodyInstance> instances[BODY_LODS];
+    std::vector<BodyInstance> markers;
+};
+
+// where the texture of a body is
+struct BodySlot {
+    size_t batch;
+    float layer;
+};
+
+// side and near planes of a view frustum, in the frame of the scene; the far
+// plane does not clip anything with the logarithmic depth buffer
+struct Frustum {
+    glm::vec4 planes[5];
+};
+
+// what a view showed when it was last rendered, see pick()
+struct PickingView {
+    bool shown;
+    glm::dmat4 view_projection;  // from the frame of the scene
+    glm::dvec4 viewport;  // x, y, width and height, from the bottom left
+    double focal_length;  // in pixels
+    glm::dvec3 scene_origin;
+    double time;
+    bool show_helpers;
+};
+
+// best candidate of pick() so far
+struct Pick {
+    CelestialBody* object;
+    double distance;  // from the cursor, in pixels
+    double depth;
+};
+
+// per-instance attributes of an orbit, see data/shaders/orbit.vert
+struct OrbitInstance {
+    glm::mat4 model;
+    glm::vec4 shape;
+    glm::vec4 anomalies;
+    glm::vec4 markers;
+    glm::vec4 color;
+};
 
 struct RenderState {
-    // matrices
+    // matrices; view and projection are those of the current view
     glm::mat4 model_matrix;
     glm::mat4 view_matrix;
     glm::mat4 projection_matrix;
+    float view_height;  // in pixels
 
     // shaders
-    GLuint base_shader;
-    GLuint hud_shader;
-    GLuint skybox_shader;
-    GLuint cubemap_shader;
-    GLuint lighting_shader;
-    GLuint position_marker_shader;
-    GLuint star_glow_shader;
-    GLuint lens_flare_shader;
-    GLuint billboard_shader;
-
-    // VAOs
-    GLuint vao;
+    Program* base_shader;
+    Program* hud_shader;
+    Program* skybox_shader;
+    Program* cubemap_shader;
+    Program* lighting_shader;
+    Program* position_marker_shader;
+    Program* star_glow_shader;
+    Program* lens_flare_shader;
+    Program* billboard_shader;
+    Program* body_shader;
+    Program* body_marker_shader;
+    Program* orbit_shader;
 
     // meshes
     CubeMesh cube = CubeMesh(10.f);
@@ -56,8 +150,25 @@ struct RenderState {
     RectMesh square = RectMesh(1, 1);
     PointMesh point = PointMesh();
     RectMesh navball_marker_mesh = RectMesh(NAVBALL_MARKER_SIZE, -NAVBALL_MARKER_SIZE);
-    map<CelestialBody*, OrbitMesh> orbit_meshes;
-    map<CelestialBody*, OrbitApsesMesh> apses_meshes;
+    OrbitSystem position_markers;
+    // no vertex buffer, only the per-instance attributes of the orbits
+    GLuint orbit_vao;
+    std::vector<OrbitInstance> orbit_instances;  // reused between frames
+    // only used for instances, see set_body_instances(); the quad and ico
+    // spheres have no texture coordinates, so they only go with cubemaps
+    UVSphereMesh body_uv_spheres[BODY_LODS] = {
+        UVSphereMesh(1, 1), UVSphereMesh(1, 2), UVSphereMesh(1, 3), UVSphereMesh(1, 4),
+    };
+    IcoSphereMesh body_ico_sphere = IcoSphereMesh(1, 2);
+    QuadSphereMesh body_quad_spheres[BODY_LODS - 1] = {
+        QuadSphereMesh(1, 2), QuadSphereMesh(1, 3), QuadSphereMesh(1, 4),
+    };
+    PointMesh body_marker = PointMesh();
+    RectMesh body_impostor = RectMesh(2, 2);
+    // segments of the flight plan, rebuilt when it is replaced
+    std::deque<OrbitArcMesh> flight_plan_meshes;
+    std::vector<CelestialBody*> flight_plan_primaries;
+    size_t flight_plan_revision = SIZE_MAX;
 
     // textures
     GLuint star_glow_texture;
@@ -74,8 +185,13 @@ struct RenderState {
     GLuint radial_out_marker_texture;
     GLuint throttle_needle_texture;
 
+    // bodies without an orbit, drawn on their own
     map<CelestialBody*, GLuint> body_textures;
     map<CelestialBody*, GLuint> body_cubemaps;
+    // every other body
+    std::vector<BodyBatch> body_batches;
+    map<CelestialBody*, BodySlot> body_slots;
+    std::vector<BodyInstance> body_instances;  // reused between frames
 
     // models
     TextPanel general_info = TextPanel(5.f, 5.f);
@@ -84,49 +200,139 @@ struct RenderState {
 
     Model rocket_model;
 
-    bool picking_active = false;
-    size_t current_picking_name = 0;
-    std::vector<CelestialBody*> picking_objects;
+    // the thumbnail is rendered with multisampling, then resolved to a
+    // texture that is drawn every frame
+    GLuint thumbnail_framebuffer;
+    GLuint thumbnail_renderbuffers[2];  // color and depth
+    GLuint thumbnail_resolve_framebuffer;
+    GLuint thumbnail_texture;
+    // what the texture shows, see thumbnail_outdated()
+    bool thumbnail_valid = false;
+    double thumbnail_refreshed_at;  // real time
+    CelestialBody* thumbnail_focus;
+    double thumbnail_time;
+    double thumbnail_theta;
+    double thumbnail_phi;
+    bool thumbnail_helpers;
+    bool thumbnail_wireframe;
+    bool thumbnail_impostors;
+    // helpers that change without time moving, e.g. while paused
+    CelestialBody* thumbnail_target;
+    size_t thumbnail_flight_plan_revision;
+    size_t thumbnail_selected_node;
+    double thumbnail_intercept_time;
+    double thumbnail_encounter_time;
+
+    // views of the last frame, see pick()
+    PickingView main_picking_view;
+    PickingView thumbnail_picking_view;
 };
 
-RenderState* make_render_state(const map<std::string, CelestialBody*>& bodies, const std::string& textures_directory) {
+static void set_orbit_instances(RenderState* render_state, size_t base) {
+    /* Point the per-instance attributes of the orbits at where their
+     * instances were written in the stream buffer */
+    glBindVertexArray(render_state->orbit_vao);
+    glBindBuffer(GL_ARRAY_BUFFER, stream_buffer());
+
+    struct {
+        GLuint location;
+        GLint size;
+        size_t offset;
+    } attributes[] = {
+        {ATTRIBUTE_INSTANCE_MODEL + 0, 4, offsetof(OrbitInstance, model) + 0 * sizeof(glm::vec4)},
+        {ATTRIBUTE_INSTANCE_MODEL + 1, 4, offsetof(OrbitInstance, model) + 1 * sizeof(glm::vec4)},
+        {ATTRIBUTE_INSTANCE_MODEL + 2, 4, offsetof(OrbitInstance, model) + 2 * sizeof(glm::vec4)},
+        {ATTRIBUTE_INSTANCE_MODEL + 3, 4, offsetof(OrbitInstance, model) + 3 * sizeof(glm::vec4)},
+        {ATTRIBUTE_INSTANCE_ORBIT_SHAPE, 4, offsetof(OrbitInstance, shape)},
+        {ATTRIBUTE_INSTANCE_ORBIT_ANOMALIES, 4, offsetof(OrbitInstance, anomalies)},
+        {ATTRIBUTE_INSTANCE_ORBIT_MARKERS, 4, offsetof(OrbitInstance, markers)},
+        {ATTRIBUTE_INSTANCE_COLOR, 4, offsetof(OrbitInstance, color)},
+    };
+    for (auto& attribute : attributes) {
+        glEnableVertexAttribArray(attribute.location);
+        glVertexAttribPointer(attribute.location, attribute.size, GL_FLOAT, GL_FALSE, (GLsizei) sizeof(OrbitInstance), (GLvoid*) (base + attribute.offset));
+        glVertexAttribDivisor(attribute.location, 1);
+    }
+
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+}
+
+static void init_thumbnail(RenderState* render_state) {
+    glGenRenderbuffers(2, render_state->thumbnail_renderbuffers);
+    glBindRenderbuffer(GL_RENDERBUFFER, render_state->thumbnail_renderbuffers[0]);
+    glRenderbufferStorageMultisample(GL_RENDERBUFFER, THUMBNAIL_SAMPLES, GL_RGBA8, THUMBNAIL_SIZE, THUMBNAIL_SIZE);
+    glBindRenderbuffer(GL_RENDERBUFFER, render_state->thumbnail_renderbuffers[1]);
+    glRenderbufferStorageMultisample(GL_RENDERBUFFER, THUMBNAIL_SAMPLES, GL_DEPTH_COMPONENT24, THUMBNAIL_SIZE, THUMBNAIL_SIZE);
+    glBindRenderbuffer(GL_RENDERBUFFER, 0);
+
+    glGenFramebuffers(1, &render_state->thumbnail_framebuffer);
+    glBindFramebuffer(GL_FRAMEBUFFER, render_state->thumbnail_framebuffer);
+    glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, render_state->thumbnail_renderbuffers[0]);
+    glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, render_state->thumbnail_renderbuffers[1]);
+    if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE) {
+        CRITICAL("Incomplete framebuffer for the thumbnail");
+        exit(EXIT_FAILURE);
+    }
+
+    glGenTextures(1, &render_state->thumbnail_texture);
+    glBindTexture(GL_TEXTURE_2D, render_state->thumbnail_texture);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, THUMBNAIL_SIZE, THUMBNAIL_SIZE, 0, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    glBindTexture(GL_TEXTURE_2D, 0);
+
+    glGenFramebuffers(1, &render_state->thumbnail_resolve_framebuffer);
+    glBindFramebuffer(GL_FRAMEBUFFER, render_state->thumbnail_resolve_framebuffer);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, render_state->thumbnail_texture, 0);
+    if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE) {
+        CRITICAL("Incomplete framebuffer for the texture of the thumbnail");
+        exit(EXIT_FAILURE);
+    }
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+}
+
+RenderState* make_render_state(const Dict& bodies, const std::string& textures_directory) {
     auto render_state = new RenderState;
 
     // shaders
     DEBUG("Shaders compilation");
-    render_state->skybox_shader = make_program(2, "skybox", "logz");
-    render_state->cubemap_shader = make_program(4, "cubemap", "lighting", "picking", "logz");
-    render_state->lighting_shader = make_program(4, "base", "lighting", "picking", "logz");
-    render_state->position_marker_shader = make_program(4, "base", "position_marker", "picking", "logz");
-    render_state->base_shader = make_program(3, "base", "picking", "logz");
-    render_state->hud_shader = make_program(2, "base", "picking");
-    render_state->star_glow_shader = make_program(3, "base", "star_glow", "logz");
-    render_state->lens_flare_shader = make_program(3, "base", "lens_flare", "logz");
-    render_state->billboard_shader = make_program(2, "base", "billboard");
+    stream_init(STREAM_SIZE);
+    uniform_blocks_init();
+    render_state->skybox_shader = reflect_program(make_program(2, "skybox", "logz"));
+    render_state->cubemap_shader = reflect_program(make_program(3, "cubemap", "lighting", "logz"));
+    render_state->lighting_shader = reflect_program(make_program(3, "base", "lighting", "logz"));
+    render_state->position_marker_shader = reflect_program(make_program(3, "base", "position_marker", "logz"));
+    render_state->base_shader = reflect_program(make_program(2, "base", "logz"));
+    render_state->hud_shader = reflect_program(make_program(1, "base"));
+    render_state->star_glow_shader = reflect_program(make_program(3, "base", "star_glow", "logz"));
+    render_state->lens_flare_shader = reflect_program(make_program(3, "base", "lens_flare", "logz"));
+    render_state->billboard_shader = reflect_program(make_program(2, "base", "billboard"));
+    render_state->body_shader = reflect_program(make_program(3, "body", "lighting", "logz"));
+    render_state->body_marker_shader = reflect_program(make_program(2, "body", "logz"));
+    render_state->orbit_shader = reflect_program(make_program(2, "orbit", "logz"));
     DEBUG("Shaders compiled");
 
     // fix orientation of cubemap (e.g. Y up → Z up)
-    glUseProgram(render_state->cubemap_shader);
+    program_use(render_state->cubemap_shader);
     glm::mat4 cubemap_matrix = glm::mat4(1.f);
     cubemap_matrix = glm::rotate(cubemap_matrix, -M_PIf32/2.f, glm::vec3(1.f, 0.f, 0.f));
     cubemap_matrix = glm::rotate(cubemap_matrix, M_PIf32/2.f, glm::vec3(0.f, 0.f, 1.f));
-    GLint var = glGetUniformLocation(render_state->cubemap_shader, "cubemap_matrix");
+    GLint var = program_uniform(render_state->cubemap_shader, "cubemap_matrix");
+    glUniformMatrix4fv(var, 1, GL_FALSE, glm::value_ptr(cubemap_matrix));
+    program_use(render_state->body_shader);
+    var = program_uniform(render_state->body_shader, "cubemap_matrix");
     glUniformMatrix4fv(var, 1, GL_FALSE, glm::value_ptr(cubemap_matrix));
+    program_use(render_state->body_marker_shader);
+    glUniform1i(program_uniform(render_state->body_marker_shader, "markers"), 1);
 
-    // VAOs
-    glGenVertexArrays(1, &render_state->vao);
-    glBindVertexArray(render_state->vao);
+    program_use(render_state->orbit_shader);
+    glUniform1i(program_uniform(render_state->orbit_shader, "n_segments"), ORBIT_SEGMENTS);
 
     // meshes
-    for (auto key_value_pair : bodies) {
-        auto name = key_value_pair.first;
-        auto body = key_value_pair.second;
-        if (body->orbit == NULL) {
-            continue;
-        }
-        render_state->orbit_meshes.emplace(body, body->orbit);
-        render_state->apses_meshes.emplace(body, body->orbit);
-    }
+    glGenVertexArrays(1, &render_state->orbit_vao);
+    init_thumbnail(render_state);
 
     // textures
     DEBUG("Textures loading");
@@ -144,24 +350,92 @@ RenderState* make_render_state(const map<std::string, CelestialBody*>& bodies, c
     render_state->radial_out_marker_texture  = load_texture("data/textures/markers/Radial-out.png");
     render_state->throttle_needle_texture    = load_texture("data/textures/needle.png");
 
+    // batch the bodies by kind and size of texture, within the limit on the
+    // layers of an array (only 256 are guaranteed)
+    GLint max_layers;
+    glGetIntegerv(GL_MAX_ARRAY_TEXTURE_LAYERS, &max_layers);
+    map<std::tuple<bool, int, int>, size_t> batch_of_texture;
+    std::vector<std::vector<std::string>> batch_paths;
     for (auto key_value_pair : bodies) {
         auto body = key_value_pair.second;
 
         auto cubemap_path = textures_directory + "/" + std::string(body->name) + "/{}.jpg";
-        auto cubemap = load_cubemap(cubemap_path.c_str());
-        if (cubemap != 0) {
-            render_state->body_cubemaps[body] = cubemap;
+        auto texture_path = textures_directory + "/" + std::string(body->name) + ".jpg";
+
+        if (body->orbit == NULL) {
+            auto cubemap = load_cubemap(cubemap_path.c_str());
+            if (cubemap != 0) {
+                render_state->body_cubemaps[body] = cubemap;
+                continue;
+            }
+
+            auto texture = load_texture(texture_path.c_str());
+            if (texture != 0) {
+                render_state->body_textures[body] = texture;
+                continue;
+            }
+
+            WARNING("Missing texture for %s", body->name);
             continue;
         }
 
-        auto texture_path = textures_directory + "/" + std::string(body->name) + ".jpg";
-        auto texture = load_texture(texture_path.c_str());
-        if (texture != 0) {
-            render_state->body_textures[body] = texture;
-            continue;
+        bool cubemaps = false;
+        int width = 0;
+        int height = 0;
+        std::string path;
+        if (cubemap_size(cubemap_path.c_str(), &width, &height) == 0) {
+            cubemaps = true;
+            path = cubemap_path;
+        } else if (image_size(texture_path.c_str(), &width, &height) == 0) {
+            path = texture_path;
+        } else {
+            WARNING("Missing texture for %s", body->name);
+            width = height = 0;
         }
 
-        WARNING("Missing texture for %s", body->name);
+        size_t layers = cubemaps ? 6 : 1;
+        auto key = std::make_tuple(cubemaps, width, height);
+        auto search = batch_of_texture.find(key);
+        size_t i;
+        if (search == batch_of_texture.end() || (render_state->body_batches[search->second].bodies.size() + 1) * layers > (size_t) max_layers) {
+            i = render_state->body_batches.size();
+            batch_of_texture[key] = i;
+            render_state->body_batches.emplace_back();
+            render_state->body_batches[i].cubemaps = cubemaps;
+            render_state->body_batches[i].texture_array = 0;
+            batch_paths.emplace_back();
+        } else {
+            i = search->second;
+        }
+        render_state->body_slots[body] = {i, (float) (render_state->body_batches[i].bodies.size() * layers)};
+        render_state->body_batches[i].bodies.push_back(body);
+        batch_paths[i].push_back(path);
+    }
+
+    for (size_t i = 0; i < render_state->body_batches.size(); i += 1) {
+        BodyBatch* batch = &render_state->body_batches[i];
+        if (batch_paths[i][0].empty()) {
+            continue;
+        }
+        std::vector<const char*> paths;
+        for (auto& path : batch_paths[i]) {
+            paths.push_back(path.c_str());
+        }
+        std::vector<int> loaded(paths.size());
+        if (batch->cubemaps) {
+            batch->texture_array = load_cubemap_array(paths.size(), paths.data(), loaded.data());
+        } else {
+            batch->texture_array = load_texture_array(paths.size(), paths.data(), loaded.data());
+        }
+        if (batch->texture_array == 0) {
+            WARNING("Could not load the textures of %zu bodies", paths.size());
+            continue;
+        }
+        for (size_t j = 0; j < paths.size(); j += 1) {
+            if (!loaded[j]) {
+                WARNING("Could not load the texture of %s", batch->bodies[j]->name);
+            }
+        }
     }
     DEBUG("Textures loaded");
 
@@ -183,89 +457,81 @@ RenderState* make_render_state(const map<std::string, CelestialBody*>& bodies, c
 }
 
 void delete_render_state(RenderState* render_state) {
+    if (render_state == NULL) {
+        return;
+    }
+    delete_program(render_state->base_shader);
+    delete_program(render_state->hud_shader);
+    delete_program(render_state->skybox_shader);
+    delete_program(render_state->cubemap_shader);
+    delete_program(render_state->lighting_shader);
+    delete_program(render_state->position_marker_shader);
+    delete_program(render_state->star_glow_shader);
+    delete_program(render_state->lens_flare_shader);
+    delete_program(render_state->billboard_shader);
+    delete_program(render_state->body_shader);
+    delete_program(render_state->body_marker_shader);
+    delete_program(render_state->orbit_shader);
+    glDeleteVertexArrays(1, &render_state->orbit_vao);
+    glDeleteFramebuffers(1, &render_state->thumbnail_framebuffer);
+    glDeleteFramebuffers(1, &render_state->thumbnail_resolve_framebuffer);
+    glDeleteRenderbuffers(2, render_state->thumbnail_renderbuffers);
+    glDeleteTextures(1, &render_state->thumbnail_texture);
+    for (auto& batch : render_state->body_batches) {
+        glDeleteTextures(1, &batch.texture_array);
+    }
+    stream_delete();
     delete render_state;
 }
 
 const time_t J2000 = 946728000UL;  // 2000-01-01T12:00:00Z
 
 void set_color(float red, float green, float blue, float alpha=1.f) {
-    GLint program;
-    glGetIntegerv(GL_CURRENT_PROGRAM, &program);
-
-    GLint var = glGetUniformLocation(program, "u_color");
-    if (var >= 0) {
-        glUniform4f(var, red, green, blue, alpha);
-    }
+    uniform_blocks_object()->color = glm::vec4(red, green, blue, alpha);
 }
 
-static void use_program(GlobalState* state, GLuint program, bool zoom=true) {
-    glUseProgram(program);
-    reset_matrices(state, zoom);
-    set_color(1, 1, 1);
-
-    GLint var;
-
-    // lighting source
-    var = glGetUniformLocation(program, "lighting_source");
-    if (var >= 0) {
-        auto scene_origin = body_global_position_at_time(state->focus, state->time);
-        auto pos = body_global_position_at_time(state->root, state->time) - scene_origin;
-        auto pos2 = state->render_state->view_matrix * state->render_state->model_matrix * glm::vec4(pos[0], pos[1], pos[2], 1.0f);
-        glUniform3fv(var, 1, glm::value_ptr(pos2));
-    }
-
-    // picking
-    var = glGetUniformLocation(program, "picking_active");
-    if (var >= 0) {
-        glUniform1i(var, state->render_state->picking_active);
-        set_picking_name(state->render_state->current_picking_name);
-    }
+static void set_model_view(GlobalState* state, const glm::mat4& model_view) {
+    ObjectBlock* object = uniform_blocks_object();
+    object->model_view_matrix = model_view;
+    object->model_view_projection_matrix = state->render_state->projection_matrix * model_view;
 }
 
 static void update_matrices(GlobalState* state) {
-    GLint program;
-    glGetIntegerv(GL_CURRENT_PROGRAM, &program);
-
-    auto model_view = state->render_state->view_matrix * state->render_state->model_matrix;
-    GLint var = glGetUniformLocation(program, "model_view_matrix");
-    if (var >= 0) {
-        glUniformMatrix4fv(var, 1, GL_FALSE, glm::value_ptr(model_view));
-    }
-
-    auto proj = state->render_state->projection_matrix;
-    var = glGetUniformLocation(program, "projection_matrix");
-    if (var >= 0) {
-        glUniformMatrix4fv(var, 1, GL_FALSE, glm::value_ptr(proj));
-    }
-
-    auto model_view_projection = state->render_state->projection_matrix * model_view;
-    var = glGetUniformLocation(program, "model_view_projection_matrix");
-    if (var >= 0) {
-        glUniformMatrix4fv(var, 1, GL_FALSE, glm::value_ptr(model_view_projection));
-    }
+    set_model_view(state, state->render_state->view_matrix * state->render_state->model_matrix);
 }
 
-void reset_matrices(GlobalState* state, bool zoom) {
+static void use_program(GlobalState* state, Program* program) {
+    /* Bind program, and reset the model matrix and the color; the values
+     * of the view are already in their uniform block */
+    program_use(program);
     state->render_state->model_matrix = glm::mat4(1.0f);
+    update_matrices(state);
+    set_color(1, 1, 1);
+}
 
-    glm::mat4 view = glm::mat4(1.0f);
-    if (zoom) {
-        double d = state->view_altitude;
-        if (state->focus != NULL) {
-            d += state->focus->radius;
-        }
-        view = glm::translate(view, glm::vec3(0.f, 0.f, -d));
+static glm::mat4 camera_view(GlobalState* state) {
+    double d = state->view_altitude;
+    if (state->focus != NULL) {
+        d += state->focus->radius;
     }
+    glm::mat4 view = glm::translate(glm::mat4(1.0f), glm::vec3(0.f, 0.f, -d));
     view = glm::rotate(view, float(glm::radians(state->view_phi)), glm::vec3(1.0f, 0.0f, 0.0f));
     view = glm::rotate(view, float(glm::radians(state->view_theta)), glm::vec3(0.0f, 0.0f, 1.0f));
-    state->render_state->view_matrix = view;
-
-    int viewport[4];
-    glGetIntegerv(GL_VIEWPORT, viewport);
-    float aspect = float(viewport[2]) / float(viewport[3]);  // width / height
-    state->render_state->projection_matrix = glm::perspective(glm::radians(45.0f), aspect, .1f, 1e7f);
+    return view;
+}
 
-    update_matrices(state);
+static void set_view(GlobalState* state, const glm::mat4& view, const glm::mat4& projection, float height, const glm::vec3& star_position) {
+    /* Write the uniform block of a view, used by every draw until the next
+     * view; height is that of the viewport */
+    state->render_state->view_matrix = view;
+    state->render_state->projection_matrix = projection;
+    state->render_state->view_height = height;
+
+    ViewBlock block = {};
+    block.view_matrix = view;
+    block.projection_matrix = projection;
+    block.lighting_source = view * glm::vec4(star_position, 1.f);
+    uniform_blocks_set_view(&block);
 }
 
 static bool is_ancestor_of(CelestialBody* candidate, CelestialBody* target) {
@@ -284,11 +550,9 @@ static bool is_ancestor_of(CelestialBody* candidate, CelestialBody* target) {
 }
 
 static void render_skybox(GlobalState* state) {
-    if (state->render_state->picking_active) {
-        return;
-    }
-
-    use_program(state, state->render_state->skybox_shader, false);
+    // the skybox follows the camera, so only the rotation of the view applies
+    use_program(state, state->render_state->skybox_shader);
+    set_model_view(state, glm::mat4(glm::mat3(state->render_state->view_matrix)));
 
     glDisable(GL_DEPTH_TEST);
     glBindTexture(GL_TEXTURE_CUBE_MAP, state->render_state->skybox_texture);
@@ -297,26 +561,19 @@ static void render_skybox(GlobalState* state) {
     glEnable(GL_DEPTH_TEST);
 }
 
-static void set_body_matrices(GlobalState* state, CelestialBody* body, const glm::dvec3& scene_origin) {
+static glm::mat4 body_model_matrix(GlobalState* state, CelestialBody* body, const glm::vec3& position) {
     auto model = glm::mat4(1.f);
-    auto position = body_global_position_at_time(body, state->time) - scene_origin;
     model = glm::translate(model, glm::vec3(position));
     model = glm::scale(model, glm::vec3(float(body->radius)));
 
-    // axial tilt
-    if (body->positive_pole != NULL) {
-        double z_angle = body->positive_pole->ecliptic_longitude - M_PI / 2.;
-        model = glm::rotate(model, float(z_angle), glm::vec3(0.f, 0.f, 1.f));
-        double x_angle = body->positive_pole->ecliptic_latitude - M_PI / 2.;
-        model = glm::rotate(model, float(x_angle), glm::vec3(1.f, 0.f, 0.f));
-    }
-
-    // OpenGL use single precision while Python has double precision
-    // reducing modulo 2 PI in Python reduces loss of significance
-    double turn_fraction = fmod(state->time / abs(body->sidereal_day), 1.);
-    model = glm::rotate(model, 2.f * M_PIf32 * float(turn_fraction), glm::vec3(0.f, 0.f, 1.f));
+    // axial tilt and rotation, in double precision
+    model *= glm::mat4(glm::dmat4(body_orientation_at_time(body, state->time)));
+    return model;
+}
 
-    state->render_state->model_matrix = model;
+static void set_body_matrices(GlobalState* state, CelestialBody* body, const glm::dvec3& scene_origin) {
+    auto position = body_global_position_at_time(body, state->time) - scene_origin;
+    state->render_state->model_matrix = body_model_matrix(state, body, position);
     update_matrices(state);
 }
 
@@ -368,22 +625,183 @@ static void render_body(GlobalState* state, CelestialBody* body, const glm::dvec
 static void render_star(GlobalState* state, const glm::dvec3& scene_origin) {
     use_program(state, state->render_state->base_shader);
 
-    set_picking_object(state, state->root);
     render_body(state, state->root, scene_origin, false);
+}
+
+static Frustum view_frustum(RenderState* render_state) {
+    // the planes are combinations of the rows of the matrix
+    glm::mat4 m = glm::transpose(render_state->projection_matrix * render_state->view_matrix);
+    Frustum frustum = {{m[3] + m[0], m[3] - m[0], m[3] + m[1], m[3] - m[1], m[3] + m[2]}};
+    for (auto& plane : frustum.planes) {
+        plane /= glm::length(glm::vec3(plane));
+    }
+    return frustum;
+}
+
+static bool in_frustum(const Frustum& frustum, const glm::vec3& center, float radius) {
+    for (auto& plane : frustum.planes) {
+        if (glm::dot(glm::vec3(plane), center) + plane.w < -radius) {
+            return false;
+        }
+    }
+    return true;
+}
+
+static float projected_size(RenderState* render_state, const glm::vec3& center, float radius) {
+    /* Approximate diameter of a sphere on screen, in pixels */
+    float depth = -(render_state->view_matrix * glm::vec4(center, 1.f)).z;
+    if (depth <= radius) {
+        return INFINITY;
+    }
+    return radius / depth * render_state->projection_matrix[1][1] * render_state->view_height;
+}
+
+static void cull_bodies(GlobalState* state, CelestialBody* body, const glm::dvec3& scene_origin, const Frustum& frustum) {
+    /* Add the visible bodies of the system of body to their batches; the
+     * sphere of influence of a body bounds its whole system */
+    RenderState* render_state = state->render_state;
+    glm::vec3 center = body_global_position_at_time(body, state->time) - scene_origin;
+    float bound = (float) fmax(body->sphere_of_influence, body->radius);
+    if (!in_frustum(frustum, center, bound)) {
+        return;
+    }
+
+    auto search = render_state->body_slots.find(body);
+    float radius = (float) body->radius;
+    if (search != render_state->body_slots.end() && in_frustum(frustum, center, radius)) {
+        BodySlot slot = search->second;
+        BodyInstance instance = {body_model_matrix(state, body, center), slot.layer};
+
+        BodyBatch* batch = &render_state->body_batches[slot.batch];
+        float pixels = projected_size(render_state, center, radius);
+        if (pixels < BODY_MARKER_PIXELS) {
+            batch->markers.push_back(instance);
+        } else {
+            int lod = 0;
+            while (lod < BODY_LODS - 1 && pixels >= BODY_LOD_PIXELS[lod]) {
+                lod += 1;
+            }
+            batch->instances[lod].push_back(instance);
+        }
+    }
+
+    // the satellites would be lost in the marker of their primary
+    if (projected_size(render_state, center, bound) < BODY_MARKER_PIXELS) {
+        return;
+    }
+    for (size_t i = 0; i < body->n_satellites; i += 1) {
+        cull_bodies(state, body->satellites[i], scene_origin, frustum);
+    }
+}
 
-    clear_picking_object(state);
+static Mesh* body_mesh(RenderState* render_state, bool cubemaps, int lod) {
+    if (!cubemaps) {
+        return &render_state->body_uv_spheres[lod];
+    } else if (lod == 0) {
+        return &render_state->body_ico_sphere;
+    } else {
+        return &render_state->body_quad_spheres[lod - 1];
+    }
+}
+
+static void set_body_instances(Mesh* mesh, size_t base) {
+    /* Point the per-instance attributes of a mesh at the instances of a
+     * batch in the stream buffer; instanced draws with a base instance are
+     * not available */
+    glBindVertexArray(mesh->vao);
+    glBindBuffer(GL_ARRAY_BUFFER, stream_buffer());
+    GLsizei stride = (GLsizei) sizeof(BodyInstance);
+    for (GLuint i = 0; i < 4; i += 1) {
+        GLuint location = ATTRIBUTE_INSTANCE_MODEL + i;
+        size_t offset = base + offsetof(BodyInstance, model) + i * sizeof(glm::vec4);
+        glEnableVertexAttribArray(location);
+        glVertexAttribPointer(location, 4, GL_FLOAT, GL_FALSE, stride, (GLvoid*) offset);
+        glVertexAttribDivisor(location, 1);
+    }
+    glEnableVertexAttribArray(ATTRIBUTE_INSTANCE_LAYER);
+    glVertexAttribPointer(ATTRIBUTE_INSTANCE_LAYER, 1, GL_FLOAT, GL_FALSE, stride, (GLvoid*) (base + offsetof(BodyInstance, layer)));
+    glVertexAttribDivisor(ATTRIBUTE_INSTANCE_LAYER, 1);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
 }
 
 static void render_bodies(GlobalState* state, const glm::dvec3& scene_origin) {
-    for (auto key_value_pair : state->bodies) {
-        auto body = key_value_pair.second;
-        if (body == state->root) {
+    RenderState* render_state = state->render_state;
+
+    // visible bodies, by batch and level of detail
+    for (auto& batch : render_state->body_batches) {
+        for (auto& instances : batch.instances) {
+            instances.clear();
+        }
+        batch.markers.clear();
+    }
+    cull_bodies(state, state->root, scene_origin, view_frustum(render_state));
+
+    // their instances, the meshes first, in the order of the draws
+    auto& instances = render_state->body_instances;
+    instances.clear();
+    for (auto& batch : render_state->body_batches) {
+        for (auto& lod_instances : batch.instances) {
+            instances.insert(instances.end(), lod_instances.begin(), lod_instances.end());
+        }
+    }
+    for (auto& batch : render_state->body_batches) {
+        instances.insert(instances.end(), batch.markers.begin(), batch.markers.end());
+    }
+    size_t base = stream_write(instances.data(), instances.size() * sizeof(BodyInstance), sizeof(float));
+
+    // a draw per batch and level of detail, or per batch for impostors
+    Program* program = render_state->body_shader;
+    use_program(state, program);
+    GLint cubemaps = program_uniform(program, "cubemaps");
+    glUniform1i(program_uniform(program, "impostors"), state->body_impostors);
+    for (auto& batch : render_state->body_batches) {
+        glUniform1i(cubemaps, batch.cubemaps);
+        glBindTexture(GL_TEXTURE_2D_ARRAY, batch.texture_array);
+        if (state->body_impostors) {
+            size_t n = 0;
+            for (auto& lod_instances : batch.instances) {
+                n += lod_instances.size();
+            }
+            if (n == 0) {
+                continue;
+            }
+            set_body_instances(&render_state->body_impostor, base);
+            render_state->body_impostor.draw_instanced((int) n);
+            base += n * sizeof(BodyInstance);
+            continue;
+        }
+        for (int lod = 0; lod < BODY_LODS; lod += 1) {
+            size_t n = batch.instances[lod].size();
+            if (n == 0) {
+                continue;
+            }
+            Mesh* mesh = body_mesh(render_state, batch.cubemaps, lod);
+            set_body_instances(mesh, base);
+            mesh->draw_instanced((int) n);
+            base += n * sizeof(BodyInstance);
+        }
+    }
+
+    // then a draw per batch for the markers
+    program = render_state->body_marker_shader;
+    use_program(state, program);
+    cubemaps = program_uniform(program, "cubemaps");
+    glPointSize(BODY_MARKER_SIZE);
+    for (auto& batch : render_state->body_batches) {
+        size_t n = batch.markers.size();
+        if (n == 0) {
             continue;
         }
-        set_picking_object(state, body);
-        render_body(state, body, scene_origin);
-        clear_picking_object(state);
+        glUniform1i(cubemaps, batch.cubemaps);
+        glBindTexture(GL_TEXTURE_2D_ARRAY, batch.texture_array);
+        set_body_instances(&render_state->body_marker, base);
+        render_state->body_marker.draw_instanced((int) n);
+        base += n * sizeof(BodyInstance);
     }
+    glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+
+    // the rocket
+    use_program(state, render_state->lighting_shader);
 
     auto model = glm::mat4(1.f);
     auto position = body_global_position_at_time(state->rocket.orbit->primary, state->time)
@@ -394,10 +812,8 @@ static void render_bodies(GlobalState* state, const glm::dvec3& scene_origin) {
     state->render_state->model_matrix = model;
     update_matrices(state);
 
-    set_picking_object(state, &state->rocket);
     glBindTexture(GL_TEXTURE_2D, 0);
     state->render_state->rocket_model.draw();
-    clear_picking_object(state);
 }
 
 static double glow_size(double radius, double temperature, double distance) {
@@ -443,21 +859,34 @@ static GLuint init_lens_flare(void) {
         data[k++] = +s; data[k++] = +s; data[k++] = 0.f; data[k++] = l + 0.5f; data[k++] = 1.f; data[k++] = o;
     }
 
+    GLuint vao;
+    glGenVertexArrays(1, &vao);
+    glBindVertexArray(vao);
+
     GLuint vbo;
     glGenBuffers(1, &vbo);
     glBindBuffer(GL_ARRAY_BUFFER, vbo);
     glBufferData(GL_ARRAY_BUFFER, n, data, GL_STATIC_DRAW);
+
+    glEnableVertexAttribArray(ATTRIBUTE_POSITION);
+    glVertexAttribPointer(ATTRIBUTE_POSITION, 3, GL_FLOAT, GL_FALSE, 6 * (GLsizei) sizeof(float), NULL);
+    glEnableVertexAttribArray(ATTRIBUTE_TEXCOORD);
+    glVertexAttribPointer(ATTRIBUTE_TEXCOORD, 2, GL_FLOAT, GL_FALSE, 6 * (GLsizei) sizeof(float), (GLvoid*)(3 * sizeof(float)));
+    glEnableVertexAttribArray(ATTRIBUTE_OFFSET);
+    glVertexAttribPointer(ATTRIBUTE_OFFSET, 1, GL_FLOAT, GL_FALSE, 6 * (GLsizei) sizeof(float), (GLvoid*)(5 * sizeof(float)));
+
+    glBindVertexArray(0);
     glBindBuffer(GL_ARRAY_BUFFER, 0);
 
     free(data);
 
-    return vbo;
+    return vao;
 }
 
 static void render_lens_flare(GlobalState* state, const glm::dvec3& scene_origin) {
-    static GLuint lens_flare_vbo = 0;
-    if (lens_flare_vbo == 0) {
-        lens_flare_vbo = init_lens_flare();
+    static GLuint lens_flare_vao = 0;
+    if (lens_flare_vao == 0) {
+        lens_flare_vao = init_lens_flare();
     }
 
     auto position = body_global_position_at_time(state->root, state->time) - scene_origin;
@@ -471,33 +900,18 @@ static void render_lens_flare(GlobalState* state, const glm::dvec3& scene_origin
 
     float intensity = .2f;
 
-    use_program(state, state->render_state->lens_flare_shader);
-
-    glBindBuffer(GL_ARRAY_BUFFER, lens_flare_vbo);
-
-    GLint var = glGetAttribLocation(state->render_state->lens_flare_shader, "v_position");
-    glEnableVertexAttribArray(var);
-    glVertexAttribPointer(var, 3, GL_FLOAT, GL_FALSE, 6 * (GLsizei) sizeof(float), NULL);
-
-    var = glGetAttribLocation(state->render_state->lens_flare_shader, "v_texcoord");
-    if (var >= 0) {
-        glEnableVertexAttribArray(var);
-        glVertexAttribPointer(var, 2, GL_FLOAT, GL_FALSE, 6 * (GLsizei) sizeof(float), (GLvoid*)(3 * sizeof(float)));
-    }
-
-    var = glGetAttribLocation(state->render_state->lens_flare_shader, "v_offset");
-    if (var >= 0) {
-        glEnableVertexAttribArray(var);
-        glVertexAttribPointer(var, 1, GL_FLOAT, GL_FALSE, 6 * (GLsizei) sizeof(float), (GLvoid*)(5 * sizeof(float)));
-    }
+    Program* program = state->render_state->lens_flare_shader;
+    use_program(state, program);
+    glBindVertexArray(lens_flare_vao);
 
     glBindTexture(GL_TEXTURE_2D, state->render_state->lens_flare_texture);
-    glUniform2fv(glGetUniformLocation(state->render_state->lens_flare_shader, "u_dims"), 1, glm::value_ptr(dims));
-    glUniform3fv(glGetUniformLocation(state->render_state->lens_flare_shader, "u_light_source"), 1, glm::value_ptr(light_source));
-    glUniform1f(glGetUniformLocation(state->render_state->lens_flare_shader, "u_intensity"), intensity);
+    glUniform2fv(program_uniform(program, "u_dims"), 1, glm::value_ptr(dims));
+    glUniform3fv(program_uniform(program, "u_light_source"), 1, glm::value_ptr(light_source));
+    glUniform1f(program_uniform(program, "u_intensity"), intensity);
 
     glDisable(GL_DEPTH_TEST);
     glBlendFunc(GL_ONE, GL_ONE);
+    uniform_blocks_flush();
     glDrawArrays(GL_TRIANGLES, 0, 36);
     glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
     glEnable(GL_DEPTH_TEST);
@@ -506,10 +920,6 @@ static void render_lens_flare(GlobalState* state, const glm::dvec3& scene_origin
 }
 
 static void render_star_glow(GlobalState* state, const glm::dvec3& scene_origin, GLuint* occlusion_query_buffer) {
-    if (state->render_state->picking_active) {
-        return;
-    }
-
     // NOTE: the visibility of the star glow (and associated lens flare) is
     // decided using occlusion queries; this means querying the GPU for the
     // number of rendered samples, which stalls until the rendering is done; to
@@ -531,25 +941,26 @@ static void render_star_glow(GlobalState* state, const glm::dvec3& scene_origin,
     glm::vec4 z = {view * glm::vec4(0.f, 0.f, 1.f, 1.f)};
     glm::vec3 camera_z = {z[0], z[1], z[2]};
 
-    use_program(state, state->render_state->star_glow_shader);
+    Program* program = state->render_state->star_glow_shader;
+    use_program(state, program);
 
     float unNoiseZ = (float) abs(
             glm::dot(camera_right, glm::vec3(1.f, 3.f, 6.f))
             + glm::dot(camera_up, glm::vec3(1.f, 3.f, 6.f))
     );
 
-    glUniform3fv(glGetUniformLocation(state->render_state->star_glow_shader, "star_glow_position"), 1, glm::value_ptr(star_glow_position));
-    glUniform3fv(glGetUniformLocation(state->render_state->star_glow_shader, "camera_right"), 1, glm::value_ptr(camera_right));
-    glUniform3fv(glGetUniformLocation(state->render_state->star_glow_shader, "camera_up"), 1, glm::value_ptr(camera_up));
-    glUniform1f(glGetUniformLocation(state->render_state->star_glow_shader, "unNoiseZ"), unNoiseZ);
+    glUniform3fv(program_uniform(program, "star_glow_position"), 1, glm::value_ptr(star_glow_position));
+    glUniform3fv(program_uniform(program, "camera_right"), 1, glm::value_ptr(camera_right));
+    glUniform3fv(program_uniform(program, "camera_up"), 1, glm::value_ptr(camera_up));
+    glUniform1f(program_uniform(program, "unNoiseZ"), unNoiseZ);
 
     glDepthMask(GL_FALSE);
 
     // draw simple rect for occlusion checking
     double s = state->root->radius;
     glm::vec2 star_glow_size = {s, s};
-    glUniform1f(glGetUniformLocation(state->render_state->star_glow_shader, "visibility"), -1.f);
-    glUniform2fv(glGetUniformLocation(state->render_state->star_glow_shader, "star_glow_size"), 1, glm::value_ptr(star_glow_size));
+    glUniform1f(program_uniform(program, "visibility"), -1.f);
+    glUniform2fv(program_uniform(program, "star_glow_size"), 1, glm::value_ptr(star_glow_size));
     // Query for passed samples
     glBeginQuery(GL_SAMPLES_PASSED, *occlusion_query_buffer);
     state->render_state->point.draw();
@@ -562,8 +973,8 @@ static void render_star_glow(GlobalState* state, const glm::dvec3& scene_origin,
     double d = glm::length(star_glow_position - camera_z);
     s = glow_size(state->root->radius, state->star_temperature, d);
     star_glow_size = {s, s};
-    glUniform1f(glGetUniformLocation(state->render_state->star_glow_shader, "visibility"), 1.f);
-    glUniform2fv(glGetUniformLocation(state->render_state->star_glow_shader, "star_glow_size"), 1, glm::value_ptr(star_glow_size));
+    glUniform1f(program_uniform(program, "visibility"), 1.f);
+    glUniform2fv(program_uniform(program, "star_glow_size"), 1, glm::value_ptr(star_glow_size));
     glBindTexture(GL_TEXTURE_2D, state->render_state->star_glow_texture);
     state->render_state->square.draw();
     glBindTexture(GL_TEXTURE_2D, 0);
@@ -580,13 +991,179 @@ static void render_position_markers(GlobalState* state, const glm::dvec3& scene_
     glPointSize(20);
     use_program(state, state->render_state->position_marker_shader);
     set_color(1, 0, 0, .5);
-    OrbitSystem(state->root, scene_origin, state->time).draw();
+    auto& markers = state->render_state->position_markers;
+    markers.update(state->root, scene_origin, state->time);
+    markers.draw();
 }
 
-static void render_orbits(GlobalState* state, const glm::dvec3& scene_origin) {
-    use_program(state, state->render_state->base_shader);
+static const Encounter* next_encounter(GlobalState* state) {
+    if (state->target == NULL || state->target->orbit == NULL) {
+        return NULL;
+    }
+    if (state->target->orbit->primary != state->rocket.orbit->primary) {
+        return NULL;
+    }
+    for (auto& encounter : state->encounters) {
+        if (encounter.time >= state->time) {
+            return &encounter;
+        }
+    }
+    return NULL;
+}
+
+static void render_encounter_markers(GlobalState* state, const glm::dvec3& scene_origin) {
+    // where the rocket and the target will be at the next closest approach
+    auto encounter = next_encounter(state);
+    if (encounter == NULL) {
+        return;
+    }
+
+    auto origin = body_global_position_at_time(state->rocket.orbit->primary, state->time) - scene_origin;
+    glPointSize(10);
+
+    auto position = origin + orbit_position_at_time(state->rocket.orbit, encounter->time);
+    state->render_state->model_matrix = glm::translate(glm::mat4(1.f), glm::vec3(position));
+    update_matrices(state);
+    set_color(0, 1, 1);
+    state->render_state->point.draw();
+
+    position = origin + orbit_position_at_time(state->target->orbit, encounter->time);
+    state->render_state->model_matrix = glm::translate(glm::mat4(1.f), glm::vec3(position));
+    update_matrices(state);
+    set_color(1, 0, 0);
+    state->render_state->point.draw();
 
     glPointSize(5);
+}
+
+static void render_flight_plan(GlobalState* state, const glm::dvec3& scene_origin) {
+    FlightPlan* plan = &state->flight_plan;
+    RenderState* render_state = state->render_state;
+
+    if (render_state->flight_plan_revision != state->flight_plan_revision) {
+        render_state->flight_plan_meshes.clear();
+        render_state->flight_plan_primaries.clear();
+        for (size_t k = 0; k < plan->legs.size(); k += 1) {
+            // the first conic is the current orbit, which is already drawn
+            for (size_t i = k == 0 ? 1 : 0; i < plan->legs[k].size(); i += 1) {
+                ConicSegment* segment = &plan->legs[k][i];
+                render_state->flight_plan_meshes.emplace_back(&segment->orbit, segment->time_start, segment->time_end);
+                render_state->flight_plan_primaries.push_back(segment->orbit.primary);
+            }
+        }
+        render_state->flight_plan_revision = state->flight_plan_revision;
+    }
+
+    // segments, from the current position of their primaries
+    set_color(1, .5f, 0);
+    for (size_t i = 0; i < render_state->flight_plan_meshes.size(); i += 1) {
+        auto position = body_global_position_at_time(render_state->flight_plan_primaries[i], state->time) - scene_origin;
+        render_state->model_matrix = glm::translate(glm::mat4(1.f), glm::vec3(position));
+        update_matrices(state);
+        render_state->flight_plan_meshes[i].draw();
+    }
+
+    // nodes, at the end of the leg before them
+    glPointSize(10);
+    for (size_t k = 0; k < plan->nodes.size() && k < plan->legs.size(); k += 1) {
+        ConicSegment* segment = &plan->legs[k].back();
+        auto position = body_global_position_at_time(segment->orbit.primary, state->time) - scene_origin;
+        position += orbit_position_at_time(&segment->orbit, segment->time_end);
+        render_state->model_matrix = glm::translate(glm::mat4(1.f), glm::vec3(position));
+        update_matrices(state);
+        if (k == state->selected_node) {
+            set_color(1, 1, 1);
+        } else {
+            set_color(1, .5f, 0);
+        }
+        render_state->point.draw();
+    }
+    glPointSize(5);
+}
+
+static void render_intercept_marker(GlobalState* state, const glm::dvec3& scene_origin) {
+    if (!state->intercept_found) {
+        return;
+    }
+
+    // where the suggested burn happens, on the current orbit
+    Orbit* orbit = state->rocket.orbit;
+    auto position = body_global_position_at_time(orbit->primary, state->time) - scene_origin;
+    position += orbit_position_at_time(orbit, state->intercept.node.time);
+    state->render_state->model_matrix = glm::translate(glm::mat4(1.f), glm::vec3(position));
+    update_matrices(state);
+    glPointSize(10);
+    set_color(1, 0, 1);
+    state->render_state->point.draw();
+    glPointSize(5);
+}
+
+static void add_orbit(GlobalState* state, Orbit* orbit, const glm::dvec3& origin, bool focused, const glm::vec4& color) {
+    /* Instance of an orbit around origin, relative to the scene; when
+     * focused, origin is the body itself and the orbit is drawn from it */
+    RenderState* render_state = state->render_state;
+
+    double mean_anomaly = orbit_mean_anomaly_at_time(orbit, state->time);
+    double eccentric_anomaly = orbit_eccentric_anomaly_at_mean_anomaly(orbit, mean_anomaly);
+    double true_anomaly = orbit_true_anomaly_at_eccentric_anomaly(orbit, eccentric_anomaly);
+
+    // NOTE: the nodes are named after what the markers show
+    double ascending_true_anomaly = 2 * M_PI - orbit->argument_of_periapsis;
+    double descending_true_anomaly = fmod(3 * M_PI - orbit->argument_of_periapsis, 2 * M_PI);
+
+    int flags = focused ? ORBIT_FOCUSED : 0;
+    int markers = 0;
+    double line_start = true_anomaly;
+    double line_end = 0.;
+    if (orbit->apoapsis > orbit->primary->sphere_of_influence || orbit->eccentricity > 1.) {  // escaping orbit
+        flags |= ORBIT_OPEN;
+
+        // from the body, brought to [-PI, PI], to the sphere of influence
+        // TODO: handle no sphere of influence
+        line_start = fmod2(true_anomaly, 2 * M_PI);
+        if (line_start > M_PI) {
+            line_start -= 2 * M_PI;
+        }
+        line_end = orbit_true_anomaly_at_escape(orbit);
+
+        // only show the markers on the remaining trajectory
+        // NOTE: 0 ≤ ν < 2π with q at 0 and Q at π
+        if (true_anomaly > M_PI) {
+            markers |= ORBIT_MARKER_PERIAPSIS;
+        }
+        if (true_anomaly < M_PI ?
+                true_anomaly < ascending_true_anomaly && ascending_true_anomaly < line_end :
+                true_anomaly < ascending_true_anomaly || ascending_true_anomaly < line_end
+        ) {
+            markers |= ORBIT_MARKER_ASCENDING_NODE;
+        }
+        if (true_anomaly < M_PI ?
+                true_anomaly < descending_true_anomaly && descending_true_anomaly < line_end :
+                true_anomaly < descending_true_anomaly || descending_true_anomaly < line_end
+        ) {
+            markers |= ORBIT_MARKER_DESCENDING_NODE;
+        }
+    } else {  // non-escaping closed orbit
+        if (orbit->eccentricity >= 5e-4) {  // not an almost circular orbit
+            markers |= ORBIT_MARKER_PERIAPSIS | ORBIT_MARKER_APOAPSIS;
+        }
+        if (orbit->inclination >= 5e-4) {  // somewhat inclined orbit
+            markers |= ORBIT_MARKER_ASCENDING_NODE | ORBIT_MARKER_DESCENDING_NODE;
+        }
+    }
+
+    OrbitInstance instance;
+    instance.model = glm::translate(glm::mat4(1.f), glm::vec3(origin)) * glm::mat4(glm::toMat4(orbit->orientation));
+    instance.shape = glm::vec4(glm::dvec4(orbit->semi_latus_rectum, orbit->eccentricity, orbit->semi_major_axis, orbit->semi_minor_axis));
+    instance.anomalies = glm::vec4(glm::dvec4(line_start, line_end, cos(eccentric_anomaly - M_PI), sin(eccentric_anomaly - M_PI)));
+    instance.markers = glm::vec4(glm::dvec4(ascending_true_anomaly, descending_true_anomaly, markers, flags));
+    instance.color = color;
+    render_state->orbit_instances.push_back(instance);
+}
+
+static void render_orbits(GlobalState* state, const glm::dvec3& scene_origin) {
+    RenderState* render_state = state->render_state;
+    render_state->orbit_instances.clear();
 
     // unfocused orbits
     for (auto key_value_pair : state->bodies) {
@@ -597,24 +1174,9 @@ static void render_orbits(GlobalState* state, const glm::dvec3& scene_origin) {
         if (body->orbit == NULL) {
             continue;
         }
-
-        // transform matrices
         auto position = body_global_position_at_time(body->orbit->primary, state->time) - scene_origin;
-        state->render_state->model_matrix = glm::translate(glm::mat4(1.f), glm::vec3(position));
-        update_matrices(state);
-
-        // select color
-        if (body == state->target) {
-            set_color(1, 0, 0, .3f);
-        } else {
-            set_color(1, 1, 0, .1f);
-        }
-
-        // draw
-        set_picking_object(state, body);
-        state->render_state->orbit_meshes.at(body).draw();
-        state->render_state->apses_meshes.at(body).draw();
-        clear_picking_object(state);
+        glm::vec4 color = body == state->target ? glm::vec4(1, 0, 0, .3f) : glm::vec4(1, 1, 0, .1f);
+        add_orbit(state, body->orbit, position, false, color);
     }
 
     // focused orbits
@@ -623,47 +1185,40 @@ static void render_orbits(GlobalState* state, const glm::dvec3& scene_origin) {
         if (body == state->root || !is_ancestor_of(body, state->focus)) {
             continue;
         }
-
-        // transform matrices
         auto position = body_global_position_at_time(body, state->time) - scene_origin;
-        state->render_state->model_matrix = glm::translate(glm::mat4(1.f), glm::vec3(position[0], position[1], position[2]));
-        update_matrices(state);
-
-        // select color
-        if (body == state->target) {
-            set_color(1, 0, 0);
-        } else {
-            set_color(1, 1, 0);
-        }
-
-        // draw
-        set_picking_object(state, body);
-        OrbitMesh(body->orbit, state->time, true).draw();
-        OrbitApsesMesh(body->orbit, state->time, true).draw();
-        clear_picking_object(state);
+        glm::vec4 color = body == state->target ? glm::vec4(1, 0, 0, 1) : glm::vec4(1, 1, 0, 1);
+        add_orbit(state, body->orbit, position, true, color);
     }
 
     // rocket
     CelestialBody* body = &state->rocket;
-
-    set_color(0, 1, 1);
-    set_picking_object(state, body);
     if (body == state->focus) {
         auto position = body_global_position_at_time(body, state->time) - scene_origin;
-        state->render_state->model_matrix = glm::translate(glm::mat4(1.f), glm::vec3(position[0], position[1], position[2]));
-        update_matrices(state);
-
-        OrbitMesh(body->orbit, state->time, true).draw();
-        OrbitApsesMesh(body->orbit, state->time, true).draw();
+        add_orbit(state, body->orbit, position, true, glm::vec4(0, 1, 1, 1));
     } else {
         auto position = body_global_position_at_time(body->orbit->primary, state->time) - scene_origin;
-        state->render_state->model_matrix = glm::translate(glm::mat4(1.f), glm::vec3(position[0], position[1], position[2]));
-        update_matrices(state);
-
-        OrbitMesh(body->orbit, state->time).draw();
-        OrbitApsesMesh(body->orbit, state->time).draw();
+        add_orbit(state, body->orbit, position, false, glm::vec4(0, 1, 1, 1));
     }
-    clear_picking_object(state);
+
+    // lines and markers of all the orbits, as two instanced draws
+    auto& instances = render_state->orbit_instances;
+    size_t offset = stream_write(instances.data(), instances.size() * sizeof(OrbitInstance), sizeof(float));
+    set_orbit_instances(render_state, offset);
+
+    Program* program = render_state->orbit_shader;
+    use_program(state, program);
+    uniform_blocks_flush();
+    GLint apses = program_uniform(program, "apses");
+    glUniform1i(apses, 0);
+    glDrawArraysInstanced(GL_LINE_STRIP, 0, ORBIT_SEGMENTS + 1, (GLsizei) instances.size());
+    glPointSize(5);
+    glUniform1i(apses, 1);
+    glDrawArraysInstanced(GL_POINTS, 0, 4, (GLsizei) instances.size());
+
+    use_program(state, render_state->base_shader);
+    render_encounter_markers(state, scene_origin);
+    render_flight_plan(state, scene_origin);
+    render_intercept_marker(state, scene_origin);
 }
 
 static void render_helpers(GlobalState* state, const glm::dvec3& scene_origin) {
@@ -732,6 +1287,44 @@ static void print_general_info(GlobalState* state, TextPanel* out) {
     out->print("Version " VERSION "\n");
 }
 
+static void print_maneuver_info(GlobalState* state, TextPanel* out) {
+    auto& nodes = state->maneuver_nodes;
+    if (nodes.empty()) {
+        return;
+    }
+
+    ManeuverNode* node = &nodes[state->selected_node];
+    out->print("\n");
+    out->print("> Maneuver %zu/%zu\n", state->selected_node + 1, nodes.size());
+    out->print("Time to burn      %14.1f s\n", node->time - state->time);
+    out->print("Prograde        %14.1f m/s\n", node->delta_v[0]);
+    out->print("Normal          %14.1f m/s\n", node->delta_v[1]);
+    out->print("Radial          %14.1f m/s\n", node->delta_v[2]);
+    out->print("Delta-v         %14.1f m/s\n", glm::length(node->delta_v));
+
+    // where the plan ends up
+    auto& legs = state->flight_plan.legs;
+    if (!legs.empty() && !legs.back().empty()) {
+        Orbit* orbit = &legs.back().back().orbit;
+        out->print("Final primary %s\n", orbit->primary->name);
+        out->print("Final periapsis   %14.1f m\n", orbit->periapsis);
+    }
+}
+
+static void print_intercept_info(GlobalState* state, TextPanel* out) {
+    if (!state->intercept_found) {
+        return;
+    }
+
+    Intercept* intercept = &state->intercept;
+    out->print("\n");
+    out->print("> Intercept %s\n", state->target->name);
+    out->print("Time to burn      %14.1f s\n", intercept->node.time - state->time);
+    out->print("Transfer duration %14.1f s\n", intercept->transfer_duration);
+    out->print("Burn delta-v    %14.1f m/s\n", glm::length(intercept->node.delta_v));
+    out->print("Total delta-v   %14.1f m/s\n", intercept->cost);
+}
+
 static void print_orbital_info(GlobalState* state, TextPanel* out) {
     auto orbit = state->rocket.orbit;
     bool circular = orbit->eccentricity < 5e-4;
@@ -816,7 +1409,20 @@ static void print_orbital_info(GlobalState* state, TextPanel* out) {
         auto tvel = body_global_velocity_at_time(state->target, state->time);
         out->print("Distance          %14.1f m\n", glm::length(tpos - cpos));
         out->print("Relative speed  %14.1f m/s\n", glm::length(tvel - cvel));
+
+        // upcoming closest approaches, starting from the next one
+        auto encounter = next_encounter(state);
+        if (encounter != NULL) {
+            out->print("Closest approaches\n");
+            auto end = state->encounters.data() + state->encounters.size();
+            for (size_t i = 0; i < HUD_ENCOUNTERS && encounter + i < end; i += 1) {
+                out->print("%14.1f s %15.1f m\n", encounter[i].time - state->time, encounter[i].distance);
+            }
+        }
     }
+
+    print_maneuver_info(state, out);
+    print_intercept_info(state, out);
 }
 
 static void render_navball_sphere(GlobalState* state) {
@@ -887,10 +1493,6 @@ static void render_navball_sphere(GlobalState* state) {
 static void render_navball_markers(GlobalState* state) {
     use_program(state, state->render_state->billboard_shader);
 
-    // use orthographic projection
-    state->render_state->view_matrix = glm::mat4(1.0f);
-    state->render_state->projection_matrix = glm::ortho(0.f, (float) state->window_width, (float) state->window_height, 0.f, -2e3f, 2e3f);
-
     // bottom center
     float w = (float) state->window_width;
     float h = (float) state->window_height;
@@ -949,11 +1551,6 @@ static void render_navball_markers(GlobalState* state) {
 static void render_navball_frame(GlobalState* state) {
     use_program(state, state->render_state->hud_shader);
 
-    // use orthographic projection
-    state->render_state->view_matrix = glm::mat4(1.0f);
-    state->render_state->projection_matrix = glm::ortho(0.f, (float) state->window_width, (float) state->window_height, 0.f, -2e3f, 2e3f);
-    update_matrices(state);
-
     // general information
     float w = (float) state->window_width;
     float h = (float) state->window_height;
@@ -1026,16 +1623,12 @@ static void render_hud(GlobalState* state) {
     if (!state->show_hud) {
         return;
     }
-    if (state->render_state->picking_active) {
-        return;
-    }
-
-    use_program(state, state->render_state->hud_shader);
 
     // use orthographic projection
-    state->render_state->view_matrix = glm::mat4(1.0f);
-    state->render_state->projection_matrix = glm::ortho(0.f, (float) state->window_width, (float) state->window_height, 0.f, -2e3f, 2e3f);
-    update_matrices(state);
+    auto projection = glm::ortho(0.f, (float) state->window_width, (float) state->window_height, 0.f, -2e3f, 2e3f);
+    set_view(state, glm::mat4(1.0f), projection, (float) state->window_height, glm::vec3(0.f));  // no lighting
+
+    use_program(state, state->render_state->hud_shader);
 
     state->render_state->general_info.clear();
     print_general_info(state, &state->render_state->general_info);
@@ -1052,11 +1645,130 @@ static void render_hud(GlobalState* state) {
     render_navball(state);
 }
 
+static void record_picking_view(GlobalState* state, PickingView* view, const glm::dvec4& viewport, const glm::dvec3& scene_origin) {
+    RenderState* render_state = state->render_state;
+    view->shown = true;
+    view->view_projection = glm::dmat4(render_state->projection_matrix * render_state->view_matrix);
+    view->viewport = viewport;
+    view->focal_length = render_state->projection_matrix[1][1] * viewport.w / 2.;
+    view->scene_origin = scene_origin;
+    view->time = state->time;
+    view->show_helpers = state->show_helpers;
+}
+
+static double intercept_marker_time(GlobalState* state) {
+    return state->intercept_found ? state->intercept.node.time : -INFINITY;
+}
+
+static double encounter_marker_time(GlobalState* state) {
+    auto encounter = next_encounter(state);
+    return encounter == NULL ? -INFINITY : encounter->time;
+}
+
+static bool thumbnail_outdated(GlobalState* state) {
+    /* Whether the view of the thumbnail changed since it was rendered; the
+     * scene moving with time only causes a refresh at the configured rate */
+    RenderState* render_state = state->render_state;
+    if (!render_state->thumbnail_valid) {
+        return true;
+    }
+    if (
+        state->focus != render_state->thumbnail_focus ||
+        state->view_theta != render_state->thumbnail_theta ||
+        state->view_phi != render_state->thumbnail_phi ||
+        state->show_helpers != render_state->thumbnail_helpers ||
+        state->show_wireframe != render_state->thumbnail_wireframe ||
+        state->body_impostors != render_state->thumbnail_impostors ||
+        state->target != render_state->thumbnail_target ||
+        state->flight_plan_revision != render_state->thumbnail_flight_plan_revision ||
+        state->selected_node != render_state->thumbnail_selected_node ||
+        intercept_marker_time(state) != render_state->thumbnail_intercept_time ||
+        encounter_marker_time(state) != render_state->thumbnail_encounter_time
+    ) {
+        return true;
+    }
+    if (state->time == render_state->thumbnail_time) {
+        return false;
+    }
+    if (state->thumbnail_refresh_rate <= 0.) {
+        return true;
+    }
+    return real_clock() - render_state->thumbnail_refreshed_at >= 1. / state->thumbnail_refresh_rate;
+}
+
+static void render_thumbnail(GlobalState* state, const glm::dvec3& scene_origin, const glm::vec3& star_position) {
+    /* Render the scene around the focus, from afar, to the texture of the
+     * thumbnail */
+    TRACE("Thumbnail render started");
+    RenderState* render_state = state->render_state;
+    glBindFramebuffer(GL_FRAMEBUFFER, render_state->thumbnail_framebuffer);
+    glViewport(0, 0, THUMBNAIL_SIZE, THUMBNAIL_SIZE);
+    glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+    double view_altitude = state->view_altitude;
+    state->view_altitude = state->focus->radius * THUMBNAIL_ALTITUDE_FACTOR;
+    auto projection = glm::perspective(glm::radians(45.0f), 1.f, .1f, 1e7f);
+    set_view(state, camera_view(state), projection, (float) THUMBNAIL_SIZE, star_position);
+    // where the texture is drawn
+    glm::dvec4 viewport(THUMBNAIL_MARGIN, THUMBNAIL_MARGIN, THUMBNAIL_SIZE, THUMBNAIL_SIZE);
+    record_picking_view(state, &render_state->thumbnail_picking_view, viewport, scene_origin);
+
+    render_skybox(state);
+    render_bodies(state, scene_origin);
+    static GLuint thumbnail_occlusion_query_buffer;
+    render_star_glow(state, scene_origin, &thumbnail_occlusion_query_buffer);
+    render_helpers(state, scene_origin);
+    render_star(state, scene_origin);
+
+    state->view_altitude = view_altitude;
+
+    // resolve the samples
+    glBindFramebuffer(GL_READ_FRAMEBUFFER, render_state->thumbnail_framebuffer);
+    glBindFramebuffer(GL_DRAW_FRAMEBUFFER, render_state->thumbnail_resolve_framebuffer);
+    glBlitFramebuffer(0, 0, THUMBNAIL_SIZE, THUMBNAIL_SIZE, 0, 0, THUMBNAIL_SIZE, THUMBNAIL_SIZE, GL_COLOR_BUFFER_BIT, GL_NEAREST);
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+
+    render_state->thumbnail_valid = true;
+    render_state->thumbnail_refreshed_at = real_clock();
+    render_state->thumbnail_focus = state->focus;
+    render_state->thumbnail_time = state->time;
+    render_state->thumbnail_theta = state->view_theta;
+    render_state->thumbnail_phi = state->view_phi;
+    render_state->thumbnail_helpers = state->show_helpers;
+    render_state->thumbnail_wireframe = state->show_wireframe;
+    render_state->thumbnail_impostors = state->body_impostors;
+    render_state->thumbnail_target = state->target;
+    render_state->thumbnail_flight_plan_revision = state->flight_plan_revision;
+    render_state->thumbnail_selected_node = state->selected_node;
+    render_state->thumbnail_intercept_time = intercept_marker_time(state);
+    render_state->thumbnail_encounter_time = encounter_marker_time(state);
+    TRACE("Thumbnail render finished");
+}
+
+static void draw_thumbnail(GlobalState* state) {
+    /* Draw the texture of the thumbnail in the bottom left corner */
+    RenderState* render_state = state->render_state;
+    auto projection = glm::ortho(0.f, (float) state->window_width, 0.f, (float) state->window_height, -1.f, 1.f);
+    set_view(state, glm::mat4(1.0f), projection, (float) state->window_height, glm::vec3(0.f));  // no lighting
+
+    use_program(state, render_state->hud_shader);
+    float center = (float) THUMBNAIL_MARGIN + (float) THUMBNAIL_SIZE / 2.f;
+    auto model = glm::translate(glm::mat4(1.f), glm::vec3(center, center, 0.f));
+    model = glm::scale(model, glm::vec3((float) THUMBNAIL_SIZE, (float) THUMBNAIL_SIZE, 1.f));
+    render_state->model_matrix = model;
+    update_matrices(state);
+
+    // the alpha of the texture is that left by blending within the thumbnail
+    glDisable(GL_DEPTH_TEST);
+    glDisable(GL_BLEND);
+    glBindTexture(GL_TEXTURE_2D, render_state->thumbnail_texture);
+    render_state->square.draw();
+    glBindTexture(GL_TEXTURE_2D, 0);
+    glEnable(GL_BLEND);
+    glEnable(GL_DEPTH_TEST);
+}
+
 void render(GlobalState* state) {
     TRACE("Render started");
-    if (state->render_state->picking_active) {
-        state->render_state->picking_objects.clear();
-    }
 
     glViewport(0, 0, state->window_width, state->window_height);
     glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
@@ -1074,8 +1786,15 @@ void render(GlobalState* state) {
         glPolygonMode(GL_FRONT_AND_BACK, GL_FILL);
     }
 
+    glm::vec3 star_position = body_global_position_at_time(state->root, state->time) - scene_origin;
+
     // main rendering
     TRACE("Main render started");
+    float aspect = float(state->window_width) / float(state->window_height);
+    auto projection = glm::perspective(glm::radians(45.0f), aspect, .1f, 1e7f);
+    set_view(state, camera_view(state), projection, (float) state->window_height, star_position);
+    glm::dvec4 viewport(0., 0., state->window_width, state->window_height);
+    record_picking_view(state, &state->render_state->main_picking_view, viewport, scene_origin);
     render_skybox(state);
     render_bodies(state, scene_origin);
     static GLuint main_occlusion_query_buffer;
@@ -1084,126 +1803,138 @@ void render(GlobalState* state) {
     render_star(state, scene_origin);
     TRACE("Main render dispatched");
 
-    // thumbnail rendering
-    if (state->view_altitude / state->focus->radius > THUMBNAIL_RATIO_THRESHOLD) {
-        TRACE("Thumbnail render started");
-        glViewport(10, 10, THUMBNAIL_SIZE, THUMBNAIL_SIZE);
-        glClear(GL_DEPTH_BUFFER_BIT);
-        double view_altitude = state->view_altitude;
-        state->view_altitude = state->focus->radius * THUMBNAIL_ALTITUDE_FACTOR;
-
-        render_skybox(state);
-        render_bodies(state, scene_origin);
-        static GLuint thumbnail_occlusion_query_buffer;
-        render_star_glow(state, scene_origin, &thumbnail_occlusion_query_buffer);
-        render_helpers(state, scene_origin);
-        render_star(state, scene_origin);
-
-        state->view_altitude = view_altitude;;
-        TRACE("Thumbnail render finished");
+    // thumbnail rendering, when outdated
+    bool show_thumbnail = state->view_altitude / state->focus->radius > THUMBNAIL_RATIO_THRESHOLD;
+    if (!show_thumbnail) {
+        state->render_state->thumbnail_valid = false;
+        state->render_state->thumbnail_picking_view.shown = false;
+    } else if (thumbnail_outdated(state)) {
+        render_thumbnail(state, scene_origin, star_position);
     }
 
     glViewport(0, 0, state->window_width, state->window_height);
     glClear(GL_DEPTH_BUFFER_BIT);
     glPolygonMode(GL_FRONT_AND_BACK, GL_FILL);
 
+    if (show_thumbnail) {
+        draw_thumbnail(state);
+    }
     render_hud(state);
+    stream_end_frame();
     TRACE("Render dispatched");
 }
 
-void set_picking_name(size_t name) {
-    GLint program;
-    glGetIntegerv(GL_CURRENT_PROGRAM, &program);
-
-    GLint var = glGetUniformLocation(program, "picking_name");
-    if (var >= 0) {
-        glUniform3f(
-            var,
-            float((name >> 16) & 0xff) / 255.f,
-            float((name >>  8) & 0xff) / 255.f,
-            float((name >>  0) & 0xff) / 255.f
-        );
+static bool to_screen(const PickingView* view, const glm::dvec3& position, glm::dvec2* pixel, double* depth) {
+    /* Where a point of the scene was in the window, in pixels from the
+     * bottom left; false when it was behind the camera */
+    glm::dvec4 clip = view->view_projection * glm::dvec4(position - view->scene_origin, 1.);
+    if (clip.w <= 0.) {
+        return false;
     }
+    glm::dvec2 ndc = glm::dvec2(clip.x, clip.y) / clip.w;
+    *pixel = glm::dvec2(view->viewport.x, view->viewport.y) + (ndc + 1.) / 2. * glm::dvec2(view->viewport.z, view->viewport.w);
+    *depth = clip.w;
+    return true;
 }
 
-void set_picking_object(GlobalState* state, CelestialBody* object) {
-    if (!state->render_state->picking_active) {
+static void consider(Pick* best, CelestialBody* object, double distance, double depth) {
+    if (distance > PICK_TOLERANCE) {
         return;
     }
-
-    state->render_state->picking_objects.push_back(object);
-    size_t name = state->render_state->picking_objects.size();
-    state->render_state->current_picking_name = name;
-    set_picking_name(name);
+    if (distance < best->distance || (distance == best->distance && depth < best->depth)) {
+        *best = {object, distance, depth};
+    }
 }
 
-void clear_picking_object(GlobalState* state) {
-    if (!state->render_state->picking_active) {
+static void pick_sphere(const PickingView* view, const glm::dvec2& cursor, CelestialBody* object, const glm::dvec3& center, double radius, Pick* best) {
+    glm::dvec2 pixel;
+    double depth;
+    if (!to_screen(view, center, &pixel, &depth)) {
+        return;
+    }
+    if (depth <= radius) {
+        consider(best, object, 0., 0.);
         return;
     }
-    state->render_state->current_picking_name = 0;
-    set_picking_name(0);
+    double pixel_radius = radius / depth * view->focal_length;
+    consider(best, object, fmax(glm::distance(pixel, cursor) - pixel_radius, 0.), depth);
 }
 
-CelestialBody* pick(GlobalState* state) {
-    // render with picking activated
-    state->render_state->picking_active = true;
-    glDisable(GL_MULTISAMPLE);
-    glDisable(GL_LINE_SMOOTH);
-    render(state);
-    glEnable(GL_LINE_SMOOTH);
-    glEnable(GL_MULTISAMPLE);
-    state->render_state->picking_active = false;
-
-    // search names in color components
-    const int search_radius = 20;
-
-    int cx = (int) state->cursor_x;
-    int cy = state->window_height - (int) state->cursor_y;
-
-    int min_x = std::max(cx - search_radius, 0);
-    int max_x = std::min(cx + search_radius, state->window_width - 1);
-    int min_y = std::max(cy - search_radius, 0);
-    int max_y = std::min(cy + search_radius, state->window_height - 1);
-
-    int w = max_x - min_x + 1;
-    int h = max_y - min_y + 1;
-
-    unsigned char* components = new unsigned char[h * w * 4];
-    glReadPixels(min_x, min_y, w, h, GL_RGBA,  GL_UNSIGNED_BYTE, components);
-
-    size_t name = 0;
-    int best_cursor_d2 = search_radius * search_radius;  // squared distance to cursor
-    for (int y = 0; y < h; y += 1) {
-        for (int x = 0; x < w; x += 1) {
-            size_t candidate_name = 0;
-            candidate_name |= ((size_t) components[(y*w + x)*4 + 0]) << 16;
-            candidate_name |= ((size_t) components[(y*w + x)*4 + 1]) <<  8;
-            candidate_name |= ((size_t) components[(y*w + x)*4 + 2]) <<  0;
-            if (candidate_name == 0) {
-                continue;
-            }
-            int dx = (x - w / 2);
-            int dy = (y - h / 2);
-            int cursor_d2 = dx * dx + dy * dy;
-            if (cursor_d2 > best_cursor_d2) {
-                continue;
-            }
-            name = candidate_name;
-            best_cursor_d2 = cursor_d2;
+static void pick_orbit(const PickingView* view, const glm::dvec2& cursor, CelestialBody* body, Pick* best) {
+    /* Test the cursor against the orbit of body, as drawn by render_orbits() */
+    Orbit* orbit = body->orbit;
+    glm::dvec3 origin = body_global_position_at_time(orbit->primary, view->time);
+
+    double start = 0.;
+    double end = 2 * M_PI;
+    if (orbit->apoapsis > orbit->primary->sphere_of_influence || orbit->eccentricity > 1.) {
+        double mean_anomaly = orbit_mean_anomaly_at_time(orbit, view->time);
+        double eccentric_anomaly = orbit_eccentric_anomaly_at_mean_anomaly(orbit, mean_anomaly);
+        start = fmod2(orbit_true_anomaly_at_eccentric_anomaly(orbit, eccentric_anomaly), 2 * M_PI);
+        if (start > M_PI) {
+            start -= 2 * M_PI;
         }
+        end = orbit_true_anomaly_at_escape(orbit);
     }
-    delete[] components;
 
-    if (name == 0) {
-        return NULL;
+    glm::dvec2 previous;
+    double previous_depth = 0.;
+    bool previous_shown = false;
+    for (int i = 0; i <= PICK_ORBIT_SEGMENTS; i += 1) {
+        double true_anomaly = start + (end - start) * i / PICK_ORBIT_SEGMENTS;
+        glm::dvec3 position = origin + orbit_position_at_true_anomaly(orbit, true_anomaly);
+        glm::dvec2 pixel;
+        double depth;
+        bool shown = to_screen(view, position, &pixel, &depth);
+        if (shown && previous_shown) {
+            // closest point of the segment
+            glm::dvec2 segment = pixel - previous;
+            double length2 = glm::dot(segment, segment);
+            double t = length2 > 0. ? glm::clamp(glm::dot(cursor - previous, segment) / length2, 0., 1.) : 0.;
+            double distance = glm::distance(cursor, previous + t * segment);
+            consider(best, body, distance, previous_depth + t * (depth - previous_depth));
+        }
+        previous = pixel;
+        previous_depth = depth;
+        previous_shown = shown;
     }
+}
 
-    size_t n_objects = state->render_state->picking_objects.size();
-    if (name > n_objects) {
-        ERROR("Picked object %zu but only %zu known objects", name, n_objects);
+CelestialBody* pick(GlobalState* state) {
+    /* Closest object to the cursor, among the bodies, the rocket and their
+     * orbits, where they were last rendered; nothing is read back from the
+     * GPU */
+    RenderState* render_state = state->render_state;
+    glm::dvec2 cursor(state->cursor_x, (double) state->window_height - state->cursor_y);
+
+    // the thumbnail is drawn over the main view
+    PickingView* view = &render_state->main_picking_view;
+    PickingView* thumbnail = &render_state->thumbnail_picking_view;
+    if (thumbnail->shown) {
+        glm::dvec2 corner = cursor - glm::dvec2(thumbnail->viewport.x, thumbnail->viewport.y);
+        if (corner.x >= 0. && corner.y >= 0. && corner.x < thumbnail->viewport.z && corner.y < thumbnail->viewport.w) {
+            view = thumbnail;
+        }
+    }
+    if (!view->shown) {
         return NULL;
-    } else {
-        return state->render_state->picking_objects[name - 1];
     }
+
+    Pick best = {NULL, INFINITY, INFINITY};
+    for (auto key_value_pair : state->bodies) {
+        CelestialBody* body = key_value_pair.second;
+        glm::dvec3 center = body_global_position_at_time(body, view->time);
+        pick_sphere(view, cursor, body, center, body->radius, &best);
+        if (view->show_helpers && body->orbit != NULL) {
+            pick_orbit(view, cursor, body, &best);
+        }
+    }
+
+    CelestialBody* rocket = &state->rocket;
+    glm::dvec3 position = body_global_position_at_time(rocket->orbit->primary, view->time) + state->rocket.state.position;
+    pick_sphere(view, cursor, rocket, position, 0., &best);
+    if (view->show_helpers) {
+        pick_orbit(view, cursor, rocket, &best);
+    }
+    return best.object;
 }
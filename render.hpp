@@ -2,14 +2,18 @@
 #define RENDER_HPP
 
 #include "body.hpp"
+#include "load.hpp"
 #include "rocket.hpp"
+#include "encounter.hpp"
+#include "maneuver.hpp"
+#include "intercept.hpp"
 
-#include <map>
 #include <string>
+#include <vector>
 
 struct RenderState;
 
-RenderState* make_render_state(const std::map<std::string, CelestialBody*>& bodies, const std::string& textures_directory);
+RenderState* make_render_state(const Dict& bodies, const std::string& textures_directory);
 void delete_render_state(RenderState* render_state);
 
 struct GlobalState {
@@ -17,15 +21,28 @@ struct GlobalState {
     bool show_wireframe = false;
     bool show_helpers = true;
     bool show_hud = true;
+    bool body_impostors = false;  // ray-cast quads instead of spheres
     bool enable_vsync = true;
 
     double star_temperature = 5778.;
+    double thumbnail_refresh_rate = 10.;  // see Config
 
-    std::map<std::string, CelestialBody*> bodies;
+    Dict bodies;
     CelestialBody* root;
     CelestialBody* focus;
     CelestialBody* target = NULL;
     Rocket rocket;
+    std::vector<Encounter> encounters;  // between the rocket and the target
+
+    std::vector<ManeuverNode> maneuver_nodes;  // chronological
+    size_t selected_node = 0;
+    // computed in the background, so it may lag behind the nodes; the
+    // revision changes whenever the plan is replaced
+    FlightPlan flight_plan;
+    size_t flight_plan_revision = 0;
+    // cheapest transfer to the target found so far, refined in the background
+    bool intercept_found = false;
+    Intercept intercept;
 
     double fps = 60.;
     double last_fps_measure;
@@ -56,12 +73,9 @@ struct GlobalState {
     ~GlobalState() { delete_render_state(this->render_state); }
 };
 
-void reset_matrices(GlobalState* state, bool zoom=true);
 void render(GlobalState* state);
 
-void set_picking_name(size_t name);
-void set_picking_object(GlobalState* state, CelestialBody* object);
-void clear_picking_object(GlobalState* state);
+// closest object to the cursor, where it was last rendered; NULL when none
 CelestialBody* pick(GlobalState* state);
 
 #endif
@@ -5,6 +5,7 @@
 
 #include <stdio.h>
 #include <stdarg.h>
+#include <string.h>
 
 void attach_shader(GLuint program, GLenum shader_type, const char* source, const char* filename) {
     DEBUG("[GLSL] %s compilation", filename);
@@ -42,9 +43,25 @@ void attach_shader(GLuint program, GLenum shader_type, const char* source, const
     DEBUG("[GLSL] %s compiled", filename);
 }
 
-void attach_shader_from_file(GLuint program, GLenum shader_type, const char* filename) {
+void attach_shader_from_file(GLuint program, GLenum shader_type, const char* filename, const char* prelude) {
     GLchar* source = load_file(filename);
-    attach_shader(program, shader_type, source, filename);
+    if (source == NULL) {
+        CRITICAL("[GLSL] Could not load %s", filename);
+        exit(EXIT_FAILURE);
+    }
+
+    // insert the prelude after the #version line, and restore line numbers
+    // for the info log
+    const char* rest = strchr(source, '\n');
+    rest = rest == NULL ? source + strlen(source) : rest + 1;
+    size_t version_length = (size_t) (rest - source);
+    const char line[] = "#line 2\n";
+    size_t n = version_length + strlen(prelude) + strlen(line) + strlen(rest) + 1;
+    GLchar* combined = MALLOC(n);
+    snprintf(combined, n, "%.*s%s%s%s", (int) version_length, source, prelude, line, rest);
+
+    attach_shader(program, shader_type, combined, filename);
+    free(combined);
     free(source);
 }
 
@@ -99,6 +116,13 @@ GLuint make_program(size_t n_shaders, ...) {
     }
     va_end(shader_list);
 
+    // uniform blocks, declared in every shader
+    GLchar* prelude = load_file("data/shaders/uniforms.glsl");
+    if (prelude == NULL) {
+        CRITICAL("[GLSL] Could not load data/shaders/uniforms.glsl");
+        exit(EXIT_FAILURE);
+    }
+
     GLuint program = glCreateProgram();
 
     // compile individual shaders
@@ -108,12 +132,13 @@ GLuint make_program(size_t n_shaders, ...) {
 
         // vertex shader
         snprintf(path, sizeof(path), "data/shaders/%s.vert", shader);
-        attach_shader_from_file(program, GL_VERTEX_SHADER, path);
+        attach_shader_from_file(program, GL_VERTEX_SHADER, path, prelude);
 
         // fragment shader
         snprintf(path, sizeof(path), "data/shaders/%s.frag", shader);
-        attach_shader_from_file(program, GL_FRAGMENT_SHADER, path);
+        attach_shader_from_file(program, GL_FRAGMENT_SHADER, path, prelude);
     }
+    free(prelude);
 
     // generate source code main(), hich calls each shader in the given order
     char dummy_buffer[1];  // makes cppcheck happy
@@ -140,6 +165,20 @@ GLuint make_program(size_t n_shaders, ...) {
     free(buffer);
     free(shaders);
 
+    // so that vertex arrays work with any program
+    glBindAttribLocation(program, ATTRIBUTE_POSITION, "v_position");
+    glBindAttribLocation(program, ATTRIBUTE_TEXCOORD, "v_texcoord");
+    glBindAttribLocation(program, ATTRIBUTE_NORMAL, "v_normal");
+    glBindAttribLocation(program, ATTRIBUTE_TANGENT, "v_tangent");
+    glBindAttribLocation(program, ATTRIBUTE_BITANGENT, "v_bitangent");
+    glBindAttribLocation(program, ATTRIBUTE_OFFSET, "v_offset");
+    glBindAttribLocation(program, ATTRIBUTE_INSTANCE_MODEL, "i_model");
+    glBindAttribLocation(program, ATTRIBUTE_INSTANCE_LAYER, "i_layer");
+    glBindAttribLocation(program, ATTRIBUTE_INSTANCE_ORBIT_SHAPE, "i_orbit_shape");
+    glBindAttribLocation(program, ATTRIBUTE_INSTANCE_ORBIT_ANOMALIES, "i_orbit_anomalies");
+    glBindAttribLocation(program, ATTRIBUTE_INSTANCE_ORBIT_MARKERS, "i_orbit_markers");
+    glBindAttribLocation(program, ATTRIBUTE_INSTANCE_COLOR, "i_color");
+
     DEBUG("[GLSL] Program linkage");
     glLinkProgram(program);
 
@@ -6,6 +6,21 @@
 #endif
 #include <GL/glew.h>
 
+// locations of the vertex attributes, the same in every program
+#define ATTRIBUTE_POSITION  0
+#define ATTRIBUTE_TEXCOORD  1
+#define ATTRIBUTE_NORMAL    2
+#define ATTRIBUTE_TANGENT   3
+#define ATTRIBUTE_BITANGENT 4
+#define ATTRIBUTE_OFFSET    5
+// per instance; a matrix takes four consecutive locations
+#define ATTRIBUTE_INSTANCE_MODEL   6
+#define ATTRIBUTE_INSTANCE_LAYER   10
+#define ATTRIBUTE_INSTANCE_ORBIT_SHAPE     11
+#define ATTRIBUTE_INSTANCE_ORBIT_ANOMALIES 12
+#define ATTRIBUTE_INSTANCE_ORBIT_MARKERS   13
+#define ATTRIBUTE_INSTANCE_COLOR           14
+
 GLuint make_program(size_t n_shaders, ...);
 
 #endif
@@ -0,0 +1,278 @@
+#include "sims_flanagan.hpp"
+
+#include "orbit.hpp"
+#include "parallel.hpp"
+
+#include <algorithm>
+#include <cmath>
+
+// relative perturbation of the impulses for finite differences
+#define SIMS_FLANAGAN_EPSILON 1e-7
+// regularization of the normal equations
+#define SIMS_FLANAGAN_DAMPING 1e-12
+
+struct SegmentState {
+    glm::dvec3 position;
+    glm::dvec3 velocity;
+};
+
+void sims_flanagan_init(SimsFlanaganLeg* leg, CelestialBody* primary, double departure_time, glm::dvec3 departure_position, glm::dvec3 departure_velocity, double arrival_time, glm::dvec3 arrival_position, glm::dvec3 arrival_velocity, size_t n_segments) {
+    leg->primary = primary;
+    leg->departure_time = departure_time;
+    leg->departure_position = departure_position;
+    leg->departure_velocity = departure_velocity;
+    leg->arrival_time = arrival_time;
+    leg->arrival_position = arrival_position;
+    leg->arrival_velocity = arrival_velocity;
+    leg->n_segments = n_segments;
+    leg->dv_x.assign(n_segments, 0.);
+    leg->dv_y.assign(n_segments, 0.);
+    leg->dv_z.assign(n_segments, 0.);
+}
+
+static void propagate(CelestialBody* primary, SegmentState* state, double time, double duration) {
+    Orbit orbit;
+    orbit_from_state(&orbit, primary, state->position, state->velocity, time);
+    orbit_state_at_time(&orbit, time + duration, &state->position, &state->velocity);
+}
+
+// number of segments in the forward half
+static size_t forward_segments(const SimsFlanaganLeg* leg) {
+    return (leg->n_segments + 1) / 2;
+}
+
+static double segment_duration(const SimsFlanaganLeg* leg) {
+    return (leg->arrival_time - leg->departure_time) / (double) leg->n_segments;
+}
+
+// propagate the segments [begin, end) forward, starting from the beginning
+// of segment begin
+static void propagate_forward(const SimsFlanaganLeg* leg, SegmentState* state, size_t begin, size_t end, SegmentState* states) {
+    double dt = segment_duration(leg);
+    for (size_t i = begin; i < end; i += 1) {
+        double time = leg->departure_time + (double) i * dt;
+        propagate(leg->primary, state, time, dt / 2.);
+        state->velocity += glm::dvec3{leg->dv_x[i], leg->dv_y[i], leg->dv_z[i]};
+        propagate(leg->primary, state, time + dt / 2., dt / 2.);
+        if (states != NULL) {
+            states[i + 1] = *state;
+        }
+    }
+}
+
+// propagate the segments [begin, end) backward, starting from the end of
+// segment end - 1
+static void propagate_backward(const SimsFlanaganLeg* leg, SegmentState* state, size_t begin, size_t end, SegmentState* states) {
+    double dt = segment_duration(leg);
+    for (size_t i = end; i > begin; i -= 1) {
+        double time = leg->departure_time + (double) i * dt;
+        propagate(leg->primary, state, time, -dt / 2.);
+        state->velocity -= glm::dvec3{leg->dv_x[i - 1], leg->dv_y[i - 1], leg->dv_z[i - 1]};
+        propagate(leg->primary, state, time - dt / 2., -dt / 2.);
+        if (states != NULL) {
+            states[i - 1] = *state;
+        }
+    }
+}
+
+void sims_flanagan_mismatch(const SimsFlanaganLeg* leg, glm::dvec3* position, glm::dvec3* velocity) {
+    size_t n_forward = forward_segments(leg);
+    SegmentState forward{leg->departure_position, leg->departure_velocity};
+    propagate_forward(leg, &forward, 0, n_forward, NULL);
+    SegmentState backward{leg->arrival_position, leg->arrival_velocity};
+    propagate_backward(leg, &backward, n_forward, leg->n_segments, NULL);
+    *position = forward.position - backward.position;
+    *velocity = forward.velocity - backward.velocity;
+}
+
+void sims_flanagan_max_impulses(const SimsFlanaganLeg* leg, std::vector<double>* max_dv) {
+    double dt = segment_duration(leg);
+    double exhaust_velocity = leg->specific_impulse * STANDARD_GRAVITY;
+    double mass = leg->mass;
+    max_dv->resize(leg->n_segments);
+    for (size_t i = 0; i < leg->n_segments; i += 1) {
+        (*max_dv)[i] = leg->max_thrust * dt / mass;
+        double dv = sqrt(leg->dv_x[i]*leg->dv_x[i] + leg->dv_y[i]*leg->dv_y[i] + leg->dv_z[i]*leg->dv_z[i]);
+        mass *= exp(-dv / exhaust_velocity);
+    }
+}
+
+double sims_flanagan_total_dv(const SimsFlanaganLeg* leg) {
+    double total = 0.;
+    for (size_t i = 0; i < leg->n_segments; i += 1) {
+        total += sqrt(leg->dv_x[i]*leg->dv_x[i] + leg->dv_y[i]*leg->dv_y[i] + leg->dv_z[i]*leg->dv_z[i]);
+    }
+    return total;
+}
+
+double sims_flanagan_final_mass(const SimsFlanaganLeg* leg) {
+    double exhaust_velocity = leg->specific_impulse * STANDARD_GRAVITY;
+    return leg->mass * exp(-sims_flanagan_total_dv(leg) / exhaust_velocity);
+}
+
+// solve the n×n system A x = b in place (Gaussian elimination with partial
+// pivoting); return -1 if A is singular
+static int solve(double* A, double* b, size_t n) {
+    for (size_t k = 0; k < n; k += 1) {
+        size_t pivot = k;
+        for (size_t i = k + 1; i < n; i += 1) {
+            if (fabs(A[i*n + k]) > fabs(A[pivot*n + k])) {
+                pivot = i;
+            }
+        }
+        if (A[pivot*n + k] == 0.) {
+            return -1;
+        }
+        if (pivot != k) {
+            for (size_t j = 0; j < n; j += 1) {
+                std::swap(A[k*n + j], A[pivot*n + j]);
+            }
+            std::swap(b[k], b[pivot]);
+        }
+        for (size_t i = k + 1; i < n; i += 1) {
+            double factor = A[i*n + k] / A[k*n + k];
+            for (size_t j = k; j < n; j += 1) {
+                A[i*n + j] -= factor * A[k*n + j];
+            }
+            b[i] -= factor * b[k];
+        }
+    }
+    for (size_t k = n; k > 0; k -= 1) {
+        size_t i = k - 1;
+        for (size_t j = i + 1; j < n; j += 1) {
+            b[i] -= A[i*n + j] * b[j];
+        }
+        b[i] /= A[i*n + i];
+    }
+    return 0;
+}
+
+int sims_flanagan_optimize(SimsFlanaganLeg* leg, double tolerance, int max_iterations) {
+    /* Minimum-norm Gauss-Newton: at each iteration, linearize the mismatch
+     * c(x) ~ c + J (x' - x) and jump to the smallest impulses x' (in the sense
+     * of the weighted sum of their squares) that cancel it; impulses are then
+     * clipped to what the thrust allows
+     *
+     * Mismatches and impulses are scaled by the departure distance and the
+     * corresponding circular speed, so that all unknowns are comparable
+     */
+    size_t n = leg->n_segments;
+    if (n == 0 || !(leg->arrival_time > leg->departure_time)) {
+        return -1;
+    }
+    size_t n_forward = forward_segments(leg);
+    size_t n_variables = 3 * n;
+    double length_scale = glm::length(leg->departure_position);
+    double speed_scale = sqrt(leg->primary->gravitational_parameter / length_scale);
+
+    std::vector<double*> components{leg->dv_x.data(), leg->dv_y.data(), leg->dv_z.data()};
+    auto scaled_mismatch = [&](const SegmentState& forward, const SegmentState& backward, double* c) {
+        glm::dvec3 dr = (forward.position - backward.position) / length_scale;
+        glm::dvec3 dv = (forward.velocity - backward.velocity) / speed_scale;
+        for (int i = 0; i < 3; i += 1) {
+            c[i] = dr[i];
+            c[3 + i] = dv[i];
+        }
+    };
+
+    std::vector<SegmentState> states(n + 1);
+    std::vector<double> jacobian(6 * n_variables);  // column-major
+    std::vector<double> max_dv;
+    std::vector<double> weights(n, 1.);  // of the squared impulses
+    double c[6];
+    for (int iteration = 0; iteration < max_iterations; iteration += 1) {
+        // nominal trajectory, keeping the states between segments
+        states[0] = {leg->departure_position, leg->departure_velocity};
+        SegmentState forward = states[0];
+        propagate_forward(leg, &forward, 0, n_forward, states.data());
+        states[n] = {leg->arrival_position, leg->arrival_velocity};
+        SegmentState backward = states[n];
+        propagate_backward(leg, &backward, n_forward, n, states.data());
+        scaled_mismatch(forward, backward, c);
+        double norm = 0.;
+        for (int i = 0; i < 6; i += 1) {
+            norm = fmax(norm, fabs(c[i]));
+        }
+        if (norm < tolerance) {
+            return 0;
+        }
+
+        // each column of the Jacobian only needs to propagate the half it
+        // belongs to, from the perturbed segment on; columns are independent
+        parallel_for(n_variables, [&](size_t begin, size_t end) {
+            SimsFlanaganLeg perturbed = *leg;
+            for (size_t k = begin; k < end; k += 1) {
+                size_t segment = k % n;
+                double* component = (k / n == 0 ? perturbed.dv_x : k / n == 1 ? perturbed.dv_y : perturbed.dv_z).data();
+                double h = SIMS_FLANAGAN_EPSILON * speed_scale;
+                component[segment] += h;
+                SegmentState f = forward;
+                SegmentState b = backward;
+                if (segment < n_forward) {
+                    f = states[segment];
+                    propagate_forward(&perturbed, &f, segment, n_forward, NULL);
+                } else {
+                    b = states[segment + 1];
+                    propagate_backward(&perturbed, &b, n_forward, segment + 1, NULL);
+                }
+                component[segment] -= h;
+                double c_k[6];
+                scaled_mismatch(f, b, c_k);
+                for (int i = 0; i < 6; i += 1) {
+                    jacobian[k * 6 + i] = (c_k[i] - c[i]) / (h / speed_scale);
+                }
+            }
+        });
+
+        // x' = W^-1 J^T λ with (J W^-1 J^T) λ = J x - c
+        double JJt[36] = {};
+        double rhs[6];
+        for (int i = 0; i < 6; i += 1) {
+            rhs[i] = -c[i];
+        }
+        for (size_t k = 0; k < n_variables; k += 1) {
+            const double* column = &jacobian[k * 6];
+            double x = components[k / n][k % n] / speed_scale;
+            double w = weights[k % n];
+            for (int i = 0; i < 6; i += 1) {
+                rhs[i] += column[i] * x;
+                for (int j = 0; j < 6; j += 1) {
+                    JJt[i*6 + j] += column[i] * column[j] / w;
+                }
+            }
+        }
+        double trace = 0.;
+        for (int i = 0; i < 6; i += 1) {
+            trace += JJt[i*6 + i];
+        }
+        for (int i = 0; i < 6; i += 1) {
+            JJt[i*6 + i] += SIMS_FLANAGAN_DAMPING * trace;
+        }
+        if (solve(JJt, rhs, 6) < 0) {
+            return -1;
+        }
+        for (size_t k = 0; k < n_variables; k += 1) {
+            const double* column = &jacobian[k * 6];
+            double x = 0.;
+            for (int i = 0; i < 6; i += 1) {
+                x += column[i] * rhs[i];
+            }
+            components[k / n][k % n] = x / weights[k % n] * speed_scale;
+        }
+
+        // bounded thrust; saturated segments get more expensive, so that
+        // the others take over
+        sims_flanagan_max_impulses(leg, &max_dv);
+        for (size_t i = 0; i < n; i += 1) {
+            double dv = sqrt(leg->dv_x[i]*leg->dv_x[i] + leg->dv_y[i]*leg->dv_y[i] + leg->dv_z[i]*leg->dv_z[i]);
+            if (dv > max_dv[i]) {
+                double factor = max_dv[i] / dv;
+                leg->dv_x[i] *= factor;
+                leg->dv_y[i] *= factor;
+                leg->dv_z[i] *= factor;
+                weights[i] *= 4.;
+            }
+        }
+    }
+    return -1;
+}
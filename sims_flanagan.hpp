@@ -0,0 +1,53 @@
+#ifndef SIMS_FLANAGAN_HPP
+#define SIMS_FLANAGAN_HPP
+
+#include "body.hpp"
+
+#include <glm/glm.hpp>
+
+#include <vector>
+
+// standard gravity, for the specific impulse
+#define STANDARD_GRAVITY 9.80665
+
+// low-thrust leg with the Sims-Flanagan transcription: the leg is split in
+// segments of equal durations, each with an impulse at its middle, and
+// bodies coast on Kepler orbits in-between; the trajectory is propagated
+// forward from departure and backward from arrival, and both halves must
+// match at the middle
+struct SimsFlanaganLeg {
+    CelestialBody* primary;
+    double departure_time;
+    glm::dvec3 departure_position;
+    glm::dvec3 departure_velocity;
+    double arrival_time;
+    glm::dvec3 arrival_position;
+    glm::dvec3 arrival_velocity;
+
+    // spacecraft
+    double mass;  // at departure
+    double max_thrust;
+    double specific_impulse;
+
+    // impulses of the segments, by component
+    size_t n_segments;
+    std::vector<double> dv_x;
+    std::vector<double> dv_y;
+    std::vector<double> dv_z;
+};
+
+// set up a leg with zero impulses
+void sims_flanagan_init(SimsFlanaganLeg* leg, CelestialBody* primary, double departure_time, glm::dvec3 departure_position, glm::dvec3 departure_velocity, double arrival_time, glm::dvec3 arrival_position, glm::dvec3 arrival_velocity, size_t n_segments);
+
+// position and velocity mismatches at the match point
+void   sims_flanagan_mismatch(const SimsFlanaganLeg* leg, glm::dvec3* position, glm::dvec3* velocity);
+// largest impulse allowed for each segment, given the mass left
+void   sims_flanagan_max_impulses(const SimsFlanaganLeg* leg, std::vector<double>* max_dv);
+double sims_flanagan_total_dv(const SimsFlanaganLeg* leg);
+double sims_flanagan_final_mass(const SimsFlanaganLeg* leg);
+
+// find impulses that close the mismatch while keeping the thrust bounded and
+// the impulses small; return -1 if no feasible leg was found
+int sims_flanagan_optimize(SimsFlanaganLeg* leg, double tolerance, int max_iterations);
+
+#endif
@@ -0,0 +1,156 @@
+#include "stream.hpp"
+
+extern "C" {
+#include "logging.h"
+}
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+
+struct StreamFence {
+    GLsync sync;
+    size_t written;  // bytes written to the ring when fenced
+};
+
+static struct {
+    GLuint buffer;
+    size_t size;
+    char* mapping;  // NULL when orphaning instead
+    // counted from the creation of the ring, so that they only increase
+    size_t written;
+    size_t released;  // bytes written before are no longer read
+    std::deque<StreamFence> fences;  // oldest first
+} stream;
+
+static bool signaled(GLsync sync, GLuint64 timeout) {
+    GLenum status = glClientWaitSync(sync, GL_SYNC_FLUSH_COMMANDS_BIT, timeout);
+    return status == GL_ALREADY_SIGNALED || status == GL_CONDITION_SATISFIED || status == GL_WAIT_FAILED;
+}
+
+static void pop_fence(void) {
+    StreamFence fence = stream.fences.front();
+    stream.fences.pop_front();
+    glDeleteSync(fence.sync);
+    stream.released = fence.written;
+}
+
+static void release(size_t written) {
+    /* Wait until the bytes written before are no longer read */
+    while (stream.released < written) {
+        if (stream.fences.empty()) {
+            // the current frame alone fills the ring
+            stream_end_frame();
+        }
+        while (!signaled(stream.fences.front().sync, UINT64_MAX)) {
+        }
+        pop_fence();
+    }
+}
+
+void stream_init(size_t size) {
+    stream.size = size;
+    stream.mapping = NULL;
+    stream.written = 0;
+    stream.released = 0;
+
+    glGenBuffers(1, &stream.buffer);
+    glBindBuffer(GL_COPY_WRITE_BUFFER, stream.buffer);
+    if (GLEW_ARB_buffer_storage) {
+        GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+        glBufferStorage(GL_COPY_WRITE_BUFFER, (GLsizeiptr) size, NULL, flags);
+        stream.mapping = (char*) glMapBufferRange(GL_COPY_WRITE_BUFFER, 0, (GLsizeiptr) size, flags);
+        if (stream.mapping == NULL) {
+            // the storage is immutable, start over with a new buffer
+            WARNING("[GLSL] Could not map the stream buffer persistently");
+            glDeleteBuffers(1, &stream.buffer);
+            glGenBuffers(1, &stream.buffer);
+            glBindBuffer(GL_COPY_WRITE_BUFFER, stream.buffer);
+        }
+    }
+    if (stream.mapping == NULL) {
+        glBufferData(GL_COPY_WRITE_BUFFER, (GLsizeiptr) size, NULL, GL_STREAM_DRAW);
+    }
+    glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+    DEBUG("[GLSL] Stream buffer of %zu bytes, %s", size, stream.mapping != NULL ? "persistently mapped" : "orphaned");
+}
+
+void stream_delete(void) {
+    while (!stream.fences.empty()) {
+        pop_fence();
+    }
+    if (stream.mapping != NULL) {
+        glBindBuffer(GL_COPY_WRITE_BUFFER, stream.buffer);
+        glUnmapBuffer(GL_COPY_WRITE_BUFFER);
+        glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+        stream.mapping = NULL;
+    }
+    glDeleteBuffers(1, &stream.buffer);
+    stream.buffer = 0;
+}
+
+GLuint stream_buffer(void) {
+    return stream.buffer;
+}
+
+size_t stream_write(const void* data, size_t n, size_t alignment) {
+    if (n > stream.size) {
+        CRITICAL("[GLSL] %zu bytes do not fit in the stream buffer (%zu bytes)", n, stream.size);
+        exit(EXIT_FAILURE);
+    }
+
+    // next aligned offset, or the start of the next lap; a lap that was
+    // filled exactly still has to wrap around
+    size_t position = stream.written % stream.size;
+    if (position == 0 && stream.written > 0) {
+        position = stream.size;
+    }
+    size_t lap = stream.written - position;
+    size_t offset = (position + alignment - 1) / alignment * alignment;
+    bool wrapped = offset + n > stream.size;
+    if (wrapped) {
+        lap += stream.size;
+        offset = 0;
+    }
+    size_t end = lap + offset + n;
+
+    if (stream.mapping != NULL) {
+        // the previous lap, up to what has been written since (what was
+        // skipped at the end of the lap was never written)
+        if (end > stream.size) {
+            release(std::min(end - stream.size, stream.written));
+        }
+        if (n > 0) {
+            memcpy(stream.mapping + offset, data, n);
+        }
+    } else {
+        glBindBuffer(GL_COPY_WRITE_BUFFER, stream.buffer);
+        if (wrapped) {
+            // the draws still reading the ring keep the previous storage
+            glBufferData(GL_COPY_WRITE_BUFFER, (GLsizeiptr) stream.size, NULL, GL_STREAM_DRAW);
+        }
+        if (n > 0) {
+            GLbitfield access = GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_RANGE_BIT | GL_MAP_UNSYNCHRONIZED_BIT;
+            void* destination = glMapBufferRange(GL_COPY_WRITE_BUFFER, (GLintptr) offset, (GLsizeiptr) n, access);
+            memcpy(destination, data, n);
+            glUnmapBuffer(GL_COPY_WRITE_BUFFER);
+        }
+        glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+    }
+    stream.written = end;
+    return offset;
+}
+
+void stream_end_frame(void) {
+    if (stream.mapping == NULL) {
+        return;
+    }
+
+    // release the frames that are already done, without waiting
+    while (!stream.fences.empty() && signaled(stream.fences.front().sync, 0)) {
+        pop_fence();
+    }
+    stream.fences.push_back({glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0), stream.written});
+}
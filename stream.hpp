@@ -0,0 +1,24 @@
+#ifndef STREAM_HPP
+#define STREAM_HPP
+
+#ifdef MSYS2
+#include <windef.h>
+#endif
+#include <GL/glew.h>
+
+#include <cstddef>
+
+// data that changes every frame (instances, uniform blocks, text, markers)
+// is sub-allocated from a single ring buffer; with ARB_buffer_storage, the
+// ring stays mapped and fences keep the CPU from overwriting what the GPU
+// has yet to read; otherwise, the ring is orphaned whenever it wraps around
+void   stream_init(size_t size);
+void   stream_delete(void);
+GLuint stream_buffer(void);
+// copy n bytes to the ring, at an offset that is a multiple of alignment,
+// and return that offset; the bytes stay valid until the ring wraps around
+size_t stream_write(const void* data, size_t n, size_t alignment);
+// to be called after the last draw of each frame
+void   stream_end_frame(void);
+
+#endif
@@ -0,0 +1,354 @@
+#include "load.hpp"
+#include "orbit.hpp"
+#include "recipes.hpp"
+#include "transfer.hpp"
+#include "optimize.hpp"
+#include "parallel.hpp"
+
+extern "C" {
+#include "util.h"
+#include "logging.h"
+}
+
+#include <algorithm>
+#include <cinttypes>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+// all-pairs table of the Δv between low orbits of the bodies of a system,
+// with the next transfer windows between bodies orbiting the same primary;
+// results are cached next to the system file, keyed by its content
+
+// bump when the output changes
+#define SUBWAY_VERSION 3
+#define SUBWAY_LOW_ORBIT_FACTOR 1.1  // radius of low orbits, relative to body radius
+#define SUBWAY_REFINE_TOLERANCE 1e-9
+// windows are refined between orbits more eccentric or inclined than this
+#define SUBWAY_REFINE_ECCENTRICITY .01
+#define SUBWAY_REFINE_INCLINATION 1e-3  // rad
+// and only when estimated within this factor of the cheapest of the pair, or
+// below the cost of a refined one
+#define SUBWAY_REFINE_MARGIN 1.25
+
+struct Window {
+    double time_at_departure;
+    double transfer_duration;
+    double cost;
+    bool refined;  // otherwise, the cost is only an estimate
+};
+
+struct Edge {
+    size_t origin;
+    size_t target;
+    std::vector<Window> windows;  // only for bodies orbiting the same primary
+    double cost;
+};
+
+static uint64_t fnv1a(const char* data, size_t size, uint64_t h) {
+    for (size_t i = 0; i < size; i += 1) {
+        h = (h ^ (uint8_t) data[i]) * 1099511628211ULL;
+    }
+    return h;
+}
+
+static double low_orbit(CelestialBody* body) {
+    return body->radius * SUBWAY_LOW_ORBIT_FACTOR;
+}
+
+static double mean_longitude_at_time(Orbit* o, double time) {
+    return o->longitude_of_ascending_node + o->argument_of_periapsis + orbit_mean_anomaly_at_time(o, time);
+}
+
+static double parent_child_cost(CelestialBody* parent, CelestialBody* child) {
+    /* Hohmann transfer from a low orbit around the parent to the orbit of the
+     * child, then capture into a low orbit around the child; the same Δv
+     * applies in the other direction */
+    double r1 = low_orbit(parent);
+    double r2 = child->orbit->semi_major_axis;
+    double mu = parent->gravitational_parameter;
+    double a = (r1 + r2) / 2.;
+    double injection_dv = sqrt(mu * (2./r1 - 1./a)) - circular_orbit_speed(parent, r1);
+    double v_encounter = circular_orbit_speed(parent, r2) - sqrt(mu * (2./r2 - 1./a));
+    double r = low_orbit(child);
+    return injection_dv + maneuver_orbit_to_escape_cost(child, r, r, fabs(v_encounter), 0.);
+}
+
+static double hohmann_window_cost(CelestialBody* origin, CelestialBody* target, double time_at_departure, double transfer_duration) {
+    /* Hohmann transfer between the distances of the bodies at departure and
+     * at arrival, from a low orbit around the origin to a low orbit around
+     * the target; ignores the plane change */
+    Orbit* o1 = origin->orbit;
+    Orbit* o2 = target->orbit;
+    double mu = o1->primary->gravitational_parameter;
+    double r1 = orbit_distance_at_time(o1, time_at_departure);
+    double r2 = orbit_distance_at_time(o2, time_at_departure + transfer_duration);
+    double a = (r1 + r2) / 2.;
+    double v_escape = sqrt(mu * (2./r1 - 1./a)) - orbit_speed_at_distance(o1, r1);
+    double v_encounter = orbit_speed_at_distance(o2, r2) - sqrt(mu * (2./r2 - 1./a));
+    double r = low_orbit(origin);
+    double s = low_orbit(target);
+    return maneuver_orbit_to_escape_cost(origin, r, r, fabs(v_escape), 0.) + maneuver_orbit_to_escape_cost(target, s, s, fabs(v_encounter), 0.);
+}
+
+static bool needs_refinement(CelestialBody* origin, CelestialBody* target) {
+    /* the Hohmann estimate is only accurate between circular coplanar orbits */
+    Orbit* o1 = origin->orbit;
+    Orbit* o2 = target->orbit;
+    if (o1->eccentricity > SUBWAY_REFINE_ECCENTRICITY || o2->eccentricity > SUBWAY_REFINE_ECCENTRICITY) {
+        return true;
+    }
+    glm::dvec3 normal1 = o1->orientation * glm::dvec3(0., 0., 1.);
+    glm::dvec3 normal2 = o2->orientation * glm::dvec3(0., 0., 1.);
+    double inclination = acos(fmin(1., glm::dot(normal1, normal2)));
+    return inclination > SUBWAY_REFINE_INCLINATION;
+}
+
+static std::vector<Window> sibling_windows(CelestialBody* origin, CelestialBody* target, double start_time, size_t n_windows) {
+    /* Windows open when the phase angle matches the one of a Hohmann
+     * transfer; between eccentric or inclined orbits, the estimates that
+     * could be the cheapest window of the pair are refined with Lambert's
+     * problem, from the cheapest one */
+    std::vector<Window> windows;
+
+    CelestialBody* primary = origin->orbit->primary;
+    double r1 = origin->orbit->semi_major_axis;
+    double r2 = target->orbit->semi_major_axis;
+    double hohmann_time = maneuver_hohmann_time(primary, r1, r2);
+    double phase_rate = target->orbit->mean_motion - origin->orbit->mean_motion;
+    if (phase_rate == 0.) {  // co-orbital
+        return windows;
+    }
+
+    double required_phase = M_PI - target->orbit->mean_motion * hohmann_time;
+    double phase = mean_longitude_at_time(target->orbit, start_time) - mean_longitude_at_time(origin->orbit, start_time);
+    double synodic = 2.*M_PI / fabs(phase_rate);
+    double first = start_time + fmod2((required_phase - phase) * (phase_rate > 0. ? 1. : -1.), 2.*M_PI) / fabs(phase_rate);
+
+    double best = INFINITY;
+    for (size_t i = 0; i < n_windows; i += 1) {
+        double departure = first + (double) i * synodic;
+        double cost = hohmann_window_cost(origin, target, departure, hohmann_time);
+        windows.push_back({departure, hohmann_time, cost, false});
+        best = fmin(best, cost);
+    }
+    if (!needs_refinement(origin, target)) {
+        return windows;
+    }
+
+    // the estimates are optimistic, so any estimate below the best refined
+    // cost must be refined as well
+    std::vector<size_t> order(n_windows);
+    for (size_t i = 0; i < n_windows; i += 1) {
+        order[i] = i;
+    }
+    std::sort(order.begin(), order.end(), [&](size_t i, size_t j) {
+        return windows[i].cost < windows[j].cost;
+    });
+    double best_refined = INFINITY;
+    double parking_radius = low_orbit(origin);
+    double apsis = low_orbit(target);
+    for (size_t i : order) {
+        Window& window = windows[i];
+        if (window.cost > best * SUBWAY_REFINE_MARGIN && window.cost >= best_refined) {
+            break;
+        }
+        // stay within half a synodic period of the estimate
+        double departure_min = fmax(start_time, window.time_at_departure - synodic / 2.);
+        double departure_max = window.time_at_departure + synodic / 2.;
+        auto cost = [&](glm::dvec2 x) {
+            if (x.x < departure_min || x.x > departure_max || x.y <= 0.) {
+                return (double) INFINITY;
+            }
+            double dv = rendez_vous_cost(origin, target, x.x, x.y, parking_radius, apsis, apsis);
+            return isnan(dv) ? INFINITY : dv;
+        };
+        glm::dvec2 x0{window.time_at_departure, hohmann_time};
+        glm::dvec2 step{fmin(synodic, hohmann_time) / 16., hohmann_time / 16.};
+        double f_min;
+        glm::dvec2 x = minimize_nelder_mead(cost, x0, step, SUBWAY_REFINE_TOLERANCE, &f_min);
+        if (!isinf(f_min)) {
+            window = {x.x, x.y, f_min, true};
+            best_refined = fmin(best_refined, f_min);
+        }
+    }
+    return windows;
+}
+
+static std::string make_table(Dict* bodies, double start_time, size_t n_windows) {
+    // bodies a spacecraft can orbit
+    std::vector<CelestialBody*> nodes;
+    for (auto& kv : *bodies) {
+        CelestialBody* body = kv.second;
+        if (body->gravitational_parameter > 0. && body->radius > 0.) {
+            nodes.push_back(body);
+        }
+    }
+    // by name, so that the table does not depend on the order of the hash
+    std::sort(nodes.begin(), nodes.end(), [](CelestialBody* a, CelestialBody* b) {
+        return strcmp(a->name, b->name) < 0;
+    });
+    size_t n = nodes.size();
+
+    // direct transfers: between parent and child, and between siblings
+    std::vector<Edge> edges;
+    for (size_t i = 0; i < n; i += 1) {
+        for (size_t j = 0; j < n; j += 1) {
+            Orbit* oi = nodes[i]->orbit;
+            Orbit* oj = nodes[j]->orbit;
+            bool parent = oj != NULL && oj->primary == nodes[i];
+            bool child = oi != NULL && oi->primary == nodes[j];
+            bool sibling = i != j && oi != NULL && oj != NULL && oi->primary == oj->primary;
+            if (parent || child || sibling) {
+                edges.push_back({i, j, {}, INFINITY});
+            }
+        }
+    }
+    parallel_for(edges.size(), [&](size_t begin, size_t end) {
+        for (size_t k = begin; k < end; k += 1) {
+            Edge& edge = edges[k];
+            CelestialBody* origin = nodes[edge.origin];
+            CelestialBody* target = nodes[edge.target];
+            if (target->orbit != NULL && target->orbit->primary == origin) {
+                edge.cost = parent_child_cost(origin, target);
+            } else if (origin->orbit->primary == target) {
+                edge.cost = parent_child_cost(target, origin);
+            } else {
+                edge.windows = sibling_windows(origin, target, start_time, n_windows);
+                // co-orbital bodies have no window, and go through the
+                // primary; estimates only count when none was refined
+                bool refined = false;
+                for (auto& window : edge.windows) {
+                    refined = refined || window.refined;
+                }
+                for (auto& window : edge.windows) {
+                    if (window.refined || !refined) {
+                        edge.cost = fmin(edge.cost, window.cost);
+                    }
+                }
+            }
+        }
+    });
+
+    // other pairs go through several direct transfers (Floyd-Warshall)
+    std::vector<double> cost(n * n, INFINITY);
+    for (size_t i = 0; i < n; i += 1) {
+        cost[i * n + i] = 0.;
+    }
+    for (auto& edge : edges) {
+        cost[edge.origin * n + edge.target] = edge.cost;
+    }
+    for (size_t k = 0; k < n; k += 1) {
+        parallel_for(n, [&](size_t begin, size_t end) {
+            for (size_t i = begin; i < end; i += 1) {
+                double c_ik = cost[i * n + k];
+                if (isinf(c_ik)) {
+                    continue;
+                }
+                for (size_t j = 0; j < n; j += 1) {
+                    double c = c_ik + cost[k * n + j];
+                    if (c < cost[i * n + j]) {
+                        cost[i * n + j] = c;
+                    }
+                }
+            }
+        });
+    }
+
+    // format
+    std::string out;
+    char line[1024];
+    for (size_t i = 0; i < n; i += 1) {
+        for (size_t j = 0; j < n; j += 1) {
+            if (i == j) {
+                continue;
+            }
+            snprintf(line, sizeof(line), "dv\t%s\t%s\t%.0f\n", nodes[i]->name, nodes[j]->name, cost[i * n + j]);
+            out += line;
+        }
+    }
+    for (auto& edge : edges) {
+        for (auto& window : edge.windows) {
+            snprintf(line, sizeof(line), "window\t%s\t%s\t%.0f\t%.0f\t%.0f\n", nodes[edge.origin]->name, nodes[edge.target]->name, window.time_at_departure, window.transfer_duration, window.cost);
+            out += line;
+        }
+    }
+    return out;
+}
+
+static int subway(const char* filename, double start_time, size_t n_windows) {
+    char* json = load_file(filename);
+    if (json == NULL) {
+        CRITICAL("Failed to open '%s'", filename);
+        return -1;
+    }
+
+    // cache key
+    char parameters[256];
+    snprintf(parameters, sizeof(parameters), "%d %.17g %zu", SUBWAY_VERSION, start_time, n_windows);
+    uint64_t h = 14695981039346656037ULL;
+    h = fnv1a(json, strlen(json), h);
+    h = fnv1a(parameters, strlen(parameters), h);
+    char header[64];
+    snprintf(header, sizeof(header), "# %016" PRIx64 "\n", h);
+
+    // cache hit; a missing cache file is not an error
+    std::string cache_filename = std::string(filename) + ".subway";
+    size_t header_length = strlen(header);
+    size_t cached_length;
+    char* cached = map_file(cache_filename.c_str(), &cached_length);
+    if (cached != NULL) {
+        if (cached_length >= header_length && memcmp(cached, header, header_length) == 0) {
+            INFO("Using cached table from '%s'", cache_filename.c_str());
+            fwrite(cached + header_length, 1, cached_length - header_length, stdout);
+            unmap_file(cached, cached_length);
+            free(json);
+            return 0;
+        }
+        unmap_file(cached, cached_length);
+    }
+
+    Dict bodies;
+    int ret = parse_bodies(&bodies, json);
+    free(json);
+    if (ret < 0) {
+        return -1;
+    }
+    std::string table = make_table(&bodies, start_time, n_windows);
+    unload_bodies(&bodies);
+    fputs(table.c_str(), stdout);
+
+    FILE* f = fopen(cache_filename.c_str(), "w");
+    if (f == NULL) {
+        WARNING("Could not write cache file '%s'", cache_filename.c_str());
+        return 0;
+    }
+    fputs(header, f);
+    fputs(table.c_str(), f);
+    fclose(f);
+    return 0;
+}
+
+int main(int argc, char** argv) {
+    if (argc > 4) {
+        fprintf(stderr, "Usage: %s [SYSTEM_FILE [N_WINDOWS [START_TIME]]]\n", argv[0]);
+        exit(EXIT_FAILURE);
+    }
+    size_t n_windows = argc > 2 ? (size_t) strtoul(argv[2], NULL, 10) : 3;
+    double start_time = argc > 3 ? strtod(argv[3], NULL) : 0.;
+
+    if (argc > 1) {
+        return subway(argv[1], start_time, n_windows) < 0 ? EXIT_FAILURE : EXIT_SUCCESS;
+    }
+
+    const char* systems[] = {"data/kerbol_system.json", "data/solar_system.json"};
+    for (const char* filename : systems) {
+        printf("# %s\n", filename);
+        if (subway(filename, start_time, n_windows) < 0) {
+            exit(EXIT_FAILURE);
+        }
+    }
+}
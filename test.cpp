@@ -4,6 +4,17 @@
 #include "coordinates.hpp"
 #include "recipes.hpp"
 #include "lambert.hpp"
+#include "transfer.hpp"
+#include "gravity_assist.hpp"
+#include "sims_flanagan.hpp"
+#include "encounter.hpp"
+#include "moid.hpp"
+#include "conjunction.hpp"
+#include "visibility.hpp"
+#include "maneuver.hpp"
+#include "intercept.hpp"
+#include "catalog.hpp"
+#include "optimize.hpp"
 #include "rocket.hpp"
 
 extern "C" {
@@ -15,6 +26,7 @@ extern "C" {
 #include <cstdio>
 #include <cstdlib>
 #include <cstring>
+#include <functional>
 
 #define countof(A) (sizeof(A)/sizeof((A)[0]))
 
@@ -130,6 +142,7 @@ CelestialBody make_dummy_object(double radius, double gravitational_parameter, d
         0,  // mass
         0,  // n_satellites
         NULL,  // satellites
+        0,  // satellites_capacity
         NULL,  // orbit
         sphere_of_influence,  // sphere_of_influence
         NULL, // north_pole
@@ -572,9 +585,137 @@ static void test_load_kerbol_system(void) {
     unload_bodies(&kerbol_system);
 }
 
+static void test_load_order(void) {
+    // satellites before their primaries, unknown parameters, escapes
+    const char* json = "{"
+        "\"Moon\": {\"radius\": 1737e3, \"mass\": 7.342e22, \"orbit\": {\"primary\": \"Earth\", \"semi_major_axis\": 384399e3}},"
+        "\"Earth\": {\"radius\": 6371e3, \"mass\": 5.972e24, \"orbit\": {\"primary\": \"Sun\", \"semi_major_axis\": 149598023e3}},"
+        "\"M\\u0061rs\": {\"radius\": 3389e3, \"colors\": [{\"name\": \"}\\\"\"}, null], \"mass\": 6.417e23, \"orbit\": {\"primary\": \"Sun\", \"semi_major_axis\": 227939200e3}},"
+        "\"Sun\": {\"radius\": 696342e3, \"mass\": 1.989e30}"
+    "}";
+    Dict bodies;
+    assertEquals(parse_bodies(&bodies, json), 0);
+    assertEquals((double) bodies.size(), 4.);
+    CelestialBody* sun = bodies["Sun"];
+    CelestialBody* earth = bodies["Earth"];
+    assert(bodies["Moon"]->orbit->primary == earth);
+    assert(earth->orbit->primary == sun);
+    assert(sun->orbit == NULL);
+    // in the order of the file
+    assertEquals((double) sun->n_satellites, 2.);
+    assert(sun->satellites[0] == earth);
+    assert(sun->satellites[1] == bodies["Mars"]);
+    // the primary was complete when the orbit was set
+    assertIsLower(9.2e8, earth->sphere_of_influence);
+    assertIsLower(earth->sphere_of_influence, 9.3e8);
+    // laid out contiguously, primaries first
+    assert(earth == sun + 1);
+    assert(bodies["Moon"] == sun + 2);
+    assert(bodies["Mars"] == sun + 3);
+    assert(earth->orbit + 1 == bodies["Moon"]->orbit);
+
+    // satellites added after loading
+    CelestialBody phobos = make_dummy_object(11e3, 7e5, 0.);
+    body_append_satellite(bodies["Mars"], &phobos);
+    body_append_satellite(sun, &phobos);
+    assertEquals((double) sun->n_satellites, 3.);
+    assert(sun->satellites[1] == bodies["Mars"]);
+    unload_bodies(&bodies);
+    assert(bodies.arena.blocks == NULL);
+
+    // reloading into the same dictionary
+    assertEquals(parse_bodies(&bodies, json), 0);
+    assertEquals((double) bodies.size(), 4.);
+    unload_bodies(&bodies);
+}
+
+static void write_file(const char* filename, const char* content) {
+    FILE* f = fopen(filename, "w");
+    if (f == NULL) {
+        fprintf(stderr, "Failed to open '%s'\n", filename);
+        exit(EXIT_FAILURE);
+    }
+    fputs(content, f);
+    fclose(f);
+}
+
+static void test_load_compiled(void) {
+    const char* filename = "test_load_compiled.json";
+    const char* compiled_filename = "test_load_compiled.json.bin";
+    write_file(filename, "{"
+        "\"Moon\": {\"radius\": 1737e3, \"mass\": 7.342e22, \"orbit\": {\"primary\": \"Earth\", \"semi_major_axis\": 384399e3, \"eccentricity\": .05}},"
+        "\"Earth\": {\"radius\": 6371e3, \"mass\": 5.972e24, \"rotational_period\": 86164, \"positive_pole\": {\"right_ascension\": 0, \"declination\": 1.5}, \"orbit\": {\"primary\": \"Sun\", \"semi_major_axis\": 149598023e3}},"
+        "\"Sun\": {\"radius\": 696342e3, \"mass\": 1.989e30},"
+        "\"Mercury\": {\"radius\": 2440e3, \"mass\": 3.301e23, \"orbit\": {\"primary\": \"Sun\", \"semi_major_axis\": 57909050e3}},"
+        "\"Venus\": {\"radius\": 6052e3, \"mass\": 4.868e24, \"orbit\": {\"primary\": \"Sun\", \"semi_major_axis\": 108208000e3}},"
+        "\"Mars\": {\"radius\": 3390e3, \"mass\": 6.417e23, \"orbit\": {\"primary\": \"Sun\", \"semi_major_axis\": 227939200e3}}"
+    "}");
+    remove(compiled_filename);
+
+    // the first load compiles the system, the second one maps it
+    Dict parsed;
+    assertEquals(load_bodies(&parsed, filename), 0);
+    assert(parsed.compiled == NULL);
+    Dict compiled;
+    assertEquals(load_bodies(&compiled, filename), 0);
+    assert(compiled.compiled != NULL);
+    assertEquals((double) compiled.size(), (double) parsed.size());
+    for (auto& kv : parsed) {
+        CelestialBody* a = kv.second;
+        CelestialBody* b = compiled.at(kv.first);
+        assert(std::string(a->name) == std::string(b->name));
+        assertEquals(a->radius, b->radius);
+        assertEquals(a->gravitational_parameter, b->gravitational_parameter);
+        assertEquals(a->sphere_of_influence, b->sphere_of_influence);
+        assertEquals(a->tilt, b->tilt);
+        assertEquals((double) a->n_satellites, (double) b->n_satellites);
+        for (size_t i = 0; i < a->n_satellites; i += 1) {
+            assert(std::string(a->satellites[i]->name) == std::string(b->satellites[i]->name));
+        }
+        assert((a->orbit == NULL) == (b->orbit == NULL));
+        if (a->orbit != NULL) {
+            assert(std::string(a->orbit->primary->name) == std::string(b->orbit->primary->name));
+            assertIsCloseOrbit(a->orbit, b->orbit);
+        }
+        assert((a->positive_pole == NULL) == (b->positive_pole == NULL));
+    }
+
+    // satellites can still be added
+    CelestialBody* earth = compiled["Earth"];
+    CelestialBody rocket = make_dummy_object(1., 0., 0.);
+    body_append_satellite(earth, &rocket);
+    assertEquals((double) earth->n_satellites, 2.);
+    assert(earth->satellites[0] == compiled["Moon"]);
+    assert(earth->satellites[1] == &rocket);
+    // including to a list longer than the initial capacity
+    CelestialBody* sun = compiled["Sun"];
+    CelestialBody* planets[4];
+    assertEquals((double) sun->n_satellites, 4.);
+    memcpy(planets, sun->satellites, sizeof(planets));
+    CelestialBody probe = make_dummy_object(1., 0., 0.);
+    body_append_satellite(sun, &probe);
+    assertEquals((double) sun->n_satellites, 5.);
+    assert(memcmp(sun->satellites, planets, sizeof(planets)) == 0);
+    assert(sun->satellites[4] == &probe);
+    unload_bodies(&compiled);
+    unload_bodies(&parsed);
+
+    // an outdated compiled system is ignored
+    write_file(filename, "{\"Sun\": {\"radius\": 1e9, \"mass\": 1.989e30}}");
+    assertEquals(load_bodies(&compiled, filename), 0);
+    assert(compiled.compiled == NULL);
+    assertEquals(compiled["Sun"]->radius, 1e9);
+    unload_bodies(&compiled);
+
+    remove(filename);
+    remove(compiled_filename);
+}
+
 static void test_load(void) {
     test_load_solar_system();
     test_load_kerbol_system();
+    test_load_order();
+    test_load_compiled();
 }
 
 static void test_recipes(void) {
@@ -701,6 +842,729 @@ void test_lambert(void) {
     }
 }
 
+void test_optimize(void) {
+    // one dimension
+    {
+        double f_min;
+        double x = minimize_brent([](double y) { return (y - 1.) * (y - 1.) + 2.; }, -5., 5., 1e-10, &f_min);
+        assertIsLower(fabs(x - 1.), 1e-6);
+        assertIsClose(f_min, 2.);
+        // minimum on the boundary
+        x = minimize_brent([](double y) { return y; }, 3., 4., 1e-10, NULL);
+        assertIsLower(fabs(x - 3.), 1e-6);
+    }
+
+    // two dimensions (Rosenbrock function)
+    {
+        auto rosenbrock = [](glm::dvec2 x) {
+            return (1. - x.x) * (1. - x.x) + 100. * (x.y - x.x*x.x) * (x.y - x.x*x.x);
+        };
+        double f_min;
+        glm::dvec2 x = minimize_nelder_mead(rosenbrock, glm::dvec2{-1., 2.}, glm::dvec2{.5, .5}, 1e-15, &f_min, 1000);
+        assertIsLower(glm::distance(x, glm::dvec2{1., 1.}), 1e-3);
+        assertIsLower(f_min, 1e-6);
+    }
+}
+
+void test_transfer(void) {
+    Dict kerbol_system;
+    if (load_bodies(&kerbol_system, "data/kerbol_system.json") < 0) {
+        fprintf(stderr, "Failed to load '%s'\n", "data/kerbol_system.json");
+        exit(EXIT_FAILURE);
+    }
+    CelestialBody* kerbin = kerbol_system.at("Kerbin");
+    CelestialBody* duna = kerbol_system.at("Duna");
+    CelestialBody* mun = kerbol_system.at("Mun");
+    double parking_radius = kerbin->radius + 100e3;
+    double apsis = duna->radius + 100e3;
+
+    // the Mun orbits Kerbin, not the Sun like Kerbin does: no common primary
+    TransferWindow window;
+    assertFails(transfer_window_search(&window, kerbin, mun, 0., 1e6, 1e5, 1e6, parking_radius, apsis, apsis));
+
+    // should do at least as well as a known good window
+    double synodic = synodic_period(kerbin->orbit, duna->orbit);
+    double hohmann_time = maneuver_hohmann_time(kerbin->orbit->primary, kerbin->orbit->semi_major_axis, duna->orbit->semi_major_axis);
+    assert(transfer_window_search(&window, kerbin, duna, 0., synodic, .5 * hohmann_time, 1.5 * hohmann_time, parking_radius, apsis, apsis) == 0);
+    double known_good = rendez_vous_cost(kerbin, duna, 5091552., 5588208., parking_radius, apsis, apsis);
+    assertIsLower(window.cost, known_good + 1.);
+    assertIsClose(window.cost, rendez_vous_cost(kerbin, duna, window.time_at_departure, window.transfer_duration, parking_radius, apsis, apsis));
+    assertIsLower(rendez_vous_cost_lower_bound(kerbin, duna, parking_radius, apsis, apsis), window.cost);
+    assertIsLower(0., window.time_at_departure);
+    assertIsLower(window.time_at_departure, synodic);
+}
+
+void test_gravity_assist(void) {
+    CelestialBody planet = make_dummy_object(6371e3, 3.98601e+14, 1e9);
+    double r = planet.radius + 100e3;
+
+    // no deflection and no change of speed
+    glm::dvec3 v{3000., 0., 0.};
+    assertIsClose(flyby_cost(&planet, v, v, r), 0.);
+    // speeding up without deflection
+    assertIsClose(flyby_cost(&planet, v, 2. * v, r), 3000.);
+    // deflection at the limit
+    double turn = flyby_maximum_turn_angle(&planet, 3000., r);
+    glm::dvec3 w{3000. * cos(turn), 3000. * sin(turn), 0.};
+    assertIsLower(flyby_cost(&planet, v, w, r), 1e-3);
+    // deflection beyond the limit
+    assertIsClose(flyby_cost(&planet, v, -v, r), maneuver_plane_change_cost(3000., M_PI - turn));
+
+    // sequences in the Kerbol system
+    Dict kerbol_system;
+    if (load_bodies(&kerbol_system, "data/kerbol_system.json") < 0) {
+        fprintf(stderr, "Failed to load '%s'\n", "data/kerbol_system.json");
+        exit(EXIT_FAILURE);
+    }
+    CelestialBody* kerbin = kerbol_system.at("Kerbin");
+    CelestialBody* jool = kerbol_system.at("Jool");
+    CelestialBody* candidates[] = {kerbol_system.at("Eve"), kerbol_system.at("Duna"), kerbin};
+    GravityAssistOptions options = {
+        0.,  // departure_min
+        4e7,  // departure_max
+        1e8,  // max_duration
+        432e3,  // time_step
+        0,  // max_flybys
+        64,  // beam_width
+        50e3,  // min_flyby_altitude
+        kerbin->radius + 100e3,  // parking_radius
+        jool->radius + 1000e3,  // apsis1
+        jool->radius + 1000e3,  // apsis2
+    };
+    GravityAssistSequence direct;
+    assert(gravity_assist_search(&direct, kerbin, jool, candidates, countof(candidates), &options) == 0);
+    assert(direct.bodies.size() == 2);
+    options.max_flybys = 2;
+    GravityAssistSequence sequence;
+    assert(gravity_assist_search(&sequence, kerbin, jool, candidates, countof(candidates), &options) == 0);
+    assertIsLower(sequence.cost, direct.cost + 1e-6);
+    assert(sequence.bodies.front() == kerbin);
+    assert(sequence.bodies.back() == jool);
+    assert(sequence.bodies.size() == sequence.times.size());
+    for (size_t i = 1; i < sequence.times.size(); i += 1) {
+        assertIsLower(sequence.times[i-1], sequence.times[i]);
+    }
+}
+
+void test_sims_flanagan(void) {
+    CelestialBody earth = make_dummy_object(6371e3, 3.98601e+14, 1e9);
+    double r1 = 7000e3;
+    double r2 = 8000e3;
+    glm::dvec3 position{r1, 0., 0.};
+    glm::dvec3 velocity{0., circular_orbit_speed(&earth, r1), 0.};
+
+    // coasting
+    {
+        Orbit orbit;
+        orbit_from_state(&orbit, &earth, position, velocity, 0.);
+        glm::dvec3 arrival_position, arrival_velocity;
+        orbit_state_at_time(&orbit, 3000., &arrival_position, &arrival_velocity);
+
+        SimsFlanaganLeg leg;
+        sims_flanagan_init(&leg, &earth, 0., position, velocity, 3000., arrival_position, arrival_velocity, 10);
+        leg.mass = 1000.;
+        leg.max_thrust = 10.;
+        leg.specific_impulse = 3000.;
+        assert(sims_flanagan_optimize(&leg, 1e-9, 20) == 0);
+        assertIsLower(sims_flanagan_total_dv(&leg), 1e-3);
+    }
+
+    // raising a circular orbit cannot beat a Hohmann transfer
+    {
+        double duration = maneuver_hohmann_time(&earth, r1, r2);
+        glm::dvec3 arrival_position{-r2, 0., 0.};
+        glm::dvec3 arrival_velocity{0., -circular_orbit_speed(&earth, r2), 0.};
+
+        SimsFlanaganLeg leg;
+        sims_flanagan_init(&leg, &earth, 0., position, velocity, duration, arrival_position, arrival_velocity, 20);
+        leg.mass = 1000.;
+        leg.max_thrust = 500.;
+        leg.specific_impulse = 3000.;
+        assert(sims_flanagan_optimize(&leg, 1e-9, 50) == 0);
+        glm::dvec3 position_mismatch, velocity_mismatch;
+        sims_flanagan_mismatch(&leg, &position_mismatch, &velocity_mismatch);
+        assertIsLower(glm::length(position_mismatch), 1.);
+        assertIsLower(maneuver_hohmann_cost(&earth, r1, r2), sims_flanagan_total_dv(&leg));
+        assertIsLower(sims_flanagan_final_mass(&leg), leg.mass);
+
+        // not enough thrust
+        sims_flanagan_init(&leg, &earth, 0., position, velocity, duration, arrival_position, arrival_velocity, 20);
+        leg.max_thrust = 1.;
+        assertFails(sims_flanagan_optimize(&leg, 1e-9, 50));
+    }
+}
+
+void test_encounter(void) {
+    CelestialBody earth = make_dummy_object(6371e3, 3.98601e+14, 1e9);
+    Orbit a, b;
+    orbit_from_periapsis(&a, &earth, 7000e3, .05);
+    orbit_orientate(&a, 0., 0., 0., 0., 0.);
+    orbit_from_periapsis(&b, &earth, 7500e3, .01);
+    orbit_orientate(&b, .3, radians(30.), 1., 0., 2.);
+
+    double time_max = 10. * a.period;
+    Encounter encounters[64];
+    int n = encounter_search(encounters, countof(encounters), &a, &b, 0., time_max);
+    assert(n > 0);
+    assertIsLower((double) n, (double) countof(encounters) - 1.);
+
+    // compare with a brute-force search
+    size_t n_minima = 0;
+    double step = 1.;
+    double d0 = glm::distance(orbit_position_at_time(&a, 0.), orbit_position_at_time(&b, 0.));
+    double d1 = glm::distance(orbit_position_at_time(&a, step), orbit_position_at_time(&b, step));
+    for (double t = step; t < time_max - step; t += step) {
+        double d2 = glm::distance(orbit_position_at_time(&a, t + step), orbit_position_at_time(&b, t + step));
+        if (d1 < d0 && d1 <= d2) {
+            assert(n_minima < (size_t) n);
+            assertIsLower(fabs(encounters[n_minima].time - t), step);
+            assertIsLower(encounters[n_minima].distance, d1);
+            assertIsLower(d1 - encounters[n_minima].distance, 1.);
+            n_minima += 1;
+        }
+        d0 = d1;
+        d1 = d2;
+    }
+    assertEquals((double) n_minima, (double) n);
+
+    // different primaries
+    CelestialBody moon = make_dummy_object(1737e3, 4.9048695e12, 66e6);
+    orbit_from_periapsis(&b, &moon, 2000e3, 0.);
+    orbit_orientate(&b, 0., 0., 0., 0., 0.);
+    assertEquals(encounter_search(encounters, countof(encounters), &a, &b, 0., time_max), -1);
+}
+
+static double brute_force_moid(Orbit* a, Orbit* b) {
+    double best = INFINITY;
+    for (double fa = 0.; fa < 2. * M_PI; fa += M_PI / 360.) {
+        auto ra = orbit_position_at_true_anomaly(a, fa);
+        for (double fb = 0.; fb < 2. * M_PI; fb += M_PI / 360.) {
+            auto rb = orbit_position_at_true_anomaly(b, fb);
+            best = fmin(best, glm::distance(ra, rb));
+        }
+    }
+    return best;
+}
+
+void test_moid(void) {
+    CelestialBody sun = make_dummy_object(696e6, 1.32712440018e20, INFINITY);
+    double au = 149597870700.;
+
+    // circles with a common center
+    Orbit a, b;
+    orbit_from_periapsis(&a, &sun, au, 0.);
+    orbit_orientate(&a, 0., 0., 0., 0., 0.);
+    orbit_from_periapsis(&b, &sun, 1.5 * au, 0.);
+    orbit_orientate(&b, 1., radians(20.), 0., 0., 0.);
+    assertIsClose(moid(&a, &b, NULL, NULL), .5 * au);
+
+    // eccentric and inclined orbits
+    Orbit orbits[8];
+    Orbit* pointers[countof(orbits)];
+    for (size_t i = 0; i < countof(orbits); i += 1) {
+        double k = (double) i;
+        orbit_from_periapsis(&orbits[i], &sun, (.6 + .15 * k) * au, .05 + .08 * k);
+        orbit_orientate(&orbits[i], .7 * k, radians(3. * k), 1.3 * k, 0., 0.);
+        pointers[i] = &orbits[i];
+    }
+
+    double fa, fb;
+    double distance = moid(&orbits[0], &orbits[5], &fa, &fb);
+    double brute_force = brute_force_moid(&orbits[0], &orbits[5]);
+    assertIsLower(distance, brute_force + 1.);
+    assertIsLower(brute_force - distance, 1e-3 * au);
+    auto ra = orbit_position_at_true_anomaly(&orbits[0], fa);
+    auto rb = orbit_position_at_true_anomaly(&orbits[5], fb);
+    assertIsClose(glm::distance(ra, rb), distance);
+
+    // the closest points are in a basin narrower than a grid cell
+    Orbit c, d;
+    orbit_from_periapsis(&c, &sun, 1.6282607178801023 * au, .73677271562012503);
+    orbit_orientate(&c, .98250315292854951, .3124481223954112, .3342831585250251, 0., 0.);
+    orbit_from_periapsis(&d, &sun, 1.0355678665151671 * au, .69425483075634342);
+    orbit_orientate(&d, 1.0320233346484711, .29579084167060948, 5.9939794900426548, 0., 0.);
+    assertIsLower(fabs(moid(&c, &d, NULL, NULL) - 1575865.100e3), 1e3);
+
+    // nearly tangent orbits
+    orbit_from_apses(&d, &sun, .5 * au, au - 1e6);
+    orbit_orientate(&d, 0., 0., 1., 0., 0.);
+    distance = moid(&a, &d, &fa, &fb);
+    assertIsLower(fabs(distance - 1e6), 1.);
+    assertIsCloseAngle(fb, M_PI);
+
+    // stationary points that are not isolated
+    orbit_from_periapsis(&d, &sun, 1.5 * au, 0.);
+    orbit_orientate(&d, 1., 0., 0., 0., 0.);
+    assertIsClose(moid(&a, &d, NULL, NULL), .5 * au);
+
+    // batches
+    MoidBatch batch;
+    moid_batch_init(&batch, pointers, countof(pointers));
+
+    double moids[countof(orbits)];
+    moid_all_vs_one(&batch, &a, INFINITY, moids);
+    for (size_t i = 0; i < countof(orbits); i += 1) {
+        assertIsClose(moids[i], moid(&orbits[i], &a, NULL, NULL));
+    }
+
+    double max_distance = .1 * au;
+    moid_all_vs_one(&batch, &a, max_distance, moids);
+    for (size_t i = 0; i < countof(orbits); i += 1) {
+        double expected = moid(&orbits[i], &a, NULL, NULL);
+        if (moids[i] == INFINITY) {
+            assertIsLower(max_distance, expected);
+        } else {
+            assertIsClose(moids[i], expected);
+        }
+    }
+
+    std::vector<MoidPair> pairs;
+    moid_all_pairs(&batch, max_distance, &pairs);
+    size_t k = 0;
+    for (size_t i = 0; i < countof(orbits); i += 1) {
+        for (size_t j = i + 1; j < countof(orbits); j += 1) {
+            double expected = moid(&orbits[i], &orbits[j], NULL, NULL);
+            if (expected >= max_distance) {
+                continue;
+            }
+            assert(k < pairs.size());
+            assertEquals((double) pairs[k].i, (double) i);
+            assertEquals((double) pairs[k].j, (double) j);
+            assertIsClose(pairs[k].moid, expected);
+            k += 1;
+        }
+    }
+    assertEquals((double) k, (double) pairs.size());
+}
+
+void test_conjunction(void) {
+    CelestialBody earth = make_dummy_object(6371e3, 3.98601e+14, 1e9);
+
+    // crossing circular orbits with various phases
+    Orbit orbits[20];
+    Orbit* pointers[countof(orbits)];
+    for (size_t i = 0; i < countof(orbits); i += 1) {
+        double k = (double) i;
+        orbit_from_periapsis(&orbits[i], &earth, 7000e3 + 10e3 * k, 0.);
+        orbit_orientate(&orbits[i], .9 * k, radians(10. * k), 0., 0., 2.1 * k);
+        pointers[i] = &orbits[i];
+    }
+    // on a collision course at time 0
+    orbit_orientate(&orbits[0], 0., 0., 0., 0., 0.);
+    orbit_orientate(&orbits[1], 0., radians(90.), 0., 0., 0.);
+    orbit_from_periapsis(&orbits[1], &earth, 7000e3, 0.);
+    // faster than the others near periapsis, so it looks further
+    orbit_from_periapsis(&orbits[19], &earth, 7100e3, .5);
+
+    ConjunctionOptions options;
+    options.time_min = -1000.;
+    options.time_max = 2. * orbits[0].period;
+    options.threshold = 300e3;
+
+    // without the last one, no object is much faster than the others; small
+    // cells make for short steps
+    std::vector<Conjunction> conjunctions;
+    for (size_t n_orbits : {countof(orbits) - 1, countof(orbits)}) {
+        for (double cell_size : {0., 2. * options.threshold}) {
+            options.cell_size = cell_size;
+            assert(conjunction_screen(&conjunctions, pointers, n_orbits, &options) == 0);
+            bool collision = false;
+            for (auto& conjunction : conjunctions) {
+                if (conjunction.i == 0 && conjunction.j == 1 && fabs(conjunction.encounter.time) < 1e-3) {
+                    assertIsLower(conjunction.encounter.distance, 1.);
+                    collision = true;
+                }
+            }
+            assert(collision);
+
+            // compare with a brute-force search
+            size_t n_found = 0;
+            for (size_t i = 0; i < n_orbits; i += 1) {
+                for (size_t j = i + 1; j < n_orbits; j += 1) {
+                    double step = 1.;
+                    double t = options.time_min;
+                    double d0 = glm::distance(orbit_position_at_time(&orbits[i], t), orbit_position_at_time(&orbits[j], t));
+                    double d1 = glm::distance(orbit_position_at_time(&orbits[i], t + step), orbit_position_at_time(&orbits[j], t + step));
+                    for (t += step; t < options.time_max - step; t += step) {
+                        double d2 = glm::distance(orbit_position_at_time(&orbits[i], t + step), orbit_position_at_time(&orbits[j], t + step));
+                        if (d1 < d0 && d1 <= d2 && d1 < options.threshold - 1e3) {
+                            bool found = false;
+                            for (auto& conjunction : conjunctions) {
+                                if (conjunction.i == i && conjunction.j == j && fabs(conjunction.encounter.time - t) <= step) {
+                                    found = true;
+                                    assertIsLower(conjunction.encounter.distance, d1 + 1e-3);
+                                }
+                            }
+                            assert(found);
+                            n_found += 1;
+                        }
+                        d0 = d1;
+                        d1 = d2;
+                    }
+                }
+            }
+            assertIsLower((double) n_found, (double) conjunctions.size());
+            for (auto& conjunction : conjunctions) {
+                assertIsLower(conjunction.encounter.distance, options.threshold);
+            }
+        }
+    }
+
+    // a fast flyby through slower objects, met at various times in the steps;
+    // the step is set by the slower objects
+    Orbit flyby[10];
+    Orbit* flyby_pointers[countof(flyby)];
+    orbit_from_periapsis(&flyby[0], &earth, 7000e3, 20.);
+    orbit_orientate(&flyby[0], 0., 0., 0., 0., 0.);
+    flyby_pointers[0] = &flyby[0];
+    for (size_t i = 1; i < countof(flyby); i += 1) {
+        double t = 1000. + 37. * (double) i;
+        glm::dvec3 position = orbit_position_at_time(&flyby[0], t);
+        glm::dvec3 velocity(0., 0., 1.01 * sqrt(earth.gravitational_parameter / glm::length(position)));
+        orbit_from_state(&flyby[i], &earth, position, velocity, t);
+        flyby_pointers[i] = &flyby[i];
+    }
+    options.time_min = 900.;
+    options.time_max = 1500.;
+    options.cell_size = 2. * options.threshold;
+    assert(conjunction_screen(&conjunctions, flyby_pointers, countof(flyby), &options) == 0);
+    for (size_t i = 1; i < countof(flyby); i += 1) {
+        double t = 1000. + 37. * (double) i;
+        bool met = false;
+        for (auto& conjunction : conjunctions) {
+            if (conjunction.i == 0 && conjunction.j == i && fabs(conjunction.encounter.time - t) < 1e-3) {
+                assertIsLower(conjunction.encounter.distance, 1.);
+                met = true;
+            }
+        }
+        assert(met);
+    }
+}
+
+static void assertWindowsMatchSampling(const std::vector<VisibilityWindow>& windows, double time_min, double time_max, const std::function<bool(double)>& visible) {
+    // every change of visibility matches the start or end of a window
+    size_t n_transitions = 0;
+    double step = 1.;
+    bool previous = visible(time_min);
+    for (double t = time_min + step; t <= time_max; t += step) {
+        bool current = visible(t);
+        if (current != previous) {
+            bool found = false;
+            for (auto& window : windows) {
+                double edge = current ? window.rise : window.set;
+                if (t - step <= edge && edge <= t) {
+                    found = true;
+                }
+            }
+            assert(found);
+            n_transitions += 1;
+        }
+        previous = current;
+    }
+    size_t n_edges = 0;
+    for (auto& window : windows) {
+        assertIsLower(window.rise, window.set);
+        n_edges += (window.rise > time_min) + (window.set < time_max);
+    }
+    assertEquals((double) n_edges, (double) n_transitions);
+}
+
+void test_visibility(void) {
+    CelestialBody earth = make_dummy_object(6371e3, 3.98601e+14, 1e9);
+    earth.sidereal_day = 86164.;
+
+    // surface positions
+    glm::dvec3 position = body_surface_position_at_time(&earth, 0., 0., 0., 0.);
+    assertIsClose(glm::distance(position, glm::dvec3(6371e3, 0., 0.)), 0.);
+    position = body_surface_position_at_time(&earth, 0., 0., 1e3, earth.sidereal_day / 4.);
+    assertIsClose(glm::distance(position, glm::dvec3(0., 6372e3, 0.)), 0.);
+    position = body_surface_position_at_time(&earth, M_PI / 2., 0., 0., 1234.);
+    assertIsClose(glm::distance(position, glm::dvec3(0., 0., 6371e3)), 0.);
+
+    Orbit a, b;
+    orbit_from_periapsis(&a, &earth, 7000e3, .01);
+    orbit_orientate(&a, .2, radians(40.), 0., 0., 1.);
+    orbit_from_periapsis(&b, &earth, 9000e3, .1);
+    orbit_orientate(&b, 1., radians(70.), 2., 0., 0.);
+    double time_max = 86400.;
+
+    // ground site
+    GroundSite site = {&earth, radians(30.), radians(10.), 0., radians(10.)};
+    std::vector<VisibilityWindow> windows;
+    assert(visibility_ground_windows(&windows, &site, &a, 0., time_max) == 0);
+    assert(!windows.empty());
+    for (auto& window : windows) {
+        assertIsLower(fabs(ground_site_elevation(&site, &a, window.rise) - site.minimum_elevation), 1e-5);
+    }
+    assertWindowsMatchSampling(windows, 0., time_max, [&](double t) {
+        return ground_site_elevation(&site, &a, t) >= site.minimum_elevation;
+    });
+
+    // inter-satellite line of sight
+    assert(visibility_satellite_windows(&windows, &a, &b, 0., time_max) == 0);
+    assert(!windows.empty());
+    assertWindowsMatchSampling(windows, 0., time_max, [&](double t) {
+        glm::dvec3 pa = orbit_position_at_time(&a, t);
+        glm::dvec3 pb = orbit_position_at_time(&b, t);
+        for (double k = 0.; k <= 1.; k += 1e-3) {
+            if (glm::length(pa + k * (pb - pa)) < earth.radius) {
+                return false;
+            }
+        }
+        return true;
+    });
+
+    // batches match the single pairs
+    Orbit* satellites[] = {&a, &b};
+    std::vector<VisibilityPass> passes;
+    assert(visibility_satellite_passes(&passes, satellites, countof(satellites), 0., time_max) == 0);
+    assertEquals((double) passes.size(), (double) windows.size());
+    GroundSite sites[] = {site, {&earth, radians(-50.), radians(120.), 0., 0.}};
+    assert(visibility_ground_passes(&passes, sites, countof(sites), satellites, countof(satellites), 0., time_max) == 0);
+    size_t n_windows = 0;
+    for (size_t i = 0; i < countof(sites); i += 1) {
+        for (size_t j = 0; j < countof(satellites); j += 1) {
+            assert(visibility_ground_windows(&windows, &sites[i], satellites[j], 0., time_max) == 0);
+            for (auto& window : windows) {
+                assertEquals((double) passes[n_windows].i, (double) i);
+                assertEquals((double) passes[n_windows].j, (double) j);
+                assertEquals(passes[n_windows].window.rise, window.rise);
+                n_windows += 1;
+            }
+        }
+    }
+    assertEquals((double) n_windows, (double) passes.size());
+
+    // different primaries
+    CelestialBody moon = make_dummy_object(1737e3, 4.9048695e12, 66e6);
+    orbit_from_periapsis(&b, &moon, 2000e3, 0.);
+    assertEquals(visibility_satellite_windows(&windows, &a, &b, 0., time_max), -1);
+    site.body = &moon;
+    assertEquals(visibility_ground_windows(&windows, &site, &a, 0., time_max), -1);
+}
+
+static void assertContinuous(ConicSegment* before, ConicSegment* after) {
+    double time = before->time_end;
+    assertEquals(after->time_start, time);
+    glm::dvec3 position_before = body_global_position_at_time(before->orbit.primary, time) + orbit_position_at_time(&before->orbit, time);
+    glm::dvec3 position_after = body_global_position_at_time(after->orbit.primary, time) + orbit_position_at_time(&after->orbit, time);
+    assertIsLower(glm::distance(position_before, position_after), 1e-3 * glm::length(orbit_position_at_time(&after->orbit, time)));
+}
+
+void test_maneuver(void) {
+    Dict solar_system;
+    if (load_bodies(&solar_system, "data/solar_system.json") < 0) {
+        fprintf(stderr, "Failed to load '%s'\n", "data/solar_system.json");
+        exit(EXIT_FAILURE);
+    }
+    CelestialBody* earth = solar_system["Earth"];
+    CelestialBody* moon = solar_system["Moon"];
+
+    Orbit orbit;
+    orbit_from_periapsis(&orbit, earth, 6671e3, 0.);
+    orbit_orientate(&orbit, 0., 0., 0., 0., 0.);
+
+    // no node
+    FlightPlan plan;
+    flight_plan_init(&plan, &orbit, 0.);
+    std::vector<ManeuverNode> nodes;
+    assertEquals((double) flight_plan_update(&plan, nodes), 0.);
+    assertEquals((double) plan.legs.size(), 1.);
+    assertEquals((double) plan.legs[0].size(), 1.);
+    assertIsClose(plan.legs[0][0].time_end, orbit.period);
+
+    // translunar injection, with the right phase
+    bool entered_moon = false;
+    for (double time = 0.; time < orbit.period && !entered_moon; time += orbit.period / 64.) {
+        nodes = {{time, {3150., 0., 0.}}};
+        assertEquals((double) flight_plan_update(&plan, nodes), 0.);
+        assertEquals((double) plan.legs.size(), 2.);
+        assertIsClose(plan.legs[0].back().time_end, time);
+        std::vector<ConicSegment>& leg = plan.legs[1];
+        for (size_t i = 1; i < leg.size(); i += 1) {
+            assertContinuous(&leg[i - 1], &leg[i]);
+            if (leg[i].orbit.primary == moon) {
+                entered_moon = true;
+            }
+        }
+    }
+    assert(entered_moon);
+
+    // escape to the Sun, then edit the last node only
+    nodes.push_back({nodes[0].time + 3600., {-1000., 0., 0.}});
+    assertEquals((double) flight_plan_update(&plan, nodes), 1.);
+    nodes[1].delta_v = {5000., 0., 0.};
+    std::vector<ConicSegment> first_legs = plan.legs[1];
+    assertEquals((double) flight_plan_update(&plan, nodes), 2.);
+    assertEquals(plan.legs[1][0].orbit.eccentricity, first_legs[0].orbit.eccentricity);
+    assertEquals((double) flight_plan_update(&plan, nodes), 3.);
+    std::vector<ConicSegment>& leg = plan.legs[2];
+    assert(leg.back().orbit.primary == earth->orbit->primary);
+    for (size_t i = 1; i < leg.size(); i += 1) {
+        assertContinuous(&leg[i - 1], &leg[i]);
+    }
+
+    // moving a node recomputes the leg before it
+    nodes[1].time += 60.;
+    assertEquals((double) flight_plan_update(&plan, nodes), 1.);
+    nodes.pop_back();
+    assertEquals((double) flight_plan_update(&plan, nodes), 1.);
+    assertEquals((double) plan.legs.size(), 2.);
+
+    unload_bodies(&solar_system);
+}
+
+void test_intercept(void) {
+    Dict solar_system;
+    if (load_bodies(&solar_system, "data/solar_system.json") < 0) {
+        fprintf(stderr, "Failed to load '%s'\n", "data/solar_system.json");
+        exit(EXIT_FAILURE);
+    }
+    CelestialBody* earth = solar_system["Earth"];
+    CelestialBody* moon = solar_system["Moon"];
+    CelestialBody* mars = solar_system["Mars"];
+
+    Orbit orbit;
+    orbit_from_periapsis(&orbit, earth, 6671e3, 0.);
+    orbit_orientate(&orbit, 0., 0., 0., 0., 0.);
+
+    // nodes round-trip
+    glm::dvec3 delta_v{100., -20., 3.};
+    ManeuverNode node = maneuver_node_from_delta_v(&orbit, 1000., delta_v);
+    assertIsClose(glm::distance(maneuver_node_delta_v(&node, &orbit), delta_v), 0.);
+
+    // out of reach
+    InterceptSearch search;
+    assertEquals(intercept_search_init(&search, &orbit, earth, 0.), -1);
+    assertEquals(intercept_search_init(&search, &orbit, solar_system["Phobos"], 0.), -1);
+
+    // cancelled
+    assertEquals(intercept_search_init(&search, &orbit, moon, 0.), 0);
+    assertEquals(intercept_search_pass(&search, []() { return true; }), -1);
+    assert(!search.found);
+
+    // to the Moon; the cost never increases
+    double cost = INFINITY;
+    while (intercept_search_pass(&search, NULL) == 0) {
+        assert(search.found);
+        assertIsLower(search.best.cost, cost * (1. + 1e-12));
+        cost = search.best.cost;
+    }
+    assert(std::isfinite(cost));
+    Intercept* intercept = &search.best;
+    assertIsClose(intercept->node.time, intercept->time_at_departure);
+
+    // the burn reaches the Moon
+    glm::dvec3 position, velocity;
+    orbit_state_at_time(&orbit, intercept->node.time, &position, &velocity);
+    velocity += maneuver_node_delta_v(&intercept->node, &orbit);
+    Orbit transfer;
+    assertEquals(orbit_from_state(&transfer, earth, position, velocity, intercept->node.time), 0);
+    double time_at_arrival = intercept->time_at_departure + intercept->transfer_duration;
+    double miss = glm::distance(orbit_position_at_time(&transfer, time_at_arrival), orbit_position_at_time(moon->orbit, time_at_arrival));
+    assertIsLower(miss, 1e3);
+
+    // to Mars, escaping the Earth
+    assertEquals(intercept_search_init(&search, &orbit, mars, 0.), 0);
+    while (intercept_search_pass(&search, NULL) == 0) {
+    }
+    assert(search.found);
+    intercept = &search.best;
+    assertIsLower(rendez_vous_cost_lower_bound(earth, mars, orbit.semi_major_axis, mars->radius + 100e3, mars->radius + 100e3), intercept->cost);
+    orbit_state_at_time(&orbit, intercept->node.time, &position, &velocity);
+    velocity += maneuver_node_delta_v(&intercept->node, &orbit);
+    assertEquals(orbit_from_state(&transfer, earth, position, velocity, intercept->node.time), 0);
+    assertIsLower(1., transfer.eccentricity);
+
+    unload_bodies(&solar_system);
+}
+
+void test_catalog(void) {
+    static const double AU = 149597870700.;
+    CelestialBody sun = make_dummy_object(696342e3, 1.32712440018e20, INFINITY);
+    Catalog catalog;
+    catalog_init(&catalog, &sun);
+
+    // header, named and unnamed asteroids, blank and malformed lines
+    const char* mpcorb_filename = "test_catalog_mpcorb.txt";
+    write_file(mpcorb_filename,
+        "MINOR PLANET CENTER ORBIT DATABASE (MPCORB)\n"
+        "Des'n     H     G   Epoch     M        Peri.      Node       Incl.       e            n           a\n"
+        "----------------------------------------------------------------------------------------------------\n"
+        "00001    3.34  0.15 K2555 188.70269   73.27343   80.25221   10.58780  0.0794013  0.21424651   2.7660512                                                               (1) Ceres\r\n"
+        "\n"
+        "K24A00A        0.15 K2555  10.00000   20.00000   30.00000    5.00000  0.5000000  1.00000000   1.5000000\n"
+        "00002    4.12  0.15 K2555 not a number\n"
+    );
+    assertEquals(catalog_import_mpcorb(&catalog, mpcorb_filename), 0);
+    assertEquals((double) catalog.entries.size(), 2.);
+    size_t ceres = catalog_find(&catalog, "(1) Ceres");
+    assertEquals((double) ceres, 0.);
+    CatalogEntry* entry = &catalog.entries[ceres];
+    assertIsClose(entry->periapsis, 2.7660512 * AU * (1. - 0.0794013));
+    assertIsClose(entry->inclination, 10.58780 * M_PI / 180.);
+    assertIsClose(entry->mean_anomaly_at_epoch, 188.70269 * M_PI / 180.);
+    // 2025-05-05 at 0h
+    assertIsClose(entry->epoch, (2460800.5 - 2451545.) * 86400.);
+    assertIsClose(entry->absolute_magnitude, 3.34);
+    size_t unnamed = catalog_find(&catalog, "K24A00A");
+    assertEquals((double) unnamed, 1.);
+    assert(std::isnan(catalog.entries[unnamed].absolute_magnitude));
+    assertEquals((double) catalog_find(&catalog, "(2) Pallas"), (double) SIZE_MAX);
+
+    // columns by name, quoted fields, and a comet with only a time of perihelion
+    const char* sbdb_filename = "test_catalog_sbdb.csv";
+    write_file(sbdb_filename,
+        "\"full_name\",\"pdes\",\"e\",\"a\",\"q\",\"i\",\"om\",\"w\",\"ma\",\"epoch\",\"tp\",\"H\"\n"
+        "\"     1 Ceres (A801 AA)\",\"1\",.0794013,2.7660512,2.546,10.5878,80.25221,73.27343,188.70269,2460800.5,2461601.2,3.34\n"
+        "\"  1P/Halley\",\"1P\",.9679,17.93,.5746,162.19,59.11,112.24,,2446470.5,2446467.4,\n"
+        "\"bad, \"\"quoted\"\"\",\"x\",,,,,,,,,,\n"
+    );
+    assertEquals(catalog_import_sbdb(&catalog, sbdb_filename), 0);
+    assertEquals((double) catalog.entries.size(), 4.);
+    size_t halley = catalog_find(&catalog, "1P/Halley");
+    assertEquals((double) halley, 3.);
+    entry = &catalog.entries[halley];
+    assertIsClose(entry->periapsis, .5746 * AU);
+    assertIsClose(entry->epoch, (2446467.4 - 2451545.) * 86400.);
+    assertEquals(entry->mean_anomaly_at_epoch, 0.);
+    assert(std::isnan(entry->absolute_magnitude));
+    assertEquals((double) catalog_find(&catalog, "1 Ceres (A801 AA)"), 2.);
+
+    // nothing is a body until materialized
+    assertEquals((double) sun.n_satellites, 0.);
+    Orbit orbit;
+    assertEquals(catalog_orbit(&catalog, ceres, &orbit), 0);
+    CelestialBody* body = catalog_materialize(&catalog, ceres);
+    assert(body != NULL);
+    assert(catalog_materialize(&catalog, ceres) == body);
+    assert(std::string(body->name) == "(1) Ceres");
+    assertIsCloseOrbit(body->orbit, &orbit);
+    assertIsClose(body->orbit->semi_major_axis, 2.7660512 * AU);
+    assertEquals((double) sun.n_satellites, 1.);
+    assert(sun.satellites[0] == body);
+
+    // both entries of Ceres; the others are further out
+    size_t n = catalog_materialize_if(&catalog, [](const CatalogEntry& e) {
+        return e.periapsis > 2. * AU && e.periapsis < 3. * AU;
+    });
+    assertEquals((double) n, 2.);
+    assertEquals((double) sun.n_satellites, 2.);
+    catalog_release(&catalog, ceres);
+    assert(catalog.bodies[ceres] == NULL);
+    assertEquals((double) sun.n_satellites, 1.);
+    catalog_materialize(&catalog, halley);
+    assertEquals((double) sun.n_satellites, 2.);
+
+    catalog_clear(&catalog);
+    assertEquals((double) sun.n_satellites, 0.);
+    assertEquals((double) catalog.entries.size(), 0.);
+    free(sun.satellites);
+
+    remove(mpcorb_filename);
+    remove(sbdb_filename);
+}
+
 void test_rk4(void) {
     // dummy object
     CelestialBody earth = make_dummy_object(6371e3, 3.98601e+14, 0);
@@ -739,6 +1603,17 @@ int main(void) {
     test_load();           printf("."); fflush(stdout);
     test_recipes();        printf("."); fflush(stdout);
     test_lambert();        printf("."); fflush(stdout);
+    test_optimize();       printf("."); fflush(stdout);
+    test_transfer();       printf("."); fflush(stdout);
+    test_gravity_assist(); printf("."); fflush(stdout);
+    test_sims_flanagan();  printf("."); fflush(stdout);
+    test_encounter();      printf("."); fflush(stdout);
+    test_moid();           printf("."); fflush(stdout);
+    test_conjunction();    printf("."); fflush(stdout);
+    test_visibility();     printf("."); fflush(stdout);
+    test_maneuver();       printf("."); fflush(stdout);
+    test_intercept();      printf("."); fflush(stdout);
+    test_catalog();        printf("."); fflush(stdout);
     test_rk4();            printf("."); fflush(stdout);
     printf("\n");
 }
@@ -3,7 +3,12 @@
 extern "C" {
 #include "util.h"
 #include "texture.h"
+#include "shaders.h"
 }
+
+#include "program.hpp"
+#include "stream.hpp"
+
 #include <cstdio>
 #include <cstdarg>
 
@@ -17,12 +22,16 @@ TextPanel::TextPanel(float x_, float y_) :
     current_col{0},
     font{load_texture("data/textures/font.png")}  // TODO: avoid loading it several times
 {
-    // set up buffer objects
-    glGenBuffers(1, &this->vbo);
+    // the vertices are written to the stream buffer when drawn, see bind()
+    glGenVertexArrays(1, &this->vao);
+    glBindVertexArray(this->vao);
+    glEnableVertexAttribArray(ATTRIBUTE_POSITION);
+    glEnableVertexAttribArray(ATTRIBUTE_TEXCOORD);
+    glBindVertexArray(0);
 }
 
 TextPanel::~TextPanel(void) {
-    glDeleteBuffers(1, &this->vbo);
+    glDeleteVertexArrays(1, &this->vao);
 }
 
 void append_vertex(TextPanel* self, int font_row, int font_col, int drow, int dcol) {
@@ -101,28 +110,19 @@ void TextPanel::clear(void) {
 }
 
 void TextPanel::bind(void) {
-    GLint program;
-    glGetIntegerv(GL_CURRENT_PROGRAM, &program);
-    glBindBuffer(GL_ARRAY_BUFFER, this->vbo);
-
-    // vertices
-    GLint var = glGetAttribLocation(program, "v_position");
-    glEnableVertexAttribArray(var);
-    glBufferData(GL_ARRAY_BUFFER, this->data.size() * sizeof(float), this->data.data(), GL_STATIC_DRAW);
-    glVertexAttribPointer(var, 2, GL_FLOAT, GL_FALSE, 4 * sizeof(float), NULL);
-
-    // textures coordinates
-    var = glGetAttribLocation(program, "v_texcoord");
-    glEnableVertexAttribArray(var);
-    glBufferData(GL_ARRAY_BUFFER, this->data.size() * sizeof(float), this->data.data(), GL_STATIC_DRAW);
-    glVertexAttribPointer(var, 2, GL_FLOAT, GL_FALSE, 4 * sizeof(float), (GLvoid*)(2 * sizeof(float)));
-
+    // each vertex is a position and texture coordinates
+    size_t offset = stream_write(this->data.data(), this->data.size() * sizeof(float), sizeof(float));
+    glBindVertexArray(this->vao);
+    glBindBuffer(GL_ARRAY_BUFFER, stream_buffer());
+    glVertexAttribPointer(ATTRIBUTE_POSITION, 2, GL_FLOAT, GL_FALSE, 4 * sizeof(float), (GLvoid*) offset);
+    glVertexAttribPointer(ATTRIBUTE_TEXCOORD, 2, GL_FLOAT, GL_FALSE, 4 * sizeof(float), (GLvoid*) (offset + 2 * sizeof(float)));
     glBindBuffer(GL_ARRAY_BUFFER, 0);
 }
 
 void TextPanel::draw(void) {
     this->bind();
     glBindTexture(GL_TEXTURE_2D, this->font);
+    uniform_blocks_flush();
     glDrawArrays(GL_TRIANGLES, 0, (GLsizei) this->data.size() / 4);
     glBindTexture(GL_TEXTURE_2D, 0);
 }
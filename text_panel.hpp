@@ -21,7 +21,7 @@ struct TextPanel {
     int current_row;
     int current_col;
     GLuint font;
-    GLuint vbo;
+    GLuint vao;
     std::vector<float> data;
 };
 
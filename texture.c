@@ -46,6 +46,12 @@ unsigned load_texture(const char* filename) {
     return texture;
 }
 
+static const char* faces[] = {
+    "PositiveX", "NegativeX",
+    "PositiveY", "NegativeY",
+    "PositiveZ", "NegativeZ",
+};
+
 unsigned load_cubemap(const char* path_pattern) {
     DEBUG("Cubemap texture '%s' loading", path_pattern);
 
@@ -53,12 +59,6 @@ unsigned load_cubemap(const char* path_pattern) {
     glGenTextures(1, &texture);
     glBindTexture(GL_TEXTURE_CUBE_MAP, texture);
 
-    static const char* faces[] = {
-        "PositiveX", "NegativeX",
-        "PositiveY", "NegativeY",
-        "PositiveZ", "NegativeZ",
-    };
-
     for (GLenum i = 0; i < 6; i += 1) {
         char* path = replace(path_pattern, "{}", faces[i]);
         int width, height;
@@ -86,3 +86,114 @@ unsigned load_cubemap(const char* path_pattern) {
     DEBUG("Cubemap texture '%s' loaded", path_pattern);
     return texture;
 }
+
+int image_size(const char* filename, int* width, int* height) {
+    if (!stbi_info(filename, width, height, NULL)) {
+        return -1;
+    }
+    return 0;
+}
+
+int cubemap_size(const char* path_pattern, int* width, int* height) {
+    char* path = replace(path_pattern, "{}", faces[0]);
+    int ret = image_size(path, width, height);
+    free(path);
+    return ret;
+}
+
+static void blank_layer(GLint layer, int width, int height) {
+    /* Opaque black, as an unbound texture would be sampled */
+    size_t size = 4 * (size_t) width * (size_t) height;
+    unsigned char* data = MALLOC(size);
+    for (size_t i = 0; i < size; i += 4) {
+        data[i] = data[i + 1] = data[i + 2] = 0;
+        data[i + 3] = 255;
+    }
+    glTexSubImage3D(GL_TEXTURE_2D_ARRAY, 0, 0, 0, layer, width, height, 1, GL_RGBA, GL_UNSIGNED_BYTE, data);
+    free(data);
+}
+
+static int load_layer(GLint layer, int width, int height, const char* filename) {
+    /* On failure, the layer is left blank, so that the others stay usable */
+    int layer_width, layer_height;
+    unsigned char* data = load_image(filename, &layer_width, &layer_height);
+    if (data == NULL) {
+        DEBUG("Failed to load texture '%s' for array\n", filename);
+        blank_layer(layer, width, height);
+        return -1;
+    }
+    if (layer_width != width || layer_height != height) {
+        DEBUG("Texture '%s' is %ix%i instead of %ix%i\n", filename, layer_width, layer_height, width, height);
+        stbi_image_free(data);
+        blank_layer(layer, width, height);
+        return -1;
+    }
+    glTexSubImage3D(GL_TEXTURE_2D_ARRAY, 0, 0, 0, layer, width, height, 1, GL_RGBA, GL_UNSIGNED_BYTE, data);
+    stbi_image_free(data);
+    return 0;
+}
+
+static unsigned make_texture_array(int width, int height, size_t n_layers, GLint wrap) {
+    unsigned texture;
+    glGenTextures(1, &texture);
+    glBindTexture(GL_TEXTURE_2D_ARRAY, texture);
+    glTexImage3D(GL_TEXTURE_2D_ARRAY, 0, GL_RGBA, width, height, (GLsizei) n_layers, 0, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, wrap);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, wrap);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    return texture;
+}
+
+static unsigned finish_texture_array(unsigned texture) {
+    glGenerateMipmap(GL_TEXTURE_2D_ARRAY);
+    glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+    return texture;
+}
+
+unsigned load_texture_array(size_t n_images, const char* const* filenames, int* loaded) {
+    DEBUG("Texture array of %zu images loading", n_images);
+
+    int width, height;
+    if (n_images == 0 || image_size(filenames[0], &width, &height) < 0) {
+        return 0;
+    }
+    unsigned texture = make_texture_array(width, height, n_images, GL_REPEAT);
+
+    stbi_set_flip_vertically_on_load(1);
+    for (size_t i = 0; i < n_images; i += 1) {
+        int ret = load_layer((GLint) i, width, height, filenames[i]);
+        if (loaded != NULL) {
+            loaded[i] = ret == 0;
+        }
+    }
+    stbi_set_flip_vertically_on_load(0);
+
+    DEBUG("Texture array of %zu images loaded", n_images);
+    return finish_texture_array(texture);
+}
+
+unsigned load_cubemap_array(size_t n_cubemaps, const char* const* path_patterns, int* loaded) {
+    DEBUG("Cubemap array of %zu cubemaps loading", n_cubemaps);
+
+    int width, height;
+    if (n_cubemaps == 0 || cubemap_size(path_patterns[0], &width, &height) < 0) {
+        return 0;
+    }
+    unsigned texture = make_texture_array(width, height, 6 * n_cubemaps, GL_CLAMP_TO_EDGE);
+
+    for (size_t i = 0; i < n_cubemaps; i += 1) {
+        int failed = 0;
+        for (size_t j = 0; j < 6; j += 1) {
+            char* path = replace(path_patterns[i], "{}", faces[j]);
+            failed |= load_layer((GLint) (6 * i + j), width, height, path) < 0;
+            free(path);
+        }
+        if (loaded != NULL) {
+            loaded[i] = !failed;
+        }
+    }
+
+    DEBUG("Cubemap array of %zu cubemaps loaded", n_cubemaps);
+    return finish_texture_array(texture);
+}
@@ -1,8 +1,25 @@
 #ifndef TEXTURE_H
 #define TEXTURE_H
 
+#include <stddef.h>
+
 unsigned char* load_image(const char* filename, int* width, int* height);
 unsigned load_texture(const char* filename);
 unsigned load_cubemap(const char* path_pattern);
 
+// size of an image without decoding it; return -1 when it cannot be read
+int image_size(const char* filename, int* width, int* height);
+// size of the faces of a cubemap, from its first face
+int cubemap_size(const char* path_pattern, int* width, int* height);
+
+// 2D texture array with a layer per image, as loaded by load_texture(); the
+// images must all have the size of the first one, the layers of those that
+// cannot be loaded are left blank, and loaded (if not NULL) tells which were;
+// the number of layers must not exceed GL_MAX_ARRAY_TEXTURE_LAYERS; return 0
+// when the size of the first image cannot be read
+unsigned load_texture_array(size_t n_images, const char* const* filenames, int* loaded);
+// 2D texture array with six layers per cubemap, in the order of the faces of
+// a cubemap texture, so that a shader can sample them as one; same as above
+unsigned load_cubemap_array(size_t n_cubemaps, const char* const* path_patterns, int* loaded);
+
 #endif
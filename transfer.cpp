@@ -0,0 +1,367 @@
+#include "transfer.hpp"
+
+#include "orbit.hpp"
+#include "recipes.hpp"
+#include "lambert.hpp"
+#include "optimize.hpp"
+#include "parallel.hpp"
+
+#include <glm/ext/matrix_transform.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+// number of departure times sampled by synodic period on the coarse grid
+#define TRANSFER_GRID_DEPARTURES_PER_SYNODIC_PERIOD 64
+#define TRANSFER_GRID_MAX_DEPARTURES 4096
+#define TRANSFER_GRID_DURATIONS 16
+// relative tolerance on the cost when refining a window
+#define TRANSFER_REFINE_TOLERANCE 1e-9
+
+double injection_prograde_at_escape_angle(CelestialBody* origin, double r0, double v_soi) {
+    /* Consider the injection orbit corresponding to the given velocity vector
+     * v_soi and return the angle formed by the position at periapsis and the
+     * velocity at escape
+     *
+     * Parameters:
+     *     origin  departed celestial body
+     *     r0      periapsis
+     *     v_soi   speed at escape
+     */
+    double mu = origin->gravitational_parameter;
+    double r_soi = origin->sphere_of_influence;
+
+    // speed at periapsis
+    double v0 = sqrt(v_soi*v_soi + 2.*mu/r0 - 2.*mu/r_soi);
+
+    // true anomaly at escape
+    double theta0;
+    {
+        double e = r0 * v0 * v0 / mu - 1.;  // injection orbit eccentricity
+        double a = r0 / (1. - e);  // injection orbit semi-major axis
+        theta0 = acos((a*(1.-e*e) - r_soi) / (e*r_soi));
+    }
+
+    // zenith angle at escape
+    double theta1 = asin(v0*r0 / (v_soi*r_soi));
+
+    return theta0 + theta1;
+}
+
+double injection_orbit_inclination_from_vsoi(CelestialBody* origin, double r0, glm::dvec3 v_soi) {
+    /* Determine the inclination required to reach a specific escape velocity
+     *
+     * Parameters:
+     *     origin  departed celestial body
+     *     r0      radius of the parking orbit
+     *     v_soi   desired velocity at escape
+     */
+
+    // determine the periapsis of the injection orbit by rotating the velocity at escape
+    double theta = injection_prograde_at_escape_angle(origin, r0, glm::length(v_soi));
+    // rotate v_soi around z by -theta and project on xy
+    double c = cos(-theta);
+    double s = sin(-theta);
+    glm::dvec3 p{
+        v_soi[0]*c - v_soi[1]*s,
+        v_soi[0]*s + v_soi[1]*c,
+        0.,
+    };
+
+    // normal of injection orbital plane
+    glm::dvec3 n = glm::cross(p, v_soi);
+
+    // angle between normals of injection orbital plane and of ecliptic plane
+    n /= glm::length(n);
+    return acos(n[2]);
+}
+
+double injection_cost(CelestialBody* origin, double parking_radius, glm::dvec3 v_escape) {
+    /* Return the Δv required to escape from an origin body and reach a specific
+     * relative velocity at escape
+     */
+
+    // inclination of the in-SoI transfer orbit
+    double injection_inclination = injection_orbit_inclination_from_vsoi(origin, parking_radius, v_escape);
+    return maneuver_orbit_to_escape_cost(origin, parking_radius, parking_radius, glm::length(v_escape), injection_inclination);
+}
+
+double insertion_cost(CelestialBody* target, double apsis1, double apsis2, glm::dvec3 v_encounter) {
+    /* Return the Δv required to insert into an orbit around a target body from
+     * a given relative velocity at encounter
+     *
+     * Parameters:
+     *     origin       celestial body to depart
+     *     r0           radius of parking orbit
+     *     v_encounter  velocity re. target at encounter
+     */
+    return maneuver_orbit_to_escape_cost(target, apsis1, apsis2, glm::length(v_encounter), 0.);
+}
+
+double rendez_vous_cost(CelestialBody* origin, CelestialBody* target, double time_at_departure, double transfer_duration, double parking_radius, double apsis1, double apsis2) {
+    /* Return the Δv required to transfer from origin to target departing at
+     * given time and taking the given time; this assumes a departure from a
+     * circular parking orbit at the origin, and an arrival into an elliptical
+     * orbit with the given apses at the raget */
+    double time_at_arrival = time_at_departure + transfer_duration;
+
+    // state of origin at departure
+    glm::dvec3 origin_position_at_departure, origin_velocity_at_departure;
+    orbit_state_at_time(origin->orbit, time_at_departure, &origin_position_at_departure, &origin_velocity_at_departure);
+
+    // state of target at arrival
+    glm::dvec3 target_position_at_arrival, target_velocity_at_arrival;
+    orbit_state_at_time(target->orbit, time_at_arrival, &target_position_at_arrival, &target_velocity_at_arrival);
+
+    // determine transfer orbit
+    glm::dvec3 transfer_velocity_at_escape, transfer_velocity_at_arrival;
+    double mu = origin->orbit->primary->gravitational_parameter;
+    lambert(transfer_velocity_at_escape, transfer_velocity_at_arrival, mu, origin_position_at_departure, target_position_at_arrival, transfer_duration, 0, 0);
+
+    // cost of injection into transfer orbit
+    glm::dvec3 v_escape = transfer_velocity_at_escape - origin_velocity_at_departure;
+    double injection_dv = injection_cost(origin, parking_radius, v_escape);
+
+    // cost of insertion into target orbit
+    glm::dvec3 v_encounter = transfer_velocity_at_arrival - target_velocity_at_arrival;
+    double insertion_dv = insertion_cost(target, apsis1, apsis2, v_encounter);
+
+    return injection_dv + insertion_dv;
+}
+
+static double plane_change_cost_at(Orbit* trajectory_at_escape, double true_anomaly_at_intercept, double relative_inclination, double x) {
+    double plane_change_angle = atan2(tan(relative_inclination), sin(true_anomaly_at_intercept - x));
+    double distance = orbit_distance_at_true_anomaly(trajectory_at_escape, x);
+    double speed = orbit_speed_at_distance(trajectory_at_escape, distance);
+    double dv = maneuver_plane_change_cost(speed, plane_change_angle);
+    return dv;
+}
+
+double rendez_vous_cost2(CelestialBody* origin, CelestialBody* target, double time_at_departure, double transfer_duration, double parking_radius, double apsis1, double apsis2) {
+    double time_at_arrival = time_at_departure + transfer_duration;
+
+    // state of origin at departure
+    glm::dvec3 origin_position_at_departure, origin_velocity_at_departure;
+    orbit_state_at_time(origin->orbit, time_at_departure, &origin_position_at_departure, &origin_velocity_at_departure);
+
+    // state of target at arrival
+    glm::dvec3 target_position_at_arrival, target_velocity_at_arrival;
+    orbit_state_at_time(target->orbit, time_at_arrival, &target_position_at_arrival, &target_velocity_at_arrival);
+
+    // determine rotation to bring target on origin's orbital plane
+    glm::dvec3 n = origin->orbit->orientation * glm::dvec3{0, 0, 1};
+    // angle between target_position_at_arrival and n
+    // TODO: just use glm::angle
+    double relative_inclination = asin(glm::dot(target_position_at_arrival, n) / glm::length(target_position_at_arrival));
+    glm::dvec3 rotation_axis = glm::cross(target_position_at_arrival, n);
+    glm::dmat3 plane_change_rotation = glm::rotate(glm::dmat4(1), -relative_inclination, rotation_axis);
+
+    // use plane_change_rotation to rotate target_position_at_arrival in origin's orbital plane
+    glm::dvec3 target_position_at_arrival_projected_on_origin_plane = plane_change_rotation * target_position_at_arrival;
+    // determine transfer velocities
+    glm::dvec3 transfer_velocity_at_escape, transfer_velocity_at_arrival;
+    double mu = origin->orbit->primary->gravitational_parameter;
+    lambert(transfer_velocity_at_escape, transfer_velocity_at_arrival, mu, origin_position_at_departure, target_position_at_arrival_projected_on_origin_plane, transfer_duration, 0, 0);
+    // first part of transfer
+    Orbit trajectory_at_escape;
+    orbit_from_state(&trajectory_at_escape, origin->orbit->primary, origin_position_at_departure, transfer_velocity_at_escape, time_at_departure);
+
+    // the plane change happens somewhere between departure and intercept
+    double mean_anomaly_at_departure = trajectory_at_escape.mean_anomaly_at_epoch;
+    double eccentric_anomaly_at_departure = orbit_eccentric_anomaly_at_mean_anomaly(&trajectory_at_escape, mean_anomaly_at_departure);
+    double true_anomaly_at_departure = orbit_true_anomaly_at_eccentric_anomaly(&trajectory_at_escape, eccentric_anomaly_at_departure);
+    double true_anomaly_at_intercept = orbit_true_anomaly_at_distance(&trajectory_at_escape, glm::length(target_position_at_arrival));  // same as projected
+    if (isnan(true_anomaly_at_intercept)) {  // circular transfer orbit
+        true_anomaly_at_intercept = true_anomaly_at_departure + M_PI;
+    } else if (glm::dot(target_position_at_arrival_projected_on_origin_plane, transfer_velocity_at_arrival) < 0.) {
+        // intercept while going towards periapsis
+        true_anomaly_at_intercept = 2.*M_PI - true_anomaly_at_intercept;
+    }
+    while (true_anomaly_at_intercept < true_anomaly_at_departure) {
+        true_anomaly_at_intercept += 2.*M_PI;
+    }
+
+    // find most efficient time to change plane
+    auto cost = [&](double x) {
+        return plane_change_cost_at(&trajectory_at_escape, true_anomaly_at_intercept, relative_inclination, x);
+    };
+    double plane_change_dv;
+    minimize_brent(cost, true_anomaly_at_departure, true_anomaly_at_intercept, 1e-8, &plane_change_dv);
+    // TODO: rotate transfer_velocity_at_arrival
+
+    // cost of injection into transfer orbit
+    glm::dvec3 v_escape = transfer_velocity_at_escape - origin_velocity_at_departure;
+    double injection_dv = injection_cost(origin, parking_radius, v_escape);
+
+    // cost of insertion into target orbit
+    glm::dvec3 v_encounter = transfer_velocity_at_arrival - target_velocity_at_arrival;
+    double insertion_dv = insertion_cost(target, apsis1, apsis2, v_encounter);
+
+    return injection_dv + plane_change_dv + insertion_dv;
+}
+
+double rendez_vous_cost_lower_bound(CelestialBody* origin, CelestialBody* target, double parking_radius, double apsis1, double apsis2) {
+    CelestialBody* primary = origin->orbit->primary;
+    double origin_periapsis = origin->orbit->periapsis;
+    double origin_apoapsis = origin->orbit->apoapsis;
+    double target_periapsis = target->orbit->periapsis;
+    double target_apoapsis = target->orbit->apoapsis;
+
+    // Hohmann transfer between the closest apses; when the orbits overlap, a
+    // transfer could leave and arrive with arbitrarily small relative speeds
+    double r1 = 0.;
+    double r2 = 0.;
+    if (origin_apoapsis < target_periapsis) {
+        r1 = origin_apoapsis;
+        r2 = target_periapsis;
+    } else if (target_apoapsis < origin_periapsis) {
+        r1 = origin_periapsis;
+        r2 = target_apoapsis;
+    }
+    double v_escape = 0.;
+    double v_encounter = 0.;
+    if (r1 > 0.) {
+        double mu = primary->gravitational_parameter;
+        double a = (r1 + r2) / 2.;
+        v_escape = fabs(sqrt(mu * (2./r1 - 1./a)) - circular_orbit_speed(primary, r1));
+        v_encounter = fabs(circular_orbit_speed(primary, r2) - sqrt(mu * (2./r2 - 1./a)));
+    }
+
+    double injection_dv = maneuver_orbit_to_escape_cost(origin, parking_radius, parking_radius, v_escape, 0.);
+    double insertion_dv = maneuver_orbit_to_escape_cost(target, apsis1, apsis2, v_encounter, 0.);
+    return injection_dv + insertion_dv;
+}
+
+struct TransferCandidate {
+    size_t departure_index;
+    size_t duration_index;
+    double lower_bound;
+};
+
+int transfer_window_search(TransferWindow* best, CelestialBody* origin, CelestialBody* target, double departure_min, double departure_max, double duration_min, double duration_max, double parking_radius, double apsis1, double apsis2) {
+    /* Sample rendez_vous_cost() on a coarse grid of departure times and
+     * transfer durations, then refine the local minima of the grid, most
+     * promising first, until the remaining ones cannot beat the best window
+     * found so far
+     */
+    if (origin->orbit == NULL || target->orbit == NULL || origin->orbit->primary != target->orbit->primary) {
+        return -1;
+    }
+    if (!(departure_min <= departure_max) || !(0. < duration_min && duration_min <= duration_max)) {
+        return -1;
+    }
+
+    auto cost = [&](double time_at_departure, double transfer_duration) {
+        double dv = rendez_vous_cost(origin, target, time_at_departure, transfer_duration, parking_radius, apsis1, apsis2);
+        return isnan(dv) ? INFINITY : dv;
+    };
+
+    // the cost is roughly periodic with the synodic period
+    double departure_range = departure_max - departure_min;
+    double duration_range = duration_max - duration_min;
+    size_t n_departures = 1;
+    if (departure_range > 0.) {
+        double synodic = synodic_period(origin->orbit, target->orbit);
+        double n = ceil(departure_range / synodic * TRANSFER_GRID_DEPARTURES_PER_SYNODIC_PERIOD);
+        n_departures = 1 + (size_t) fmax(2., fmin(n, TRANSFER_GRID_MAX_DEPARTURES));
+    }
+    size_t n_durations = duration_range > 0. ? 1 + TRANSFER_GRID_DURATIONS : 1;
+    double departure_step = n_departures > 1 ? departure_range / (double) (n_departures - 1) : 0.;
+    double duration_step = n_durations > 1 ? duration_range / (double) (n_durations - 1) : 0.;
+
+    // coarse grid
+    std::vector<double> grid(n_departures * n_durations);
+    parallel_for(n_departures, [&](size_t begin, size_t end) {
+        for (size_t i = begin; i < end; i += 1) {
+            double time_at_departure = departure_min + (double) i * departure_step;
+            for (size_t j = 0; j < n_durations; j += 1) {
+                double transfer_duration = duration_min + (double) j * duration_step;
+                grid[i * n_durations + j] = cost(time_at_departure, transfer_duration);
+            }
+        }
+    });
+
+    // the best grid point is the first incumbent
+    size_t best_index = (size_t) (std::min_element(grid.begin(), grid.end()) - grid.begin());
+    if (isinf(grid[best_index])) {
+        return -1;
+    }
+    *best = {
+        departure_min + (double) (best_index / n_durations) * departure_step,
+        duration_min + (double) (best_index % n_durations) * duration_step,
+        grid[best_index],
+    };
+
+    // local minima of the grid; assume that the cost does not dip below a
+    // grid point by more than it varies around it
+    double cost_floor = rendez_vous_cost_lower_bound(origin, target, parking_radius, apsis1, apsis2);
+    std::vector<TransferCandidate> candidates;
+    for (size_t i = 0; i < n_departures; i += 1) {
+        for (size_t j = 0; j < n_durations; j += 1) {
+            double value = grid[i * n_durations + j];
+            if (isinf(value)) {
+                continue;
+            }
+            bool is_minimum = true;
+            double spread = 0.;
+            for (size_t k = i > 0 ? i - 1 : 0; k <= i + 1 && k < n_departures; k += 1) {
+                for (size_t l = j > 0 ? j - 1 : 0; l <= j + 1 && l < n_durations; l += 1) {
+                    double other = grid[k * n_durations + l];
+                    if (other < value) {
+                        is_minimum = false;
+                    } else if (!isinf(other)) {
+                        spread = fmax(spread, other - value);
+                    }
+                }
+            }
+            if (is_minimum) {
+                candidates.push_back({i, j, fmax(cost_floor, value - spread)});
+            }
+        }
+    }
+    std::sort(candidates.begin(), candidates.end(), [](const TransferCandidate& a, const TransferCandidate& b) {
+        return a.lower_bound < b.lower_bound;
+    });
+
+    // refine candidates, a batch at a time, within the grid cells around them
+    auto refine = [&](const TransferCandidate& candidate) {
+        // work in grid units to keep the simplex well-conditioned
+        auto to_window = [&](glm::dvec2 x) {
+            double i = fmax(0., fmin(x.x, (double) (n_departures - 1)));
+            double j = fmax(0., fmin(x.y, (double) (n_durations - 1)));
+            return glm::dvec2{departure_min + i * departure_step, duration_min + j * duration_step};
+        };
+        auto f = [&](glm::dvec2 x) {
+            glm::dvec2 window = to_window(x);
+            return cost(window.x, window.y);
+        };
+        glm::dvec2 x0{(double) candidate.departure_index, (double) candidate.duration_index};
+        double f_min;
+        glm::dvec2 x = minimize_nelder_mead(f, x0, glm::dvec2{.5, .5}, TRANSFER_REFINE_TOLERANCE, &f_min);
+        glm::dvec2 window = to_window(x);
+        return TransferWindow{window.x, window.y, f_min};
+    };
+    size_t batch_size = parallel_concurrency();
+    size_t next = 0;
+    while (next < candidates.size() && candidates[next].lower_bound < best->cost) {
+        size_t n = 0;
+        while (next + n < candidates.size() && n < batch_size && candidates[next + n].lower_bound < best->cost) {
+            n += 1;
+        }
+
+        std::vector<TransferWindow> refined(n);
+        parallel_for(n, [&](size_t begin, size_t end) {
+            for (size_t k = begin; k < end; k += 1) {
+                refined[k] = refine(candidates[next + k]);
+            }
+        });
+        for (auto& window : refined) {
+            if (window.cost < best->cost) {
+                *best = window;
+            }
+        }
+        next += n;
+    }
+    return 0;
+}
@@ -0,0 +1,37 @@
+#ifndef TRANSFER_HPP
+#define TRANSFER_HPP
+
+#include "body.hpp"
+
+#include <glm/glm.hpp>
+
+// primary                         common primary of origin and target
+// injection orbit                 orbit in origin's SoI used to escape
+// transfer orbit                  orbit around primary
+// insertion orbit                 orbit in target's SoI used to capture
+// escape                          when leaving origin SoI
+// encounter                       when entering target SoI
+
+double injection_prograde_at_escape_angle(CelestialBody* origin, double r0, double v_soi);
+double injection_orbit_inclination_from_vsoi(CelestialBody* origin, double r0, glm::dvec3 v_soi);
+double injection_cost(CelestialBody* origin, double parking_radius, glm::dvec3 v_escape);
+double insertion_cost(CelestialBody* target, double apsis1, double apsis2, glm::dvec3 v_encounter);
+
+double rendez_vous_cost (CelestialBody* origin, CelestialBody* target, double time_at_departure, double transfer_duration, double parking_radius, double apsis1, double apsis2);
+double rendez_vous_cost2(CelestialBody* origin, CelestialBody* target, double time_at_departure, double transfer_duration, double parking_radius, double apsis1, double apsis2);
+// estimated lower bound of rendez_vous_cost() for any departure time and
+// transfer duration, from Hohmann transfers between the closest apses
+double rendez_vous_cost_lower_bound(CelestialBody* origin, CelestialBody* target, double parking_radius, double apsis1, double apsis2);
+
+struct TransferWindow {
+    double time_at_departure;
+    double transfer_duration;
+    double cost;
+};
+
+// coarse-to-fine search of the cheapest transfer window (according to
+// rendez_vous_cost()) with departure and duration in the given ranges; origin
+// and target must orbit the same primary; return -1 on failure
+int transfer_window_search(TransferWindow* best, CelestialBody* origin, CelestialBody* target, double departure_min, double departure_max, double duration_min, double duration_max, double parking_radius, double apsis1, double apsis2);
+
+#endif
@@ -1,7 +1,17 @@
+#ifndef _WIN32
+#define _POSIX_C_SOURCE 200809L
+#endif
+
 #include "util.h"
 
 #include <stdio.h>
 #include <string.h>
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
 
 #include "logging.h"
 
@@ -68,6 +78,80 @@ char* load_file(const char* filename) {
     return ret;
 }
 
+char* map_file(const char* filename, size_t* length) {
+    // not reported, since callers may just be checking for a file
+#ifdef _WIN32
+    // no mmap(), read a private copy instead; the content may be binary, so
+    // neither text mode nor strlen() will do
+    FILE* f = fopen(filename, "rb");
+    if (f == NULL) {
+        return NULL;
+    }
+
+    if (fseek(f, 0, SEEK_END) < 0) {
+        perror("while seeking end of file");
+        fclose(f);
+        return NULL;
+    }
+    long size = ftell(f);
+    if (size <= 0 || fseek(f, 0, SEEK_SET) < 0) {
+        if (size < 0) {
+            perror("while reading file");
+        }
+        fclose(f);
+        return NULL;
+    }
+    *length = (size_t) size;
+
+    char* ret = (char*) MALLOC(*length);
+    if (fread(ret, 1, *length, f) < *length) {
+        perror("incomplete read");
+        free(ret);
+        ret = NULL;
+    }
+    fclose(f);
+    return ret;
+#else
+    int fd = open(filename, O_RDONLY);
+    if (fd < 0) {
+        return NULL;
+    }
+
+    struct stat st;
+    if (fstat(fd, &st) < 0) {
+        perror("while reading file");
+        close(fd);
+        return NULL;
+    }
+    *length = (size_t) st.st_size;
+    if (*length == 0) {
+        close(fd);
+        return NULL;
+    }
+
+    void* ret = mmap(NULL, *length, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (ret == MAP_FAILED) {
+        perror("while mapping file");
+        return NULL;
+    }
+    // the file is read once from start to end; pages already read can go
+    posix_madvise(ret, *length, POSIX_MADV_SEQUENTIAL);
+    return (char*) ret;
+#endif
+}
+
+void unmap_file(char* data, size_t length) {
+#ifdef _WIN32
+    (void) length;
+    free(data);
+#else
+    if (data != NULL) {
+        munmap(data, length);
+    }
+#endif
+}
+
 char* human_quantity(double value, const char* unit) {
     size_t n = 100 + strlen(unit);
     char* ret = (char*) MALLOC(n);
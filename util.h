@@ -58,6 +58,10 @@ inline double real_clock(void) {
 }
 
 char* load_file(const char* filename);
+// view of a file, without copying it where possible; changes stay private to
+// the process; the content is not NUL-terminated; return NULL on failure
+char* map_file(const char* filename, size_t* length);
+void unmap_file(char* data, size_t length);
 char* human_quantity(double v, const char* unit);
 
 size_t count(const char* s, const char* pattern);
@@ -0,0 +1,223 @@
+#include "visibility.hpp"
+
+#include "parallel.hpp"
+
+#include <algorithm>
+#include <cmath>
+
+// a window is assumed to last at least this long, in seconds
+#define VISIBILITY_MIN_STEP 1.
+#define VISIBILITY_STEPS_PER_REVOLUTION 16
+// fraction of the step that the rate bound would allow
+#define VISIBILITY_STEP_SAFETY .5
+#define VISIBILITY_MAX_ITERATIONS 60
+#define VISIBILITY_TIME_TOLERANCE 1e-3
+
+// visible when the value is non-negative; the value changes no faster than
+// max_rate
+struct Margin {
+    double value;
+    double max_rate;
+};
+
+template<typename F>
+static double refine(F margin, double low, double f_low, double high, double f_high) {
+    /* Illinois variant of the regula falsi on a sign-changing bracket */
+    int side = 0;
+    double time = low;
+    for (int i = 0; i < VISIBILITY_MAX_ITERATIONS && high - low > VISIBILITY_TIME_TOLERANCE; i += 1) {
+        time = (low * f_high - high * f_low) / (f_high - f_low);
+        if (!(low < time && time < high)) {
+            time = (low + high) / 2.;
+        }
+        double f = margin(time).value;
+        if ((f >= 0.) == (f_low >= 0.)) {
+            low = time;
+            f_low = f;
+            if (side == -1) {
+                f_high /= 2.;
+            }
+            side = -1;
+        } else {
+            high = time;
+            f_high = f;
+            if (side == 1) {
+                f_low /= 2.;
+            }
+            side = 1;
+        }
+    }
+    return (low + high) / 2.;
+}
+
+template<typename F>
+static void find_windows(std::vector<VisibilityWindow>* windows, F margin, double max_step, double time_min, double time_max) {
+    /* Step as far as the rate bound allows without a change of visibility */
+    double time = time_min;
+    Margin m = margin(time);
+    double rise = time_min;
+    while (time < time_max) {
+        double step = VISIBILITY_STEP_SAFETY * fabs(m.value) / m.max_rate;
+        step = fmax(VISIBILITY_MIN_STEP, fmin(step, max_step));
+        double next_time = fmin(time + step, time_max);
+        Margin next = margin(next_time);
+
+        if ((m.value >= 0.) != (next.value >= 0.)) {
+            double crossing = refine(margin, time, m.value, next_time, next.value);
+            if (next.value >= 0.) {
+                rise = crossing;
+            } else {
+                windows->push_back({rise, crossing});
+            }
+        }
+
+        time = next_time;
+        m = next;
+    }
+    if (m.value >= 0.) {
+        windows->push_back({rise, time_max});
+    }
+}
+
+static double max_step_for(Orbit* o, double time_min, double time_max) {
+    double max_step = (time_max - time_min) / VISIBILITY_STEPS_PER_REVOLUTION;
+    if (o->eccentricity < 1.) {
+        max_step = fmin(max_step, o->period / VISIBILITY_STEPS_PER_REVOLUTION);
+    }
+    return max_step;
+}
+
+static Margin ground_margin(GroundSite* site, Orbit* satellite, double time) {
+    CelestialBody* body = site->body;
+    glm::dmat3 orientation = body_orientation_at_time(body, time);
+    glm::dvec3 local = glm::dvec3(
+        cos(site->latitude) * cos(site->longitude),
+        cos(site->latitude) * sin(site->longitude),
+        sin(site->latitude)
+    );
+    glm::dvec3 up = orientation * local;
+    glm::dvec3 site_position = (body->radius + site->altitude) * up;
+    double angular_speed = body->sidereal_day == 0. ? 0. : 2. * M_PI / fabs(body->sidereal_day);
+    glm::dvec3 site_velocity = glm::cross(angular_speed * orientation[2], site_position);
+
+    glm::dvec3 position, velocity;
+    orbit_state_at_time(satellite, time, &position, &velocity);
+    glm::dvec3 line_of_sight = position - site_position;
+    double distance = glm::length(line_of_sight);
+    double elevation = asin(fmax(-1., fmin(glm::dot(up, line_of_sight) / distance, 1.)));
+
+    // the direction of the satellite and the vertical turn no faster than this
+    double max_rate = glm::length(velocity - site_velocity) / distance + angular_speed;
+    return {elevation - site->minimum_elevation, max_rate};
+}
+
+static Margin satellite_margin(Orbit* a, Orbit* b, double time) {
+    glm::dvec3 position_a, velocity_a, position_b, velocity_b;
+    orbit_state_at_time(a, time, &position_a, &velocity_a);
+    orbit_state_at_time(b, time, &position_b, &velocity_b);
+
+    // distance from the center of the primary to the line-of-sight segment
+    glm::dvec3 segment = position_b - position_a;
+    double length2 = glm::dot(segment, segment);
+    double t = length2 > 0. ? -glm::dot(position_a, segment) / length2 : 0.;
+    t = fmax(0., fmin(t, 1.));
+    double clearance = glm::length(position_a + t * segment) - a->primary->radius;
+
+    // the segment moves no faster than its fastest end
+    double max_rate = fmax(glm::length(velocity_a), glm::length(velocity_b));
+    return {clearance, max_rate};
+}
+
+double ground_site_elevation(GroundSite* site, Orbit* satellite, double time) {
+    return ground_margin(site, satellite, time).value + site->minimum_elevation;
+}
+
+int visibility_ground_windows(std::vector<VisibilityWindow>* windows, GroundSite* site, Orbit* satellite, double time_min, double time_max) {
+    windows->clear();
+    if (satellite->primary != site->body || !(time_min < time_max)) {
+        return -1;
+    }
+
+    double max_step = max_step_for(satellite, time_min, time_max);
+    if (site->body->sidereal_day != 0.) {
+        max_step = fmin(max_step, fabs(site->body->sidereal_day) / VISIBILITY_STEPS_PER_REVOLUTION);
+    }
+    find_windows(windows, [&](double time) {
+        return ground_margin(site, satellite, time);
+    }, max_step, time_min, time_max);
+    return 0;
+}
+
+int visibility_satellite_windows(std::vector<VisibilityWindow>* windows, Orbit* a, Orbit* b, double time_min, double time_max) {
+    windows->clear();
+    if (a->primary != b->primary || !(time_min < time_max)) {
+        return -1;
+    }
+
+    double max_step = fmin(max_step_for(a, time_min, time_max), max_step_for(b, time_min, time_max));
+    find_windows(windows, [&](double time) {
+        return satellite_margin(a, b, time);
+    }, max_step, time_min, time_max);
+    return 0;
+}
+
+int visibility_ground_passes(std::vector<VisibilityPass>* passes, GroundSite* sites, size_t n_sites, Orbit** satellites, size_t n_satellites, double time_min, double time_max) {
+    passes->clear();
+    if (!(time_min < time_max)) {
+        return -1;
+    }
+    for (size_t i = 0; i < n_sites; i += 1) {
+        for (size_t j = 0; j < n_satellites; j += 1) {
+            if (satellites[j]->primary != sites[i].body) {
+                return -1;
+            }
+        }
+    }
+
+    // one task per pair, since there may be few sites
+    std::vector<std::vector<VisibilityWindow>> pair_windows(n_sites * n_satellites);
+    parallel_for(pair_windows.size(), [&](size_t begin, size_t end) {
+        for (size_t k = begin; k < end; k += 1) {
+            GroundSite* site = &sites[k / n_satellites];
+            visibility_ground_windows(&pair_windows[k], site, satellites[k % n_satellites], time_min, time_max);
+        }
+    });
+
+    for (size_t k = 0; k < pair_windows.size(); k += 1) {
+        for (auto& window : pair_windows[k]) {
+            passes->push_back({k / n_satellites, k % n_satellites, window});
+        }
+    }
+    return 0;
+}
+
+int visibility_satellite_passes(std::vector<VisibilityPass>* passes, Orbit** satellites, size_t n_satellites, double time_min, double time_max) {
+    passes->clear();
+    if (!(time_min < time_max)) {
+        return -1;
+    }
+    for (size_t i = 1; i < n_satellites; i += 1) {
+        if (satellites[i]->primary != satellites[0]->primary) {
+            return -1;
+        }
+    }
+
+    // one task per satellite, with the satellites after it
+    std::vector<std::vector<VisibilityPass>> satellite_passes(n_satellites);
+    parallel_for(n_satellites, [&](size_t begin, size_t end) {
+        std::vector<VisibilityWindow> windows;
+        for (size_t i = begin; i < end; i += 1) {
+            for (size_t j = i + 1; j < n_satellites; j += 1) {
+                visibility_satellite_windows(&windows, satellites[i], satellites[j], time_min, time_max);
+                for (auto& window : windows) {
+                    satellite_passes[i].push_back({i, j, window});
+                }
+            }
+        }
+    });
+
+    for (auto& v : satellite_passes) {
+        passes->insert(passes->end(), v.begin(), v.end());
+    }
+    return 0;
+}
@@ -0,0 +1,44 @@
+#ifndef VISIBILITY_HPP
+#define VISIBILITY_HPP
+
+#include "body.hpp"
+#include "orbit.hpp"
+
+#include <vector>
+
+struct GroundSite {
+    CelestialBody* body;
+    double latitude;
+    double longitude;  // from the prime meridian, see body_orientation_at_time()
+    double altitude;
+    double minimum_elevation;  // above the local horizon
+};
+
+struct VisibilityWindow {
+    double rise;
+    double set;
+};
+
+struct VisibilityPass {
+    size_t i;
+    size_t j;
+    VisibilityWindow window;
+};
+
+// elevation of the satellite above the horizon of the site, in radians
+double ground_site_elevation(GroundSite* site, Orbit* satellite, double time);
+
+// windows within [time_min, time_max] during which the satellite stands
+// above the minimum elevation of the site; the satellite must orbit the body
+// of the site; windows are clipped to the time span; return -1 on failure
+int visibility_ground_windows(std::vector<VisibilityWindow>* windows, GroundSite* site, Orbit* satellite, double time_min, double time_max);
+// windows within [time_min, time_max] during which the line of sight between
+// two satellites of the same primary clears its surface; return -1 on failure
+int visibility_satellite_windows(std::vector<VisibilityWindow>* windows, Orbit* a, Orbit* b, double time_min, double time_max);
+
+// windows between every site i and satellite j, ordered by i, j then time
+int visibility_ground_passes(std::vector<VisibilityPass>* passes, GroundSite* sites, size_t n_sites, Orbit** satellites, size_t n_satellites, double time_min, double time_max);
+// windows between every pair (i < j) of satellites, ordered by i, j then time
+int visibility_satellite_passes(std::vector<VisibilityPass>* passes, Orbit** satellites, size_t n_satellites, double time_min, double time_max);
+
+#endif